@@ -4,8 +4,21 @@
 #
 #-------------------------------------------------
 
+# Headless command line tool is built from the same project:
+#     qmake CONFIG+=cli
+#
+# So are the benchmarks, which write results in QtTest formats:
+#     qmake CONFIG+=benchmarks
+#     QT_QPA_PLATFORM=offscreen HexEditorBenchmarks -xml -o results.xml
+#
+# And the tests of data sources against files and a child process:
+#     qmake CONFIG+=tests
+#     HexEditorTests
+
 QT       += core gui
 
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets concurrent
+
 TARGET = HexEditor
 TEMPLATE = app
 
@@ -24,11 +37,149 @@ CONFIG (debug, debug|release) {
     RCC_DIR = release/gen
 }
 
-SOURCES +=  src/main.cpp\
-            src/main/mainwindow.cpp \
-    src/widgets/hexeditor.cpp
+ENGINE_SOURCES = \
+    src/engine/structuretemplate.cpp \
+    src/engine/structureoverlay.cpp \
+    src/engine/mappedfile.cpp \
+    src/engine/hexsearch.cpp \
+    src/engine/hexpatch.cpp \
+    src/engine/hextransform.cpp \
+    src/engine/hexcodec.cpp \
+    src/engine/streamdecompressor.cpp \
+    src/engine/hexprofiler.cpp \
+    src/engine/fileloader.cpp \
+    src/engine/filewatcher.cpp \
+    src/engine/sparsefile.cpp \
+    src/engine/hexdatasource.cpp \
+    src/engine/hexdocument.cpp \
+    src/engine/hexannotations.cpp \
+    src/engine/stringextractor.cpp \
+    src/engine/hexencoding.cpp \
+    src/engine/hexviewmode.cpp \
+    src/engine/sessionjournal.cpp \
+    src/engine/hexselection.cpp \
+    src/engine/hexexporter.cpp \
+    src/engine/hexrecords.cpp
+
+ENGINE_HEADERS = \
+    src/engine/structuretemplate.h \
+    src/engine/structureoverlay.h \
+    src/engine/mappedfile.h \
+    src/engine/hexsearch.h \
+    src/engine/hexpatch.h \
+    src/engine/hextransform.h \
+    src/engine/hexcodec.h \
+    src/engine/streamdecompressor.h \
+    src/engine/hexprofiler.h \
+    src/engine/fileloader.h \
+    src/engine/filewatcher.h \
+    src/engine/sparsefile.h \
+    src/engine/hexdatasource.h \
+    src/engine/hexdocument.h \
+    src/engine/hexannotations.h \
+    src/engine/stringextractor.h \
+    src/engine/hexencoding.h \
+    src/engine/hexviewmode.h \
+    src/engine/sessionjournal.h \
+    src/engine/hexselection.h \
+    src/engine/hexexporter.h \
+    src/engine/hexrecords.h
+
+# zlib is required, LZ4 and LZMA streams are optional:
+#     qmake CONFIG+=lz4 CONFIG+=lzma
+LIBS += -lz
+
+CONFIG (lz4) {
+    DEFINES += HEXEDITOR_LZ4
+    LIBS += -llz4
+}
+
+CONFIG (lzma) {
+    DEFINES += HEXEDITOR_LZMA
+    LIBS += -llzma
+}
+
+# Timers around hot paths and performance overlay:
+#     qmake CONFIG+=profiling
+CONFIG (profiling) {
+    DEFINES += HEXEDITOR_PROFILING
+}
+
+CONFIG (cli) {
+    TARGET = HexEditorCli
+
+    QT -= gui widgets
+    CONFIG += console
+    CONFIG -= app_bundle
+
+    RC_FILE =
+    RESOURCES =
 
-HEADERS  += src/main/mainwindow.h \
-    src/widgets/hexeditor.h
+    OBJECTS_DIR = $$OBJECTS_DIR/cli
+    MOC_DIR = $$MOC_DIR/cli
 
-FORMS    += src/main/mainwindow.ui
+    SOURCES += src/cli/main.cpp \
+        $$ENGINE_SOURCES
+
+    HEADERS += $$ENGINE_HEADERS
+} else:CONFIG (benchmarks) {
+    TARGET = HexEditorBenchmarks
+
+    QT += testlib
+    CONFIG += console
+    CONFIG -= app_bundle
+
+    RC_FILE =
+    RESOURCES =
+
+    OBJECTS_DIR = $$OBJECTS_DIR/benchmarks
+    MOC_DIR = $$MOC_DIR/benchmarks
+
+    SOURCES += benchmarks/main.cpp \
+        benchmarks/hexeditorbenchmark.cpp \
+        src/widgets/hexeditor.cpp \
+        $$ENGINE_SOURCES
+
+    HEADERS += benchmarks/hexeditorbenchmark.h \
+        src/widgets/hexeditor.h \
+        $$ENGINE_HEADERS
+} else:CONFIG (tests) {
+    TARGET = HexEditorTests
+
+    QT -= gui widgets
+    QT += testlib
+    CONFIG += console
+    CONFIG -= app_bundle
+
+    RC_FILE =
+    RESOURCES =
+
+    OBJECTS_DIR = $$OBJECTS_DIR/tests
+    MOC_DIR = $$MOC_DIR/tests
+
+    SOURCES += tests/main.cpp \
+        tests/datasourcetest.cpp \
+        $$ENGINE_SOURCES
+
+    HEADERS += tests/datasourcetest.h \
+        $$ENGINE_HEADERS
+} else {
+    SOURCES +=  src/main.cpp\
+                src/main/mainwindow.cpp \
+        src/widgets/hexeditor.cpp \
+        src/widgets/datainspector.cpp \
+        src/widgets/compressionview.cpp \
+        src/widgets/stringsview.cpp \
+        src/widgets/memorybudget.cpp \
+        $$ENGINE_SOURCES
+
+    HEADERS  += src/main/mainwindow.h \
+        src/widgets/hexeditor.h \
+        src/widgets/datainspector.h \
+        src/widgets/compressionview.h \
+        src/widgets/stringsview.h \
+        src/widgets/memorybudget.h \
+        $$ENGINE_HEADERS
+
+    FORMS    += src/main/mainwindow.ui
+}
@@ -0,0 +1,225 @@
+#include "hexeditorbenchmark.h"
+
+#include <QtTest/QtTest>
+#include <QScrollBar>
+
+#define VIEW_WIDTH    1024
+#define VIEW_HEIGHT   768
+#define UNDO_STEPS    1000
+
+HexEditorBenchmark::HexEditorBenchmark() :
+    QObject()
+{
+    mEditor=0;
+}
+
+QByteArray HexEditorBenchmark::testData(int aSize)
+{
+    QByteArray aData(aSize, 0);
+    quint32 aValue=0x12345678;
+
+    for (int i=0; i<aSize; ++i)
+    {
+        aValue=aValue*1103515245+12345;
+        aData[i]=(char)(aValue >> 16);
+    }
+
+    return aData;
+}
+
+void HexEditorBenchmark::renderFrame()
+{
+    // Rendering into an image runs paintEvent synchronously, no window system is needed
+    mEditor->viewport()->render(&mFrame);
+}
+
+void HexEditorBenchmark::init()
+{
+    mEditor=new HexEditor();
+    mEditor->resize(VIEW_WIDTH, VIEW_HEIGHT);
+    mEditor->setAttribute(Qt::WA_DontShowOnScreen);
+    mEditor->show();
+
+    mFrame=QImage(mEditor->viewport()->size(), QImage::Format_ARGB32_Premultiplied);
+}
+
+void HexEditorBenchmark::cleanup()
+{
+    delete mEditor;
+    mEditor=0;
+}
+
+// ------------------------------------------------------------------
+
+void HexEditorBenchmark::paintFrame_data()
+{
+    QTest::addColumn<int>("size");
+    QTest::addColumn<double>("offset");
+
+    QTest::newRow("64K top")     << (64 << 10) << 0.0;
+    QTest::newRow("64K end")     << (64 << 10) << 1.0;
+    QTest::newRow("16M top")     << (16 << 20) << 0.0;
+    QTest::newRow("16M middle")  << (16 << 20) << 0.5;
+    QTest::newRow("16M end")     << (16 << 20) << 1.0;
+    QTest::newRow("128M middle") << (128 << 20) << 0.5;
+}
+
+void HexEditorBenchmark::paintFrame()
+{
+    QFETCH(int, size);
+    QFETCH(double, offset);
+
+    mEditor->setData(testData(size));
+
+    QScrollBar *aScrollBar=mEditor->verticalScrollBar();
+    aScrollBar->setValue(aScrollBar->minimum()+(int)((aScrollBar->maximum()-aScrollBar->minimum())*offset));
+
+    QBENCHMARK
+    {
+        renderFrame();
+    }
+}
+
+void HexEditorBenchmark::setData_data()
+{
+    QTest::addColumn<int>("size");
+
+    QTest::newRow("64K")  << (64 << 10);
+    QTest::newRow("16M")  << (16 << 20);
+    QTest::newRow("128M") << (128 << 20);
+}
+
+void HexEditorBenchmark::setData()
+{
+    QFETCH(int, size);
+
+    QByteArray aFirst=testData(size);
+    QByteArray aSecond=aFirst;
+    aSecond[size-1]=aSecond.at(size-1)+1;
+
+    bool aToggle=false;
+
+    QBENCHMARK
+    {
+        mEditor->setData(aToggle ? aFirst : aSecond);
+        aToggle=!aToggle;
+    }
+}
+
+void HexEditorBenchmark::keystrokeToRepaint_data()
+{
+    QTest::addColumn<int>("size");
+
+    QTest::newRow("64K") << (64 << 10);
+    QTest::newRow("16M") << (16 << 20);
+}
+
+void HexEditorBenchmark::keystrokeToRepaint()
+{
+    QFETCH(int, size);
+
+    mEditor->setData(testData(size));
+    mEditor->setMode(HexEditor::OVERWRITE);
+    mEditor->setPosition(size/2);
+
+    QBENCHMARK
+    {
+        QTest::keyClick(mEditor, Qt::Key_A);
+        renderFrame();
+    }
+}
+
+void HexEditorBenchmark::insertRemove_data()
+{
+    QTest::addColumn<int>("size");
+
+    QTest::newRow("64K") << (64 << 10);
+    QTest::newRow("16M") << (16 << 20);
+}
+
+void HexEditorBenchmark::insertRemove()
+{
+    QFETCH(int, size);
+
+    mEditor->setData(testData(size));
+
+    QBENCHMARK
+    {
+        mEditor->insert(0, 'A');
+        mEditor->remove(0, 1);
+    }
+}
+
+void HexEditorBenchmark::copy_data()
+{
+    QTest::addColumn<int>("length");
+
+    QTest::newRow("4K") << (4 << 10);
+    QTest::newRow("1M") << (1 << 20);
+}
+
+void HexEditorBenchmark::copy()
+{
+    QFETCH(int, length);
+
+    mEditor->setData(testData(length*2));
+    mEditor->setSelection(0, length);
+
+    QBENCHMARK
+    {
+        mEditor->copy();
+    }
+}
+
+void HexEditorBenchmark::paste_data()
+{
+    copy_data();
+}
+
+void HexEditorBenchmark::paste()
+{
+    QFETCH(int, length);
+
+    mEditor->setData(testData(length*2));
+    mEditor->setSelection(0, length);
+    mEditor->copy();
+
+    QBENCHMARK
+    {
+        mEditor->setSelection(0, length);
+        mEditor->paste();
+    }
+}
+
+void HexEditorBenchmark::undoRedo_data()
+{
+    QTest::addColumn<int>("size");
+
+    QTest::newRow("64K") << (64 << 10);
+    QTest::newRow("16M") << (16 << 20);
+}
+
+void HexEditorBenchmark::undoRedo()
+{
+    QFETCH(int, size);
+
+    mEditor->setData(testData(size));
+
+    for (int i=0; i<UNDO_STEPS; ++i)
+    {
+        mEditor->insert(i*2, (char)i);
+    }
+
+    QBENCHMARK
+    {
+        for (int i=0; i<UNDO_STEPS; ++i)
+        {
+            mEditor->undo();
+        }
+
+        for (int i=0; i<UNDO_STEPS; ++i)
+        {
+            mEditor->redo();
+        }
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef HEXEDITORBENCHMARK_H
+#define HEXEDITORBENCHMARK_H
+
+#include <QObject>
+#include <QImage>
+
+#include "src/widgets/hexeditor.h"
+
+class HexEditorBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    HexEditorBenchmark();
+
+protected:
+    HexEditor *mEditor;
+    QImage     mFrame;
+
+    static QByteArray testData(int aSize);
+    void renderFrame();
+
+private slots:
+    void init();
+    void cleanup();
+
+    void paintFrame_data();
+    void paintFrame();
+    void setData_data();
+    void setData();
+    void keystrokeToRepaint_data();
+    void keystrokeToRepaint();
+    void insertRemove_data();
+    void insertRemove();
+    void copy_data();
+    void copy();
+    void paste_data();
+    void paste();
+    void undoRedo_data();
+    void undoRedo();
+};
+
+#endif // HEXEDITORBENCHMARK_H
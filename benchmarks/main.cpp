@@ -0,0 +1,21 @@
+#include <QApplication>
+#include <QtTest/QtTest>
+
+#include "hexeditorbenchmark.h"
+
+int main(int argc, char *argv[])
+{
+#if QT_VERSION >= 0x050000
+    // Benchmarks run on build machines without display
+    if (qgetenv("QT_QPA_PLATFORM").isEmpty())
+    {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+#endif
+
+    QApplication a(argc, argv);
+
+    HexEditorBenchmark aBenchmark;
+
+    return QTest::qExec(&aBenchmark, argc, argv);
+}
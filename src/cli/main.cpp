@@ -0,0 +1,704 @@
+#include <QCoreApplication>
+#include <QStringList>
+#include <QTextStream>
+#include <QCryptographicHash>
+#include <QFile>
+
+#include "src/engine/mappedfile.h"
+#include "src/engine/hexsearch.h"
+#include "src/engine/hexpatch.h"
+#include "src/engine/sparsefile.h"
+#include "src/engine/stringextractor.h"
+#include "src/engine/hexdocument.h"
+
+#define EXIT_FOUND     0
+#define EXIT_NOT_FOUND 1
+#define EXIT_ERROR     2
+
+static QTextStream out(stdout);
+static QTextStream err(stderr);
+
+static int usage()
+{
+    err << "Usage: HexEditorCli <command> [options] <arguments>\n"
+           "\n"
+           "Commands:\n"
+           "    search  [-j threads] [--text] <file> <pattern>\n"
+           "    replace [-j threads] [--text] [-o output] <file> <pattern> <replacement>\n"
+           "    patch   [-o output] <file> <patch>\n"
+           "    hash    [-a md5|sha1|sha256|...] <file>...\n"
+           "    diff    [-j threads] [-f hexdiff|ips|bps] [-o output] <file1> <file2>\n"
+           "    strings [-n min-length] [-e encodings] [-r regexp] <file>\n"
+           "\n"
+           "Patterns are hex strings where \"?\" matches any nibble, e.g. \"DE AD ?? E?\".\n"
+           "With --text pattern and replacement are taken as Latin-1 text.\n"
+           "diff prints a patch that can be applied with the patch command,\n"
+           "patch accepts any of the diff formats.\n"
+           "strings encodings are any of a (ASCII), 8 (UTF-8), l (UTF-16LE) and\n"
+           "b (UTF-16BE), \"a\" by default. With -r matches of the regular expression\n"
+           "are printed instead, bytes are Latin-1 chars in it.\n";
+
+    err.flush();
+
+    return EXIT_ERROR;
+}
+
+static bool takeOption(QStringList &aArguments, const QString &aName, QString &aValue)
+{
+    int aIndex=aArguments.indexOf(aName);
+
+    if (aIndex<0 || aIndex+1>=aArguments.size())
+    {
+        return false;
+    }
+
+    aValue=aArguments.at(aIndex+1);
+    aArguments.removeAt(aIndex);
+    aArguments.removeAt(aIndex);
+
+    return true;
+}
+
+static bool takeFlag(QStringList &aArguments, const QString &aName)
+{
+    return aArguments.removeAll(aName)>0;
+}
+
+static bool parsePattern(const QString &aText, bool aIsText, HexPattern &aPattern)
+{
+    if (aIsText)
+    {
+        aPattern=HexPattern(aText.toLatin1());
+        return !aPattern.isEmpty();
+    }
+
+    if (!HexPattern::fromString(aText, aPattern))
+    {
+        err << "Invalid pattern: " << aText << "\n";
+        return false;
+    }
+
+    return true;
+}
+
+static bool openMapped(MappedFile &aFile, QIODevice::OpenMode aMode=QIODevice::ReadOnly)
+{
+    if (!aFile.open(aMode))
+    {
+        err << aFile.fileName() << ": " << aFile.errorString() << "\n";
+        return false;
+    }
+
+    return true;
+}
+
+static bool prepareOutput(const QString &aInput, const QString &aOutput)
+{
+    if (aOutput.isEmpty() || aOutput==aInput)
+    {
+        return true;
+    }
+
+    QString aError;
+
+    // Holes of disk images stay holes in the copy
+    if (!SparseFile::copy(aInput, aOutput, &aError))
+    {
+        err << "Can't create " << aOutput << ": " << aError << "\n";
+        return false;
+    }
+
+    return true;
+}
+
+static QVector<HexRange> fileHoles(const QString &aFileName)
+{
+    QFile aFile(aFileName);
+
+    if (!aFile.open(QIODevice::ReadOnly))
+    {
+        return QVector<HexRange>();
+    }
+
+    return SparseFile::holes(aFile);
+}
+
+// ------------------------------------------------------------------
+
+static int searchCommand(QStringList aArguments)
+{
+    QString aThreads;
+    takeOption(aArguments, "-j", aThreads);
+    bool aIsText=takeFlag(aArguments, "--text");
+
+    HexPattern aPattern;
+
+    if (aArguments.size()!=2 || !parsePattern(aArguments.at(1), aIsText, aPattern))
+    {
+        return usage();
+    }
+
+    MappedFile aFile(aArguments.at(0));
+
+    if (!openMapped(aFile))
+    {
+        return EXIT_ERROR;
+    }
+
+    // Holes are never mapped in, unless the pattern is all zeros
+    QVector<HexRange> aRanges=SparseFile::searchRanges(fileHoles(aFile.fileName()), aFile.size(), aPattern);
+    QVector<qint64> aResults;
+
+    for (int i=0; i<aRanges.size(); ++i)
+    {
+        qint64 aStart=aRanges.at(i).pos;
+        qint64 aSize=qMin(aFile.size()-aStart, aRanges.at(i).length+aPattern.length()-1);
+        QVector<qint64> aFound=HexSearch::findAll(aFile.data()+aStart, aSize, aPattern, aThreads.toInt());
+
+        for (int j=0; j<aFound.size(); ++j)
+        {
+            aResults.append(aStart+aFound.at(j));
+        }
+    }
+
+    for (int i=0; i<aResults.size(); ++i)
+    {
+        out << QString("%1").arg(aResults.at(i), 16, 16, QChar('0')).toUpper() << "\n";
+    }
+
+    return aResults.isEmpty() ? EXIT_NOT_FOUND : EXIT_FOUND;
+}
+
+static int replaceCommand(QStringList aArguments)
+{
+    QString aThreads;
+    QString aOutput;
+    takeOption(aArguments, "-j", aThreads);
+    takeOption(aArguments, "-o", aOutput);
+    bool aIsText=takeFlag(aArguments, "--text");
+
+    HexPattern aPattern;
+    HexPattern aReplacement;
+
+    if (
+        aArguments.size()!=3
+        ||
+        !parsePattern(aArguments.at(1), aIsText, aPattern)
+        ||
+        !parsePattern(aArguments.at(2), aIsText, aReplacement)
+       )
+    {
+        return usage();
+    }
+
+    QString aInput=aArguments.at(0);
+
+    if (aOutput.isEmpty())
+    {
+        aOutput=aInput;
+    }
+
+    QVector<qint64> aResults;
+
+    if (aReplacement.length()==aPattern.length())
+    {
+        // In place: masked nibbles of the replacement keep original data
+        if (!prepareOutput(aInput, aOutput))
+        {
+            return EXIT_ERROR;
+        }
+
+        MappedFile aFile(aOutput);
+
+        if (!openMapped(aFile, QIODevice::ReadWrite))
+        {
+            return EXIT_ERROR;
+        }
+
+        uchar *aData=aFile.writableData();
+        aResults=HexSearch::findAll(aData, aFile.size(), aPattern, aThreads.toInt());
+
+        const uchar *aBytes=(const uchar *)aReplacement.mBytes.constData();
+        const uchar *aMask=(const uchar *)aReplacement.mMask.constData();
+        qint64 aNextFree=0;
+
+        for (int i=0; i<aResults.size(); ++i)
+        {
+            qint64 aPos=aResults.at(i);
+
+            if (aPos<aNextFree)
+            {
+                continue;
+            }
+
+            for (int j=0; j<aReplacement.length(); ++j)
+            {
+                aData[aPos+j]=(aData[aPos+j] & ~aMask[j]) | aBytes[j];
+            }
+
+            aNextFree=aPos+aPattern.length();
+        }
+    }
+    else
+    {
+        if (aOutput==aInput)
+        {
+            err << "Replacement of different length requires -o\n";
+            return EXIT_ERROR;
+        }
+
+        if (aReplacement.isMasked())
+        {
+            err << "Replacement of different length can't contain wildcards\n";
+            return EXIT_ERROR;
+        }
+
+        MappedFile aFile(aInput);
+
+        if (!openMapped(aFile))
+        {
+            return EXIT_ERROR;
+        }
+
+        QFile aOutputFile(aOutput);
+
+        if (!aOutputFile.open(QIODevice::WriteOnly))
+        {
+            err << aOutput << ": " << aOutputFile.errorString() << "\n";
+            return EXIT_ERROR;
+        }
+
+        aResults=HexSearch::findAll(aFile.data(), aFile.size(), aPattern, aThreads.toInt());
+
+        const char *aData=(const char *)aFile.data();
+        qint64 aNextFree=0;
+
+        for (int i=0; i<aResults.size(); ++i)
+        {
+            qint64 aPos=aResults.at(i);
+
+            if (aPos<aNextFree)
+            {
+                continue;
+            }
+
+            aOutputFile.write(aData+aNextFree, aPos-aNextFree);
+            aOutputFile.write(aReplacement.mBytes);
+
+            aNextFree=aPos+aPattern.length();
+        }
+
+        if (aOutputFile.write(aData+aNextFree, aFile.size()-aNextFree)<0)
+        {
+            err << aOutput << ": " << aOutputFile.errorString() << "\n";
+            return EXIT_ERROR;
+        }
+    }
+
+    out << aResults.size() << " match(es)\n";
+
+    return aResults.isEmpty() ? EXIT_NOT_FOUND : EXIT_FOUND;
+}
+
+static int patchCommand(QStringList aArguments)
+{
+    QString aOutput;
+    takeOption(aArguments, "-o", aOutput);
+
+    if (aArguments.size()!=2)
+    {
+        return usage();
+    }
+
+    QString aInput=aArguments.at(0);
+
+    if (aOutput.isEmpty())
+    {
+        aOutput=aInput;
+    }
+
+    QFile aPatchFile(aArguments.at(1));
+
+    if (!aPatchFile.open(QIODevice::ReadOnly))
+    {
+        err << aPatchFile.fileName() << ": " << aPatchFile.errorString() << "\n";
+        return EXIT_ERROR;
+    }
+
+    HexPatch aPatch;
+    QString aError;
+
+    if (!aPatch.read(&aPatchFile, &aError))
+    {
+        err << aPatchFile.fileName() << ": " << aError << "\n";
+        return EXIT_ERROR;
+    }
+
+    MappedFile aFile(aInput);
+
+    if (!openMapped(aFile))
+    {
+        return EXIT_ERROR;
+    }
+
+    aPatch=aPatch.bind(aFile.size());
+
+    if (
+        !aPatch.checkSource(aFile.data(), aFile.size(), &aError)
+        ||
+        !aPatch.checkTarget(aFile.data(), aFile.size(), &aError)
+       )
+    {
+        err << aInput << ": " << aError << "\n";
+        return EXIT_ERROR;
+    }
+
+    if (aPatch.isInPlace())
+    {
+        // Only changed ranges are written, the rest of the file is never read
+        aFile.close();
+
+        if (!prepareOutput(aInput, aOutput))
+        {
+            return EXIT_ERROR;
+        }
+
+        QFile aOutputFile(aOutput);
+
+        if (!aOutputFile.open(QIODevice::ReadWrite) || !aPatch.applyInPlace(&aOutputFile))
+        {
+            err << aOutput << ": " << aOutputFile.errorString() << "\n";
+            return EXIT_ERROR;
+        }
+    }
+    else
+    {
+        if (aOutput==aInput)
+        {
+            err << "Patch moves data around and requires -o\n";
+            return EXIT_ERROR;
+        }
+
+        QFile aOutputFile(aOutput);
+
+        // Target copies read back what was already written
+        if (
+            !aOutputFile.open(QIODevice::ReadWrite | QIODevice::Truncate)
+            ||
+            !aPatch.apply(aFile.data(), aFile.size(), &aOutputFile)
+           )
+        {
+            err << aOutput << ": " << aOutputFile.errorString() << "\n";
+            return EXIT_ERROR;
+        }
+    }
+
+    return EXIT_FOUND;
+}
+
+static int hashCommand(QStringList aArguments)
+{
+    QString aAlgorithmName="md5";
+    takeOption(aArguments, "-a", aAlgorithmName);
+
+    QCryptographicHash::Algorithm aAlgorithm;
+
+    if (aAlgorithmName=="md4")
+    {
+        aAlgorithm=QCryptographicHash::Md4;
+    }
+    else
+    if (aAlgorithmName=="md5")
+    {
+        aAlgorithm=QCryptographicHash::Md5;
+    }
+    else
+    if (aAlgorithmName=="sha1")
+    {
+        aAlgorithm=QCryptographicHash::Sha1;
+    }
+#if QT_VERSION >= 0x050000
+    else
+    if (aAlgorithmName=="sha256")
+    {
+        aAlgorithm=QCryptographicHash::Sha256;
+    }
+    else
+    if (aAlgorithmName=="sha512")
+    {
+        aAlgorithm=QCryptographicHash::Sha512;
+    }
+#endif
+    else
+    {
+        err << "Unsupported hash algorithm: " << aAlgorithmName << "\n";
+        return EXIT_ERROR;
+    }
+
+    if (aArguments.isEmpty())
+    {
+        return usage();
+    }
+
+    int aResult=EXIT_FOUND;
+
+    for (int i=0; i<aArguments.size(); ++i)
+    {
+        MappedFile aFile(aArguments.at(i));
+
+        if (!openMapped(aFile))
+        {
+            aResult=EXIT_ERROR;
+            continue;
+        }
+
+        QCryptographicHash aHash(aAlgorithm);
+        const char *aData=(const char *)aFile.data();
+
+        // Holes are hashed from a zero buffer, so their pages are never touched
+        QVector<HexRange> aHoles=fileHoles(aFile.fileName());
+        QByteArray aZeros(1 << 20, 0);
+        qint64 aPos=0;
+
+        for (int j=0; j<=aHoles.size(); ++j)
+        {
+            qint64 aDataEnd=j<aHoles.size() ? aHoles.at(j).pos : aFile.size();
+
+            for (; aPos<aDataEnd; aPos+=(1 << 20))
+            {
+                aHash.addData(aData+aPos, qMin((qint64)(1 << 20), aDataEnd-aPos));
+            }
+
+            aPos=aDataEnd;
+
+            if (j<aHoles.size())
+            {
+                qint64 aHoleEnd=aHoles.at(j).pos+aHoles.at(j).length;
+
+                for (; aPos<aHoleEnd; aPos+=aZeros.size())
+                {
+                    aHash.addData(aZeros.constData(), qMin((qint64)aZeros.size(), aHoleEnd-aPos));
+                }
+
+                aPos=aHoleEnd;
+            }
+        }
+
+        out << aHash.result().toHex() << "  " << aArguments.at(i) << "\n";
+    }
+
+    return aResult;
+}
+
+static int diffCommand(QStringList aArguments)
+{
+    QString aThreads;
+    QString aFormatName="hexdiff";
+    QString aOutput;
+    takeOption(aArguments, "-j", aThreads);
+    takeOption(aArguments, "-f", aFormatName);
+    takeOption(aArguments, "-o", aOutput);
+
+    HexPatch::Format aFormat;
+
+    if (aFormatName=="hexdiff")
+    {
+        aFormat=HexPatch::FORMAT_HEXDIFF;
+    }
+    else
+    if (aFormatName=="ips")
+    {
+        aFormat=HexPatch::FORMAT_IPS;
+    }
+    else
+    if (aFormatName=="bps")
+    {
+        aFormat=HexPatch::FORMAT_BPS;
+    }
+    else
+    {
+        err << "Unsupported patch format: " << aFormatName << "\n";
+        return EXIT_ERROR;
+    }
+
+    if (aArguments.size()!=2)
+    {
+        return usage();
+    }
+
+    MappedFile aFirst(aArguments.at(0));
+    MappedFile aSecond(aArguments.at(1));
+
+    if (!openMapped(aFirst) || !openMapped(aSecond))
+    {
+        return EXIT_ERROR;
+    }
+
+    HexPatch aPatch=HexPatch::fromCompare(aFirst.data(), aFirst.size(), aSecond.data(), aSecond.size(), aThreads.toInt());
+
+    QFile aOutputFile;
+    bool ok;
+
+    if (aOutput.isEmpty())
+    {
+        out.flush();
+        ok=aOutputFile.open(stdout, QIODevice::WriteOnly);
+    }
+    else
+    {
+        aOutputFile.setFileName(aOutput);
+        ok=aOutputFile.open(QIODevice::WriteOnly);
+    }
+
+    if (!ok)
+    {
+        err << aOutput << ": " << aOutputFile.errorString() << "\n";
+        return EXIT_ERROR;
+    }
+
+    if (aFormat==HexPatch::FORMAT_HEXDIFF)
+    {
+        aOutputFile.write(QString("# %1 -> %2\n").arg(aArguments.at(0)).arg(aArguments.at(1)).toUtf8());
+    }
+
+    QString aError;
+
+    if (!aPatch.write(&aOutputFile, aFormat, aFirst.data(), aFirst.size(), &aError))
+    {
+        err << aError << "\n";
+        return EXIT_ERROR;
+    }
+
+    return aPatch.isEmpty() ? EXIT_FOUND : EXIT_NOT_FOUND;
+}
+
+// ------------------------------------------------------------------
+
+static int stringsCommand(QStringList aArguments)
+{
+    QString aMinLength="4";
+    QString aEncodingsText="a";
+    QString aRegExpText;
+
+    takeOption(aArguments, "-n", aMinLength);
+    takeOption(aArguments, "-e", aEncodingsText);
+    bool aIsRegExp=takeOption(aArguments, "-r", aRegExpText);
+
+    int aEncodings=0;
+
+    for (int i=0; i<aEncodingsText.length(); ++i)
+    {
+        switch (aEncodingsText.at(i).toLatin1())
+        {
+            case 'a': aEncodings|=StringExtractor::ASCII;   break;
+            case '8': aEncodings|=StringExtractor::UTF8;    break;
+            case 'l': aEncodings|=StringExtractor::UTF16LE; break;
+            case 'b': aEncodings|=StringExtractor::UTF16BE; break;
+            default:  return usage();
+        }
+    }
+
+    QRegExp aRegExp(aRegExpText);
+
+    if (aArguments.size()!=1 || aMinLength.toInt()<=0 || aEncodings==0 || (aIsRegExp && !aRegExp.isValid()))
+    {
+        return usage();
+    }
+
+    HexDataSource *aSource=HexDataSource::create(aArguments.at(0));
+
+    if (!aSource->open(false))
+    {
+        err << aArguments.at(0) << ": " << aSource->errorString() << "\n";
+        delete aSource;
+
+        return EXIT_ERROR;
+    }
+
+    // Extractor reads the file chunk by chunk, so it can be larger than memory
+    HexDocument *aData=new SourceDocument(aSource);
+    StringExtractor *aExtractor;
+
+    if (aIsRegExp)
+    {
+        aExtractor=new StringExtractor(aData, aRegExp);
+    }
+    else
+    {
+        aExtractor=new StringExtractor(aData, aEncodings, aMinLength.toInt());
+    }
+
+    aExtractor->start();
+    aExtractor->wait();
+
+    QList<ExtractedString> aResults=aExtractor->takeResults();
+    delete aExtractor;
+
+    for (int i=0; i<aResults.size(); ++i)
+    {
+        const ExtractedString &aResult=aResults.at(i);
+
+        out << QString("%1").arg(aResult.pos, 16, 16, QChar('0')).toUpper() << " "
+            << StringExtractor::encodingName(aResult.encoding) << " "
+            << aResult.text << "\n";
+    }
+
+    return aResults.isEmpty() ? EXIT_NOT_FOUND : EXIT_FOUND;
+}
+
+// ------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QStringList aArguments=a.arguments();
+    aArguments.removeFirst();
+
+    if (aArguments.isEmpty())
+    {
+        return usage();
+    }
+
+    QString aCommand=aArguments.takeFirst();
+    int res;
+
+    if (aCommand=="search")
+    {
+        res=searchCommand(aArguments);
+    }
+    else
+    if (aCommand=="replace")
+    {
+        res=replaceCommand(aArguments);
+    }
+    else
+    if (aCommand=="patch")
+    {
+        res=patchCommand(aArguments);
+    }
+    else
+    if (aCommand=="hash")
+    {
+        res=hashCommand(aArguments);
+    }
+    else
+    if (aCommand=="diff")
+    {
+        res=diffCommand(aArguments);
+    }
+    else
+    if (aCommand=="strings")
+    {
+        res=stringsCommand(aArguments);
+    }
+    else
+    {
+        res=usage();
+    }
+
+    out.flush();
+    err.flush();
+
+    return res;
+}
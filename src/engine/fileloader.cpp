@@ -0,0 +1,119 @@
+#include "fileloader.h"
+
+#include <QFile>
+#include <QMutexLocker>
+
+#include "sparsefile.h"
+#include "hexprofiler.h"
+
+#define FIRST_CHUNK_SIZE (64 << 10)
+#define CHUNK_SIZE       (4 << 20)
+
+FileLoader::FileLoader(const QString &aFileName, QObject *parent) :
+    QThread(parent)
+{
+    mFileName=aFileName;
+    mStopped=false;
+}
+
+FileLoader::~FileLoader()
+{
+    stop();
+    wait();
+}
+
+QString FileLoader::fileName() const
+{
+    return mFileName;
+}
+
+QVector<HexRange> FileLoader::holes() const
+{
+    return mHoles;
+}
+
+void FileLoader::stop()
+{
+    QMutexLocker aLocker(&mMutex);
+    mStopped=true;
+}
+
+bool FileLoader::isStopped()
+{
+    QMutexLocker aLocker(&mMutex);
+    return mStopped;
+}
+
+void FileLoader::run()
+{
+    QFile aFile(mFileName);
+
+    if (!aFile.open(QIODevice::ReadOnly))
+    {
+        emit loadFinished(false, aFile.errorString());
+        return;
+    }
+
+    // Size is unknown for sequential files, they are read until the end
+    qint64 aTotal=aFile.isSequential() ? -1 : aFile.size();
+
+    mHoles=SparseFile::holes(aFile);
+
+    emit progress(0, aTotal);
+
+    qint64 aLoaded=0;
+    qint64 aChunkSize=FIRST_CHUNK_SIZE;
+    int    aHoleIndex=0;
+
+    while (!isStopped())
+    {
+        QByteArray aChunk;
+
+        while (aHoleIndex<mHoles.size() && mHoles.at(aHoleIndex).pos+mHoles.at(aHoleIndex).length<=aLoaded)
+        {
+            ++aHoleIndex;
+        }
+
+        if (aHoleIndex<mHoles.size() && mHoles.at(aHoleIndex).pos<=aLoaded)
+        {
+            // Holes are read as zeros anyway, so the file isn't touched there
+            aChunk=QByteArray((int)qMin(aChunkSize, mHoles.at(aHoleIndex).pos+mHoles.at(aHoleIndex).length-aLoaded), 0);
+
+            if (!aFile.seek(aLoaded+aChunk.size()))
+            {
+                emit loadFinished(false, aFile.errorString());
+                return;
+            }
+        }
+        else
+        {
+            // Data is read up to the next hole
+            if (aHoleIndex<mHoles.size())
+            {
+                aChunkSize=qMin(aChunkSize, mHoles.at(aHoleIndex).pos-aLoaded);
+            }
+
+            HEX_PROFILE_SCOPE("io.load");
+            aChunk=aFile.read(aChunkSize);
+        }
+
+        if (aChunk.isEmpty())
+        {
+            if (aFile.error()!=QFile::NoError)
+            {
+                emit loadFinished(false, aFile.errorString());
+                return;
+            }
+
+            break;
+        }
+
+        aLoaded+=aChunk.size();
+        aChunkSize=CHUNK_SIZE;
+
+        emit chunkLoaded(aChunk);
+        emit progress(aLoaded, aTotal);
+    }
+
+    emit loadFinished(!isStopped(), QString());
+}
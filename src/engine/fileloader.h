@@ -0,0 +1,43 @@
+#ifndef FILELOADER_H
+#define FILELOADER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QVector>
+
+#include "hexsearch.h"
+
+/*
+ * Reads file in its own thread. The first chunk is small, so the
+ * beginning of the file can be shown before the rest is read. Holes of
+ * sparse files are filled with zeros without reading them.
+ */
+class FileLoader : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit FileLoader(const QString &aFileName, QObject *parent=0);
+    ~FileLoader();
+
+    QString fileName() const;
+    QVector<HexRange> holes() const; // Valid after loadFinished()
+    void stop();
+
+protected:
+    QString mFileName;
+    QMutex  mMutex;
+    bool    mStopped;
+
+    QVector<HexRange> mHoles;
+
+    bool isStopped();
+    void run();
+
+signals:
+    void chunkLoaded(QByteArray aChunk);
+    void progress(qint64 aLoaded, qint64 aTotal);
+    void loadFinished(bool aSuccess, QString aError);
+};
+
+#endif // FILELOADER_H
@@ -0,0 +1,275 @@
+#include "filewatcher.h"
+
+#include <QFile>
+#include <QMutexLocker>
+
+#include "hexpatch.h"
+#include "hexprofiler.h"
+
+#define CHECKSUM_BLOCK_SIZE (64 << 10)
+#define APPEND_CHUNK_SIZE   (4 << 20)
+#define CHANGE_DELAY_MS     100 // Writers usually produce many events at once
+
+FileWatcher::FileWatcher(const QString &aFileName, qint64 aKnownSize, QObject *parent) :
+    QThread(parent)
+{
+    mFileName=aFileName;
+    mPending=false;
+    mStopped=false;
+    mKnownSize=aKnownSize;
+    mSize=-1;
+
+    mDelayTimer.setSingleShot(true);
+    mDelayTimer.setInterval(CHANGE_DELAY_MS);
+
+    connect(&mWatcher,    SIGNAL(fileChanged(QString)), this, SLOT(fileChanged()));
+    connect(&mDelayTimer, SIGNAL(timeout()),            this, SLOT(scan()));
+    connect(this,         SIGNAL(finished()),           this, SLOT(scanFinished()));
+
+    mWatcher.addPath(mFileName);
+
+    // The first scan builds checksums and catches anything written after aKnownSize
+    scan();
+}
+
+FileWatcher::~FileWatcher()
+{
+    stop();
+    wait();
+}
+
+QString FileWatcher::fileName() const
+{
+    return mFileName;
+}
+
+void FileWatcher::stop()
+{
+    QMutexLocker aLocker(&mMutex);
+    mStopped=true;
+}
+
+bool FileWatcher::isStopped()
+{
+    QMutexLocker aLocker(&mMutex);
+    return mStopped;
+}
+
+void FileWatcher::fileChanged()
+{
+    // Files that are replaced by rename are dropped from the watcher
+    if (!mWatcher.files().contains(mFileName) && QFile::exists(mFileName))
+    {
+        mWatcher.addPath(mFileName);
+    }
+
+    mDelayTimer.start();
+}
+
+void FileWatcher::scan()
+{
+    if (isStopped())
+    {
+        return;
+    }
+
+    if (isRunning())
+    {
+        mPending=true;
+        return;
+    }
+
+    start(QThread::LowPriority);
+}
+
+void FileWatcher::scanFinished()
+{
+    if (mPending)
+    {
+        mPending=false;
+        scan();
+    }
+}
+
+bool FileWatcher::readBlock(QFile &aFile, qint64 aPos, qint64 aLength, QByteArray &aBlock)
+{
+    if (!aFile.seek(aPos))
+    {
+        return false;
+    }
+
+    aBlock=aFile.read(aLength);
+
+    return aBlock.size()==aLength;
+}
+
+void FileWatcher::rescan(QFile &aFile, qint64 aSize)
+{
+    HEX_PROFILE_SCOPE("watch.rescan");
+
+    bool aBaseline=mSize<0;
+
+    if (!aBaseline && aSize<mSize)
+    {
+        emit fileTruncated(aSize);
+    }
+
+    qint64 aBlocksCount=(aSize+CHECKSUM_BLOCK_SIZE-1)/CHECKSUM_BLOCK_SIZE;
+    QVector<quint32> aChecksums(aBlocksCount);
+
+    for (qint64 i=0; i<aBlocksCount; ++i)
+    {
+        if (isStopped())
+        {
+            return;
+        }
+
+        qint64 aPos=i*CHECKSUM_BLOCK_SIZE;
+        QByteArray aBlock;
+
+        if (!readBlock(aFile, aPos, qMin((qint64)CHECKSUM_BLOCK_SIZE, aSize-aPos), aBlock))
+        {
+            return;
+        }
+
+        aChecksums[i]=HexPatch::crc32(0, (const uchar *)aBlock.constData(), aBlock.size());
+
+        if (
+            !aBaseline
+            &&
+            (
+             i>=mChecksums.size()
+             ||
+             aChecksums.at(i)!=mChecksums.at(i)
+            )
+           )
+        {
+            // Only part that was known before is changed, the rest is appended
+            qint64 aKnownLength=qMin((qint64)aBlock.size(), mSize-aPos);
+
+            if (aKnownLength>0)
+            {
+                emit blockChanged(aPos, aBlock.left(aKnownLength));
+            }
+
+            if (aKnownLength<aBlock.size())
+            {
+                emit dataAppended(aBlock.mid(qMax((qint64)0, aKnownLength)));
+            }
+        }
+    }
+
+    mChecksums=aChecksums;
+    mSize=aSize;
+}
+
+void FileWatcher::append(QFile &aFile, qint64 aSize)
+{
+    HEX_PROFILE_SCOPE("watch.append");
+
+    // Last block could be rewritten before growing, check it first
+    qint64 aLastPos=(mSize/CHECKSUM_BLOCK_SIZE)*CHECKSUM_BLOCK_SIZE;
+
+    if (aLastPos<mSize)
+    {
+        QByteArray aBlock;
+
+        if (!readBlock(aFile, aLastPos, mSize-aLastPos, aBlock))
+        {
+            return;
+        }
+
+        if (HexPatch::crc32(0, (const uchar *)aBlock.constData(), aBlock.size())!=mChecksums.last())
+        {
+            emit blockChanged(aLastPos, aBlock);
+            mChecksums.last()=HexPatch::crc32(0, (const uchar *)aBlock.constData(), aBlock.size());
+        }
+    }
+
+    if (!aFile.seek(mSize))
+    {
+        return;
+    }
+
+    while (mSize<aSize && !isStopped())
+    {
+        QByteArray aChunk=aFile.read(qMin((qint64)APPEND_CHUNK_SIZE, aSize-mSize));
+
+        if (aChunk.isEmpty())
+        {
+            return;
+        }
+
+        // Checksums are continued, so partial block gets the same one as after full rescan
+        const uchar *aData=(const uchar *)aChunk.constData();
+        qint64 aLeft=aChunk.size();
+        qint64 aPos=mSize;
+
+        while (aLeft>0)
+        {
+            qint64 aOffset=aPos % CHECKSUM_BLOCK_SIZE;
+            qint64 aCount=qMin(aLeft, CHECKSUM_BLOCK_SIZE-aOffset);
+
+            if (aOffset==0)
+            {
+                mChecksums.append(HexPatch::crc32(0, aData, aCount));
+            }
+            else
+            {
+                mChecksums.last()=HexPatch::crc32(mChecksums.last(), aData, aCount);
+            }
+
+            aData+=aCount;
+            aLeft-=aCount;
+            aPos+=aCount;
+        }
+
+        mSize+=aChunk.size();
+
+        emit dataAppended(aChunk);
+    }
+}
+
+void FileWatcher::run()
+{
+    QFile aFile(mFileName);
+
+    if (!aFile.open(QIODevice::ReadOnly))
+    {
+        return;
+    }
+
+    qint64 aSize=aFile.size();
+
+    if (mSize<0)
+    {
+        rescan(aFile, qMin(aSize, mKnownSize));
+
+        if (mSize<0)
+        {
+            return;
+        }
+
+        if (aSize<mKnownSize)
+        {
+            emit fileTruncated(aSize);
+        }
+
+        if (aSize>mSize)
+        {
+            append(aFile, aSize);
+        }
+
+        return;
+    }
+
+    // Growing file is treated as appended, in-place changes without growth need the rescan
+    if (aSize>mSize)
+    {
+        append(aFile, aSize);
+    }
+    else
+    {
+        rescan(aFile, aSize);
+    }
+}
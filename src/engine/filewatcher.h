@@ -0,0 +1,59 @@
+#ifndef FILEWATCHER_H
+#define FILEWATCHER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QVector>
+#include <QTimer>
+#include <QFileSystemWatcher>
+
+/*
+ * Watches the file and finds out what was changed in it. Files that
+ * only grow are handled cheaply: the last partial block is verified and
+ * the new bytes are read. Other changes are found by rescanning block
+ * checksums, and only blocks that differ are reported. Scans are done
+ * in own thread.
+ */
+class FileWatcher : public QThread
+{
+    Q_OBJECT
+
+public:
+    // aKnownSize is the size of file data that the caller already has
+    FileWatcher(const QString &aFileName, qint64 aKnownSize, QObject *parent=0);
+    ~FileWatcher();
+
+    QString fileName() const;
+    void stop();
+
+protected:
+    QString            mFileName;
+    QFileSystemWatcher mWatcher;
+    QTimer             mDelayTimer;
+    bool               mPending;
+    QMutex             mMutex;
+    bool               mStopped;
+
+    // Used only by the scanning thread
+    qint64             mKnownSize;
+    qint64             mSize;      // -1 until the first scan
+    QVector<quint32>   mChecksums; // Last one covers partial block
+
+    bool isStopped();
+    bool readBlock(QFile &aFile, qint64 aPos, qint64 aLength, QByteArray &aBlock);
+    void rescan(QFile &aFile, qint64 aSize);
+    void append(QFile &aFile, qint64 aSize);
+    void run();
+
+protected slots:
+    void fileChanged();
+    void scan();
+    void scanFinished();
+
+signals:
+    void dataAppended(QByteArray aData);
+    void blockChanged(qint64 aPos, QByteArray aData);
+    void fileTruncated(qint64 aSize);
+};
+
+#endif // FILEWATCHER_H
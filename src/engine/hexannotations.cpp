@@ -0,0 +1,438 @@
+#include "hexannotations.h"
+
+#include "hexprofiler.h"
+
+HexAnnotations::HexAnnotations()
+{
+    mRoot=0;
+    mCount=0;
+    mLastId=0;
+    mSeed=0x9E3779B9;
+}
+
+HexAnnotations::~HexAnnotations()
+{
+    destroy(mRoot);
+}
+
+int HexAnnotations::add(qint64 aStart, qint64 aEnd, const QString &aText)
+{
+    mSeed=mSeed*1664525+1013904223; // Linear congruential generator
+
+    Node *aNode=new Node();
+    aNode->id=++mLastId;
+    aNode->start=aStart;
+    aNode->end=qMax(aEnd, aStart+1);
+    aNode->maxEnd=aNode->end;
+    aNode->shift=0;
+    aNode->priority=mSeed;
+    aNode->text=aText;
+    aNode->left=0;
+    aNode->right=0;
+
+    Node *aLeft;
+    Node *aRight;
+
+    split(mRoot, aStart, aLeft, aRight);
+    mRoot=merge(merge(aLeft, aNode), aRight);
+
+    ++mCount;
+
+    return aNode->id;
+}
+
+bool HexAnnotations::remove(const HexAnnotation &aAnnotation)
+{
+    Node *aLeft;
+    Node *aMiddle;
+    Node *aRight;
+
+    split(mRoot,  aAnnotation.start,   aLeft,   aRight);
+    split(aRight, aAnnotation.start+1, aMiddle, aRight);
+
+    bool aFound=removeId(aMiddle, aAnnotation.id);
+
+    mRoot=merge(merge(aLeft, aMiddle), aRight);
+
+    return aFound;
+}
+
+void HexAnnotations::clear()
+{
+    destroy(mRoot);
+
+    mRoot=0;
+    mCount=0;
+}
+
+int HexAnnotations::count() const
+{
+    return mCount;
+}
+
+QList<HexAnnotation> HexAnnotations::find(qint64 aStart, qint64 aEnd) const
+{
+    HEX_PROFILE_SCOPE("annotations.find");
+
+    QList<HexAnnotation> aAnnotations;
+    collect(mRoot, 0, aStart, aEnd, aAnnotations);
+
+    return aAnnotations;
+}
+
+bool HexAnnotations::next(qint64 aPos, HexAnnotation &aAnnotation) const
+{
+    const Node *aNode=mRoot;
+    const Node *aFound=0;
+    qint64 aOffset=0;
+    qint64 aFoundOffset=0;
+
+    while (aNode)
+    {
+        qint64 aChildOffset=aOffset+aNode->shift;
+
+        if (aNode->start+aOffset>aPos)
+        {
+            aFound=aNode;
+            aFoundOffset=aOffset;
+            aNode=aNode->left;
+        }
+        else
+        {
+            aNode=aNode->right;
+        }
+
+        aOffset=aChildOffset;
+    }
+
+    if (!aFound)
+    {
+        return false;
+    }
+
+    aAnnotation=annotation(aFound, aFoundOffset);
+
+    return true;
+}
+
+bool HexAnnotations::previous(qint64 aPos, HexAnnotation &aAnnotation) const
+{
+    const Node *aNode=mRoot;
+    const Node *aFound=0;
+    qint64 aOffset=0;
+    qint64 aFoundOffset=0;
+
+    while (aNode)
+    {
+        qint64 aChildOffset=aOffset+aNode->shift;
+
+        if (aNode->start+aOffset<aPos)
+        {
+            aFound=aNode;
+            aFoundOffset=aOffset;
+            aNode=aNode->right;
+        }
+        else
+        {
+            aNode=aNode->left;
+        }
+
+        aOffset=aChildOffset;
+    }
+
+    if (!aFound)
+    {
+        return false;
+    }
+
+    aAnnotation=annotation(aFound, aFoundOffset);
+
+    return true;
+}
+
+void HexAnnotations::inserted(qint64 aPos, qint64 aLength)
+{
+    if (!mRoot || aLength<=0)
+    {
+        return;
+    }
+
+    HEX_PROFILE_SCOPE("annotations.inserted");
+
+    Node *aLeft;
+    Node *aRight;
+
+    split(mRoot, aPos, aLeft, aRight);
+
+    growEnds(aLeft, aPos, aLength); // Ranges around aPos get longer
+    applyShift(aRight, aLength);
+
+    mRoot=merge(aLeft, aRight);
+}
+
+void HexAnnotations::removed(qint64 aPos, qint64 aLength)
+{
+    if (!mRoot || aLength<=0)
+    {
+        return;
+    }
+
+    HEX_PROFILE_SCOPE("annotations.removed");
+
+    Node *aLeft;
+    Node *aMiddle;
+    Node *aRight;
+
+    split(mRoot,  aPos,         aLeft,   aRight);
+    split(aRight, aPos+aLength, aMiddle, aRight);
+
+    clipEnds(aLeft, aPos, aLength);
+    applyShift(aRight, -aLength);
+
+    // Ranges that start inside the removed bytes are dropped, unless they end after them
+    QList<Node *> aNodes;
+    collect(aMiddle, aNodes);
+
+    for (int i=0; i<aNodes.size(); ++i)
+    {
+        Node *aNode=aNodes.at(i);
+
+        if (aNode->end>aPos+aLength)
+        {
+            aNode->start=aPos;
+            aNode->end-=aLength;
+            aNode->shift=0;
+            aNode->left=0;
+            aNode->right=0;
+            update(aNode);
+
+            aRight=merge(aNode, aRight);
+        }
+        else
+        {
+            delete aNode;
+            --mCount;
+        }
+    }
+
+    mRoot=merge(aLeft, aRight);
+}
+
+// ------------------------------------------------------------------
+
+void HexAnnotations::applyShift(Node *aNode, qint64 aShift)
+{
+    if (aNode)
+    {
+        aNode->start+=aShift;
+        aNode->end+=aShift;
+        aNode->maxEnd+=aShift;
+        aNode->shift+=aShift;
+    }
+}
+
+void HexAnnotations::push(Node *aNode)
+{
+    if (aNode->shift)
+    {
+        applyShift(aNode->left,  aNode->shift);
+        applyShift(aNode->right, aNode->shift);
+
+        aNode->shift=0;
+    }
+}
+
+void HexAnnotations::update(Node *aNode)
+{
+    aNode->maxEnd=aNode->end;
+
+    if (aNode->left)
+    {
+        aNode->maxEnd=qMax(aNode->maxEnd, aNode->left->maxEnd+aNode->shift);
+    }
+
+    if (aNode->right)
+    {
+        aNode->maxEnd=qMax(aNode->maxEnd, aNode->right->maxEnd+aNode->shift);
+    }
+}
+
+void HexAnnotations::split(Node *aNode, qint64 aStart, Node *&aLeft, Node *&aRight)
+{
+    if (!aNode)
+    {
+        aLeft=0;
+        aRight=0;
+
+        return;
+    }
+
+    push(aNode);
+
+    if (aNode->start<aStart)
+    {
+        split(aNode->right, aStart, aNode->right, aRight);
+        aLeft=aNode;
+    }
+    else
+    {
+        split(aNode->left, aStart, aLeft, aNode->left);
+        aRight=aNode;
+    }
+
+    update(aNode);
+}
+
+HexAnnotations::Node* HexAnnotations::merge(Node *aLeft, Node *aRight)
+{
+    if (!aLeft)
+    {
+        return aRight;
+    }
+
+    if (!aRight)
+    {
+        return aLeft;
+    }
+
+    if (aLeft->priority>aRight->priority)
+    {
+        push(aLeft);
+        aLeft->right=merge(aLeft->right, aRight);
+        update(aLeft);
+
+        return aLeft;
+    }
+
+    push(aRight);
+    aRight->left=merge(aLeft, aRight->left);
+    update(aRight);
+
+    return aRight;
+}
+
+void HexAnnotations::destroy(Node *aNode)
+{
+    if (aNode)
+    {
+        destroy(aNode->left);
+        destroy(aNode->right);
+
+        delete aNode;
+    }
+}
+
+void HexAnnotations::growEnds(Node *aNode, qint64 aPos, qint64 aLength)
+{
+    if (!aNode || aNode->maxEnd<=aPos)
+    {
+        return;
+    }
+
+    push(aNode);
+
+    if (aNode->end>aPos)
+    {
+        aNode->end+=aLength;
+    }
+
+    growEnds(aNode->left,  aPos, aLength);
+    growEnds(aNode->right, aPos, aLength);
+
+    update(aNode);
+}
+
+void HexAnnotations::clipEnds(Node *aNode, qint64 aPos, qint64 aLength)
+{
+    if (!aNode || aNode->maxEnd<=aPos)
+    {
+        return;
+    }
+
+    push(aNode);
+
+    if (aNode->end>aPos)
+    {
+        aNode->end=aNode->end>=aPos+aLength ? aNode->end-aLength : aPos;
+    }
+
+    clipEnds(aNode->left,  aPos, aLength);
+    clipEnds(aNode->right, aPos, aLength);
+
+    update(aNode);
+}
+
+void HexAnnotations::collect(Node *aNode, QList<Node *> &aNodes)
+{
+    if (aNode)
+    {
+        push(aNode);
+
+        collect(aNode->left,  aNodes);
+        collect(aNode->right, aNodes);
+
+        aNodes.append(aNode);
+    }
+}
+
+void HexAnnotations::collect(const Node *aNode, qint64 aOffset, qint64 aStart, qint64 aEnd, QList<HexAnnotation> &aAnnotations)
+{
+    // Nothing in the subtree reaches aStart
+    if (!aNode || aNode->maxEnd+aOffset<=aStart)
+    {
+        return;
+    }
+
+    collect(aNode->left, aOffset+aNode->shift, aStart, aEnd, aAnnotations);
+
+    // Everything to the right starts even later
+    if (aNode->start+aOffset>=aEnd)
+    {
+        return;
+    }
+
+    if (aNode->end+aOffset>aStart)
+    {
+        aAnnotations.append(annotation(aNode, aOffset));
+    }
+
+    collect(aNode->right, aOffset+aNode->shift, aStart, aEnd, aAnnotations);
+}
+
+HexAnnotation HexAnnotations::annotation(const Node *aNode, qint64 aOffset)
+{
+    HexAnnotation aAnnotation;
+
+    aAnnotation.id=aNode->id;
+    aAnnotation.start=aNode->start+aOffset;
+    aAnnotation.end=aNode->end+aOffset;
+    aAnnotation.text=aNode->text;
+
+    return aAnnotation;
+}
+
+bool HexAnnotations::removeId(Node *&aNode, int aId)
+{
+    if (!aNode)
+    {
+        return false;
+    }
+
+    push(aNode);
+
+    if (aNode->id==aId)
+    {
+        Node *aRemoved=aNode;
+
+        aNode=merge(aNode->left, aNode->right);
+        delete aRemoved;
+        --mCount;
+
+        return true;
+    }
+
+    bool aFound=removeId(aNode->left, aId) || removeId(aNode->right, aId);
+    update(aNode);
+
+    return aFound;
+}
@@ -0,0 +1,79 @@
+#ifndef HEXANNOTATIONS_H
+#define HEXANNOTATIONS_H
+
+#include <QList>
+#include <QString>
+
+struct HexAnnotation
+{
+    int     id;
+    qint64  start;
+    qint64  end;  // Exclusive
+    QString text; // Empty for plain bookmarks
+};
+
+/*
+ * Bookmarks and annotated ranges that follow edits of the data. Ranges
+ * are kept in a treap ordered by start, where every node knows the
+ * largest end in its subtree. Shifts are stored lazily in subtree roots,
+ * so an insertion or removal moves all following ranges in O(log n);
+ * only ranges that cross the edited position are visited one by one.
+ */
+class HexAnnotations
+{
+public:
+    HexAnnotations();
+    ~HexAnnotations();
+
+    int  add(qint64 aStart, qint64 aEnd, const QString &aText=QString()); // Returns id
+    bool remove(const HexAnnotation &aAnnotation); // Found by current start and id
+    void clear();
+    int  count() const;
+
+    QList<HexAnnotation> find(qint64 aStart, qint64 aEnd) const; // Ranges that intersect [aStart, aEnd), sorted by start
+    bool next(qint64 aPos, HexAnnotation &aAnnotation) const;     // First one that starts after aPos
+    bool previous(qint64 aPos, HexAnnotation &aAnnotation) const; // Last one that starts before aPos
+
+    // Called on every change of the data
+    void inserted(qint64 aPos, qint64 aLength);
+    void removed(qint64 aPos, qint64 aLength);
+
+private:
+    // Values of a node are relative to the sum of shifts of its ancestors
+    struct Node
+    {
+        int      id;
+        qint64   start;
+        qint64   end;
+        qint64   maxEnd;   // Largest end in the subtree
+        qint64   shift;    // Not yet applied to children
+        quint32  priority;
+        QString  text;
+        Node    *left;
+        Node    *right;
+    };
+
+    Node    *mRoot;
+    int      mCount;
+    int      mLastId;
+    quint32  mSeed;   // For priorities of nodes
+
+    static void applyShift(Node *aNode, qint64 aShift);
+    static void push(Node *aNode);
+    static void update(Node *aNode);
+    static void split(Node *aNode, qint64 aStart, Node *&aLeft, Node *&aRight); // aLeft gets starts below aStart
+    static Node* merge(Node *aLeft, Node *aRight);
+    static void destroy(Node *aNode);
+
+    static void growEnds(Node *aNode, qint64 aPos, qint64 aLength);
+    static void clipEnds(Node *aNode, qint64 aPos, qint64 aLength);
+    static void collect(Node *aNode, QList<Node *> &aNodes);
+    static void collect(const Node *aNode, qint64 aOffset, qint64 aStart, qint64 aEnd, QList<HexAnnotation> &aAnnotations);
+    static HexAnnotation annotation(const Node *aNode, qint64 aOffset);
+
+    bool removeId(Node *&aNode, int aId);
+
+    Q_DISABLE_COPY(HexAnnotations)
+};
+
+#endif // HEXANNOTATIONS_H
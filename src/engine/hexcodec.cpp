@@ -0,0 +1,521 @@
+#include "hexcodec.h"
+
+#include "hexdocument.h"
+#include "hexprofiler.h"
+
+#include <zlib.h>
+
+#ifdef HEXEDITOR_LZ4
+#include <lz4frame.h>
+#endif
+
+#ifdef HEXEDITOR_LZMA
+#include <lzma.h>
+#endif
+
+#include <string.h>
+
+#define MAX_STEP_INPUT   (1 << 30)
+#define COMPRESS_CHUNK   (1 << 20) // Input read and output produced at once by compress()
+
+HexCodec::HexCodec(Type aType)
+{
+    mType=aType;
+    mStream=0;
+    mInitialized=false;
+}
+
+HexCodec::~HexCodec()
+{
+    if (!mStream)
+    {
+        return;
+    }
+
+    switch (mType)
+    {
+        case CODEC_ZLIB:
+        case CODEC_GZIP:
+        case CODEC_DEFLATE:
+        {
+            inflateEnd((z_stream *)mStream);
+            delete (z_stream *)mStream;
+        }
+        break;
+        case CODEC_LZ4:
+        {
+#ifdef HEXEDITOR_LZ4
+            LZ4F_freeDecompressionContext((LZ4F_dctx *)mStream);
+#endif
+        }
+        break;
+        case CODEC_LZMA:
+        {
+#ifdef HEXEDITOR_LZMA
+            lzma_end((lzma_stream *)mStream);
+            delete (lzma_stream *)mStream;
+#endif
+        }
+        break;
+    }
+}
+
+HexCodec::Type HexCodec::type() const
+{
+    return mType;
+}
+
+QString HexCodec::errorString() const
+{
+    return mError;
+}
+
+bool HexCodec::init()
+{
+    mInitialized=true;
+
+    switch (mType)
+    {
+        case CODEC_ZLIB:
+        case CODEC_GZIP:
+        case CODEC_DEFLATE:
+        {
+            z_stream *aStream=new z_stream;
+            memset(aStream, 0, sizeof(z_stream));
+
+            int aWindowBits=mType==CODEC_ZLIB ? MAX_WBITS : mType==CODEC_GZIP ? 16+MAX_WBITS : -MAX_WBITS;
+
+            if (inflateInit2(aStream, aWindowBits)!=Z_OK)
+            {
+                delete aStream;
+                mError="Can't initialize zlib";
+                return false;
+            }
+
+            mStream=aStream;
+        }
+        break;
+        case CODEC_LZ4:
+        {
+#ifdef HEXEDITOR_LZ4
+            LZ4F_dctx *aContext;
+
+            if (LZ4F_isError(LZ4F_createDecompressionContext(&aContext, LZ4F_VERSION)))
+            {
+                mError="Can't initialize LZ4";
+                return false;
+            }
+
+            mStream=aContext;
+#else
+            mError="LZ4 support is not built in";
+            return false;
+#endif
+        }
+        break;
+        case CODEC_LZMA:
+        {
+#ifdef HEXEDITOR_LZMA
+            lzma_stream aInitStream=LZMA_STREAM_INIT;
+            lzma_stream *aStream=new lzma_stream;
+            *aStream=aInitStream;
+
+            if (lzma_auto_decoder(aStream, UINT64_MAX, 0)!=LZMA_OK)
+            {
+                delete aStream;
+                mError="Can't initialize LZMA";
+                return false;
+            }
+
+            mStream=aStream;
+#else
+            mError="LZMA support is not built in";
+            return false;
+#endif
+        }
+        break;
+    }
+
+    return true;
+}
+
+bool HexCodec::decompress(const uchar *&aInput, qint64 &aInputLeft, uchar *aOutput, int aOutputSize, int &aProduced, bool &aEnd)
+{
+    aProduced=0;
+    aEnd=false;
+
+    if (!mInitialized && !init())
+    {
+        return false;
+    }
+
+    if (!mStream)
+    {
+        return false;
+    }
+
+    qint64 aInputSize=qMin(aInputLeft, (qint64)MAX_STEP_INPUT);
+    qint64 aConsumed=0;
+
+    switch (mType)
+    {
+        case CODEC_ZLIB:
+        case CODEC_GZIP:
+        case CODEC_DEFLATE:
+        {
+            z_stream *aStream=(z_stream *)mStream;
+
+            aStream->next_in=(Bytef *)aInput;
+            aStream->avail_in=aInputSize;
+            aStream->next_out=aOutput;
+            aStream->avail_out=aOutputSize;
+
+            int aResult=inflate(aStream, Z_NO_FLUSH);
+
+            aConsumed=aInputSize-aStream->avail_in;
+            aProduced=aOutputSize-aStream->avail_out;
+
+            if (aResult==Z_STREAM_END)
+            {
+                aEnd=true;
+            }
+            else
+            if (aResult!=Z_OK && aResult!=Z_BUF_ERROR)
+            {
+                mError=aStream->msg ? QString::fromLatin1(aStream->msg) : QString("zlib error %1").arg(aResult);
+                return false;
+            }
+        }
+        break;
+        case CODEC_LZ4:
+        {
+#ifdef HEXEDITOR_LZ4
+            size_t aSourceSize=aInputSize;
+            size_t aTargetSize=aOutputSize;
+            size_t aResult=LZ4F_decompress((LZ4F_dctx *)mStream, aOutput, &aTargetSize, aInput, &aSourceSize, 0);
+
+            if (LZ4F_isError(aResult))
+            {
+                mError=QString::fromLatin1(LZ4F_getErrorName(aResult));
+                return false;
+            }
+
+            aConsumed=aSourceSize;
+            aProduced=aTargetSize;
+            aEnd=aResult==0;
+#endif
+        }
+        break;
+        case CODEC_LZMA:
+        {
+#ifdef HEXEDITOR_LZMA
+            lzma_stream *aStream=(lzma_stream *)mStream;
+
+            aStream->next_in=aInput;
+            aStream->avail_in=aInputSize;
+            aStream->next_out=aOutput;
+            aStream->avail_out=aOutputSize;
+
+            lzma_ret aResult=lzma_code(aStream, LZMA_RUN);
+
+            aConsumed=aInputSize-aStream->avail_in;
+            aProduced=aOutputSize-aStream->avail_out;
+
+            if (aResult==LZMA_STREAM_END)
+            {
+                aEnd=true;
+            }
+            else
+            if (aResult!=LZMA_OK && aResult!=LZMA_BUF_ERROR)
+            {
+                mError=QString("LZMA error %1").arg(aResult);
+                return false;
+            }
+#endif
+        }
+        break;
+    }
+
+    aInput+=aConsumed;
+    aInputLeft-=aConsumed;
+
+    if (!aEnd && aConsumed==0 && aProduced==0)
+    {
+        mError="Compressed data is truncated";
+        return false;
+    }
+
+    return true;
+}
+
+// Next part of aInput is read to aBuffer and aPos moves past it. Count of bytes or -1 if they can't be read
+static qint64 readInput(const HexDocument *aInput, qint64 &aPos, QByteArray &aBuffer)
+{
+    qint64 aCount=qMin(aInput->size()-aPos, (qint64)aBuffer.size());
+
+    if (aInput->read(aPos, aBuffer.data(), aCount)!=aCount)
+    {
+        return -1;
+    }
+
+    aPos+=aCount;
+
+    return aCount;
+}
+
+static bool appendOutput(QByteArray &aOutput, const char *aData, qint64 aLength, QString &aErrorText)
+{
+    if (aOutput.size()+aLength>HexDocument::maxArraySize())
+    {
+        aErrorText="Compressed data is too large";
+        return false;
+    }
+
+    aOutput.append(aData, (int)aLength);
+
+    return true;
+}
+
+bool HexCodec::compress(Type aType, const HexDocument *aInput, QByteArray &aOutput, QString *aError)
+{
+    HEX_PROFILE_SCOPE("codec.compress");
+
+    QString    aErrorText;
+    QByteArray aBuffer(COMPRESS_CHUNK, 0);
+    qint64     aSize=aInput->size();
+    qint64     aPos=0;
+
+    aOutput.clear();
+
+    switch (aType)
+    {
+        case CODEC_ZLIB:
+        case CODEC_GZIP:
+        case CODEC_DEFLATE:
+        {
+            z_stream aStream;
+            memset(&aStream, 0, sizeof(z_stream));
+
+            int aWindowBits=aType==CODEC_ZLIB ? MAX_WBITS : aType==CODEC_GZIP ? 16+MAX_WBITS : -MAX_WBITS;
+
+            if (deflateInit2(&aStream, Z_BEST_COMPRESSION, Z_DEFLATED, aWindowBits, 8, Z_DEFAULT_STRATEGY)!=Z_OK)
+            {
+                aErrorText="Can't initialize zlib";
+                break;
+            }
+
+            QByteArray aChunk(COMPRESS_CHUNK, 0);
+            int aResult=Z_OK;
+
+            while (aResult==Z_OK && aErrorText.isEmpty())
+            {
+                if (aStream.avail_in==0 && aPos<aSize)
+                {
+                    qint64 aCount=readInput(aInput, aPos, aBuffer);
+
+                    if (aCount<0)
+                    {
+                        aErrorText="Data can't be read";
+                        break;
+                    }
+
+                    aStream.next_in=(Bytef *)aBuffer.data();
+                    aStream.avail_in=aCount;
+                }
+
+                aStream.next_out=(Bytef *)aChunk.data();
+                aStream.avail_out=aChunk.size();
+
+                aResult=deflate(&aStream, aPos<aSize ? Z_NO_FLUSH : Z_FINISH);
+
+                appendOutput(aOutput, aChunk.constData(), aChunk.size()-aStream.avail_out, aErrorText);
+            }
+
+            deflateEnd(&aStream);
+
+            if (aErrorText.isEmpty() && aResult!=Z_STREAM_END)
+            {
+                aErrorText=QString("zlib error %1").arg(aResult);
+            }
+        }
+        break;
+        case CODEC_LZ4:
+        {
+#ifdef HEXEDITOR_LZ4
+            LZ4F_cctx *aContext;
+
+            if (LZ4F_isError(LZ4F_createCompressionContext(&aContext, LZ4F_VERSION)))
+            {
+                aErrorText="Can't initialize LZ4";
+                break;
+            }
+
+            // Bound of a chunk is enough for the frame header and the end of the frame too
+            QByteArray aChunk((int)LZ4F_compressBound(COMPRESS_CHUNK, 0), 0);
+            size_t aResult=LZ4F_compressBegin(aContext, aChunk.data(), aChunk.size(), 0);
+
+            while (!LZ4F_isError(aResult) && appendOutput(aOutput, aChunk.constData(), aResult, aErrorText) && aPos<aSize)
+            {
+                qint64 aCount=readInput(aInput, aPos, aBuffer);
+
+                if (aCount<0)
+                {
+                    aErrorText="Data can't be read";
+                    break;
+                }
+
+                aResult=LZ4F_compressUpdate(aContext, aChunk.data(), aChunk.size(), aBuffer.constData(), aCount, 0);
+            }
+
+            if (!LZ4F_isError(aResult) && aErrorText.isEmpty())
+            {
+                aResult=LZ4F_compressEnd(aContext, aChunk.data(), aChunk.size(), 0);
+
+                if (!LZ4F_isError(aResult))
+                {
+                    appendOutput(aOutput, aChunk.constData(), aResult, aErrorText);
+                }
+            }
+
+            LZ4F_freeCompressionContext(aContext);
+
+            if (aErrorText.isEmpty() && LZ4F_isError(aResult))
+            {
+                aErrorText=QString::fromLatin1(LZ4F_getErrorName(aResult));
+            }
+#else
+            aErrorText="LZ4 support is not built in";
+#endif
+        }
+        break;
+        case CODEC_LZMA:
+        {
+#ifdef HEXEDITOR_LZMA
+            lzma_stream aStream=LZMA_STREAM_INIT;
+
+            if (lzma_easy_encoder(&aStream, LZMA_PRESET_DEFAULT, LZMA_CHECK_CRC64)!=LZMA_OK)
+            {
+                aErrorText="Can't initialize LZMA";
+                break;
+            }
+
+            QByteArray aChunk(COMPRESS_CHUNK, 0);
+            lzma_ret aResult=LZMA_OK;
+
+            while (aResult==LZMA_OK && aErrorText.isEmpty())
+            {
+                if (aStream.avail_in==0 && aPos<aSize)
+                {
+                    qint64 aCount=readInput(aInput, aPos, aBuffer);
+
+                    if (aCount<0)
+                    {
+                        aErrorText="Data can't be read";
+                        break;
+                    }
+
+                    aStream.next_in=(const uint8_t *)aBuffer.constData();
+                    aStream.avail_in=aCount;
+                }
+
+                aStream.next_out=(uint8_t *)aChunk.data();
+                aStream.avail_out=aChunk.size();
+
+                aResult=lzma_code(&aStream, aPos<aSize ? LZMA_RUN : LZMA_FINISH);
+
+                appendOutput(aOutput, aChunk.constData(), aChunk.size()-aStream.avail_out, aErrorText);
+            }
+
+            lzma_end(&aStream);
+
+            if (aErrorText.isEmpty() && aResult!=LZMA_STREAM_END)
+            {
+                aErrorText=QString("LZMA error %1").arg(aResult);
+            }
+#else
+            aErrorText="LZMA support is not built in";
+#endif
+        }
+        break;
+    }
+
+    if (!aErrorText.isEmpty())
+    {
+        aOutput.clear();
+
+        if (aError)
+        {
+            *aError=aErrorText;
+        }
+
+        return false;
+    }
+
+    return true;
+}
+
+QList<HexCodec::Type> HexCodec::types()
+{
+    QList<Type> aTypes;
+
+    aTypes.append(CODEC_ZLIB);
+    aTypes.append(CODEC_GZIP);
+    aTypes.append(CODEC_DEFLATE);
+
+#ifdef HEXEDITOR_LZ4
+    aTypes.append(CODEC_LZ4);
+#endif
+
+#ifdef HEXEDITOR_LZMA
+    aTypes.append(CODEC_LZMA);
+#endif
+
+    return aTypes;
+}
+
+QString HexCodec::name(Type aType)
+{
+    switch (aType)
+    {
+        case CODEC_ZLIB:    return "zlib";
+        case CODEC_GZIP:    return "gzip";
+        case CODEC_DEFLATE: return "deflate";
+        case CODEC_LZ4:     return "LZ4";
+        case CODEC_LZMA:    return "LZMA";
+    }
+
+    return QString();
+}
+
+bool HexCodec::detect(const uchar *aData, qint64 aSize, Type &aType)
+{
+    if (aSize>=2 && aData[0]==0x1F && aData[1]==0x8B)
+    {
+        aType=CODEC_GZIP;
+    }
+    else
+    if (aSize>=4 && aData[0]==0x04 && aData[1]==0x22 && aData[2]==0x4D && aData[3]==0x18)
+    {
+        aType=CODEC_LZ4;
+    }
+    else
+    if (
+        (aSize>=6 && memcmp(aData, "\xFD" "7zXZ\x00", 6)==0)
+        ||
+        (aSize>=3 && aData[0]==0x5D && aData[1]==0x00 && aData[2]==0x00)
+       )
+    {
+        aType=CODEC_LZMA;
+    }
+    else
+    if (aSize>=2 && (aData[0] & 0x0F)==Z_DEFLATED && ((aData[0] << 8) | aData[1]) % 31==0)
+    {
+        aType=CODEC_ZLIB;
+    }
+    else
+    {
+        return false;
+    }
+
+    return types().contains(aType);
+}
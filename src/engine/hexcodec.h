@@ -0,0 +1,53 @@
+#ifndef HEXCODEC_H
+#define HEXCODEC_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+class HexDocument;
+
+/*
+ * Streaming decoder and encoder for compressed streams embedded into
+ * data. Encoder reads its input chunk by chunk. zlib is always available, LZ4 and LZMA are built only with
+ * qmake CONFIG+=lz4 and CONFIG+=lzma.
+ */
+class HexCodec
+{
+public:
+    enum Type
+    {
+        CODEC_ZLIB,
+        CODEC_GZIP,
+        CODEC_DEFLATE, // Raw deflate without header
+        CODEC_LZ4,     // LZ4 frame
+        CODEC_LZMA     // xz container, legacy .lzma is accepted on decompression
+    };
+
+    explicit HexCodec(Type aType);
+    ~HexCodec();
+
+    Type type() const;
+    QString errorString() const;
+
+    // Advances aInput and decreases aInputLeft by consumed bytes. aEnd becomes true at the end of stream
+    bool decompress(const uchar *&aInput, qint64 &aInputLeft, uchar *aOutput, int aOutputSize, int &aProduced, bool &aEnd);
+
+    static bool compress(Type aType, const HexDocument *aInput, QByteArray &aOutput, QString *aError=0);
+
+    static QList<Type> types();
+    static QString name(Type aType);
+    static bool detect(const uchar *aData, qint64 aSize, Type &aType);
+
+private:
+    Type     mType;
+    void    *mStream;
+    bool     mInitialized;
+    QString  mError;
+
+    bool init();
+
+    Q_DISABLE_COPY(HexCodec)
+};
+
+#endif // HEXCODEC_H
@@ -0,0 +1,731 @@
+#include "hexdatasource.h"
+
+#include "hexprofiler.h"
+
+#include <QTextStream>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <stdlib.h>
+#endif
+
+#ifdef Q_OS_LINUX
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <linux/fs.h>
+#endif
+
+#include <string.h>
+
+#define DEFAULT_PAGE_SIZE   4096
+#define BOUNCE_BUFFER_SIZE  (1 << 20)
+
+HexDataSource::HexDataSource()
+{
+}
+
+HexDataSource::~HexDataSource()
+{
+}
+
+int HexDataSource::pageSize() const
+{
+    return DEFAULT_PAGE_SIZE;
+}
+
+QVector<HexRange> HexDataSource::unreadableRanges() const
+{
+    return QVector<HexRange>();
+}
+
+bool HexDataSource::flush()
+{
+    return true;
+}
+
+QString HexDataSource::errorString() const
+{
+    return mError;
+}
+
+HexDataSource* HexDataSource::create(const QString &aName)
+{
+    if (aName.startsWith("pid:"))
+    {
+        return new ProcessMemoryDataSource(aName.mid(4).toLongLong());
+    }
+
+#ifdef Q_OS_UNIX
+    struct stat aStat;
+
+    if (stat(QFile::encodeName(aName).constData(), &aStat)==0)
+    {
+        if (S_ISBLK(aStat.st_mode))
+        {
+            return new BlockDeviceDataSource(aName);
+        }
+
+        // Character devices and pipes can't be mapped
+        if (!S_ISREG(aStat.st_mode))
+        {
+            return new FileDataSource(aName);
+        }
+    }
+#endif
+
+    return new MappedDataSource(aName);
+}
+
+// *********************************************************************************
+//                                FileDataSource
+// *********************************************************************************
+
+FileDataSource::FileDataSource(const QString &aFileName) :
+    mFile(aFileName)
+{
+}
+
+QString FileDataSource::name() const
+{
+    return mFile.fileName();
+}
+
+bool FileDataSource::open(bool aWritable)
+{
+    close();
+
+    if (!mFile.open(aWritable ? QIODevice::ReadWrite : QIODevice::ReadOnly))
+    {
+        mError=mFile.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+void FileDataSource::close()
+{
+    if (mFile.isOpen())
+    {
+        mFile.close();
+    }
+}
+
+qint64 FileDataSource::size() const
+{
+    return mFile.size();
+}
+
+bool FileDataSource::isWritable() const
+{
+    return mFile.openMode() & QIODevice::WriteOnly;
+}
+
+bool FileDataSource::read(qint64 aPos, char *aBuffer, qint64 aLength)
+{
+    HEX_PROFILE_SCOPE("io.source.read");
+
+    if (!mFile.seek(aPos) || mFile.read(aBuffer, aLength)!=aLength)
+    {
+        mError=mFile.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+bool FileDataSource::write(qint64 aPos, const char *aData, qint64 aLength)
+{
+    HEX_PROFILE_SCOPE("io.source.write");
+
+    if (!mFile.seek(aPos) || mFile.write(aData, aLength)!=aLength || !mFile.flush())
+    {
+        mError=mFile.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+// *********************************************************************************
+//                               MappedDataSource
+// *********************************************************************************
+
+MappedDataSource::MappedDataSource(const QString &aFileName) :
+    mFile(aFileName)
+{
+    mWritable=false;
+}
+
+QString MappedDataSource::name() const
+{
+    return mFile.fileName();
+}
+
+bool MappedDataSource::open(bool aWritable)
+{
+    if (!mFile.open(aWritable ? QIODevice::ReadWrite : QIODevice::ReadOnly))
+    {
+        mError=mFile.errorString();
+        return false;
+    }
+
+    mWritable=aWritable;
+
+    return true;
+}
+
+void MappedDataSource::close()
+{
+    mFile.close();
+    mWritable=false;
+}
+
+qint64 MappedDataSource::size() const
+{
+    return mFile.size();
+}
+
+bool MappedDataSource::isWritable() const
+{
+    return mWritable;
+}
+
+bool MappedDataSource::read(qint64 aPos, char *aBuffer, qint64 aLength)
+{
+    if (aPos<0 || aPos+aLength>mFile.size())
+    {
+        mError="Read beyond the end of file";
+        return false;
+    }
+
+    memcpy(aBuffer, mFile.data()+aPos, aLength);
+
+    return true;
+}
+
+bool MappedDataSource::write(qint64 aPos, const char *aData, qint64 aLength)
+{
+    uchar *aTarget=mFile.writableData();
+
+    if (!aTarget || aPos<0 || aPos+aLength>mFile.size())
+    {
+        mError="File is not writable at this position";
+        return false;
+    }
+
+    memcpy(aTarget+aPos, aData, aLength);
+
+    return true;
+}
+
+// *********************************************************************************
+//                             BlockDeviceDataSource
+// *********************************************************************************
+
+BlockDeviceDataSource::BlockDeviceDataSource(const QString &aDeviceName)
+{
+    mDeviceName=aDeviceName;
+    mHandle=-1;
+    mWritable=false;
+    mDirect=false;
+    mSize=0;
+    mBlockSize=DEFAULT_PAGE_SIZE;
+    mBuffer=0;
+    mBufferSize=0;
+}
+
+BlockDeviceDataSource::~BlockDeviceDataSource()
+{
+    close();
+}
+
+QString BlockDeviceDataSource::name() const
+{
+    return mDeviceName;
+}
+
+bool BlockDeviceDataSource::open(bool aWritable)
+{
+    close();
+
+#ifdef Q_OS_UNIX
+    QByteArray aPath=QFile::encodeName(mDeviceName);
+    int aFlags=aWritable ? O_RDWR : O_RDONLY;
+
+    struct stat aStat;
+
+    if (stat(aPath.constData(), &aStat)!=0)
+    {
+        mError=QString::fromLocal8Bit(strerror(errno));
+        return false;
+    }
+
+    mDirect=S_ISBLK(aStat.st_mode) || (S_ISREG(aStat.st_mode) && aStat.st_size%DEFAULT_PAGE_SIZE==0);
+
+#ifdef O_DIRECT
+    if (mDirect)
+    {
+        mHandle=::open(aPath.constData(), aFlags | O_DIRECT);
+    }
+#else
+    mDirect=false;
+#endif
+
+    // Some devices and filesystems refuse O_DIRECT, they are read through the page cache
+    if (mHandle<0)
+    {
+        mDirect=false;
+        mHandle=::open(aPath.constData(), aFlags);
+    }
+
+    if (mHandle<0)
+    {
+        mError=QString::fromLocal8Bit(strerror(errno));
+        return false;
+    }
+
+    mWritable=aWritable;
+    mSize=-1;
+
+#ifdef Q_OS_LINUX
+    if (S_ISBLK(aStat.st_mode))
+    {
+        unsigned long long aDeviceSize;
+        int aSectorSize;
+
+        if (ioctl(mHandle, BLKGETSIZE64, &aDeviceSize)==0)
+        {
+            mSize=aDeviceSize;
+        }
+
+        if (ioctl(mHandle, BLKSSZGET, &aSectorSize)==0 && aSectorSize>0)
+        {
+            mBlockSize=aSectorSize;
+        }
+    }
+#endif
+
+    if (mSize<0)
+    {
+        mSize=::lseek(mHandle, 0, SEEK_END);
+    }
+
+    mBufferSize=BOUNCE_BUFFER_SIZE;
+
+    void *aBuffer;
+
+    if (posix_memalign(&aBuffer, qMax(mBlockSize, DEFAULT_PAGE_SIZE), mBufferSize)!=0)
+    {
+        mError="Not enough memory";
+        close();
+        return false;
+    }
+
+    mBuffer=(char *)aBuffer;
+
+    return true;
+#else
+    Q_UNUSED(aWritable);
+
+    mError="Block devices are not supported on this platform";
+    return false;
+#endif
+}
+
+void BlockDeviceDataSource::close()
+{
+#ifdef Q_OS_UNIX
+    if (mHandle>=0)
+    {
+        ::close(mHandle);
+        mHandle=-1;
+    }
+
+    free(mBuffer);
+#endif
+
+    mBuffer=0;
+    mBufferSize=0;
+    mSize=0;
+    mWritable=false;
+}
+
+qint64 BlockDeviceDataSource::size() const
+{
+    return mSize;
+}
+
+bool BlockDeviceDataSource::isWritable() const
+{
+    return mWritable;
+}
+
+bool BlockDeviceDataSource::isDirect() const
+{
+    return mDirect;
+}
+
+int BlockDeviceDataSource::pageSize() const
+{
+    return qMax(mBlockSize, DEFAULT_PAGE_SIZE);
+}
+
+bool BlockDeviceDataSource::read(qint64 aPos, char *aBuffer, qint64 aLength)
+{
+    HEX_PROFILE_SCOPE("io.source.read");
+    return transfer(aPos, aBuffer, 0, aLength);
+}
+
+bool BlockDeviceDataSource::write(qint64 aPos, const char *aData, qint64 aLength)
+{
+    HEX_PROFILE_SCOPE("io.source.write");
+
+    if (!mWritable)
+    {
+        mError="Device is opened read-only";
+        return false;
+    }
+
+    return transfer(aPos, 0, aData, aLength);
+}
+
+bool BlockDeviceDataSource::transfer(qint64 aPos, char *aBuffer, const char *aData, qint64 aLength)
+{
+#ifdef Q_OS_UNIX
+    if (mHandle<0 || aPos<0 || aPos+aLength>mSize)
+    {
+        mError="Access beyond the end of device";
+        return false;
+    }
+
+    while (aLength>0)
+    {
+        qint64 aStart=aPos;
+        qint64 aEnd=aPos+aLength;
+
+        if (mDirect)
+        {
+            aStart=aPos & ~(qint64)(mBlockSize-1);
+            aEnd=qMin((aPos+aLength+mBlockSize-1) & ~(qint64)(mBlockSize-1), aStart+mBufferSize);
+        }
+        else
+        {
+            aEnd=qMin(aEnd, aStart+mBufferSize);
+        }
+
+        qint64 aCount=qMin(aEnd, aPos+aLength)-aPos;
+        qint64 aOffset=aPos-aStart;
+        qint64 aSpan=aEnd-aStart;
+
+        // Direct writes of partial blocks have to keep the rest of these blocks
+        if (aBuffer || aOffset>0 || aCount<aSpan)
+        {
+            if (pread(mHandle, mBuffer, aSpan, aStart)!=aSpan)
+            {
+                mError=QString::fromLocal8Bit(strerror(errno));
+                return false;
+            }
+        }
+
+        if (aBuffer)
+        {
+            memcpy(aBuffer, mBuffer+aOffset, aCount);
+            aBuffer+=aCount;
+        }
+        else
+        {
+            memcpy(mBuffer+aOffset, aData, aCount);
+            aData+=aCount;
+
+            if (pwrite(mHandle, mBuffer, aSpan, aStart)!=aSpan)
+            {
+                mError=QString::fromLocal8Bit(strerror(errno));
+                return false;
+            }
+        }
+
+        aPos+=aCount;
+        aLength-=aCount;
+    }
+
+    return true;
+#else
+    Q_UNUSED(aPos);
+    Q_UNUSED(aBuffer);
+    Q_UNUSED(aData);
+    Q_UNUSED(aLength);
+
+    return false;
+#endif
+}
+
+// *********************************************************************************
+//                            ProcessMemoryDataSource
+// *********************************************************************************
+
+ProcessMemoryDataSource::ProcessMemoryDataSource(qint64 aPid)
+{
+    mPid=aPid;
+    mHandle=-1;
+    mWritable=false;
+}
+
+ProcessMemoryDataSource::~ProcessMemoryDataSource()
+{
+    close();
+}
+
+QString ProcessMemoryDataSource::name() const
+{
+    return QString("pid:%1").arg(mPid);
+}
+
+bool ProcessMemoryDataSource::open(bool aWritable)
+{
+    close();
+
+#ifdef Q_OS_LINUX
+    if (!refreshRegions())
+    {
+        return false;
+    }
+
+    // /proc/<pid>/mem is a fallback for reads and the only way for writes
+    mHandle=::open(QString("/proc/%1/mem").arg(mPid).toLatin1().constData(), aWritable ? O_RDWR : O_RDONLY);
+
+    if (mHandle<0)
+    {
+        mError=QString::fromLocal8Bit(strerror(errno));
+        return false;
+    }
+
+    mWritable=aWritable;
+
+    return true;
+#else
+    Q_UNUSED(aWritable);
+
+    mError="Process memory is supported only on Linux";
+    return false;
+#endif
+}
+
+void ProcessMemoryDataSource::close()
+{
+#ifdef Q_OS_UNIX
+    if (mHandle>=0)
+    {
+        ::close(mHandle);
+        mHandle=-1;
+    }
+#endif
+
+    mWritable=false;
+}
+
+qint64 ProcessMemoryDataSource::size() const
+{
+    return mRegions.isEmpty() ? 0 : mRegions.last().end;
+}
+
+bool ProcessMemoryDataSource::isWritable() const
+{
+    return mWritable;
+}
+
+QVector<HexRange> ProcessMemoryDataSource::unreadableRanges() const
+{
+    QVector<HexRange> aRanges;
+    qint64 aPos=0;
+
+    for (int i=0; i<mRegions.size(); ++i)
+    {
+        const ProcessMemoryRegion &aRegion=mRegions.at(i);
+
+        if (!aRegion.permissions.startsWith('r'))
+        {
+            continue;
+        }
+
+        if (aRegion.start>aPos)
+        {
+            HexRange aRange;
+            aRange.pos=aPos;
+            aRange.length=aRegion.start-aPos;
+            aRanges.append(aRange);
+        }
+
+        aPos=qMax(aPos, aRegion.end);
+    }
+
+    if (aPos<size())
+    {
+        HexRange aRange;
+        aRange.pos=aPos;
+        aRange.length=size()-aPos;
+        aRanges.append(aRange);
+    }
+
+    return aRanges;
+}
+
+bool ProcessMemoryDataSource::read(qint64 aPos, char *aBuffer, qint64 aLength)
+{
+    HEX_PROFILE_SCOPE("io.source.read");
+
+    memset(aBuffer, 0, aLength);
+
+    for (int i=0; i<mRegions.size(); ++i)
+    {
+        const ProcessMemoryRegion &aRegion=mRegions.at(i);
+        qint64 aStart=qMax(aPos, aRegion.start);
+        qint64 aEnd=qMin(aPos+aLength, aRegion.end);
+
+        if (aStart>=aEnd || !aRegion.permissions.startsWith('r'))
+        {
+            continue;
+        }
+
+        if (!readRange(aStart, aBuffer+(aStart-aPos), aEnd-aStart))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool ProcessMemoryDataSource::readRange(qint64 aPos, char *aBuffer, qint64 aLength)
+{
+#ifdef Q_OS_LINUX
+    struct iovec aLocal;
+    struct iovec aRemote;
+
+    aLocal.iov_base=aBuffer;
+    aLocal.iov_len=aLength;
+    aRemote.iov_base=(void *)(quintptr)aPos;
+    aRemote.iov_len=aLength;
+
+    if (process_vm_readv((pid_t)mPid, &aLocal, 1, &aRemote, 1, 0)==aLength)
+    {
+        return true;
+    }
+
+    // Guard pages and special mappings fail with EFAULT or EIO, they stay zeros
+    if (pread(mHandle, aBuffer, aLength, aPos)<0 && (errno==EPERM || errno==EACCES))
+    {
+        mError=QString::fromLocal8Bit(strerror(errno));
+        return false;
+    }
+
+    return true;
+#else
+    Q_UNUSED(aPos);
+    Q_UNUSED(aBuffer);
+    Q_UNUSED(aLength);
+
+    return false;
+#endif
+}
+
+bool ProcessMemoryDataSource::write(qint64 aPos, const char *aData, qint64 aLength)
+{
+    HEX_PROFILE_SCOPE("io.source.write");
+
+#ifdef Q_OS_LINUX
+    if (!mWritable)
+    {
+        mError="Process memory is opened read-only";
+        return false;
+    }
+
+    while (aLength>0)
+    {
+        ssize_t aWritten=pwrite(mHandle, aData, aLength, aPos);
+
+        if (aWritten<=0)
+        {
+            mError=QString::fromLocal8Bit(strerror(errno));
+            return false;
+        }
+
+        aData+=aWritten;
+        aPos+=aWritten;
+        aLength-=aWritten;
+    }
+
+    return true;
+#else
+    Q_UNUSED(aPos);
+    Q_UNUSED(aData);
+    Q_UNUSED(aLength);
+
+    return false;
+#endif
+}
+
+qint64 ProcessMemoryDataSource::pid() const
+{
+    return mPid;
+}
+
+bool ProcessMemoryDataSource::refreshRegions()
+{
+    QFile aFile(QString("/proc/%1/maps").arg(mPid));
+
+    if (!aFile.open(QIODevice::ReadOnly))
+    {
+        mError=aFile.errorString();
+        return false;
+    }
+
+    mRegions.clear();
+
+    // "00400000-00452000 r-xp 00000000 08:02 173521      /usr/bin/dbus-daemon"
+    QTextStream aStream(&aFile);
+
+    for (QString aLine=aStream.readLine(); !aLine.isNull(); aLine=aStream.readLine())
+    {
+        QStringList aFields=aLine.split(' ', QString::SkipEmptyParts);
+
+        if (aFields.size()<5)
+        {
+            continue;
+        }
+
+        QStringList aAddresses=aFields.at(0).split('-');
+        bool ok1;
+        bool ok2;
+
+        ProcessMemoryRegion aRegion;
+        aRegion.start=aAddresses.first().toLongLong(&ok1, 16);
+        aRegion.end=aAddresses.last().toLongLong(&ok2, 16);
+        aRegion.permissions=aFields.at(1);
+        aRegion.name=aFields.size()>5 ? QStringList(aFields.mid(5)).join(" ") : QString();
+
+        // Kernel addresses like [vsyscall] don't fit and can't be read anyway
+        if (!ok1 || !ok2 || aRegion.start>=aRegion.end)
+        {
+            continue;
+        }
+
+        mRegions.append(aRegion);
+    }
+
+    if (mRegions.isEmpty())
+    {
+        mError="Process has no memory regions";
+        return false;
+    }
+
+    return true;
+}
+
+QList<ProcessMemoryRegion> ProcessMemoryDataSource::regions() const
+{
+    return mRegions;
+}
@@ -0,0 +1,169 @@
+#ifndef HEXDATASOURCE_H
+#define HEXDATASOURCE_H
+
+#include <QFile>
+#include <QVector>
+#include <QStringList>
+
+#include "mappedfile.h"
+#include "hexsearch.h"
+
+/*
+ * Random access storage that data is read from and written back to.
+ * Sources are read page by page on demand, so they can be much larger
+ * than memory. Bytes of unreadable ranges are read as zeros.
+ */
+class HexDataSource
+{
+public:
+    HexDataSource();
+    virtual ~HexDataSource();
+
+    virtual QString name() const=0;
+    virtual bool    open(bool aWritable)=0;
+    virtual void    close()=0;
+    virtual qint64  size() const=0;
+    virtual bool    isWritable() const=0;
+    virtual int     pageSize() const;
+    virtual QVector<HexRange> unreadableRanges() const;
+
+    // Both return false on I/O error, reads never go beyond size()
+    virtual bool read(qint64 aPos, char *aBuffer, qint64 aLength)=0;
+    virtual bool write(qint64 aPos, const char *aData, qint64 aLength)=0;
+    virtual bool flush(); // After all writes of a write back
+
+    QString errorString() const;
+
+    // "pid:1234" is memory of process 1234, block devices and regular files are detected by path
+    static HexDataSource* create(const QString &aName);
+
+protected:
+    QString mError;
+
+private:
+    Q_DISABLE_COPY(HexDataSource)
+};
+
+// *********************************************************************************
+
+class FileDataSource : public HexDataSource
+{
+public:
+    explicit FileDataSource(const QString &aFileName);
+
+    QString name() const;
+    bool    open(bool aWritable);
+    void    close();
+    qint64  size() const;
+    bool    isWritable() const;
+    bool    read(qint64 aPos, char *aBuffer, qint64 aLength);
+    bool    write(qint64 aPos, const char *aData, qint64 aLength);
+
+private:
+    QFile mFile;
+};
+
+// *********************************************************************************
+
+class MappedDataSource : public HexDataSource
+{
+public:
+    explicit MappedDataSource(const QString &aFileName);
+
+    QString name() const;
+    bool    open(bool aWritable);
+    void    close();
+    qint64  size() const;
+    bool    isWritable() const;
+    bool    read(qint64 aPos, char *aBuffer, qint64 aLength);
+    bool    write(qint64 aPos, const char *aData, qint64 aLength);
+
+private:
+    MappedFile mFile;
+    bool       mWritable;
+};
+
+// *********************************************************************************
+
+/*
+ * Block device opened with O_DIRECT where it is possible. Direct I/O
+ * needs aligned offsets, lengths and buffers, so requests go through an
+ * aligned bounce buffer and partial blocks are read before being written.
+ * Regular files of whole blocks, like images of loop devices, are opened
+ * the same way.
+ */
+class BlockDeviceDataSource : public HexDataSource
+{
+public:
+    explicit BlockDeviceDataSource(const QString &aDeviceName);
+    ~BlockDeviceDataSource();
+
+    QString name() const;
+    bool    open(bool aWritable);
+    void    close();
+    qint64  size() const;
+    bool    isWritable() const;
+    int     pageSize() const;
+    bool    read(qint64 aPos, char *aBuffer, qint64 aLength);
+    bool    write(qint64 aPos, const char *aData, qint64 aLength);
+
+    bool isDirect() const; // O_DIRECT is in use
+
+private:
+    QString mDeviceName;
+    int     mHandle;
+    bool    mWritable;
+    bool    mDirect;     // Direct I/O never goes beyond the end, so files must be whole blocks
+    qint64  mSize;
+    int     mBlockSize;
+    char   *mBuffer;     // Aligned to mBlockSize
+    int     mBufferSize;
+
+    bool transfer(qint64 aPos, char *aBuffer, const char *aData, qint64 aLength);
+};
+
+// *********************************************************************************
+
+struct ProcessMemoryRegion
+{
+    qint64  start;
+    qint64  end;
+    QString permissions; // "rw-p"
+    QString name;        // Mapped file, [heap], [stack], ...
+};
+
+/*
+ * Address space of a live process. Only mapped readable regions are
+ * read, the rest is reported as unreadable. process_vm_readv() is used
+ * for reads, writes go to /proc/<pid>/mem, which can also change
+ * read-only pages.
+ */
+class ProcessMemoryDataSource : public HexDataSource
+{
+public:
+    explicit ProcessMemoryDataSource(qint64 aPid);
+    ~ProcessMemoryDataSource();
+
+    QString name() const;
+    bool    open(bool aWritable);
+    void    close();
+    qint64  size() const;
+    bool    isWritable() const;
+    QVector<HexRange> unreadableRanges() const;
+    bool    read(qint64 aPos, char *aBuffer, qint64 aLength);
+    bool    write(qint64 aPos, const char *aData, qint64 aLength);
+
+    qint64 pid() const;
+    bool   refreshRegions();
+    QList<ProcessMemoryRegion> regions() const;
+
+private:
+    qint64                     mPid;
+    int                        mHandle;
+    bool                       mWritable;
+    QList<ProcessMemoryRegion> mRegions; // Sorted by address
+
+    bool readRange(qint64 aPos, char *aBuffer, qint64 aLength);
+};
+
+#endif // HEXDATASOURCE_H
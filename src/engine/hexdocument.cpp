@@ -0,0 +1,1171 @@
+#include "hexdocument.h"
+
+#include "hexprofiler.h"
+#include "sessionjournal.h"
+
+#include <QPair>
+#include <QMutexLocker>
+
+#include <string.h>
+#include <limits.h>
+
+#define SEARCH_BLOCK_SIZE  (1 << 20)
+#define PAGE_CACHE_SIZE    1024 // Pages
+#define ZERO_BLOCK_SIZE    (64 << 10)
+#define MAX_ARRAY_OVERHEAD (1 << 10)
+
+quint64 HexDocument::sLastVersion=0;
+
+HexDocument::HexDocument()
+{
+    mVersion=++sLastVersion;
+    mJournal=0;
+}
+
+HexDocument::~HexDocument()
+{
+}
+
+const char* HexDocument::constData() const
+{
+    return 0;
+}
+
+char* HexDocument::writableData(qint64 /*aPos*/, qint64 /*aLength*/)
+{
+    return 0;
+}
+
+QByteArray HexDocument::mid(qint64 aPos, qint64 aLength) const
+{
+    if (aPos<0 || aPos>=size())
+    {
+        return QByteArray();
+    }
+
+    if (aLength<0 || aLength>size()-aPos)
+    {
+        aLength=size()-aPos;
+    }
+
+    aLength=qMin(aLength, maxArraySize());
+
+    QByteArray aResult((int)aLength, 0);
+    read(aPos, aResult.data(), aLength);
+
+    return aResult;
+}
+
+void HexDocument::reserve(qint64 /*aSize*/)
+{
+}
+
+HexDocument* HexDocument::snapshot() const
+{
+    if (size()>maxArraySize())
+    {
+        return 0;
+    }
+
+    return new ByteArrayDocument(mid(0));
+}
+
+qint64 HexDocument::cacheSize() const
+{
+    return 0;
+}
+
+void HexDocument::trimCache(qint64 /*aSize*/)
+{
+}
+
+bool HexDocument::isCached(qint64 /*aPos*/, qint64 /*aLength*/) const
+{
+    return true;
+}
+
+void HexDocument::prefetch(qint64 /*aPos*/, qint64 /*aLength*/)
+{
+}
+
+qint64 HexDocument::read(qint64 aPos, char *aBuffer, qint64 aLength) const
+{
+    if (aPos<0 || aPos>=size() || aLength<=0)
+    {
+        return 0;
+    }
+
+    aLength=qMin(aLength, size()-aPos);
+
+    qint64 aDone=0;
+
+    while (aDone<aLength)
+    {
+        qint64 aCount;
+        const char *aChunk=chunk(aPos+aDone, aCount);
+
+        if (aCount<=0)
+        {
+            break;
+        }
+
+        aCount=qMin(aCount, aLength-aDone);
+        memcpy(aBuffer+aDone, aChunk, aCount);
+
+        aDone+=aCount;
+    }
+
+    // Rest of the buffer shouldn't keep old bytes for callers that don't check the result
+    memset(aBuffer+aDone, 0, aLength-aDone);
+
+    return aDone;
+}
+
+qint64 HexDocument::maxArraySize()
+{
+    // Header of the array takes a part of the int range
+    return INT_MAX-MAX_ARRAY_OVERHEAD;
+}
+
+char HexDocument::at(qint64 aPos) const
+{
+    qint64 aCount;
+    return *chunk(aPos, aCount);
+}
+
+void HexDocument::insert(qint64 aPos, const QByteArray &aData)
+{
+    if (aPos<0 || aPos>size() || aData.isEmpty())
+    {
+        return;
+    }
+
+    // Journal queues edits of a change when the change is committed, after the data
+    if (mJournal)
+    {
+        mJournal->edited(aPos, 0, aData);
+    }
+
+    insertData(aPos, aData.constData(), aData.size());
+    mAnnotations.inserted(aPos, aData.size());
+    touch();
+}
+
+void HexDocument::remove(qint64 aPos, qint64 aLength)
+{
+    if (aPos<0 || aPos>=size() || aLength<=0)
+    {
+        return;
+    }
+
+    aLength=qMin(aLength, size()-aPos);
+
+    if (mJournal)
+    {
+        mJournal->edited(aPos, aLength, QByteArray());
+    }
+
+    removeData(aPos, aLength);
+    mAnnotations.removed(aPos, aLength);
+    touch();
+}
+
+void HexDocument::replace(qint64 aPos, qint64 aLength, const QByteArray &aData)
+{
+    if (aPos<0 || aPos>size())
+    {
+        return;
+    }
+
+    aLength=qMax((qint64)0, qMin(aLength, size()-aPos));
+
+    if (mJournal)
+    {
+        mJournal->edited(aPos, aLength, aData);
+    }
+
+    // Common part is overwritten, so nothing is moved when sizes are the same
+    qint64 aCommon=qMin(aLength, (qint64)aData.size());
+
+    if (aCommon>0)
+    {
+        overwriteData(aPos, aData.constData(), aCommon);
+    }
+
+    if (aLength>aCommon)
+    {
+        removeData(aPos+aCommon, aLength-aCommon);
+        mAnnotations.removed(aPos+aCommon, aLength-aCommon);
+    }
+    else
+    if (aData.size()>aCommon)
+    {
+        insertData(aPos+aCommon, aData.constData()+aCommon, aData.size()-aCommon);
+        mAnnotations.inserted(aPos+aCommon, aData.size()-aCommon);
+    }
+
+    touch();
+}
+
+void HexDocument::replace(const QList<HexReplacement> &aReplacements)
+{
+    qint64 aEnd=0;
+
+    for (int i=0; i<aReplacements.size(); ++i)
+    {
+        const HexReplacement &aReplacement=aReplacements.at(i);
+
+        if (aReplacement.pos<aEnd || aReplacement.removedLength<0 || aReplacement.pos+aReplacement.removedLength>size())
+        {
+            return;
+        }
+
+        aEnd=aReplacement.pos+aReplacement.removedLength;
+    }
+
+    if (aReplacements.isEmpty())
+    {
+        return;
+    }
+
+    // Journal and annotations get the replacements one by one, each one moves the ones after it
+    qint64 aShift=0;
+
+    for (int i=0; i<aReplacements.size(); ++i)
+    {
+        const HexReplacement &aReplacement=aReplacements.at(i);
+        qint64 aPos=aReplacement.pos+aShift;
+        qint64 aInserted=aReplacement.inserted.size();
+        qint64 aCommon=qMin(aReplacement.removedLength, aInserted);
+
+        if (mJournal)
+        {
+            mJournal->edited(aPos, aReplacement.removedLength, aReplacement.inserted);
+        }
+
+        if (aReplacement.removedLength>aCommon)
+        {
+            mAnnotations.removed(aPos+aCommon, aReplacement.removedLength-aCommon);
+        }
+        else
+        if (aInserted>aCommon)
+        {
+            mAnnotations.inserted(aPos+aCommon, aInserted-aCommon);
+        }
+
+        aShift+=aInserted-aReplacement.removedLength;
+    }
+
+    replaceData(aReplacements);
+    touch();
+}
+
+void HexDocument::replaceData(const QList<HexReplacement> &aReplacements)
+{
+    qint64 aShift=0;
+
+    for (int i=0; i<aReplacements.size(); ++i)
+    {
+        const HexReplacement &aReplacement=aReplacements.at(i);
+        qint64 aPos=aReplacement.pos+aShift;
+        qint64 aInserted=aReplacement.inserted.size();
+        qint64 aCommon=qMin(aReplacement.removedLength, aInserted);
+
+        if (aCommon>0)
+        {
+            overwriteData(aPos, aReplacement.inserted.constData(), aCommon);
+        }
+
+        if (aReplacement.removedLength>aCommon)
+        {
+            removeData(aPos+aCommon, aReplacement.removedLength-aCommon);
+        }
+        else
+        if (aInserted>aCommon)
+        {
+            insertData(aPos+aCommon, aReplacement.inserted.constData()+aCommon, aInserted-aCommon);
+        }
+
+        aShift+=aInserted-aReplacement.removedLength;
+    }
+}
+
+void HexDocument::append(const QByteArray &aData)
+{
+    insert(size(), aData);
+}
+
+void HexDocument::touch()
+{
+    mVersion=++sLastVersion;
+}
+
+void HexDocument::touch(qint64 aPos, qint64 aLength)
+{
+    touch();
+
+    // Bytes aren't read when an operation record stands for them
+    if (mJournal && mJournal->collectsEdits())
+    {
+        mJournal->edited(aPos, aLength, mid(aPos, aLength));
+    }
+}
+
+qint64 HexDocument::indexOf(const HexPattern &aPattern, qint64 aFrom, qint64 aTo) const
+{
+    qint64 aLength=aPattern.length();
+
+    if (aFrom<0)
+    {
+        aFrom=0;
+    }
+
+    if (aTo<0 || aTo>size()-aLength+1)
+    {
+        aTo=size()-aLength+1; // Last start position + 1
+    }
+
+    if (aLength==0 || aFrom>=aTo)
+    {
+        return -1;
+    }
+
+    const char *aData=constData();
+
+    if (aData)
+    {
+        return HexSearch::indexOf((const uchar *)aData, size(), aPattern, aFrom, aTo);
+    }
+
+    // Blocks overlap by pattern length, so matches on the border are found
+    QByteArray aBuffer;
+
+    for (qint64 aStart=aFrom; aStart<aTo; aStart+=SEARCH_BLOCK_SIZE)
+    {
+        qint64 aStarts=qMin((qint64)SEARCH_BLOCK_SIZE, aTo-aStart);
+
+        aBuffer.resize(aStarts+aLength-1);
+        read(aStart, aBuffer.data(), aBuffer.size());
+
+        qint64 aFound=HexSearch::indexOf((const uchar *)aBuffer.constData(), aBuffer.size(), aPattern, 0, aStarts);
+
+        if (aFound>=0)
+        {
+            return aStart+aFound;
+        }
+    }
+
+    return -1;
+}
+
+qint64 HexDocument::lastIndexOf(const HexPattern &aPattern, qint64 aFrom, qint64 aTo) const
+{
+    qint64 aLength=aPattern.length();
+
+    if (aLength==0 || aLength>size())
+    {
+        return -1;
+    }
+
+    if (aFrom<0 || aFrom>size()-aLength)
+    {
+        aFrom=size()-aLength;
+    }
+
+    aTo=qMax(aTo, (qint64)0);
+
+    const char *aData=constData();
+
+    if (aData)
+    {
+        return HexSearch::lastIndexOf((const uchar *)aData, size(), aPattern, aFrom, aTo);
+    }
+
+    QByteArray aBuffer;
+
+    for (qint64 aEnd=aFrom+1; aEnd>aTo; aEnd-=SEARCH_BLOCK_SIZE)
+    {
+        qint64 aStart=qMax(aTo, aEnd-SEARCH_BLOCK_SIZE);
+
+        aBuffer.resize(aEnd-aStart+aLength-1);
+        read(aStart, aBuffer.data(), aBuffer.size());
+
+        qint64 aFound=HexSearch::lastIndexOf((const uchar *)aBuffer.constData(), aBuffer.size(), aPattern, aEnd-aStart-1);
+
+        if (aFound>=0)
+        {
+            return aStart+aFound;
+        }
+    }
+
+    return -1;
+}
+
+quint64 HexDocument::version() const
+{
+    return mVersion;
+}
+
+HexAnnotations& HexDocument::annotations()
+{
+    return mAnnotations;
+}
+
+const HexAnnotations& HexDocument::annotations() const
+{
+    return mAnnotations;
+}
+
+SessionJournal* HexDocument::journal() const
+{
+    return mJournal;
+}
+
+void HexDocument::setJournal(SessionJournal *aJournal)
+{
+    mJournal=aJournal;
+}
+
+// *********************************************************************************
+//                                ByteArrayDocument
+// *********************************************************************************
+
+ByteArrayDocument::ByteArrayDocument(const QByteArray &aData) :
+    HexDocument()
+{
+    mData=aData;
+}
+
+qint64 ByteArrayDocument::size() const
+{
+    return mData.size();
+}
+
+const char* ByteArrayDocument::chunk(qint64 aPos, qint64 &aLength) const
+{
+    aLength=mData.size()-aPos;
+    return mData.constData()+aPos;
+}
+
+const char* ByteArrayDocument::constData() const
+{
+    return mData.constData();
+}
+
+char* ByteArrayDocument::writableData(qint64 aPos, qint64 /*aLength*/)
+{
+    return mData.data()+aPos;
+}
+
+QByteArray ByteArrayDocument::mid(qint64 aPos, qint64 aLength) const
+{
+    return mData.mid((int)aPos, (int)aLength);
+}
+
+void ByteArrayDocument::reserve(qint64 aSize)
+{
+    mData.reserve((int)qMin(aSize, maxArraySize()));
+}
+
+HexDocument* ByteArrayDocument::snapshot() const
+{
+    // Implicitly shared, changes of this document detach from it
+    return new ByteArrayDocument(mData);
+}
+
+QByteArray ByteArrayDocument::byteArray() const
+{
+    return mData;
+}
+
+void ByteArrayDocument::insertData(qint64 aPos, const char *aData, qint64 aLength)
+{
+    if (aPos==mData.size())
+    {
+        mData.append(aData, aLength);
+    }
+    else
+    {
+        mData.insert(aPos, QByteArray::fromRawData(aData, aLength));
+    }
+}
+
+void ByteArrayDocument::removeData(qint64 aPos, qint64 aLength)
+{
+    mData.remove(aPos, aLength);
+}
+
+void ByteArrayDocument::overwriteData(qint64 aPos, const char *aData, qint64 aLength)
+{
+    memcpy(mData.data()+aPos, aData, aLength);
+}
+
+// *********************************************************************************
+//                                 SourceDocument
+// *********************************************************************************
+
+SourceDocument::SourceDocument(HexDataSource *aSource, qint64 aBase, qint64 aLength) :
+    HexDocument(),
+    mPages(PAGE_CACHE_SIZE)
+{
+    mSource=aSource;
+    mPagesGeneration=0;
+    mPageLoader=0;
+    mBase=qBound((qint64)0, aBase, mSource->size());
+    mLength=aLength<0 ? mSource->size()-mBase : qMin(aLength, mSource->size()-mBase);
+    mSize=mLength;
+
+    resetPieces();
+}
+
+SourceDocument::~SourceDocument()
+{
+    delete mPageLoader;
+    delete mSource;
+}
+
+qint64 SourceDocument::size() const
+{
+    return mSize;
+}
+
+const char* SourceDocument::chunk(qint64 aPos, qint64 &aLength) const
+{
+    int aIndex=findPiece(aPos);
+    const Piece &aPiece=mPieces.at(aIndex);
+    qint64 aOffset=aPos-mStarts.at(aIndex);
+
+    if (aPiece.sourcePos<0)
+    {
+        aLength=aPiece.length-aOffset;
+        return aPiece.data.constData()+aOffset;
+    }
+
+    if (aPiece.zeros)
+    {
+        static const char aZeros[ZERO_BLOCK_SIZE]={0};
+
+        aLength=qMin(aPiece.length-aOffset, (qint64)ZERO_BLOCK_SIZE);
+        return aZeros;
+    }
+
+    qint64 aSourcePos=aPiece.sourcePos+aOffset;
+    int    aPageSize=mSource->pageSize();
+    qint64 aPageIndex=aSourcePos/aPageSize;
+
+    mLastPage=page(aPageIndex);
+
+    qint64 aPageOffset=aSourcePos-aPageIndex*aPageSize;
+    aLength=qMin(mLastPage.size()-aPageOffset, aPiece.length-aOffset);
+
+    return mLastPage.constData()+aPageOffset;
+}
+
+qint64 SourceDocument::cacheSize() const
+{
+    QMutexLocker aLocker(&mPagesMutex);
+
+    return (qint64)mPages.totalCost()*mSource->pageSize();
+}
+
+void SourceDocument::trimCache(qint64 aSize)
+{
+    QMutexLocker aLocker(&mPagesMutex);
+
+    // Lower limit evicts pages right away, the old one lets the cache grow again when it is used
+    int aMaxCost=mPages.maxCost();
+
+    mPages.setMaxCost((int)qBound((qint64)0, aSize/mSource->pageSize(), (qint64)aMaxCost));
+    mPages.setMaxCost(aMaxCost);
+}
+
+bool SourceDocument::isCached(qint64 aPos, qint64 aLength) const
+{
+    return missingPages(aPos, aLength).isEmpty();
+}
+
+void SourceDocument::prefetch(qint64 aPos, qint64 aLength)
+{
+    QVector<qint64> aPages=missingPages(aPos, aLength);
+
+    if (aPages.isEmpty())
+    {
+        return;
+    }
+
+    if (!mPageLoader)
+    {
+        mPageLoader=new PageLoader(this);
+        mPageLoader->start(QThread::LowPriority);
+    }
+
+    mPageLoader->load(aPages);
+}
+
+HexDocument* SourceDocument::snapshot() const
+{
+    // Own handle of the source and own page cache, nothing is shared with this document
+    HexDataSource *aSource=HexDataSource::create(mSource->name());
+
+    if (!aSource->open(false))
+    {
+        delete aSource;
+        return HexDocument::snapshot();
+    }
+
+    SourceDocument *aSnapshot=new SourceDocument(aSource, mBase, mLength);
+
+    aSnapshot->mPieces=mPieces;
+    aSnapshot->mStarts=mStarts;
+    aSnapshot->mSize=mSize;
+
+    return aSnapshot;
+}
+
+HexDataSource* SourceDocument::source() const
+{
+    return mSource;
+}
+
+qint64 SourceDocument::base() const
+{
+    return mBase;
+}
+
+bool SourceDocument::reopenSource(bool aWritable, QString *aError)
+{
+    bool aOpened;
+
+    {
+        QMutexLocker aLocker(&mSourceMutex);
+
+        aOpened=mSource->open(aWritable);
+
+        if (!aOpened && aError)
+        {
+            *aError=mSource->errorString();
+        }
+    }
+
+    dropPages();
+
+    return aOpened;
+}
+
+void SourceDocument::closeSource()
+{
+    {
+        QMutexLocker aLocker(&mSourceMutex);
+        mSource->close();
+    }
+
+    // Pages read while the source was closed are zeros
+    dropPages();
+}
+
+QString SourceDocument::errorString() const
+{
+    QMutexLocker aLocker(&mPagesMutex);
+
+    return mError;
+}
+
+bool SourceDocument::writeBack(QString *aError)
+{
+    HEX_PROFILE_SCOPE("document.writeBack");
+
+    QString aErrorText;
+
+    if (!mSource->isWritable())
+    {
+        aErrorText="Data source is opened read-only";
+    }
+    else
+    if (mSize!=mLength)
+    {
+        aErrorText="Size of data can't be changed in a data source";
+    }
+
+    // Moved bytes are read before anything is written, since they can be overwritten
+    QList<QPair<qint64, QByteArray> > aWrites;
+
+    for (int i=0; i<mPieces.size() && aErrorText.isEmpty(); ++i)
+    {
+        const Piece &aPiece=mPieces.at(i);
+
+        if (aPiece.sourcePos<0)
+        {
+            aWrites.append(qMakePair(mBase+mStarts.at(i), aPiece.data));
+        }
+        else
+        if (aPiece.sourcePos!=mBase+mStarts.at(i))
+        {
+            aWrites.append(qMakePair(mBase+mStarts.at(i), mid(mStarts.at(i), aPiece.length)));
+        }
+    }
+
+    {
+        QMutexLocker aLocker(&mSourceMutex);
+
+        for (int i=0; i<aWrites.size() && aErrorText.isEmpty(); ++i)
+        {
+            const QPair<qint64, QByteArray> &aWrite=aWrites.at(i);
+
+            if (!mSource->write(aWrite.first, aWrite.second.constData(), aWrite.second.size()))
+            {
+                aErrorText=QString("%1 at %2").arg(mSource->errorString()).arg(aWrite.first, 0, 16);
+            }
+        }
+
+        if (aErrorText.isEmpty() && !mSource->flush())
+        {
+            aErrorText=mSource->errorString();
+        }
+    }
+
+    if (!aErrorText.isEmpty())
+    {
+        {
+            QMutexLocker aLocker(&mPagesMutex);
+            mError=aErrorText;
+        }
+
+        if (aError)
+        {
+            *aError=aErrorText;
+        }
+
+        return false;
+    }
+
+    // Source has the same bytes now
+    resetPieces();
+
+    return true;
+}
+
+void SourceDocument::sourceReplaced()
+{
+    mLength=mSize;
+    resetPieces();
+}
+
+void SourceDocument::setHoles(const QVector<HexRange> &aHoles)
+{
+    // Pieces are cut at borders of holes in one pass, both are sorted
+    QList<Piece> aPieces;
+    int aHole=0;
+
+    for (int i=0; i<mPieces.size(); ++i)
+    {
+        Piece  aPiece=mPieces.at(i);
+        qint64 aStart=mStarts.at(i);
+
+        if (aPiece.sourcePos<0 || aPiece.zeros)
+        {
+            aPieces.append(aPiece);
+            continue;
+        }
+
+        while (aPiece.length>0)
+        {
+            while (aHole<aHoles.size() && aHoles.at(aHole).pos+aHoles.at(aHole).length<=aStart)
+            {
+                ++aHole;
+            }
+
+            Piece aPart=aPiece;
+
+            if (aHole<aHoles.size() && aHoles.at(aHole).pos<=aStart)
+            {
+                aPart.length=qMin(aPiece.length, aHoles.at(aHole).pos+aHoles.at(aHole).length-aStart);
+                aPart.zeros=true;
+            }
+            else
+            if (aHole<aHoles.size())
+            {
+                aPart.length=qMin(aPiece.length, aHoles.at(aHole).pos-aStart);
+            }
+
+            aPieces.append(aPart);
+
+            aPiece.sourcePos+=aPart.length;
+            aPiece.length-=aPart.length;
+            aStart+=aPart.length;
+        }
+    }
+
+    mPieces=aPieces;
+    updateStarts();
+}
+
+void SourceDocument::insertData(qint64 aPos, const char *aData, qint64 aLength)
+{
+    int aIndex=split(aPos);
+
+    // Typing extends the previous piece instead of adding one per byte
+    if (
+        aIndex>0
+        &&
+        mPieces.at(aIndex-1).sourcePos<0
+        &&
+        mStarts.at(aIndex-1)+mPieces.at(aIndex-1).length==aPos
+       )
+    {
+        Piece &aPrevious=mPieces[aIndex-1];
+
+        aPrevious.data.append(aData, aLength);
+        aPrevious.length+=aLength;
+    }
+    else
+    {
+        Piece aPiece;
+        aPiece.sourcePos=-1;
+        aPiece.length=aLength;
+        aPiece.data=QByteArray(aData, aLength);
+        aPiece.zeros=false;
+
+        mPieces.insert(aIndex, aPiece);
+    }
+
+    mSize+=aLength;
+    updateStarts();
+}
+
+void SourceDocument::removeData(qint64 aPos, qint64 aLength)
+{
+    int aFirst=split(aPos);
+    int aLast=split(aPos+aLength);
+
+    for (int i=aLast-1; i>=aFirst; --i)
+    {
+        mPieces.removeAt(i);
+    }
+
+    mSize-=aLength;
+    updateStarts();
+}
+
+void SourceDocument::overwriteData(qint64 aPos, const char *aData, qint64 aLength)
+{
+    removeData(aPos, aLength);
+    insertData(aPos, aData, aLength);
+}
+
+void SourceDocument::replaceData(const QList<HexReplacement> &aReplacements)
+{
+    QList<Piece> aPieces;
+    qint64 aOldSize=mSize;
+    qint64 aPos=0;
+
+    for (int i=0; i<aReplacements.size(); ++i)
+    {
+        const HexReplacement &aReplacement=aReplacements.at(i);
+
+        appendPieces(aPieces, aPos, aReplacement.pos);
+
+        if (!aReplacement.inserted.isEmpty())
+        {
+            Piece aPiece;
+            aPiece.sourcePos=-1;
+            aPiece.length=aReplacement.inserted.size();
+            aPiece.data=aReplacement.inserted;
+            aPiece.zeros=false;
+
+            aPieces.append(aPiece);
+        }
+
+        aPos=aReplacement.pos+aReplacement.removedLength;
+        mSize+=aReplacement.inserted.size()-aReplacement.removedLength;
+    }
+
+    appendPieces(aPieces, aPos, aOldSize);
+
+    mPieces=aPieces;
+    updateStarts();
+}
+
+void SourceDocument::appendPieces(QList<Piece> &aPieces, qint64 aStart, qint64 aEnd) const
+{
+    for (int i=aStart<aEnd ? findPiece(aStart) : mPieces.size(); i<mPieces.size() && mStarts.at(i)<aEnd; ++i)
+    {
+        Piece aPart=mPieces.at(i);
+        qint64 aOffset=qMax((qint64)0, aStart-mStarts.at(i));
+
+        aPart.length=qMin(aPart.length, aEnd-mStarts.at(i))-aOffset;
+
+        if (aPart.sourcePos<0)
+        {
+            aPart.data=aPart.data.mid(aOffset, aPart.length);
+        }
+        else
+        {
+            aPart.sourcePos+=aOffset;
+        }
+
+        aPieces.append(aPart);
+    }
+}
+
+int SourceDocument::findPiece(qint64 aPos) const
+{
+    // Last piece that starts at or before aPos
+    int aLow=0;
+    int aHigh=mStarts.size();
+
+    while (aLow<aHigh)
+    {
+        int aMiddle=(aLow+aHigh)/2;
+
+        if (mStarts.at(aMiddle)<=aPos)
+        {
+            aLow=aMiddle+1;
+        }
+        else
+        {
+            aHigh=aMiddle;
+        }
+    }
+
+    return aLow-1;
+}
+
+int SourceDocument::split(qint64 aPos)
+{
+    if (aPos>=mSize)
+    {
+        return mPieces.size();
+    }
+
+    int aIndex=findPiece(aPos);
+    qint64 aOffset=aPos-mStarts.at(aIndex);
+
+    if (aOffset==0)
+    {
+        return aIndex;
+    }
+
+    Piece aTail=mPieces.at(aIndex);
+    Piece &aHead=mPieces[aIndex];
+
+    aTail.length-=aOffset;
+
+    if (aTail.sourcePos<0)
+    {
+        aTail.data=aHead.data.mid(aOffset);
+        aHead.data.truncate(aOffset);
+    }
+    else
+    {
+        aTail.sourcePos+=aOffset;
+    }
+
+    aHead.length=aOffset;
+    mPieces.insert(aIndex+1, aTail);
+    updateStarts();
+
+    return aIndex+1;
+}
+
+void SourceDocument::resetPieces()
+{
+    mPieces.clear();
+
+    if (mLength>0)
+    {
+        Piece aPiece;
+        aPiece.sourcePos=mBase;
+        aPiece.length=mLength;
+        aPiece.zeros=false;
+
+        mPieces.append(aPiece);
+    }
+
+    updateStarts();
+    dropPages();
+}
+
+void SourceDocument::updateStarts()
+{
+    mStarts.resize(mPieces.size());
+
+    qint64 aPos=0;
+
+    for (int i=0; i<mPieces.size(); ++i)
+    {
+        mStarts[i]=aPos;
+        aPos+=mPieces.at(i).length;
+    }
+}
+
+void SourceDocument::dropPages()
+{
+    QMutexLocker aLocker(&mPagesMutex);
+
+    mPages.clear();
+    ++mPagesGeneration;
+    mLastPage.clear();
+}
+
+QByteArray SourceDocument::page(qint64 aIndex) const
+{
+    {
+        QMutexLocker aLocker(&mPagesMutex);
+        QByteArray *aPage=mPages.object(aIndex);
+
+        if (aPage)
+        {
+            HEX_PROFILE_COUNT("document.page.hit", 1);
+            return *aPage;
+        }
+    }
+
+    HEX_PROFILE_COUNT("document.page.miss", 1);
+
+    return loadPage(aIndex);
+}
+
+QByteArray SourceDocument::loadPage(qint64 aIndex) const
+{
+    quint64 aGeneration;
+
+    {
+        QMutexLocker aLocker(&mPagesMutex);
+        aGeneration=mPagesGeneration;
+    }
+
+    // Cache isn't locked while the source is read, so cached pages are shown meanwhile
+    QByteArray aPage;
+    QString    aError;
+
+    {
+        QMutexLocker aLocker(&mSourceMutex);
+
+        int    aPageSize=mSource->pageSize();
+        qint64 aPageStart=aIndex*aPageSize;
+
+        aPage=QByteArray((int)qBound((qint64)0, mSource->size()-aPageStart, (qint64)aPageSize), 0);
+
+        // Page stays zeros if it can't be read
+        if (!mSource->read(aPageStart, aPage.data(), aPage.size()))
+        {
+            aError=mSource->errorString();
+        }
+    }
+
+    QMutexLocker aLocker(&mPagesMutex);
+
+    if (!aError.isEmpty())
+    {
+        mError=aError;
+    }
+
+    // Page read before the source changed would be stale
+    if (aGeneration==mPagesGeneration)
+    {
+        mPages.insert(aIndex, new QByteArray(aPage));
+    }
+
+    return aPage;
+}
+
+QVector<qint64> SourceDocument::missingPages(qint64 aPos, qint64 aLength) const
+{
+    QVector<qint64> aPages;
+    qint64 aEnd=qMin(aPos+aLength, mSize);
+    int    aPageSize=mSource->pageSize();
+
+    QMutexLocker aLocker(&mPagesMutex);
+
+    for (qint64 aStart=qMax(aPos, (qint64)0); aStart<aEnd; )
+    {
+        int aIndex=findPiece(aStart);
+        const Piece &aPiece=mPieces.at(aIndex);
+        qint64 aPieceEnd=qMin(mStarts.at(aIndex)+aPiece.length, aEnd);
+
+        // Bytes in memory and holes are never read
+        if (aPiece.sourcePos>=0 && !aPiece.zeros)
+        {
+            qint64 aSourceStart=aPiece.sourcePos+aStart-mStarts.at(aIndex);
+            qint64 aSourceEnd=aSourceStart+aPieceEnd-aStart;
+
+            for (qint64 i=aSourceStart/aPageSize; i*aPageSize<aSourceEnd; ++i)
+            {
+                if (!mPages.contains(i) && !aPages.contains(i))
+                {
+                    aPages.append(i);
+                }
+            }
+        }
+
+        aStart=aPieceEnd;
+    }
+
+    return aPages;
+}
+
+// *********************************************************************************
+//                                   PageLoader
+// *********************************************************************************
+
+PageLoader::PageLoader(const SourceDocument *aDocument) :
+    QThread()
+{
+    mDocument=aDocument;
+    mStopped=false;
+}
+
+PageLoader::~PageLoader()
+{
+    stop();
+    wait();
+}
+
+void PageLoader::load(const QVector<qint64> &aPages)
+{
+    QMutexLocker aLocker(&mMutex);
+
+    mQueue=aPages;
+    mQueued.wakeOne();
+}
+
+void PageLoader::stop()
+{
+    QMutexLocker aLocker(&mMutex);
+
+    mStopped=true;
+    mQueued.wakeOne();
+}
+
+void PageLoader::run()
+{
+    bool aStopped=false;
+
+    while (!aStopped)
+    {
+        qint64 aPage=-1;
+
+        {
+            QMutexLocker aLocker(&mMutex);
+
+            while (mQueue.isEmpty() && !mStopped)
+            {
+                mQueued.wait(&mMutex);
+            }
+
+            aStopped=mStopped;
+
+            if (!aStopped)
+            {
+                aPage=mQueue.first();
+                mQueue.remove(0);
+            }
+        }
+
+        if (aPage>=0)
+        {
+            HEX_PROFILE_SCOPE("document.prefetch");
+            mDocument->loadPage(aPage);
+        }
+    }
+}
@@ -0,0 +1,223 @@
+#ifndef HEXDOCUMENT_H
+#define HEXDOCUMENT_H
+
+#include <QByteArray>
+#include <QCache>
+#include <QList>
+#include <QVector>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include "hexsearch.h"
+#include "hexdatasource.h"
+#include "hexannotations.h"
+#include "hexpatch.h"
+
+class SessionJournal;
+class PageLoader;
+
+/*
+ * Bytes being edited. Everything that reads or changes data goes through
+ * this interface, so data doesn't have to be one array in memory. Every
+ * change gives the document a new version, versions are never repeated
+ * between documents. Annotations of the document follow its changes, the
+ * journal of the document gets every change.
+ */
+class HexDocument
+{
+public:
+    HexDocument();
+    virtual ~HexDocument();
+
+    virtual qint64 size() const=0;
+
+    // Contiguous bytes at aPos, valid until the next call or change. aLength gets their count
+    virtual const char* chunk(qint64 aPos, qint64 &aLength) const=0;
+
+    virtual const char* constData() const;                  // Whole data if it is one array in memory, else 0
+    virtual char* writableData(qint64 aPos, qint64 aLength); // Same for in place changes, touch(aPos, aLength) must follow them
+    virtual QByteArray mid(qint64 aPos, qint64 aLength=-1) const; // At most maxArraySize() bytes
+    virtual void reserve(qint64 aSize);
+    virtual HexDocument* snapshot() const; // Own copy of the bytes to read in another thread while this one changes, 0 if it can't be made
+
+    // Bytes kept only to make reading faster, they can be dropped any time
+    virtual qint64 cacheSize() const;
+    virtual void trimCache(qint64 aSize); // Least recently used bytes go first
+
+    // Reading ahead, so that bytes are in memory before they are needed
+    virtual bool isCached(qint64 aPos, qint64 aLength) const; // Reading the range doesn't wait for a source
+    virtual void prefetch(qint64 aPos, qint64 aLength);       // Range is read in the background
+
+    qint64 read(qint64 aPos, char *aBuffer, qint64 aLength) const; // Bytes read, stops at an empty chunk and zeroes the rest
+
+    static qint64 maxArraySize(); // Largest QByteArray, data in memory can't be larger
+    char at(qint64 aPos) const;
+
+    void insert(qint64 aPos, const QByteArray &aData);
+    void remove(qint64 aPos, qint64 aLength);
+    void replace(qint64 aPos, qint64 aLength, const QByteArray &aData);
+    void replace(const QList<HexReplacement> &aReplacements); // Sorted ranges that don't overlap, at positions before any of them is replaced
+    void append(const QByteArray &aData);
+    void touch();
+    void touch(qint64 aPos, qint64 aLength); // After in place changes of the range
+
+    qint64 indexOf(const HexPattern &aPattern, qint64 aFrom=0, qint64 aTo=-1) const;
+    qint64 lastIndexOf(const HexPattern &aPattern, qint64 aFrom=-1, qint64 aTo=0) const;
+
+    quint64 version() const;
+
+    HexAnnotations& annotations();
+    const HexAnnotations& annotations() const;
+
+    SessionJournal* journal() const;
+    void setJournal(SessionJournal *aJournal); // Not owned, 0 stops journaling
+
+protected:
+    // Positions are checked before these are called
+    virtual void insertData(qint64 aPos, const char *aData, qint64 aLength)=0;
+    virtual void removeData(qint64 aPos, qint64 aLength)=0;
+    virtual void overwriteData(qint64 aPos, const char *aData, qint64 aLength)=0;
+    virtual void replaceData(const QList<HexReplacement> &aReplacements); // One by one, unless data can be rebuilt at once
+
+private:
+    quint64         mVersion;
+    HexAnnotations  mAnnotations;
+    SessionJournal *mJournal;
+
+    static quint64 sLastVersion;
+
+    Q_DISABLE_COPY(HexDocument)
+};
+
+// *********************************************************************************
+
+class ByteArrayDocument : public HexDocument
+{
+public:
+    explicit ByteArrayDocument(const QByteArray &aData=QByteArray());
+
+    qint64 size() const;
+    const char* chunk(qint64 aPos, qint64 &aLength) const;
+    const char* constData() const;
+    char* writableData(qint64 aPos, qint64 aLength);
+    QByteArray mid(qint64 aPos, qint64 aLength=-1) const;
+    void reserve(qint64 aSize);
+    HexDocument* snapshot() const;
+
+    QByteArray byteArray() const;
+
+protected:
+    void insertData(qint64 aPos, const char *aData, qint64 aLength);
+    void removeData(qint64 aPos, qint64 aLength);
+    void overwriteData(qint64 aPos, const char *aData, qint64 aLength);
+
+private:
+    QByteArray mData;
+};
+
+// *********************************************************************************
+
+/*
+ * Piece table over a range of HexDataSource. Unchanged bytes are read
+ * from the source page by page when they are needed and kept in a small
+ * page cache, changes live in memory until writeBack(). Holes given by
+ * setHoles() are zeros that take neither memory nor reads. Pages asked
+ * for by prefetch() are read by a PageLoader thread, so the source and
+ * the cache are used under locks, and the source is opened and closed
+ * only through the document.
+ */
+class SourceDocument : public HexDocument
+{
+public:
+    SourceDocument(HexDataSource *aSource, qint64 aBase=0, qint64 aLength=-1); // Takes ownership of opened aSource
+    ~SourceDocument();
+
+    qint64 size() const;
+    const char* chunk(qint64 aPos, qint64 &aLength) const;
+    qint64 cacheSize() const;
+    void trimCache(qint64 aSize);
+    bool isCached(qint64 aPos, qint64 aLength) const;
+    void prefetch(qint64 aPos, qint64 aLength);
+    HexDocument* snapshot() const; // Pieces are copied, the source is opened once more
+
+    HexDataSource* source() const;
+    bool reopenSource(bool aWritable, QString *aError=0);
+    void closeSource();
+    qint64 base() const;
+    QString errorString() const; // Last read or write error
+
+    bool writeBack(QString *aError=0); // Writes only changed ranges, size must be the same
+    void sourceReplaced();             // Source has the bytes of the document now, like a file replaced by the saved one
+
+    void setHoles(const QVector<HexRange> &aHoles); // Ranges that are zeros in the source, they are never read
+
+protected:
+    void insertData(qint64 aPos, const char *aData, qint64 aLength);
+    void removeData(qint64 aPos, qint64 aLength);
+    void overwriteData(qint64 aPos, const char *aData, qint64 aLength);
+    void replaceData(const QList<HexReplacement> &aReplacements); // Pieces are rebuilt in one pass
+
+private:
+    struct Piece
+    {
+        qint64     sourcePos; // -1 for bytes in data
+        qint64     length;
+        QByteArray data;
+        bool       zeros;     // Hole of the source, read as zeros without touching the source
+    };
+
+    HexDataSource                     *mSource;
+    qint64                             mBase;
+    qint64                             mLength;
+    qint64                             mSize;
+    QList<Piece>                       mPieces;
+    QVector<qint64>                    mStarts;      // Start of every piece
+    mutable QMutex                     mSourceMutex; // Reads and writes of mSource
+    mutable QMutex                     mPagesMutex;  // mPages, mPagesGeneration and mError
+    mutable QCache<qint64, QByteArray> mPages;
+    mutable quint64                    mPagesGeneration; // Changes when pages are dropped, so older reads aren't cached
+    mutable QByteArray                 mLastPage;    // Keeps the page returned by chunk()
+    mutable QString                    mError;
+    PageLoader                        *mPageLoader;  // Started by the first prefetch()
+
+    int findPiece(qint64 aPos) const;
+    int split(qint64 aPos);
+    void appendPieces(QList<Piece> &aPieces, qint64 aStart, qint64 aEnd) const; // Parts of pieces in [aStart, aEnd)
+    void resetPieces(); // One piece over the whole range of the source
+    void updateStarts();
+    void dropPages();
+    QByteArray page(qint64 aIndex) const;
+    QByteArray loadPage(qint64 aIndex) const; // Any thread
+    QVector<qint64> missingPages(qint64 aPos, qint64 aLength) const;
+
+    friend class PageLoader;
+};
+
+// *********************************************************************************
+
+/*
+ * Reads pages of a SourceDocument in its own thread. New requests replace
+ * the ones that weren't served yet, since they come for the part of data
+ * that is about to be shown.
+ */
+class PageLoader : public QThread
+{
+public:
+    explicit PageLoader(const SourceDocument *aDocument);
+    ~PageLoader();
+
+    void load(const QVector<qint64> &aPages);
+    void stop();
+
+protected:
+    const SourceDocument *mDocument;
+    QMutex                mMutex;
+    QWaitCondition        mQueued;
+    QVector<qint64>       mQueue;
+    bool                  mStopped;
+
+    void run();
+};
+
+#endif // HEXDOCUMENT_H
@@ -0,0 +1,416 @@
+#include "hexencoding.h"
+
+#include <QHash>
+
+#define NOT_PRINTABLE_GLYPH 9734
+
+// Chars 0x80-0xFF, 0x00-0x7F are ASCII
+static const ushort cp437[128]={
+    0x00C7, 0x00FC, 0x00E9, 0x00E2, 0x00E4, 0x00E0, 0x00E5, 0x00E7, 0x00EA, 0x00EB, 0x00E8, 0x00EF, 0x00EE, 0x00EC, 0x00C4, 0x00C5,
+    0x00C9, 0x00E6, 0x00C6, 0x00F4, 0x00F6, 0x00F2, 0x00FB, 0x00F9, 0x00FF, 0x00D6, 0x00DC, 0x00A2, 0x00A3, 0x00A5, 0x20A7, 0x0192,
+    0x00E1, 0x00ED, 0x00F3, 0x00FA, 0x00F1, 0x00D1, 0x00AA, 0x00BA, 0x00BF, 0x2310, 0x00AC, 0x00BD, 0x00BC, 0x00A1, 0x00AB, 0x00BB,
+    0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556, 0x2555, 0x2563, 0x2551, 0x2557, 0x255D, 0x255C, 0x255B, 0x2510,
+    0x2514, 0x2534, 0x252C, 0x251C, 0x2500, 0x253C, 0x255E, 0x255F, 0x255A, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256C, 0x2567,
+    0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256B, 0x256A, 0x2518, 0x250C, 0x2588, 0x2584, 0x258C, 0x2590, 0x2580,
+    0x03B1, 0x00DF, 0x0393, 0x03C0, 0x03A3, 0x03C3, 0x00B5, 0x03C4, 0x03A6, 0x0398, 0x03A9, 0x03B4, 0x221E, 0x03C6, 0x03B5, 0x2229,
+    0x2261, 0x00B1, 0x2265, 0x2264, 0x2320, 0x2321, 0x00F7, 0x2248, 0x00B0, 0x2219, 0x00B7, 0x221A, 0x207F, 0x00B2, 0x25A0, 0x00A0
+};
+
+// Pictures that DOS shows for control chars 0x01-0x1F
+static const ushort cp437Controls[32]={
+    0x0000, 0x263A, 0x263B, 0x2665, 0x2666, 0x2663, 0x2660, 0x2022, 0x25D8, 0x25CB, 0x25D9, 0x2642, 0x2640, 0x266A, 0x266B, 0x263C,
+    0x25BA, 0x25C4, 0x2195, 0x203C, 0x00B6, 0x00A7, 0x25AC, 0x21A8, 0x2191, 0x2193, 0x2192, 0x2190, 0x221F, 0x2194, 0x25B2, 0x25BC
+};
+
+// Chars 0x80-0xFF, 0x98 is not defined and kept as C1 control
+static const ushort windows1251[128]={
+    0x0402, 0x0403, 0x201A, 0x0453, 0x201E, 0x2026, 0x2020, 0x2021, 0x20AC, 0x2030, 0x0409, 0x2039, 0x040A, 0x040C, 0x040B, 0x040F,
+    0x0452, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014, 0x0098, 0x2122, 0x0459, 0x203A, 0x045A, 0x045C, 0x045B, 0x045F,
+    0x00A0, 0x040E, 0x045E, 0x0408, 0x00A4, 0x0490, 0x00A6, 0x00A7, 0x0401, 0x00A9, 0x0404, 0x00AB, 0x00AC, 0x00AD, 0x00AE, 0x0407,
+    0x00B0, 0x00B1, 0x0406, 0x0456, 0x0491, 0x00B5, 0x00B6, 0x00B7, 0x0451, 0x2116, 0x0454, 0x00BB, 0x0458, 0x0405, 0x0455, 0x0457,
+    0x0410, 0x0411, 0x0412, 0x0413, 0x0414, 0x0415, 0x0416, 0x0417, 0x0418, 0x0419, 0x041A, 0x041B, 0x041C, 0x041D, 0x041E, 0x041F,
+    0x0420, 0x0421, 0x0422, 0x0423, 0x0424, 0x0425, 0x0426, 0x0427, 0x0428, 0x0429, 0x042A, 0x042B, 0x042C, 0x042D, 0x042E, 0x042F,
+    0x0430, 0x0431, 0x0432, 0x0433, 0x0434, 0x0435, 0x0436, 0x0437, 0x0438, 0x0439, 0x043A, 0x043B, 0x043C, 0x043D, 0x043E, 0x043F,
+    0x0440, 0x0441, 0x0442, 0x0443, 0x0444, 0x0445, 0x0446, 0x0447, 0x0448, 0x0449, 0x044A, 0x044B, 0x044C, 0x044D, 0x044E, 0x044F
+};
+
+static const ushort ebcdic037[256]={
+    0x0000, 0x0001, 0x0002, 0x0003, 0x009C, 0x0009, 0x0086, 0x007F, 0x0097, 0x008D, 0x008E, 0x000B, 0x000C, 0x000D, 0x000E, 0x000F,
+    0x0010, 0x0011, 0x0012, 0x0013, 0x009D, 0x0085, 0x0008, 0x0087, 0x0018, 0x0019, 0x0092, 0x008F, 0x001C, 0x001D, 0x001E, 0x001F,
+    0x0080, 0x0081, 0x0082, 0x0083, 0x0084, 0x000A, 0x0017, 0x001B, 0x0088, 0x0089, 0x008A, 0x008B, 0x008C, 0x0005, 0x0006, 0x0007,
+    0x0090, 0x0091, 0x0016, 0x0093, 0x0094, 0x0095, 0x0096, 0x0004, 0x0098, 0x0099, 0x009A, 0x009B, 0x0014, 0x0015, 0x009E, 0x001A,
+    0x0020, 0x00A0, 0x00E2, 0x00E4, 0x00E0, 0x00E1, 0x00E3, 0x00E5, 0x00E7, 0x00F1, 0x00A2, 0x002E, 0x003C, 0x0028, 0x002B, 0x007C,
+    0x0026, 0x00E9, 0x00EA, 0x00EB, 0x00E8, 0x00ED, 0x00EE, 0x00EF, 0x00EC, 0x00DF, 0x0021, 0x0024, 0x002A, 0x0029, 0x003B, 0x00AC,
+    0x002D, 0x002F, 0x00C2, 0x00C4, 0x00C0, 0x00C1, 0x00C3, 0x00C5, 0x00C7, 0x00D1, 0x00A6, 0x002C, 0x0025, 0x005F, 0x003E, 0x003F,
+    0x00F8, 0x00C9, 0x00CA, 0x00CB, 0x00C8, 0x00CD, 0x00CE, 0x00CF, 0x00CC, 0x0060, 0x003A, 0x0023, 0x0040, 0x0027, 0x003D, 0x0022,
+    0x00D8, 0x0061, 0x0062, 0x0063, 0x0064, 0x0065, 0x0066, 0x0067, 0x0068, 0x0069, 0x00AB, 0x00BB, 0x00F0, 0x00FD, 0x00FE, 0x00B1,
+    0x00B0, 0x006A, 0x006B, 0x006C, 0x006D, 0x006E, 0x006F, 0x0070, 0x0071, 0x0072, 0x00AA, 0x00BA, 0x00E6, 0x00B8, 0x00C6, 0x00A4,
+    0x00B5, 0x007E, 0x0073, 0x0074, 0x0075, 0x0076, 0x0077, 0x0078, 0x0079, 0x007A, 0x00A1, 0x00BF, 0x00D0, 0x00DD, 0x00DE, 0x00AE,
+    0x005E, 0x00A3, 0x00A5, 0x00B7, 0x00A9, 0x00A7, 0x00B6, 0x00BC, 0x00BD, 0x00BE, 0x005B, 0x005D, 0x00AF, 0x00A8, 0x00B4, 0x00D7,
+    0x007B, 0x0041, 0x0042, 0x0043, 0x0044, 0x0045, 0x0046, 0x0047, 0x0048, 0x0049, 0x00AD, 0x00F4, 0x00F6, 0x00F2, 0x00F3, 0x00F5,
+    0x007D, 0x004A, 0x004B, 0x004C, 0x004D, 0x004E, 0x004F, 0x0050, 0x0051, 0x0052, 0x00B9, 0x00FB, 0x00FC, 0x00F9, 0x00FA, 0x00FF,
+    0x005C, 0x00F7, 0x0053, 0x0054, 0x0055, 0x0056, 0x0057, 0x0058, 0x0059, 0x005A, 0x00B2, 0x00D4, 0x00D6, 0x00D2, 0x00D3, 0x00D5,
+    0x0030, 0x0031, 0x0032, 0x0033, 0x0034, 0x0035, 0x0036, 0x0037, 0x0038, 0x0039, 0x00B3, 0x00DB, 0x00DC, 0x00D9, 0x00DA, 0x009F
+};
+
+// Unicode char of the byte in single byte encoding
+static ushort charCode(HexEncoding::Type aType, uchar aByte)
+{
+    switch (aType)
+    {
+        case HexEncoding::CP437:       return aByte>=0x80 ? cp437[aByte-0x80] : aByte;
+        case HexEncoding::EBCDIC:      return ebcdic037[aByte];
+        case HexEncoding::WINDOWS1251: return aByte>=0x80 ? windows1251[aByte-0x80] : aByte;
+        default:                       break;
+    }
+
+    return aByte;
+}
+
+// Text pane shows whitespaces and control chars with special glyphs
+static QString displayGlyph(uint aCode)
+{
+    switch (aCode)
+    {
+        case 9:  return QString(QChar(26));
+        case 10: return QString(QChar(8629));
+        case 13: return QString(QChar(8601));
+        case 32: return QString(QChar(183));
+        default: break;
+    }
+
+    if (aCode>=128 && aCode<=160)
+    {
+        return QString(QChar(NOT_PRINTABLE_GLYPH));
+    }
+
+    if (aCode>=0x10000)
+    {
+        QString aGlyph;
+        aGlyph.append(QChar(QChar::highSurrogate(aCode)));
+        aGlyph.append(QChar(QChar::lowSurrogate(aCode)));
+
+        return aGlyph;
+    }
+
+    return QString(QChar((ushort)aCode));
+}
+
+// Length in bytes of a valid UTF-8 char at aPos or 0. aCode gets the char
+static int utf8Char(const uchar *aData, int aSize, int aPos, uint &aCode)
+{
+    aCode=aData[aPos];
+
+    if (aCode<0x80)
+    {
+        return 1;
+    }
+
+    int  aLength;
+    uint aMin;
+
+    if (aCode>=0xC2 && aCode<=0xDF)
+    {
+        aLength=2;
+        aMin=0x80;
+        aCode&=0x1F;
+    }
+    else
+    if (aCode>=0xE0 && aCode<=0xEF)
+    {
+        aLength=3;
+        aMin=0x800;
+        aCode&=0x0F;
+    }
+    else
+    if (aCode>=0xF0 && aCode<=0xF4)
+    {
+        aLength=4;
+        aMin=0x10000;
+        aCode&=0x07;
+    }
+    else
+    {
+        return 0;
+    }
+
+    if (aPos+aLength>aSize)
+    {
+        return 0;
+    }
+
+    for (int i=1; i<aLength; ++i)
+    {
+        if ((aData[aPos+i] & 0xC0)!=0x80)
+        {
+            return 0;
+        }
+
+        aCode=(aCode << 6) | (aData[aPos+i] & 0x3F);
+    }
+
+    if (
+        aCode<aMin
+        ||
+        aCode>0x10FFFF
+        ||
+        (aCode>=0xD800 && aCode<=0xDFFF)
+       )
+    {
+        return 0;
+    }
+
+    return aLength;
+}
+
+static ushort utf16Unit(HexEncoding::Type aType, const uchar *aData, int aPos)
+{
+    return aType==HexEncoding::UTF16LE ? aData[aPos] | (aData[aPos+1] << 8) : (aData[aPos] << 8) | aData[aPos+1];
+}
+
+QString HexEncoding::name(Type aType)
+{
+    switch (aType)
+    {
+        case LATIN1:      return "Latin-1";
+        case CP437:       return "DOS (CP437)";
+        case EBCDIC:      return "EBCDIC (CP037)";
+        case WINDOWS1251: return "Windows-1251";
+        case UTF8:        return "UTF-8";
+        case UTF16LE:     return "UTF-16LE";
+        case UTF16BE:     return "UTF-16BE";
+        default:          break;
+    }
+
+    return QString();
+}
+
+bool HexEncoding::isMultiByte(Type aType)
+{
+    return aType==UTF8 || aType==UTF16LE || aType==UTF16BE;
+}
+
+int HexEncoding::contextSize(Type aType)
+{
+    // Longest UTF-8 char is 4 bytes, surrogate pair of UTF-16 is 4 bytes too
+    return isMultiByte(aType) ? 3 : 0;
+}
+
+const QVector<QString>& HexEncoding::glyphs(Type aType)
+{
+    static QVector<QString> tables[TYPES_COUNT];
+
+    QVector<QString> &aTable=tables[aType];
+
+    if (aTable.isEmpty())
+    {
+        aTable.resize(256);
+
+        for (int i=0; i<256; ++i)
+        {
+            aTable[i]=displayGlyph(charCode(aType, i));
+        }
+
+        if (aType==CP437)
+        {
+            for (int i=1; i<32; ++i)
+            {
+                aTable[i]=QString(QChar(cp437Controls[i]));
+            }
+
+            aTable[0x7F]=QString(QChar(0x2302));
+        }
+    }
+
+    return aTable;
+}
+
+void HexEncoding::decode(Type aType, const uchar *aData, int aSize, int aOffset, int aCount, qint64 aPos, QString *aGlyphs)
+{
+    if (!isMultiByte(aType))
+    {
+        const QVector<QString> &aTable=glyphs(aType);
+
+        for (int i=0; i<aCount; ++i)
+        {
+            aGlyphs[i]=aTable.at(aData[aOffset+i]);
+        }
+
+        return;
+    }
+
+    for (int i=0; i<aCount; ++i)
+    {
+        int  aIndex=aOffset+i;
+        uint aCode;
+
+        aGlyphs[i]=QString();
+
+        if (aType==UTF8)
+        {
+            if (utf8Char(aData, aSize, aIndex, aCode)>0)
+            {
+                aGlyphs[i]=displayGlyph(aCode);
+                continue;
+            }
+
+            // Continuation byte is a part of the nearest char before it, if that char is long enough
+            bool aInsideChar=false;
+
+            if ((aData[aIndex] & 0xC0)==0x80)
+            {
+                for (int j=1; j<=3 && aIndex-j>=0; ++j)
+                {
+                    if ((aData[aIndex-j] & 0xC0)!=0x80)
+                    {
+                        aInsideChar=utf8Char(aData, aSize, aIndex-j, aCode)>j;
+                        break;
+                    }
+                }
+            }
+
+            if (!aInsideChar)
+            {
+                aGlyphs[i]=QString(QChar(NOT_PRINTABLE_GLYPH));
+            }
+        }
+        else
+        {
+            if ((aPos+i) & 1)
+            {
+                continue; // Second byte of a unit
+            }
+
+            if (aIndex+1>=aSize)
+            {
+                aGlyphs[i]=QString(QChar(NOT_PRINTABLE_GLYPH));
+                continue;
+            }
+
+            aCode=utf16Unit(aType, aData, aIndex);
+
+            if (QChar::isHighSurrogate(aCode))
+            {
+                if (aIndex+3<aSize && QChar::isLowSurrogate(utf16Unit(aType, aData, aIndex+2)))
+                {
+                    aGlyphs[i]=displayGlyph(QChar::surrogateToUcs4((ushort)aCode, utf16Unit(aType, aData, aIndex+2)));
+                }
+                else
+                {
+                    aGlyphs[i]=QString(QChar(NOT_PRINTABLE_GLYPH));
+                }
+            }
+            else
+            if (QChar::isLowSurrogate(aCode))
+            {
+                if (aIndex<2 || !QChar::isHighSurrogate(utf16Unit(aType, aData, aIndex-2)))
+                {
+                    aGlyphs[i]=QString(QChar(NOT_PRINTABLE_GLYPH));
+                }
+            }
+            else
+            {
+                aGlyphs[i]=displayGlyph(aCode);
+            }
+        }
+    }
+}
+
+QString HexEncoding::toUnicode(Type aType, const QByteArray &aData)
+{
+    switch (aType)
+    {
+        case UTF8:
+        {
+            return QString::fromUtf8(aData.constData(), aData.size());
+        }
+        case UTF16LE:
+        case UTF16BE:
+        {
+            QString aText;
+            aText.reserve(aData.size()/2);
+
+            for (int i=0; i+1<aData.size(); i+=2)
+            {
+                aText.append(QChar(utf16Unit(aType, (const uchar *)aData.constData(), i)));
+            }
+
+            return aText;
+        }
+        default: break;
+    }
+
+    QString aText;
+    aText.resize(aData.size());
+
+    for (int i=0; i<aData.size(); ++i)
+    {
+        aText[i]=QChar(charCode(aType, aData.at(i)));
+    }
+
+    return aText;
+}
+
+QByteArray HexEncoding::fromUnicode(Type aType, const QString &aText)
+{
+    QByteArray aData;
+
+    switch (aType)
+    {
+        case UTF8:
+        {
+            return aText.toUtf8();
+        }
+        case UTF16LE:
+        case UTF16BE:
+        {
+            aData.reserve(aText.length()*2);
+
+            for (int i=0; i<aText.length(); ++i)
+            {
+                ushort aCode=aText.at(i).unicode();
+
+                if (aType==UTF16LE)
+                {
+                    aData.append((char)(aCode & 0xFF));
+                    aData.append((char)(aCode >> 8));
+                }
+                else
+                {
+                    aData.append((char)(aCode >> 8));
+                    aData.append((char)(aCode & 0xFF));
+                }
+            }
+
+            return aData;
+        }
+        default: break;
+    }
+
+    static QHash<ushort, uchar> reverseTables[TYPES_COUNT];
+
+    QHash<ushort, uchar> &aReverse=reverseTables[aType];
+
+    if (aReverse.isEmpty())
+    {
+        // Lowest byte wins for chars with several bytes
+        for (int i=255; i>=0; --i)
+        {
+            aReverse.insert(charCode(aType, i), i);
+        }
+    }
+
+    aData.reserve(aText.length());
+
+    for (int i=0; i<aText.length(); ++i)
+    {
+        QHash<ushort, uchar>::const_iterator it=aReverse.constFind(aText.at(i).unicode());
+
+        if (it!=aReverse.constEnd())
+        {
+            aData.append((char)it.value());
+        }
+    }
+
+    return aData;
+}
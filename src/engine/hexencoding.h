@@ -0,0 +1,45 @@
+#ifndef HEXENCODING_H
+#define HEXENCODING_H
+
+#include <QString>
+#include <QVector>
+#include <QByteArray>
+
+/*
+ * Encodings of the text pane. Single byte code pages are 256-entry glyph
+ * tables built once on first use. UTF-8 and UTF-16 are decoded only for
+ * the bytes being drawn, with a few bytes around them as context, so a
+ * char is shown at its first byte and other bytes of it stay empty.
+ */
+class HexEncoding
+{
+public:
+    enum Type
+    {
+        LATIN1,
+        CP437,
+        EBCDIC,      // Code page 037
+        WINDOWS1251,
+        UTF8,
+        UTF16LE,
+        UTF16BE,
+        TYPES_COUNT
+    };
+
+    static QString name(Type aType);
+    static bool isMultiByte(Type aType);
+    static int contextSize(Type aType); // Bytes needed before and after decoded bytes
+
+    // Glyphs of aCount bytes from aOffset of aData. Bytes outside of them are context,
+    // aPos is position of aData[aOffset] in the data, UTF-16 chars start at even positions
+    static void decode(Type aType, const uchar *aData, int aSize, int aOffset, int aCount, qint64 aPos, QString *aGlyphs);
+
+    // For clipboard and typing. Chars that can't be encoded are dropped
+    static QString toUnicode(Type aType, const QByteArray &aData);
+    static QByteArray fromUnicode(Type aType, const QString &aText);
+
+protected:
+    static const QVector<QString>& glyphs(Type aType);
+};
+
+#endif // HEXENCODING_H
@@ -0,0 +1,318 @@
+#include "hexexporter.h"
+
+#include <QMutexLocker>
+
+#include "hexprofiler.h"
+
+#define ARRAY_LINE_BYTES   16
+#define BASE64_LINE_BYTES  57   // 76 chars
+
+static const char hexDigits[]="0123456789ABCDEF";
+
+static void setError(QString *aError, const QString &aText)
+{
+    if (aError)
+    {
+        *aError=aText;
+    }
+}
+
+static void appendHex(QByteArray &aOutput, quint8 aByte)
+{
+    aOutput.append(hexDigits[aByte>>4]);
+    aOutput.append(hexDigits[aByte & 15]);
+}
+
+HexExporter::HexExporter(const QString &aFileName, Format aFormat, qint64 aTotal, QObject *parent) :
+    QThread(parent),
+    mFile(aFileName),
+    mRecordWriter(aFormat==FORMAT_SREC ? HexRecordWriter::SREC : HexRecordWriter::INTEL_HEX)
+{
+    mFormat=aFormat;
+    mTotal=aTotal;
+    mQueuedSize=0;
+    mFinished=false;
+    mStopped=false;
+
+    mColumn=0;
+}
+
+HexExporter::~HexExporter()
+{
+    stop();
+    wait();
+}
+
+QString HexExporter::formatName(Format aFormat)
+{
+    switch (aFormat)
+    {
+        case FORMAT_RAW:       return "Raw binary";
+        case FORMAT_C_ARRAY:   return "C array";
+        case FORMAT_PYTHON:    return "Python bytes";
+        case FORMAT_BASE64:    return "Base64";
+        case FORMAT_INTEL_HEX: return "Intel HEX";
+        case FORMAT_SREC:      return "Motorola S-record";
+        default:               break;
+    }
+
+    return QString();
+}
+
+QString HexExporter::formatFilter(Format aFormat)
+{
+    switch (aFormat)
+    {
+        case FORMAT_RAW:       return formatName(aFormat)+" (*.bin)";
+        case FORMAT_C_ARRAY:   return formatName(aFormat)+" (*.c *.h)";
+        case FORMAT_PYTHON:    return formatName(aFormat)+" (*.py)";
+        case FORMAT_BASE64:    return formatName(aFormat)+" (*.b64 *.txt)";
+        case FORMAT_INTEL_HEX: return formatName(aFormat)+" (*.hex *.ihex)";
+        case FORMAT_SREC:      return formatName(aFormat)+" (*.srec *.s19 *.s28 *.s37)";
+        default:               break;
+    }
+
+    return QString();
+}
+
+bool HexExporter::open(QString *aError)
+{
+    if (!mFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        setError(aError, "Can't create file "+mFile.fileName());
+        return false;
+    }
+
+    return true;
+}
+
+void HexExporter::append(qint64 aPos, const QByteArray &aData)
+{
+    QMutexLocker aLocker(&mMutex);
+
+    Chunk aChunk;
+    aChunk.pos=aPos;
+    aChunk.data=aData;
+
+    mQueue.append(aChunk);
+    mQueuedSize+=aData.size();
+    mQueued.wakeOne();
+}
+
+void HexExporter::finish()
+{
+    QMutexLocker aLocker(&mMutex);
+
+    mFinished=true;
+    mQueued.wakeOne();
+}
+
+void HexExporter::stop()
+{
+    QMutexLocker aLocker(&mMutex);
+
+    mStopped=true;
+    mQueued.wakeOne();
+}
+
+qint64 HexExporter::queuedSize()
+{
+    QMutexLocker aLocker(&mMutex);
+    return mQueuedSize;
+}
+
+// ------------------------------------------------------------------
+
+QByteArray HexExporter::header() const
+{
+    switch (mFormat)
+    {
+        case FORMAT_C_ARRAY: return "unsigned char data["+QByteArray::number(mTotal)+"] = {\n";
+        case FORMAT_PYTHON:  return "data = bytes([\n";
+        case FORMAT_SREC:    return mRecordWriter.header();
+        default:             break;
+    }
+
+    return QByteArray();
+}
+
+QByteArray HexExporter::footer()
+{
+    QByteArray aOutput;
+
+    switch (mFormat)
+    {
+        case FORMAT_C_ARRAY:
+        case FORMAT_PYTHON:
+        {
+            if (mColumn>0)
+            {
+                aOutput.append('\n');
+            }
+
+            aOutput.append(mFormat==FORMAT_C_ARRAY ? "};\n" : "])\n");
+        }
+        break;
+        case FORMAT_BASE64:
+        {
+            if (!mBase64Rest.isEmpty())
+            {
+                aOutput=mBase64Rest.toBase64()+"\n";
+            }
+        }
+        break;
+        case FORMAT_INTEL_HEX:
+        case FORMAT_SREC:
+        {
+            aOutput=mRecordWriter.footer();
+        }
+        break;
+        default:
+        {
+        }
+        break;
+    }
+
+    return aOutput;
+}
+
+bool HexExporter::write(const QByteArray &aData, QString *aError)
+{
+    if (mFile.write(aData)!=aData.size())
+    {
+        setError(aError, mFile.errorString());
+        return false;
+    }
+
+    return true;
+}
+
+bool HexExporter::format(const Chunk &aChunk, QByteArray &aOutput, QString *aError)
+{
+    HEX_PROFILE_SCOPE("export.format");
+
+    switch (mFormat)
+    {
+        case FORMAT_RAW:
+        {
+            aOutput=aChunk.data;
+        }
+        break;
+        case FORMAT_C_ARRAY:
+        case FORMAT_PYTHON:
+        {
+            appendArray(aChunk.data, aOutput);
+        }
+        break;
+        case FORMAT_BASE64:
+        {
+            // Lines are made of whole groups of 3 bytes, the rest waits for the next chunk
+            mBase64Rest.append(aChunk.data);
+
+            int aPos=0;
+
+            for (; aPos+BASE64_LINE_BYTES<=mBase64Rest.size(); aPos+=BASE64_LINE_BYTES)
+            {
+                aOutput.append(mBase64Rest.mid(aPos, BASE64_LINE_BYTES).toBase64());
+                aOutput.append('\n');
+            }
+
+            mBase64Rest=mBase64Rest.mid(aPos);
+        }
+        break;
+        case FORMAT_INTEL_HEX:
+        case FORMAT_SREC:
+        {
+            if (aChunk.pos+aChunk.data.size()>Q_INT64_C(0x100000000))
+            {
+                setError(aError, formatName(mFormat)+" addresses are limited to 4 GB");
+                return false;
+            }
+
+            aOutput=mRecordWriter.data(aChunk.pos, aChunk.data);
+        }
+        break;
+        default:
+        {
+        }
+        break;
+    }
+
+    return true;
+}
+
+void HexExporter::appendArray(const QByteArray &aData, QByteArray &aOutput)
+{
+    aOutput.reserve(aData.size()*6+aData.size()/ARRAY_LINE_BYTES*5);
+
+    for (int i=0; i<aData.size(); ++i)
+    {
+        aOutput.append(mColumn==0 ? "    0x" : " 0x");
+        appendHex(aOutput, (quint8)aData.at(i));
+        aOutput.append(',');
+
+        if (++mColumn==ARRAY_LINE_BYTES)
+        {
+            aOutput.append('\n');
+            mColumn=0;
+        }
+    }
+}
+
+// ------------------------------------------------------------------
+
+void HexExporter::run()
+{
+    QString aError;
+    qint64 aDone=0;
+    bool aSuccess=write(header(), &aError);
+
+    while (aSuccess)
+    {
+        Chunk aChunk;
+
+        {
+            QMutexLocker aLocker(&mMutex);
+
+            while (mQueue.isEmpty() && !mFinished && !mStopped)
+            {
+                mQueued.wait(&mMutex);
+            }
+
+            if (mStopped)
+            {
+                aSuccess=false;
+                break;
+            }
+
+            if (mQueue.isEmpty())
+            {
+                break;
+            }
+
+            aChunk=mQueue.takeFirst();
+            mQueuedSize-=aChunk.data.size();
+        }
+
+        QByteArray aOutput;
+        aSuccess=format(aChunk, aOutput, &aError) && write(aOutput, &aError);
+
+        aDone+=aChunk.data.size();
+        emit progress(aDone, mTotal);
+    }
+
+    if (aSuccess)
+    {
+        aSuccess=write(footer(), &aError);
+    }
+
+    mFile.close();
+
+    // Cut output is worse than none
+    if (!aSuccess)
+    {
+        mFile.remove();
+    }
+
+    emit exportFinished(aSuccess, aError);
+}
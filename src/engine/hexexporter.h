@@ -0,0 +1,82 @@
+#ifndef HEXEXPORTER_H
+#define HEXEXPORTER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QFile>
+#include <QList>
+
+#include "hexrecords.h"
+
+/*
+ * Writes bytes to a file in one of text or binary formats in its own
+ * thread. Bytes are given chunk by chunk with their positions, each chunk
+ * is formatted and written as soon as it comes, so the whole output is
+ * never in memory. Positions are only written by Intel HEX and S-record,
+ * other formats put chunks one after another.
+ */
+class HexExporter : public QThread
+{
+    Q_OBJECT
+
+public:
+    enum Format
+    {
+        FORMAT_RAW,
+        FORMAT_C_ARRAY,
+        FORMAT_PYTHON,
+        FORMAT_BASE64,
+        FORMAT_INTEL_HEX,
+        FORMAT_SREC,
+        FORMATS_COUNT
+    };
+
+    HexExporter(const QString &aFileName, Format aFormat, qint64 aTotal, QObject *parent=0); // aTotal bytes will be given
+    ~HexExporter();
+
+    static QString formatName(Format aFormat);
+    static QString formatFilter(Format aFormat); // For file dialogs
+
+    bool open(QString *aError=0); // Before start()
+    void append(qint64 aPos, const QByteArray &aData);
+    void finish(); // Nothing more will be appended
+    void stop();   // File is removed
+    qint64 queuedSize(); // Bytes that aren't written yet
+
+protected:
+    struct Chunk
+    {
+        qint64     pos;
+        QByteArray data;
+    };
+
+    QFile          mFile;
+    Format         mFormat;
+    qint64         mTotal;
+    QMutex         mMutex;
+    QWaitCondition mQueued;
+    QList<Chunk>   mQueue;
+    qint64         mQueuedSize;
+    bool           mFinished;
+    bool           mStopped;
+
+    // State of formatting, used only by the thread
+    int            mColumn;       // Bytes in the current line of arrays
+    QByteArray     mBase64Rest;   // Bytes of the line that isn't complete yet
+    HexRecordWriter mRecordWriter; // Of Intel HEX and S-record
+
+    QByteArray header() const;
+    QByteArray footer();
+    bool write(const QByteArray &aData, QString *aError);
+    bool format(const Chunk &aChunk, QByteArray &aOutput, QString *aError);
+    void appendArray(const QByteArray &aData, QByteArray &aOutput);
+
+    void run();
+
+signals:
+    void progress(qint64 aDone, qint64 aTotal);
+    void exportFinished(bool aSuccess, QString aError);
+};
+
+#endif // HEXEXPORTER_H
@@ -0,0 +1,1661 @@
+#include "hexpatch.h"
+
+#include "hexsearch.h"
+#include "hexprofiler.h"
+#include "hexdocument.h"
+
+#include <string.h>
+#include <QtAlgorithms>
+
+#define IPS_MAX_OFFSET   0xFFFFFF
+#define IPS_MAX_RECORD   0xFFFF
+#define IPS_EOF_OFFSET   0x454F46
+#define HEXDIFF_LINE     64
+#define SOURCE_CHUNK     (1 << 20) // Bytes read at once and largest edit made from copies
+
+static void writeBpsNumber(QByteArray &aPatch, quint64 aNumber)
+{
+    while (true)
+    {
+        uchar aByte=aNumber & 0x7F;
+        aNumber>>=7;
+
+        if (aNumber==0)
+        {
+            aPatch.append((char)(aByte | 0x80));
+            break;
+        }
+
+        aPatch.append((char)aByte);
+        --aNumber;
+    }
+}
+
+static bool readBpsNumber(const QByteArray &aPatch, int &aPos, int aEnd, quint64 &aNumber)
+{
+    aNumber=0;
+    quint64 aShift=1;
+
+    while (aPos<aEnd)
+    {
+        uchar aByte=aPatch.at(aPos++);
+        aNumber+=(aByte & 0x7F)*aShift;
+
+        if (aByte & 0x80)
+        {
+            return true;
+        }
+
+        aShift<<=7;
+        aNumber+=aShift;
+    }
+
+    return false;
+}
+
+static void writeBigEndian(QByteArray &aPatch, quint32 aValue, int aBytes)
+{
+    for (int i=aBytes-1; i>=0; --i)
+    {
+        aPatch.append((char)(aValue >> (i*8)));
+    }
+}
+
+static quint32 readBigEndian(const QByteArray &aPatch, int aPos, int aBytes)
+{
+    quint32 aValue=0;
+
+    for (int i=0; i<aBytes; ++i)
+    {
+        aValue=(aValue << 8) | (uchar)aPatch.at(aPos+i);
+    }
+
+    return aValue;
+}
+
+static quint32 readLittleEndian32(const QByteArray &aPatch, int aPos)
+{
+    quint32 aValue=0;
+
+    for (int i=3; i>=0; --i)
+    {
+        aValue=(aValue << 8) | (uchar)aPatch.at(aPos+i);
+    }
+
+    return aValue;
+}
+
+static void writeLittleEndian32(QByteArray &aPatch, quint32 aValue)
+{
+    for (int i=0; i<4; ++i)
+    {
+        aPatch.append((char)(aValue >> (i*8)));
+    }
+}
+
+static void setError(QString *aError, const QString &aText)
+{
+    if (aError)
+    {
+        *aError=aText;
+    }
+}
+
+// *********************************************************************************
+//                                  HexPatchSource
+// *********************************************************************************
+
+HexPatchSource::HexPatchSource(const uchar *aData, qint64 aSize)
+{
+    mData=aData;
+    mSize=aSize;
+    mDocument=0;
+    mSource=0;
+    mPatch=0;
+}
+
+HexPatchSource::HexPatchSource(const HexDocument *aDocument)
+{
+    mData=0;
+    mSize=aDocument->size();
+    mDocument=aDocument;
+    mSource=0;
+    mPatch=0;
+}
+
+HexPatchSource::HexPatchSource(const HexPatchSource *aSource, const HexPatch *aPatch)
+{
+    mData=0;
+    mSize=aPatch->targetSize();
+    mDocument=0;
+    mSource=aSource;
+    mPatch=aPatch;
+
+    const QList<HexPatchOperation> &aOperations=aPatch->operations();
+    qint64 aStart=0;
+
+    for (int i=0; i<aOperations.size(); ++i)
+    {
+        mStarts.append(aStart);
+        aStart+=aOperations.at(i).length;
+    }
+}
+
+bool HexPatchSource::isNull() const
+{
+    return !mData && !mDocument && !mPatch;
+}
+
+qint64 HexPatchSource::size() const
+{
+    return mSize;
+}
+
+qint64 HexPatchSource::read(qint64 aPos, char *aBuffer, qint64 aLength) const
+{
+    aLength=qMin(aLength, mSize-aPos);
+
+    if (aPos<0 || aLength<=0 || isNull())
+    {
+        return 0;
+    }
+
+    if (mData)
+    {
+        memcpy(aBuffer, mData+aPos, aLength);
+        return aLength;
+    }
+
+    if (mDocument)
+    {
+        return mDocument->read(aPos, aBuffer, aLength);
+    }
+
+    return readPatch(aPos, aBuffer, aLength);
+}
+
+qint64 HexPatchSource::readPatch(qint64 aPos, char *aBuffer, qint64 aLength) const
+{
+    const QList<HexPatchOperation> &aOperations=mPatch->operations();
+    int aIndex=qUpperBound(mStarts.begin(), mStarts.end(), aPos)-mStarts.begin()-1;
+    qint64 aDone=0;
+
+    for (; aDone<aLength && aIndex>=0 && aIndex<aOperations.size(); ++aIndex)
+    {
+        const HexPatchOperation &aOperation=aOperations.at(aIndex);
+        qint64 aOffset=aPos+aDone-mStarts.at(aIndex);
+        qint64 aCount=qMin(aOperation.length-aOffset, aLength-aDone);
+
+        switch (aOperation.type)
+        {
+            case HexPatchOperation::SourceCopy:
+            {
+                if (mSource->read(aOperation.pos+aOffset, aBuffer+aDone, aCount)!=aCount)
+                {
+                    return aDone;
+                }
+            }
+            break;
+            case HexPatchOperation::TargetCopy:
+            {
+                // Copy that overlaps itself repeats its first aPeriod bytes, which BPS uses for run-length encoding
+                qint64 aPeriod=mStarts.at(aIndex)-aOperation.pos;
+
+                if (aPeriod<=0)
+                {
+                    return aDone;
+                }
+
+                qint64 aCopied=0;
+
+                while (aCopied<aCount)
+                {
+                    if (aCopied>=aPeriod)
+                    {
+                        aBuffer[aDone+aCopied]=aBuffer[aDone+aCopied-aPeriod];
+                        ++aCopied;
+                        continue;
+                    }
+
+                    qint64 aFrom=(aOffset+aCopied) % aPeriod;
+                    qint64 aPart=qMin(aCount-aCopied, aPeriod-aFrom);
+
+                    if (readPatch(aOperation.pos+aFrom, aBuffer+aDone+aCopied, aPart)!=aPart)
+                    {
+                        return aDone;
+                    }
+
+                    aCopied+=aPart;
+                }
+            }
+            break;
+            case HexPatchOperation::Data:
+            {
+                memcpy(aBuffer+aDone, aOperation.data.constData()+aOffset, aCount);
+            }
+            break;
+        }
+
+        aDone+=aCount;
+    }
+
+    return aDone;
+}
+
+QByteArray HexPatchSource::mid(qint64 aPos, qint64 aLength) const
+{
+    QByteArray aResult(qMax((qint64)0, qMin(aLength, mSize-aPos)), 0);
+
+    aResult.resize(read(aPos, aResult.data(), aResult.size()));
+
+    return aResult;
+}
+
+quint32 HexPatchSource::crc32(quint32 aCrc, qint64 aPos, qint64 aLength) const
+{
+    if (mData)
+    {
+        return HexPatch::crc32(aCrc, mData+aPos, aLength);
+    }
+
+    QByteArray aBuffer(SOURCE_CHUNK, 0);
+    qint64 aDone=0;
+
+    while (aDone<aLength)
+    {
+        qint64 aCount=read(aPos+aDone, aBuffer.data(), qMin(aLength-aDone, (qint64)SOURCE_CHUNK));
+
+        if (aCount<=0)
+        {
+            break;
+        }
+
+        aCrc=HexPatch::crc32(aCrc, (const uchar *)aBuffer.constData(), aCount);
+        aDone+=aCount;
+    }
+
+    return aCrc;
+}
+
+// *********************************************************************************
+//                                     HexPatch
+// *********************************************************************************
+
+HexPatch::HexPatch()
+{
+    mSourceSize=0;
+    mTargetSize=0;
+    mTruncateSize=-1;
+    mHasCrc=false;
+    mSourceCrc=0;
+    mTargetCrc=0;
+}
+
+quint32 HexPatch::crc32(quint32 aCrc, const uchar *aData, qint64 aLength)
+{
+    static quint32 aTable[256];
+    static bool    aTableReady=false;
+
+    if (!aTableReady)
+    {
+        for (quint32 i=0; i<256; ++i)
+        {
+            quint32 aValue=i;
+
+            for (int j=0; j<8; ++j)
+            {
+                aValue=(aValue & 1) ? (aValue >> 1) ^ 0xEDB88320 : aValue >> 1;
+            }
+
+            aTable[i]=aValue;
+        }
+
+        aTableReady=true;
+    }
+
+    aCrc=~aCrc;
+
+    for (qint64 i=0; i<aLength; ++i)
+    {
+        aCrc=aTable[(aCrc ^ aData[i]) & 0xFF] ^ (aCrc >> 8);
+    }
+
+    return ~aCrc;
+}
+
+// ------------------------------------------------------------------
+
+void HexPatch::appendCopy(qint64 aSourcePos, qint64 aLength)
+{
+    if (aLength<=0)
+    {
+        return;
+    }
+
+    if (
+        !mOperations.isEmpty()
+        &&
+        mOperations.last().type==HexPatchOperation::SourceCopy
+        &&
+        mOperations.last().pos+mOperations.last().length==aSourcePos
+       )
+    {
+        mOperations.last().length+=aLength;
+    }
+    else
+    {
+        HexPatchOperation aOperation;
+        aOperation.type=HexPatchOperation::SourceCopy;
+        aOperation.pos=aSourcePos;
+        aOperation.length=aLength;
+
+        mOperations.append(aOperation);
+    }
+
+    mTargetSize+=aLength;
+}
+
+void HexPatch::appendData(const char *aData, qint64 aLength)
+{
+    if (aLength<=0)
+    {
+        return;
+    }
+
+    if (!mOperations.isEmpty() && mOperations.last().type==HexPatchOperation::Data)
+    {
+        mOperations.last().data.append(aData, aLength);
+        mOperations.last().length+=aLength;
+    }
+    else
+    {
+        HexPatchOperation aOperation;
+        aOperation.type=HexPatchOperation::Data;
+        aOperation.pos=0;
+        aOperation.length=aLength;
+        aOperation.data=QByteArray(aData, aLength);
+
+        mOperations.append(aOperation);
+    }
+
+    mTargetSize+=aLength;
+}
+
+void HexPatch::fromOverlay(qint64 aSourceSize, qint64 aTargetSize, const QList<HexEdit> &aOverlay)
+{
+    mOperations.clear();
+    mOverlay.clear();
+    mSourceSize=aSourceSize;
+    mTargetSize=0;
+    mTruncateSize=-1;
+
+    qint64 aPos=0;
+
+    for (int i=0; i<=aOverlay.size(); ++i)
+    {
+        qint64 aNext=i<aOverlay.size() ? qMin(aOverlay.at(i).pos, aTargetSize) : aTargetSize;
+
+        if (aNext>aPos)
+        {
+            qint64 aCopyEnd=qMin(aNext, aSourceSize);
+
+            appendCopy(aPos, aCopyEnd-aPos);
+
+            if (aNext>aCopyEnd)
+            {
+                appendData(QByteArray(aNext-qMax(aPos, aCopyEnd), 0).constData(), aNext-qMax(aPos, aCopyEnd));
+            }
+
+            aPos=aNext;
+        }
+
+        if (i<aOverlay.size() && aPos<aTargetSize)
+        {
+            const QByteArray &aData=aOverlay.at(i).inserted;
+            qint64 aLength=qMin((qint64)aData.size(), aTargetSize-aPos);
+
+            appendData(aData.constData(), aLength);
+            aPos+=aLength;
+        }
+    }
+}
+
+void HexPatch::addOverlay(QList<HexEdit> &aOverlay, qint64 aPos, const QByteArray &aData)
+{
+    qint64 aEnd=aPos+aData.size();
+    int    aIndex=aOverlay.size();
+
+    // Later writes win, so cut everything they cover
+    while (aIndex>0 && aOverlay.at(aIndex-1).pos+aOverlay.at(aIndex-1).inserted.size()>aPos)
+    {
+        --aIndex;
+    }
+
+    while (aIndex<aOverlay.size() && aOverlay.at(aIndex).pos<aEnd)
+    {
+        HexEdit &aEdit=aOverlay[aIndex];
+        qint64 aEditEnd=aEdit.pos+aEdit.inserted.size();
+
+        if (aEdit.pos<aPos)
+        {
+            if (aEditEnd>aEnd)
+            {
+                HexEdit aTail;
+                aTail.pos=aEnd;
+                aTail.inserted=aEdit.inserted.mid(aEnd-aEdit.pos);
+
+                aOverlay.insert(aIndex+1, aTail);
+            }
+
+            aOverlay[aIndex].inserted.truncate(aPos-aOverlay.at(aIndex).pos);
+            ++aIndex;
+        }
+        else
+        if (aEditEnd>aEnd)
+        {
+            aEdit.inserted=aEdit.inserted.mid(aEnd-aEdit.pos);
+            aEdit.pos=aEnd;
+            break;
+        }
+        else
+        {
+            aOverlay.removeAt(aIndex);
+        }
+    }
+
+    HexEdit aEdit;
+    aEdit.pos=aPos;
+    aEdit.inserted=aData;
+
+    if (aIndex>0 && aOverlay.at(aIndex-1).pos+aOverlay.at(aIndex-1).inserted.size()==aPos)
+    {
+        aOverlay[aIndex-1].inserted.append(aData);
+    }
+    else
+    {
+        aOverlay.insert(aIndex, aEdit);
+    }
+}
+
+// ------------------------------------------------------------------
+
+HexPatch HexPatch::fromCompare(const uchar *aSource, qint64 aSourceSize, const uchar *aTarget, qint64 aTargetSize, int aThreads)
+{
+    QVector<HexRange> aRanges=HexSearch::compare(aSource, aSourceSize, aTarget, aTargetSize, aThreads);
+    QList<HexEdit> aOverlay;
+
+    for (int i=0; i<aRanges.size(); ++i)
+    {
+        qint64 aEnd=qMin(aRanges.at(i).pos+aRanges.at(i).length, aTargetSize);
+
+        if (aEnd>aRanges.at(i).pos)
+        {
+            HexEdit aEdit;
+            aEdit.pos=aRanges.at(i).pos;
+            aEdit.inserted=QByteArray((const char *)aTarget+aEdit.pos, aEnd-aEdit.pos);
+
+            aOverlay.append(aEdit);
+        }
+    }
+
+    HexPatch aPatch;
+    aPatch.fromOverlay(aSourceSize, aTargetSize, aOverlay);
+
+    return aPatch;
+}
+
+static int splitOperations(QList<HexPatchOperation> &aOperations, qint64 aPos)
+{
+    qint64 aStart=0;
+
+    for (int i=0; i<aOperations.size(); ++i)
+    {
+        if (aPos==aStart)
+        {
+            return i;
+        }
+
+        HexPatchOperation &aOperation=aOperations[i];
+
+        if (aPos<aStart+aOperation.length)
+        {
+            qint64 aHead=aPos-aStart;
+            HexPatchOperation aTail=aOperation;
+
+            aTail.length-=aHead;
+
+            if (aOperation.type==HexPatchOperation::Data)
+            {
+                aTail.data=aOperation.data.mid(aHead);
+                aOperation.data.truncate(aHead);
+            }
+            else
+            {
+                aTail.pos+=aHead;
+            }
+
+            aOperation.length=aHead;
+            aOperations.insert(i+1, aTail);
+
+            return i+1;
+        }
+
+        aStart+=aOperation.length;
+    }
+
+    return aOperations.size();
+}
+
+HexPatch HexPatch::fromEdits(qint64 aSourceSize, const QList<HexEdit> &aEdits)
+{
+    QList<HexReplacement> aReplacements;
+
+    for (int i=0; i<aEdits.size(); ++i)
+    {
+        HexReplacement aReplacement;
+        aReplacement.pos=aEdits.at(i).pos;
+        aReplacement.removedLength=aEdits.at(i).removed.size();
+        aReplacement.insertedLength=aEdits.at(i).inserted.size();
+        aReplacement.inserted=aEdits.at(i).inserted;
+
+        aReplacements.append(aReplacement);
+    }
+
+    return fromReplacements(aSourceSize, aReplacements);
+}
+
+HexPatch HexPatch::fromReplacements(qint64 aSourceSize, const QList<HexReplacement> &aReplacements, const HexPatchSource &aTarget)
+{
+    QList<HexPatchOperation> aOperations;
+
+    if (aSourceSize>0)
+    {
+        HexPatchOperation aOperation;
+        aOperation.type=HexPatchOperation::SourceCopy;
+        aOperation.pos=0;
+        aOperation.length=aSourceSize;
+
+        aOperations.append(aOperation);
+    }
+
+    for (int i=0; i<aReplacements.size(); ++i)
+    {
+        const HexReplacement &aReplacement=aReplacements.at(i);
+
+        int aFirst=splitOperations(aOperations, aReplacement.pos);
+        int aLast=splitOperations(aOperations, aReplacement.pos+aReplacement.removedLength);
+
+        while (aLast>aFirst)
+        {
+            aOperations.removeAt(aFirst);
+            --aLast;
+        }
+
+        if (aReplacement.insertedLength>0)
+        {
+            HexPatchOperation aOperation;
+            aOperation.type=HexPatchOperation::Data;
+            aOperation.pos=0;
+            aOperation.length=aReplacement.insertedLength;
+            aOperation.data=aReplacement.inserted;
+
+            aOperations.insert(aFirst, aOperation);
+        }
+    }
+
+    HexPatch aPatch;
+    aPatch.mSourceSize=aSourceSize;
+
+    for (int i=0; i<aOperations.size(); ++i)
+    {
+        const HexPatchOperation &aOperation=aOperations.at(i);
+
+        if (aOperation.type==HexPatchOperation::Data)
+        {
+            // Bytes that replacements don't have are where the operation ends up in the target
+            if (aOperation.data.size()==aOperation.length)
+            {
+                aPatch.appendData(aOperation.data.constData(), aOperation.length);
+            }
+            else
+            {
+                QByteArray aData=aTarget.mid(aPatch.mTargetSize, aOperation.length);
+                aPatch.appendData(aData.constData(), aData.size());
+            }
+        }
+        else
+        {
+            aPatch.appendCopy(aOperation.pos, aOperation.length);
+        }
+    }
+
+    return aPatch;
+}
+
+HexPatch::Format HexPatch::detectFormat(const QByteArray &aHeader)
+{
+    if (aHeader.startsWith("PATCH"))
+    {
+        return FORMAT_IPS;
+    }
+
+    if (aHeader.startsWith("BPS1"))
+    {
+        return FORMAT_BPS;
+    }
+
+    return FORMAT_HEXDIFF;
+}
+
+// ------------------------------------------------------------------
+
+bool HexPatch::isEmpty() const
+{
+    if (mSourceSize<0)
+    {
+        return mOverlay.isEmpty() && mTruncateSize<0;
+    }
+
+    for (int i=0; i<mOperations.size(); ++i)
+    {
+        if (mOperations.at(i).type!=HexPatchOperation::SourceCopy)
+        {
+            return false;
+        }
+    }
+
+    return mTargetSize==mSourceSize && isInPlace();
+}
+
+bool HexPatch::isInPlace() const
+{
+    if (mSourceSize<0)
+    {
+        return true;
+    }
+
+    qint64 aTargetPos=0;
+
+    for (int i=0; i<mOperations.size(); ++i)
+    {
+        const HexPatchOperation &aOperation=mOperations.at(i);
+
+        if (
+            aOperation.type==HexPatchOperation::TargetCopy
+            ||
+            (aOperation.type==HexPatchOperation::SourceCopy && aOperation.pos!=aTargetPos)
+           )
+        {
+            return false;
+        }
+
+        aTargetPos+=aOperation.length;
+    }
+
+    return true;
+}
+
+bool HexPatch::checkSource(const uchar *aSource, qint64 aSourceSize, QString *aError) const
+{
+    return checkSource(HexPatchSource(aSource, aSourceSize), aError);
+}
+
+bool HexPatch::checkSource(const HexPatchSource &aSource, QString *aError) const
+{
+    if (mSourceSize>=0 && mSourceSize!=aSource.size())
+    {
+        setError(aError, QString("Patch expects %1 bytes of source data but there are %2").arg(mSourceSize).arg(aSource.size()));
+        return false;
+    }
+
+    if (mHasCrc && aSource.crc32(0, 0, aSource.size())!=mSourceCrc)
+    {
+        setError(aError, "Patch was made for different source data");
+        return false;
+    }
+
+    return true;
+}
+
+bool HexPatch::checkTarget(const uchar *aSource, qint64 aSourceSize, QString *aError) const
+{
+    return checkTarget(HexPatchSource(aSource, aSourceSize), aError);
+}
+
+bool HexPatch::checkTarget(const HexPatchSource &aSource, QString *aError) const
+{
+    if (!mHasCrc)
+    {
+        return true;
+    }
+
+    quint32 aCrc=0;
+    bool aTargetCopy=false;
+    qint64 aTargetPos=0;
+
+    // Without target copies the checksum is taken from the operations, nothing is built
+    for (int i=0; i<mOperations.size(); ++i)
+    {
+        const HexPatchOperation &aOperation=mOperations.at(i);
+
+        switch (aOperation.type)
+        {
+            case HexPatchOperation::SourceCopy:
+            {
+                if (aOperation.pos+aOperation.length>aSource.size())
+                {
+                    setError(aError, "Patch reads beyond the end of source data");
+                    return false;
+                }
+
+                aCrc=aTargetCopy ? aCrc : aSource.crc32(aCrc, aOperation.pos, aOperation.length);
+            }
+            break;
+            case HexPatchOperation::TargetCopy:
+            {
+                if (aOperation.pos>=aTargetPos)
+                {
+                    setError(aError, "Patch is damaged");
+                    return false;
+                }
+
+                aTargetCopy=true;
+            }
+            break;
+            case HexPatchOperation::Data:
+            {
+                aCrc=aTargetCopy ? aCrc : crc32(aCrc, (const uchar *)aOperation.data.constData(), aOperation.length);
+            }
+            break;
+        }
+
+        aTargetPos+=aOperation.length;
+    }
+
+    // Target is read through the patch chunk by chunk
+    if (aTargetCopy)
+    {
+        HexPatchSource aTarget(&aSource, this);
+        aCrc=aTarget.crc32(0, 0, mTargetSize);
+    }
+
+    if (aCrc!=mTargetCrc)
+    {
+        setError(aError, "Patched data doesn't match the checksum of the patch");
+        return false;
+    }
+
+    return true;
+}
+
+HexPatch HexPatch::bind(qint64 aSourceSize) const
+{
+    if (mSourceSize>=0)
+    {
+        return *this;
+    }
+
+    qint64 aTargetSize=mTruncateSize;
+
+    if (aTargetSize<0)
+    {
+        aTargetSize=aSourceSize;
+
+        if (!mOverlay.isEmpty())
+        {
+            aTargetSize=qMax(aTargetSize, mOverlay.last().pos+mOverlay.last().inserted.size());
+        }
+    }
+
+    HexPatch aPatch;
+    aPatch.fromOverlay(aSourceSize, aTargetSize, mOverlay);
+
+    return aPatch;
+}
+
+qint64 HexPatch::sourceSize() const
+{
+    return mSourceSize;
+}
+
+qint64 HexPatch::targetSize() const
+{
+    return mTargetSize;
+}
+
+const QList<HexPatchOperation>& HexPatch::operations() const
+{
+    return mOperations;
+}
+
+QList<HexEdit> HexPatch::edits(const HexPatchSource &aSource) const
+{
+    QList<HexEdit> aEdits;
+    HexPatchSource aTarget(&aSource, this);
+    qint64 aTargetPos=0;
+
+    // Every operation but a copy from the same position changes its range, neighbours make one edit
+    for (int i=0; i<mOperations.size(); ++i)
+    {
+        const HexPatchOperation &aOperation=mOperations.at(i);
+
+        if (aOperation.type==HexPatchOperation::SourceCopy && aOperation.pos==aTargetPos)
+        {
+            aTargetPos+=aOperation.length;
+            continue;
+        }
+
+        qint64 aEnd=aTargetPos+aOperation.length;
+
+        while (aTargetPos<aEnd)
+        {
+            QByteArray aBytes;
+
+            if (aOperation.type==HexPatchOperation::Data)
+            {
+                aBytes=aOperation.data.mid(aOperation.length-(aEnd-aTargetPos));
+            }
+            else
+            {
+                aBytes=aTarget.mid(aTargetPos, qMin(aEnd-aTargetPos, (qint64)SOURCE_CHUNK));
+            }
+
+            if (aBytes.isEmpty())
+            {
+                return aEdits;
+            }
+
+            if (
+                !aEdits.isEmpty()
+                &&
+                aEdits.last().pos+aEdits.last().inserted.size()==aTargetPos
+                &&
+                aEdits.last().inserted.size()+aBytes.size()<=SOURCE_CHUNK
+               )
+            {
+                aEdits.last().inserted.append(aBytes);
+            }
+            else
+            {
+                HexEdit aEdit;
+                aEdit.pos=aTargetPos;
+                aEdit.inserted=aBytes;
+
+                aEdits.append(aEdit);
+            }
+
+            aTargetPos+=aBytes.size();
+        }
+    }
+
+    // Only the last edits can go past the end of the source
+    for (int i=0; i<aEdits.size(); ++i)
+    {
+        HexEdit &aEdit=aEdits[i];
+        aEdit.removed=aSource.mid(aEdit.pos, aEdit.inserted.size());
+    }
+
+    for (qint64 aPos=mTargetSize; aPos<aSource.size(); aPos+=SOURCE_CHUNK)
+    {
+        HexEdit aEdit;
+        aEdit.pos=aPos;
+        aEdit.removed=aSource.mid(aPos, SOURCE_CHUNK);
+
+        aEdits.append(aEdit);
+    }
+
+    return aEdits;
+}
+
+// ------------------------------------------------------------------
+
+bool HexPatch::apply(const uchar *aSource, qint64 aSourceSize, uchar *aTarget) const
+{
+    if (mSourceSize<0)
+    {
+        return bind(aSourceSize).apply(aSource, aSourceSize, aTarget);
+    }
+
+    qint64 aTargetPos=0;
+
+    for (int i=0; i<mOperations.size(); ++i)
+    {
+        const HexPatchOperation &aOperation=mOperations.at(i);
+
+        switch (aOperation.type)
+        {
+            case HexPatchOperation::SourceCopy:
+            {
+                if (aOperation.pos+aOperation.length>aSourceSize)
+                {
+                    return false;
+                }
+
+                memcpy(aTarget+aTargetPos, aSource+aOperation.pos, aOperation.length);
+            }
+            break;
+            case HexPatchOperation::TargetCopy:
+            {
+                if (aOperation.pos>=aTargetPos)
+                {
+                    return false;
+                }
+
+                // Source and destination may overlap, which BPS uses for run-length encoding
+                for (qint64 j=0; j<aOperation.length; ++j)
+                {
+                    aTarget[aTargetPos+j]=aTarget[aOperation.pos+j];
+                }
+            }
+            break;
+            case HexPatchOperation::Data:
+            {
+                memcpy(aTarget+aTargetPos, aOperation.data.constData(), aOperation.length);
+            }
+            break;
+        }
+
+        aTargetPos+=aOperation.length;
+    }
+
+    return true;
+}
+
+bool HexPatch::apply(const uchar *aSource, qint64 aSourceSize, QIODevice *aTarget) const
+{
+    if (mSourceSize<0)
+    {
+        return bind(aSourceSize).apply(aSource, aSourceSize, aTarget);
+    }
+
+    qint64 aStart=aTarget->pos();
+    qint64 aTargetPos=0;
+
+    for (int i=0; i<mOperations.size(); ++i)
+    {
+        const HexPatchOperation &aOperation=mOperations.at(i);
+
+        switch (aOperation.type)
+        {
+            case HexPatchOperation::SourceCopy:
+            {
+                if (
+                    aOperation.pos+aOperation.length>aSourceSize
+                    ||
+                    aTarget->write((const char *)aSource+aOperation.pos, aOperation.length)!=aOperation.length
+                   )
+                {
+                    return false;
+                }
+            }
+            break;
+            case HexPatchOperation::TargetCopy:
+            {
+                if (aOperation.pos>=aTargetPos || !aTarget->isReadable())
+                {
+                    return false;
+                }
+
+                qint64 aCopied=0;
+
+                while (aCopied<aOperation.length)
+                {
+                    // Never read past what was already written
+                    qint64 aBlock=qMin(qMin(aOperation.length-aCopied, aTargetPos-aOperation.pos), (qint64)(1 << 20));
+                    QByteArray aBuffer;
+
+                    if (
+                        !aTarget->seek(aStart+aOperation.pos+aCopied)
+                        ||
+                        (aBuffer=aTarget->read(aBlock)).size()!=aBlock
+                        ||
+                        !aTarget->seek(aStart+aTargetPos+aCopied)
+                        ||
+                        aTarget->write(aBuffer)!=aBlock
+                       )
+                    {
+                        return false;
+                    }
+
+                    aCopied+=aBlock;
+                }
+            }
+            break;
+            case HexPatchOperation::Data:
+            {
+                if (aTarget->write(aOperation.data)!=aOperation.length)
+                {
+                    return false;
+                }
+            }
+            break;
+        }
+
+        aTargetPos+=aOperation.length;
+    }
+
+    return true;
+}
+
+bool HexPatch::applyInPlace(QFile *aTarget) const
+{
+    if (mSourceSize<0)
+    {
+        return bind(aTarget->size()).applyInPlace(aTarget);
+    }
+
+    if (!isInPlace() || aTarget->size()!=mSourceSize)
+    {
+        return false;
+    }
+
+    qint64 aTargetPos=0;
+
+    for (int i=0; i<mOperations.size(); ++i)
+    {
+        const HexPatchOperation &aOperation=mOperations.at(i);
+
+        if (aOperation.type==HexPatchOperation::Data)
+        {
+            if (!aTarget->seek(aTargetPos) || aTarget->write(aOperation.data)!=aOperation.length)
+            {
+                return false;
+            }
+        }
+
+        aTargetPos+=aOperation.length;
+    }
+
+    return aTarget->size()==mTargetSize || aTarget->resize(mTargetSize);
+}
+
+// ------------------------------------------------------------------
+
+bool HexPatch::read(QIODevice *aDevice, QString *aError)
+{
+    HEX_PROFILE_SCOPE("io.patch.read");
+
+    QByteArray aPatch=aDevice->readAll();
+
+    *this=HexPatch();
+
+    switch (detectFormat(aPatch))
+    {
+        case FORMAT_IPS:     return readIps(aPatch, aError);
+        case FORMAT_BPS:     return readBps(aPatch, aError);
+        case FORMAT_HEXDIFF: return readHexDiff(aPatch, aError);
+        default:             break;
+    }
+
+    setError(aError, "Unknown patch format");
+
+    return false;
+}
+
+bool HexPatch::readHexDiff(const QByteArray &aPatch, QString *aError)
+{
+    QList<QByteArray> aLines=aPatch.split('\n');
+
+    mSourceSize=-1;
+
+    for (int i=0; i<aLines.size(); ++i)
+    {
+        QByteArray aLine=aLines.at(i).trimmed();
+
+        if (aLine.isEmpty() || aLine.startsWith('#'))
+        {
+            continue;
+        }
+
+        QList<QByteArray> aParts=aLine.split(' ');
+        bool ok=aParts.size()==2;
+
+        if (ok)
+        {
+            if (aParts.at(0)=="size")
+            {
+                mTruncateSize=aParts.at(1).toLongLong(&ok);
+            }
+            else
+            {
+                qint64 aPos=aParts.at(0).toLongLong(&ok, 16);
+
+                if (ok)
+                {
+                    addOverlay(mOverlay, aPos, QByteArray::fromHex(aParts.at(1)));
+                }
+            }
+        }
+
+        if (!ok)
+        {
+            setError(aError, QString("Line %1: invalid record").arg(i+1));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool HexPatch::readIps(const QByteArray &aPatch, QString *aError)
+{
+    int aPos=5; // "PATCH"
+
+    mSourceSize=-1;
+
+    while (true)
+    {
+        if (aPos+3>aPatch.size())
+        {
+            setError(aError, "Unexpected end of IPS patch");
+            return false;
+        }
+
+        quint32 aOffset=readBigEndian(aPatch, aPos, 3);
+        aPos+=3;
+
+        if (aOffset==IPS_EOF_OFFSET)
+        {
+            if (aPos+3<=aPatch.size())
+            {
+                mTruncateSize=readBigEndian(aPatch, aPos, 3);
+            }
+
+            return true;
+        }
+
+        if (aPos+2>aPatch.size())
+        {
+            setError(aError, "Unexpected end of IPS patch");
+            return false;
+        }
+
+        int aLength=readBigEndian(aPatch, aPos, 2);
+        aPos+=2;
+
+        if (aLength==0)
+        {
+            if (aPos+3>aPatch.size())
+            {
+                setError(aError, "Unexpected end of IPS patch");
+                return false;
+            }
+
+            int aCount=readBigEndian(aPatch, aPos, 2);
+
+            addOverlay(mOverlay, aOffset, QByteArray(aCount, aPatch.at(aPos+2)));
+            aPos+=3;
+        }
+        else
+        {
+            if (aPos+aLength>aPatch.size())
+            {
+                setError(aError, "Unexpected end of IPS patch");
+                return false;
+            }
+
+            addOverlay(mOverlay, aOffset, aPatch.mid(aPos, aLength));
+            aPos+=aLength;
+        }
+    }
+}
+
+bool HexPatch::readBps(const QByteArray &aPatch, QString *aError)
+{
+    if (aPatch.size()<16)
+    {
+        setError(aError, "BPS patch is too short");
+        return false;
+    }
+
+    int aEnd=aPatch.size()-12;
+
+    if (crc32(0, (const uchar *)aPatch.constData(), aPatch.size()-4)!=readLittleEndian32(aPatch, aPatch.size()-4))
+    {
+        setError(aError, "BPS patch is corrupted");
+        return false;
+    }
+
+    int     aPos=4; // "BPS1"
+    quint64 aSourceSize;
+    quint64 aTargetSize;
+    quint64 aMetadataSize;
+
+    if (
+        !readBpsNumber(aPatch, aPos, aEnd, aSourceSize)
+        ||
+        !readBpsNumber(aPatch, aPos, aEnd, aTargetSize)
+        ||
+        !readBpsNumber(aPatch, aPos, aEnd, aMetadataSize)
+        ||
+        aMetadataSize>(quint64)(aEnd-aPos)
+       )
+    {
+        setError(aError, "Invalid BPS header");
+        return false;
+    }
+
+    aPos+=aMetadataSize;
+
+    mSourceSize=aSourceSize;
+
+    qint64 aSourceRelative=0;
+    qint64 aTargetRelative=0;
+
+    while (aPos<aEnd)
+    {
+        quint64 aData;
+
+        if (!readBpsNumber(aPatch, aPos, aEnd, aData))
+        {
+            setError(aError, "Invalid BPS action");
+            return false;
+        }
+
+        int    aAction=aData & 3;
+        qint64 aLength=(aData >> 2)+1;
+
+        switch (aAction)
+        {
+            case 0: // SourceRead
+            {
+                if (mTargetSize+aLength>mSourceSize)
+                {
+                    setError(aError, "BPS source read is out of range");
+                    return false;
+                }
+
+                HexPatchOperation aOperation;
+                aOperation.type=HexPatchOperation::SourceCopy;
+                aOperation.pos=mTargetSize;
+                aOperation.length=aLength;
+
+                mOperations.append(aOperation);
+                mTargetSize+=aLength;
+            }
+            break;
+            case 1: // TargetRead
+            {
+                if (aLength>aEnd-aPos)
+                {
+                    setError(aError, "BPS target read is out of range");
+                    return false;
+                }
+
+                appendData(aPatch.constData()+aPos, aLength);
+                aPos+=aLength;
+            }
+            break;
+            case 2: // SourceCopy
+            case 3: // TargetCopy
+            {
+                quint64 aOffsetData;
+
+                if (!readBpsNumber(aPatch, aPos, aEnd, aOffsetData))
+                {
+                    setError(aError, "Invalid BPS action");
+                    return false;
+                }
+
+                qint64 aOffset=(aOffsetData & 1 ? -1 : 1)*(qint64)(aOffsetData >> 1);
+                qint64 &aRelative=aAction==2 ? aSourceRelative : aTargetRelative;
+
+                aRelative+=aOffset;
+
+                if (aRelative<0 || (aAction==2 ? aRelative+aLength>mSourceSize : aRelative>=mTargetSize))
+                {
+                    setError(aError, "BPS copy is out of range");
+                    return false;
+                }
+
+                HexPatchOperation aOperation;
+                aOperation.type=aAction==2 ? HexPatchOperation::SourceCopy : HexPatchOperation::TargetCopy;
+                aOperation.pos=aRelative;
+                aOperation.length=aLength;
+
+                mOperations.append(aOperation);
+                mTargetSize+=aLength;
+
+                aRelative+=aLength;
+            }
+            break;
+        }
+    }
+
+    if ((quint64)mTargetSize!=aTargetSize)
+    {
+        setError(aError, "BPS patch produces wrong target size");
+        return false;
+    }
+
+    mHasCrc=true;
+    mSourceCrc=readLittleEndian32(aPatch, aEnd);
+    mTargetCrc=readLittleEndian32(aPatch, aEnd+4);
+
+    return true;
+}
+
+// ------------------------------------------------------------------
+
+bool HexPatch::overlay(const HexPatchSource &aSource, QList<HexEdit> &aOverlay, QString *aError) const
+{
+    if (mSourceSize<0)
+    {
+        aOverlay=mOverlay;
+        return true;
+    }
+
+    qint64 aTargetPos=0;
+
+    for (int i=0; i<mOperations.size(); ++i)
+    {
+        const HexPatchOperation &aOperation=mOperations.at(i);
+
+        if (aOperation.type==HexPatchOperation::TargetCopy)
+        {
+            setError(aError, "Patch can't be converted to the in-place format");
+            return false;
+        }
+
+        if (aOperation.type==HexPatchOperation::Data)
+        {
+            addOverlay(aOverlay, aTargetPos, aOperation.data);
+        }
+        else
+        if (aOperation.pos!=aTargetPos)
+        {
+            if (aSource.isNull() || aOperation.pos+aOperation.length>aSource.size())
+            {
+                setError(aError, "Source data is required to convert the patch");
+                return false;
+            }
+
+            addOverlay(aOverlay, aTargetPos, aSource.mid(aOperation.pos, aOperation.length));
+        }
+
+        aTargetPos+=aOperation.length;
+    }
+
+    return true;
+}
+
+bool HexPatch::write(QIODevice *aDevice, Format aFormat, const uchar *aSource, qint64 aSourceSize, QString *aError) const
+{
+    return write(aDevice, aFormat, HexPatchSource(aSource, aSourceSize), aError);
+}
+
+bool HexPatch::write(QIODevice *aDevice, Format aFormat, const HexPatchSource &aSource, QString *aError) const
+{
+    HEX_PROFILE_SCOPE("io.patch.write");
+
+    switch (aFormat)
+    {
+        case FORMAT_HEXDIFF:
+        {
+            if (!writeHexDiff(aDevice, aSource))
+            {
+                setError(aError, aDevice->errorString());
+                return false;
+            }
+
+            return true;
+        }
+        case FORMAT_IPS:
+        {
+            return writeIps(aDevice, aSource, aError);
+        }
+        case FORMAT_BPS:
+        {
+            if (aSource.isNull() && aSource.size()>0)
+            {
+                setError(aError, "Source data is required to create BPS patch");
+                return false;
+            }
+
+            if (!bind(aSource.size()).writeBps(aDevice, aSource))
+            {
+                setError(aError, aDevice->errorString());
+                return false;
+            }
+
+            return true;
+        }
+        default:
+        {
+            break;
+        }
+    }
+
+    setError(aError, "Unknown patch format");
+
+    return false;
+}
+
+bool HexPatch::writeHexDiff(QIODevice *aDevice, const HexPatchSource &aSource) const
+{
+    QList<HexEdit> aOverlay;
+
+    if (!overlay(aSource, aOverlay, 0))
+    {
+        return false;
+    }
+
+    qint64 aTargetSize=mSourceSize<0 ? mTruncateSize : mTargetSize;
+
+    if (aTargetSize>=0 && aTargetSize!=aSource.size())
+    {
+        if (aDevice->write(QString("size %1\n").arg(aTargetSize).toLatin1())<0)
+        {
+            return false;
+        }
+    }
+
+    for (int i=0; i<aOverlay.size(); ++i)
+    {
+        const HexEdit &aEdit=aOverlay.at(i);
+
+        for (int j=0; j<aEdit.inserted.size(); j+=HEXDIFF_LINE)
+        {
+            QByteArray aLine=QString("%1 ").arg(aEdit.pos+j, 16, 16, QChar('0')).toUpper().toLatin1();
+            aLine.append(aEdit.inserted.mid(j, HEXDIFF_LINE).toHex().toUpper());
+            aLine.append('\n');
+
+            if (aDevice->write(aLine)<0)
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool HexPatch::writeIps(QIODevice *aDevice, const HexPatchSource &aSource, QString *aError) const
+{
+    QList<HexEdit> aOverlay;
+
+    if (!overlay(aSource, aOverlay, aError))
+    {
+        return false;
+    }
+
+    QByteArray aPatch("PATCH");
+    qint64 aPrevEnd=-1;
+    char   aLastByte=0;
+
+    for (int i=0; i<aOverlay.size(); ++i)
+    {
+        const HexEdit &aEdit=aOverlay.at(i);
+
+        for (int j=0; j<aEdit.inserted.size(); j+=IPS_MAX_RECORD)
+        {
+            qint64     aOffset=aEdit.pos+j;
+            QByteArray aData=aEdit.inserted.mid(j, IPS_MAX_RECORD);
+
+            if (aOffset==IPS_EOF_OFFSET)
+            {
+                // Offset would be read as end of patch, so start one byte earlier
+                char aPrevByte;
+
+                if (aPrevEnd==aOffset)
+                {
+                    aPrevByte=aLastByte;
+                }
+                else
+                if (!aSource.isNull() && aOffset-1<aSource.size())
+                {
+                    aPrevByte=aSource.mid(aOffset-1, 1).at(0);
+                }
+                else
+                {
+                    setError(aError, "Source data is required to create IPS patch");
+                    return false;
+                }
+
+                aData.prepend(aPrevByte);
+                --aOffset;
+
+                if (aData.size()>IPS_MAX_RECORD)
+                {
+                    aData.chop(1);
+                    j-=1;
+                }
+            }
+
+            if (aOffset+aData.size()-1>IPS_MAX_OFFSET)
+            {
+                setError(aError, "IPS patch can't address data above 16 MiB");
+                return false;
+            }
+
+            writeBigEndian(aPatch, aOffset, 3);
+
+            if (aData.size()>=3 && aData.count(aData.at(0))==aData.size())
+            {
+                writeBigEndian(aPatch, 0, 2);
+                writeBigEndian(aPatch, aData.size(), 2);
+                aPatch.append(aData.at(0));
+            }
+            else
+            {
+                writeBigEndian(aPatch, aData.size(), 2);
+                aPatch.append(aData);
+            }
+
+            aPrevEnd=aOffset+aData.size();
+            aLastByte=aData.at(aData.size()-1);
+        }
+    }
+
+    aPatch.append("EOF");
+
+    qint64 aTargetSize=mSourceSize<0 ? mTruncateSize : mTargetSize;
+
+    if (aTargetSize>=0 && aTargetSize<aSource.size())
+    {
+        if (aTargetSize>IPS_MAX_OFFSET)
+        {
+            setError(aError, "IPS patch can't truncate data above 16 MiB");
+            return false;
+        }
+
+        writeBigEndian(aPatch, aTargetSize, 3);
+    }
+
+    if (aDevice->write(aPatch)!=aPatch.size())
+    {
+        setError(aError, aDevice->errorString());
+        return false;
+    }
+
+    return true;
+}
+
+bool HexPatch::writeBps(QIODevice *aDevice, const HexPatchSource &aSource) const
+{
+    QByteArray aPatch("BPS1");
+
+    writeBpsNumber(aPatch, aSource.size());
+    writeBpsNumber(aPatch, mTargetSize);
+    writeBpsNumber(aPatch, 0);
+
+    quint32 aTargetCrc=0;
+    bool    aHasTargetCopy=false;
+
+    qint64 aTargetPos=0;
+    qint64 aSourceRelative=0;
+    qint64 aTargetRelative=0;
+
+    for (int i=0; i<mOperations.size(); ++i)
+    {
+        const HexPatchOperation &aOperation=mOperations.at(i);
+
+        switch (aOperation.type)
+        {
+            case HexPatchOperation::SourceCopy:
+            {
+                if (aOperation.pos==aTargetPos)
+                {
+                    writeBpsNumber(aPatch, ((aOperation.length-1) << 2) | 0);
+                }
+                else
+                {
+                    qint64 aOffset=aOperation.pos-aSourceRelative;
+
+                    writeBpsNumber(aPatch, ((aOperation.length-1) << 2) | 2);
+                    writeBpsNumber(aPatch, (qAbs(aOffset) << 1) | (aOffset<0 ? 1 : 0));
+
+                    aSourceRelative=aOperation.pos+aOperation.length;
+                }
+
+                aTargetCrc=aSource.crc32(aTargetCrc, aOperation.pos, aOperation.length);
+            }
+            break;
+            case HexPatchOperation::TargetCopy:
+            {
+                qint64 aOffset=aOperation.pos-aTargetRelative;
+
+                writeBpsNumber(aPatch, ((aOperation.length-1) << 2) | 3);
+                writeBpsNumber(aPatch, (qAbs(aOffset) << 1) | (aOffset<0 ? 1 : 0));
+
+                aTargetRelative=aOperation.pos+aOperation.length;
+                aHasTargetCopy=true;
+            }
+            break;
+            case HexPatchOperation::Data:
+            {
+                writeBpsNumber(aPatch, ((aOperation.length-1) << 2) | 1);
+                aPatch.append(aOperation.data);
+
+                aTargetCrc=crc32(aTargetCrc, (const uchar *)aOperation.data.constData(), aOperation.length);
+            }
+            break;
+        }
+
+        aTargetPos+=aOperation.length;
+    }
+
+    if (aHasTargetCopy)
+    {
+        if (mHasCrc)
+        {
+            aTargetCrc=mTargetCrc;
+        }
+        else
+        {
+            HexPatchSource aTarget(&aSource, this);
+            aTargetCrc=aTarget.crc32(0, 0, mTargetSize);
+        }
+    }
+
+    quint32 aSourceCrc=aSource.crc32(0, 0, aSource.size());
+
+    writeLittleEndian32(aPatch, aSourceCrc);
+    writeLittleEndian32(aPatch, aTargetCrc);
+
+    quint32 aPatchCrc=crc32(0, (const uchar *)aPatch.constData(), aPatch.size());
+
+    writeLittleEndian32(aPatch, aPatchCrc);
+
+    return aDevice->write(aPatch)==aPatch.size();
+}
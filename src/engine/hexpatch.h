@@ -0,0 +1,148 @@
+#ifndef HEXPATCH_H
+#define HEXPATCH_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+
+class HexDocument;
+class HexPatch;
+
+struct HexEdit
+{
+    qint64     pos;
+    QByteArray removed;
+    QByteArray inserted;
+};
+
+struct HexReplacement
+{
+    qint64     pos;
+    qint64     removedLength;
+    qint64     insertedLength;
+    QByteArray inserted;       // Empty if the bytes are read from the target later
+};
+
+struct HexPatchOperation
+{
+    enum Type
+    {
+        SourceCopy,
+        TargetCopy,
+        Data
+    };
+
+    Type       type;
+    qint64     pos;    // Source position for SourceCopy and target position for TargetCopy
+    qint64     length;
+    QByteArray data;
+};
+
+/*
+ * Data a patch is made from or applied to: one array, a document, or a
+ * patch applied to other data. Bytes are read chunk by chunk, so the data
+ * doesn't have to be one array. Everything given to the constructors must
+ * outlive the source.
+ */
+class HexPatchSource
+{
+public:
+    HexPatchSource(const uchar *aData=0, qint64 aSize=0);
+    explicit HexPatchSource(const HexDocument *aDocument);
+    HexPatchSource(const HexPatchSource *aSource, const HexPatch *aPatch); // Bound aPatch applied to aSource
+
+    bool isNull() const;
+    qint64 size() const;
+
+    qint64 read(qint64 aPos, char *aBuffer, qint64 aLength) const;
+    QByteArray mid(qint64 aPos, qint64 aLength) const;
+    quint32 crc32(quint32 aCrc, qint64 aPos, qint64 aLength) const;
+
+private:
+    const uchar          *mData;
+    qint64                mSize;
+    const HexDocument    *mDocument;
+    const HexPatchSource *mSource;
+    const HexPatch       *mPatch;
+    QList<qint64>         mStarts;   // Target position of every operation of mPatch
+
+    qint64 readPatch(qint64 aPos, char *aBuffer, qint64 aLength) const;
+};
+
+// *********************************************************************************
+
+/*
+ * Patch is a sequence of operations producing the target from start to
+ * end. Patch is "in place" if every SourceCopy reads from the same
+ * position it writes to, so it can be applied by overwriting Data
+ * operations and resizing, without touching the rest.
+ */
+class HexPatch
+{
+public:
+    enum Format
+    {
+        FORMAT_UNKNOWN,
+        FORMAT_HEXDIFF, // Text: "size N" and "OFFSET HEXBYTES" lines
+        FORMAT_IPS,
+        FORMAT_BPS
+    };
+
+    HexPatch();
+
+    static HexPatch fromCompare(const uchar *aSource, qint64 aSourceSize, const uchar *aTarget, qint64 aTargetSize, int aThreads=0);
+    static HexPatch fromEdits(qint64 aSourceSize, const QList<HexEdit> &aEdits);
+    static HexPatch fromReplacements(qint64 aSourceSize, const QList<HexReplacement> &aReplacements, const HexPatchSource &aTarget=HexPatchSource()); // Replacements are made in order, missing bytes are read from aTarget
+    static Format detectFormat(const QByteArray &aHeader);
+
+    bool read(QIODevice *aDevice, QString *aError=0);
+    bool write(QIODevice *aDevice, Format aFormat, const uchar *aSource, qint64 aSourceSize, QString *aError=0) const;
+    bool write(QIODevice *aDevice, Format aFormat, const HexPatchSource &aSource, QString *aError=0) const;
+
+    bool isEmpty() const;
+    bool isInPlace() const;
+    bool checkSource(const uchar *aSource, qint64 aSourceSize, QString *aError=0) const;
+    bool checkSource(const HexPatchSource &aSource, QString *aError=0) const;
+    bool checkTarget(const uchar *aSource, qint64 aSourceSize, QString *aError=0) const; // Checksum of the result, before it is made
+    bool checkTarget(const HexPatchSource &aSource, QString *aError=0) const;
+
+    HexPatch bind(qint64 aSourceSize) const;
+    QList<HexEdit> edits(const HexPatchSource &aSource) const; // Sorted ranges of bound patch that change aSource, with the bytes they replace
+
+    bool apply(const uchar *aSource, qint64 aSourceSize, uchar *aTarget) const;
+    bool apply(const uchar *aSource, qint64 aSourceSize, QIODevice *aTarget) const;
+    bool applyInPlace(QFile *aTarget) const;
+
+    qint64 sourceSize() const;
+    qint64 targetSize() const;
+    const QList<HexPatchOperation>& operations() const;
+
+    static quint32 crc32(quint32 aCrc, const uchar *aData, qint64 aLength);
+
+private:
+    QList<HexPatchOperation> mOperations;
+    qint64                   mSourceSize;  // -1 if the patch is not bound to a source yet (IPS, hexdiff)
+    qint64                   mTargetSize;
+    QList<HexEdit>           mOverlay;     // Writes of unbound patch
+    qint64                   mTruncateSize;
+    bool                     mHasCrc;
+    quint32                  mSourceCrc;
+    quint32                  mTargetCrc;
+
+    void appendCopy(qint64 aSourcePos, qint64 aLength);
+    void appendData(const char *aData, qint64 aLength);
+    void fromOverlay(qint64 aSourceSize, qint64 aTargetSize, const QList<HexEdit> &aOverlay);
+    static void addOverlay(QList<HexEdit> &aOverlay, qint64 aPos, const QByteArray &aData);
+
+    bool readHexDiff(const QByteArray &aPatch, QString *aError);
+    bool readIps(const QByteArray &aPatch, QString *aError);
+    bool readBps(const QByteArray &aPatch, QString *aError);
+
+    bool writeHexDiff(QIODevice *aDevice, const HexPatchSource &aSource) const;
+    bool writeIps(QIODevice *aDevice, const HexPatchSource &aSource, QString *aError) const;
+    bool writeBps(QIODevice *aDevice, const HexPatchSource &aSource) const;
+
+    bool overlay(const HexPatchSource &aSource, QList<HexEdit> &aOverlay, QString *aError) const;
+};
+
+#endif // HEXPATCH_H
@@ -0,0 +1,173 @@
+#include "hexprofiler.h"
+
+#ifdef HEXEDITOR_PROFILING
+
+#include <QMutexLocker>
+
+HexProfiler* HexProfiler::instance()
+{
+    static HexProfiler aProfiler;
+    return &aProfiler;
+}
+
+HexProfiler::HexProfiler()
+{
+    mLastFrameTime=0;
+    mFramesCount=0;
+    mFrameTimer.start();
+}
+
+void HexProfiler::add(QHash<const char *, HexProfileEntry> &aEntries, const char *aName, qint64 aCalls, qint64 aNanoseconds, qint64 aValue)
+{
+    QHash<const char *, HexProfileEntry>::iterator it=aEntries.find(aName);
+
+    if (it==aEntries.end())
+    {
+        HexProfileEntry aEntry;
+        aEntry.calls=0;
+        aEntry.nanoseconds=0;
+        aEntry.maxNanoseconds=0;
+        aEntry.value=0;
+
+        it=aEntries.insert(aName, aEntry);
+    }
+
+    it.value().calls+=aCalls;
+    it.value().nanoseconds+=aNanoseconds;
+    it.value().maxNanoseconds=qMax(it.value().maxNanoseconds, aNanoseconds);
+    it.value().value+=aValue;
+}
+
+void HexProfiler::addTime(const char *aName, qint64 aNanoseconds)
+{
+    QMutexLocker aLocker(&mMutex);
+
+    add(mCurrentFrame, aName, 1, aNanoseconds, 0);
+    add(mTotals,       aName, 1, aNanoseconds, 0);
+}
+
+void HexProfiler::count(const char *aName, qint64 aValue)
+{
+    QMutexLocker aLocker(&mMutex);
+
+    add(mCurrentFrame, aName, 0, 0, aValue);
+    add(mTotals,       aName, 0, 0, aValue);
+}
+
+void HexProfiler::endFrame()
+{
+    QMutexLocker aLocker(&mMutex);
+
+    mLastFrame=mCurrentFrame;
+    mCurrentFrame.clear();
+
+    mLastFrameTime=mFrameTimer.nsecsElapsed();
+    mFrameTimer.restart();
+    ++mFramesCount;
+}
+
+void HexProfiler::reset()
+{
+    QMutexLocker aLocker(&mMutex);
+
+    mCurrentFrame.clear();
+    mLastFrame.clear();
+    mTotals.clear();
+
+    mLastFrameTime=0;
+    mFramesCount=0;
+    mFrameTimer.restart();
+}
+
+QMap<QString, HexProfileEntry> HexProfiler::merged(const QHash<const char *, HexProfileEntry> &aEntries)
+{
+    // Same name may come from different string literals
+    QMap<QString, HexProfileEntry> aResult;
+
+    for (QHash<const char *, HexProfileEntry>::const_iterator it=aEntries.constBegin(); it!=aEntries.constEnd(); ++it)
+    {
+        QMap<QString, HexProfileEntry>::iterator aTarget=aResult.find(QString::fromLatin1(it.key()));
+
+        if (aTarget==aResult.end())
+        {
+            aResult.insert(QString::fromLatin1(it.key()), it.value());
+        }
+        else
+        {
+            aTarget.value().calls+=it.value().calls;
+            aTarget.value().nanoseconds+=it.value().nanoseconds;
+            aTarget.value().maxNanoseconds=qMax(aTarget.value().maxNanoseconds, it.value().maxNanoseconds);
+            aTarget.value().value+=it.value().value;
+        }
+    }
+
+    return aResult;
+}
+
+QMap<QString, HexProfileEntry> HexProfiler::lastFrame() const
+{
+    QMutexLocker aLocker(&mMutex);
+    return merged(mLastFrame);
+}
+
+QMap<QString, HexProfileEntry> HexProfiler::totals() const
+{
+    QMutexLocker aLocker(&mMutex);
+    return merged(mTotals);
+}
+
+qint64 HexProfiler::framesCount() const
+{
+    QMutexLocker aLocker(&mMutex);
+    return mFramesCount;
+}
+
+qint64 HexProfiler::lastFrameTime() const
+{
+    QMutexLocker aLocker(&mMutex);
+    return mLastFrameTime;
+}
+
+QStringList HexProfiler::overlayLines() const
+{
+    QMap<QString, HexProfileEntry> aFrame=lastFrame();
+    QMap<QString, HexProfileEntry> aTotals=totals();
+    QStringList aLines;
+
+    aLines.append(QString("Frame: %1 ms").arg(lastFrameTime()/1000000.0, 0, 'f', 2));
+
+    for (QMap<QString, HexProfileEntry>::const_iterator it=aFrame.constBegin(); it!=aFrame.constEnd(); ++it)
+    {
+        const HexProfileEntry &aEntry=it.value();
+
+        if (aEntry.calls>0)
+        {
+            aLines.append(QString("%1: %2 x %3 ms").arg(it.key()).arg(aEntry.calls).arg(aEntry.nanoseconds/1000000.0, 0, 'f', 3));
+        }
+        else
+        if (!it.key().endsWith(".hit") && !it.key().endsWith(".miss"))
+        {
+            aLines.append(QString("%1: %2").arg(it.key()).arg(aEntry.value));
+        }
+    }
+
+    // Hit rates are more useful over whole session than over single frame
+    for (QMap<QString, HexProfileEntry>::const_iterator it=aTotals.constBegin(); it!=aTotals.constEnd(); ++it)
+    {
+        if (it.key().endsWith(".hit"))
+        {
+            QString aName=it.key().left(it.key().length()-4);
+            qint64 aHits=it.value().value;
+            qint64 aMisses=aTotals.value(aName+".miss").value;
+
+            if (aHits+aMisses>0)
+            {
+                aLines.append(QString("%1: %2% hits").arg(aName).arg(aHits*100.0/(aHits+aMisses), 0, 'f', 1));
+            }
+        }
+    }
+
+    return aLines;
+}
+
+#endif // HEXEDITOR_PROFILING
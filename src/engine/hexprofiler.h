@@ -0,0 +1,95 @@
+#ifndef HEXPROFILER_H
+#define HEXPROFILER_H
+
+/*
+ * Scoped timers and counters for hot paths. Profiler is built only with
+ * qmake CONFIG+=profiling, otherwise all macros expand to nothing.
+ *
+ * Frame is everything that happened between two paint events. Counters
+ * named "xxx.hit" and "xxx.miss" are reported as hit rate of "xxx".
+ */
+#ifdef HEXEDITOR_PROFILING
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QHash>
+#include <QMap>
+#include <QStringList>
+
+struct HexProfileEntry
+{
+    qint64 calls;
+    qint64 nanoseconds;
+    qint64 maxNanoseconds;
+    qint64 value;          // Sum of counted values
+};
+
+class HexProfiler
+{
+public:
+    static HexProfiler* instance();
+
+    void addTime(const char *aName, qint64 aNanoseconds);
+    void count(const char *aName, qint64 aValue);
+    void endFrame();
+    void reset();
+
+    QMap<QString, HexProfileEntry> lastFrame() const;
+    QMap<QString, HexProfileEntry> totals() const;
+    qint64 framesCount() const;
+    qint64 lastFrameTime() const;
+
+    QStringList overlayLines() const;
+
+private:
+    HexProfiler();
+
+    mutable QMutex                          mMutex;
+    QHash<const char *, HexProfileEntry>    mCurrentFrame;
+    QHash<const char *, HexProfileEntry>    mLastFrame;
+    QHash<const char *, HexProfileEntry>    mTotals;
+    QElapsedTimer                           mFrameTimer;
+    qint64                                  mLastFrameTime;
+    qint64                                  mFramesCount;
+
+    static void add(QHash<const char *, HexProfileEntry> &aEntries, const char *aName, qint64 aCalls, qint64 aNanoseconds, qint64 aValue);
+    static QMap<QString, HexProfileEntry> merged(const QHash<const char *, HexProfileEntry> &aEntries);
+
+    Q_DISABLE_COPY(HexProfiler)
+};
+
+class HexProfileScope
+{
+public:
+    explicit HexProfileScope(const char *aName)
+    {
+        mName=aName;
+        mTimer.start();
+    }
+
+    ~HexProfileScope()
+    {
+        HexProfiler::instance()->addTime(mName, mTimer.nsecsElapsed());
+    }
+
+private:
+    const char    *mName;
+    QElapsedTimer  mTimer;
+};
+
+#define HEX_PROFILE_CONCAT_IMPL(aFirst, aSecond) aFirst##aSecond
+#define HEX_PROFILE_CONCAT(aFirst, aSecond)      HEX_PROFILE_CONCAT_IMPL(aFirst, aSecond)
+
+#define HEX_PROFILE_SCOPE(aName)         HexProfileScope HEX_PROFILE_CONCAT(hexProfileScope, __LINE__)(aName)
+#define HEX_PROFILE_COUNT(aName, aValue) HexProfiler::instance()->count(aName, aValue)
+#define HEX_PROFILE_FRAME()              HexProfiler::instance()->endFrame()
+
+#else
+
+#define HEX_PROFILE_SCOPE(aName)
+#define HEX_PROFILE_COUNT(aName, aValue)
+#define HEX_PROFILE_FRAME()
+
+#endif // HEXEDITOR_PROFILING
+
+#endif // HEXPROFILER_H
@@ -0,0 +1,701 @@
+#include "hexrecords.h"
+
+#include <QFileInfo>
+
+#if QT_VERSION >= 0x050100
+#include <QSaveFile>
+#endif
+
+#include "sparsefile.h"
+#include "hexprofiler.h"
+
+#include <string.h>
+
+#define DEFAULT_RECORD_BYTES  16
+#define MAX_RECORD_BYTES      250  // S3 records have 4 address bytes and a checksum in 255
+#define DETECT_LINES          8    // Lines looked at by isRecordFile()
+
+static const char hexDigits[]="0123456789ABCDEF";
+
+static void appendHex(QByteArray &aOutput, quint8 aByte)
+{
+    aOutput.append(hexDigits[aByte>>4]);
+    aOutput.append(hexDigits[aByte & 15]);
+}
+
+// Hex digits after the record mark, QByteArray::fromHex() would skip wrong characters
+static bool decodeRecord(const QByteArray &aHex, QByteArray &aBytes)
+{
+    if (aHex.isEmpty() || aHex.size()%2!=0)
+    {
+        return false;
+    }
+
+    for (int i=0; i<aHex.size(); ++i)
+    {
+        char aChar=aHex.at(i);
+
+        if (
+            (aChar<'0' || aChar>'9')
+            &&
+            (aChar<'A' || aChar>'F')
+            &&
+            (aChar<'a' || aChar>'f')
+           )
+        {
+            return false;
+        }
+    }
+
+    aBytes=QByteArray::fromHex(aHex);
+
+    return true;
+}
+
+static quint8 byteSum(const QByteArray &aBytes, int aCount)
+{
+    quint8 aSum=0;
+
+    for (int i=0; i<aCount; ++i)
+    {
+        aSum+=(quint8)aBytes.at(i);
+    }
+
+    return aSum;
+}
+
+static qint64 bigEndian(const QByteArray &aBytes, int aPos, int aCount)
+{
+    qint64 aValue=0;
+
+    for (int i=0; i<aCount; ++i)
+    {
+        aValue=(aValue<<8) | (quint8)aBytes.at(aPos+i);
+    }
+
+    return aValue;
+}
+
+// *********************************************************************************
+//                                 HexRecordWriter
+// *********************************************************************************
+
+HexRecordWriter::HexRecordWriter(Format aFormat, int aRecordBytes, int aAddressBytes)
+{
+    mFormat=aFormat;
+    mRecordBytes=qBound(1, aRecordBytes, MAX_RECORD_BYTES);
+    mAddressBytes=qBound(2, aAddressBytes, 4);
+    mUpperAddress=0;
+}
+
+QByteArray HexRecordWriter::header() const
+{
+    return mFormat==SREC ? record("S0", QByteArray::fromHex("030000"), false) : QByteArray();
+}
+
+QByteArray HexRecordWriter::data(qint64 aPos, const QByteArray &aData)
+{
+    QByteArray aOutput;
+    int i=0;
+
+    while (i<aData.size())
+    {
+        qint64 aAddress=aPos+i;
+        int aLength=qMin(mRecordBytes, aData.size()-i);
+        QByteArray aBytes;
+
+        if (mFormat==INTEL_HEX)
+        {
+            // Upper 16 bits of addresses are set by extended linear address records
+            if ((aAddress>>16)!=mUpperAddress)
+            {
+                mUpperAddress=aAddress>>16;
+
+                QByteArray aExtended=QByteArray::fromHex("02000004");
+                aExtended.append((char)(mUpperAddress>>8));
+                aExtended.append((char)mUpperAddress);
+
+                aOutput.append(record(":", aExtended, true));
+            }
+
+            // Records don't cross 64 KB segments
+            aLength=(int)qMin((qint64)aLength, 0x10000-(aAddress & 0xFFFF));
+
+            aBytes.append((char)aLength);
+            aBytes.append((char)(aAddress>>8));
+            aBytes.append((char)aAddress);
+            aBytes.append((char)0);
+            aBytes.append(aData.constData()+i, aLength);
+
+            aOutput.append(record(":", aBytes, true));
+        }
+        else
+        {
+            static const char *sPrefixes[]={"S1", "S2", "S3"};
+
+            aBytes.append((char)(aLength+mAddressBytes+1));
+
+            for (int j=mAddressBytes-1; j>=0; --j)
+            {
+                aBytes.append((char)(aAddress>>(j*8)));
+            }
+
+            aBytes.append(aData.constData()+i, aLength);
+
+            aOutput.append(record(sPrefixes[mAddressBytes-2], aBytes, false));
+        }
+
+        i+=aLength;
+    }
+
+    return aOutput;
+}
+
+QByteArray HexRecordWriter::footer() const
+{
+    if (mFormat==INTEL_HEX)
+    {
+        return record(":", QByteArray::fromHex("00000001"), true);
+    }
+
+    // Termination record matches data records: S9 for S1, S8 for S2, S7 for S3
+    static const char *sPrefixes[]={"S9", "S8", "S7"};
+
+    QByteArray aBytes(mAddressBytes+1, 0);
+    aBytes[0]=(char)(mAddressBytes+1);
+
+    return record(sPrefixes[mAddressBytes-2], aBytes, false);
+}
+
+QByteArray HexRecordWriter::record(const char *aPrefix, const QByteArray &aBytes, bool aIntel)
+{
+    // Intel HEX takes two's complement of the sum, S-record takes one's complement
+    QByteArray aRecord(aPrefix);
+    quint8 aSum=byteSum(aBytes, aBytes.size());
+
+    for (int i=0; i<aBytes.size(); ++i)
+    {
+        appendHex(aRecord, (quint8)aBytes.at(i));
+    }
+
+    appendHex(aRecord, aIntel ? (quint8)(0x100-aSum) : (quint8)~aSum);
+    aRecord.append('\n');
+
+    return aRecord;
+}
+
+// *********************************************************************************
+//                                RecordDataSource
+// *********************************************************************************
+
+RecordDataSource::RecordDataSource(const QString &aFileName)
+{
+    mFileName=aFileName;
+    mWritable=false;
+    mModified=false;
+    mFormat=HexRecordWriter::INTEL_HEX;
+    mRecordBytes=DEFAULT_RECORD_BYTES;
+    mAddressBytes=2;
+}
+
+QString RecordDataSource::name() const
+{
+    return mFileName;
+}
+
+bool RecordDataSource::open(bool aWritable)
+{
+    HEX_PROFILE_SCOPE("io.records.parse");
+
+    close();
+
+    if (aWritable && !QFileInfo(mFileName).isWritable())
+    {
+        mError="File is read-only";
+        return false;
+    }
+
+    QFile aFile(mFileName);
+
+    if (!aFile.open(QIODevice::ReadOnly))
+    {
+        mError=aFile.errorString();
+        return false;
+    }
+
+    // Line by line, the text of the file is never in memory at once
+    qint64 aUpperAddress=0;
+    bool aEnd=false;
+    int aLineNumber=0;
+
+    mRecordBytes=0;
+
+    while (!aEnd && !aFile.atEnd())
+    {
+        QByteArray aLine=aFile.readLine().trimmed();
+        QString aError;
+
+        ++aLineNumber;
+
+        if (aLine.isEmpty())
+        {
+            continue;
+        }
+
+        if (!parseLine(aLine, aUpperAddress, aEnd, aError))
+        {
+            mError=QString("Line %1: %2").arg(aLineNumber).arg(aError);
+            close();
+
+            return false;
+        }
+    }
+
+    if (aFile.error()!=QFile::NoError)
+    {
+        mError=aFile.errorString();
+        close();
+
+        return false;
+    }
+
+    if (mRecordBytes==0)
+    {
+        mRecordBytes=DEFAULT_RECORD_BYTES;
+    }
+
+    mWritable=aWritable;
+
+    return true;
+}
+
+void RecordDataSource::close()
+{
+    mWritable=false;
+    mModified=false;
+    mHeader.clear();
+    mFooter.clear();
+    mSegments.clear();
+    mAddressBytes=2;
+}
+
+qint64 RecordDataSource::size() const
+{
+    if (mSegments.isEmpty())
+    {
+        return 0;
+    }
+
+    QMap<qint64, QByteArray>::const_iterator aLast=mSegments.constEnd()-1;
+
+    return aLast.key()+aLast.value().size();
+}
+
+bool RecordDataSource::isWritable() const
+{
+    return mWritable;
+}
+
+QVector<HexRange> RecordDataSource::unreadableRanges() const
+{
+    QVector<HexRange> aGaps;
+    qint64 aPos=0;
+
+    for (QMap<qint64, QByteArray>::const_iterator i=mSegments.constBegin(); i!=mSegments.constEnd(); ++i)
+    {
+        if (i.key()>aPos)
+        {
+            HexRange aGap;
+            aGap.pos=aPos;
+            aGap.length=i.key()-aPos;
+            aGaps.append(aGap);
+        }
+
+        aPos=i.key()+i.value().size();
+    }
+
+    return aGaps;
+}
+
+bool RecordDataSource::read(qint64 aPos, char *aBuffer, qint64 aLength)
+{
+    HEX_PROFILE_SCOPE("io.source.read");
+
+    memset(aBuffer, 0, aLength);
+
+    // Segment that can start before aPos, then all that start inside the range
+    QMap<qint64, QByteArray>::const_iterator i=mSegments.upperBound(aPos);
+
+    if (i!=mSegments.constBegin())
+    {
+        --i;
+    }
+
+    for (; i!=mSegments.constEnd() && i.key()<aPos+aLength; ++i)
+    {
+        qint64 aStart=qMax(aPos, i.key());
+        qint64 aEnd=qMin(aPos+aLength, i.key()+i.value().size());
+
+        if (aStart<aEnd)
+        {
+            memcpy(aBuffer+aStart-aPos, i.value().constData()+aStart-i.key(), aEnd-aStart);
+        }
+    }
+
+    return true;
+}
+
+bool RecordDataSource::write(qint64 aPos, const char *aData, qint64 aLength)
+{
+    if (!mWritable)
+    {
+        mError="File is opened read-only";
+        return false;
+    }
+
+    // File is written once, by flush()
+    store(aPos, aData, aLength);
+    mModified=true;
+
+    return true;
+}
+
+bool RecordDataSource::flush()
+{
+    HEX_PROFILE_SCOPE("io.records.write");
+
+    if (!mModified)
+    {
+        return true;
+    }
+
+#if QT_VERSION >= 0x050100
+    // Old file is replaced only by a complete and synced new one
+    QSaveFile aFile(mFileName);
+
+    if (!aFile.open(QIODevice::WriteOnly))
+    {
+        mError="Can't create file "+mFileName;
+        return false;
+    }
+
+    if (!writeRecords(aFile) || !aFile.commit())
+    {
+        mError=aFile.errorString();
+        aFile.cancelWriting();
+
+        return false;
+    }
+#else
+    QString aTempName=SparseFile::unusedName(mFileName+".tmp");
+    QFile aFile(aTempName);
+
+    if (!aFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        mError="Can't create file "+aTempName;
+        return false;
+    }
+
+    if (!writeRecords(aFile) || !aFile.flush())
+    {
+        mError=aFile.errorString();
+        aFile.close();
+        aFile.remove();
+
+        return false;
+    }
+
+    SparseFile::sync(aFile);
+    aFile.close();
+
+    if (!SparseFile::replace(aTempName, mFileName, &mError))
+    {
+        QFile::remove(aTempName);
+        return false;
+    }
+#endif
+
+    mModified=false;
+
+    return true;
+}
+
+qint64 RecordDataSource::start() const
+{
+    return mSegments.isEmpty() ? 0 : mSegments.constBegin().key();
+}
+
+bool RecordDataSource::isRecordFile(const QString &aFileName)
+{
+    QFile aFile(aFileName);
+
+    if (!aFile.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+
+    // First record decides, binary files fail on the first line
+    for (int i=0; i<DETECT_LINES && !aFile.atEnd(); ++i)
+    {
+        QByteArray aLine=aFile.readLine(MAX_RECORD_BYTES*2+16).trimmed();
+        QByteArray aBytes;
+
+        if (aLine.isEmpty())
+        {
+            continue;
+        }
+
+        if (aLine.startsWith(':'))
+        {
+            return decodeRecord(aLine.mid(1), aBytes) && aBytes.size()>=5 && byteSum(aBytes, aBytes.size())==0;
+        }
+
+        if (aLine.size()>2 && aLine.at(0)=='S' && aLine.at(1)>='0' && aLine.at(1)<='9')
+        {
+            return decodeRecord(aLine.mid(2), aBytes) && aBytes.size()>=3 && (quint8)~byteSum(aBytes, aBytes.size()-1)==(quint8)aBytes.at(aBytes.size()-1);
+        }
+
+        return false;
+    }
+
+    return false;
+}
+
+bool RecordDataSource::parseLine(const QByteArray &aLine, qint64 &aUpperAddress, bool &aEnd, QString &aError)
+{
+    QByteArray aBytes;
+    bool aIntel=aLine.startsWith(':');
+    bool aFirst=mSegments.isEmpty() && mHeader.isEmpty() && mFooter.isEmpty();
+
+    if (!aIntel && (aLine.size()<2 || aLine.at(0)!='S'))
+    {
+        aError="Not a record";
+        return false;
+    }
+
+    if (aFirst)
+    {
+        mFormat=aIntel ? HexRecordWriter::INTEL_HEX : HexRecordWriter::SREC;
+    }
+    else
+    if (aIntel!=(mFormat==HexRecordWriter::INTEL_HEX))
+    {
+        aError="Intel HEX and S-records are mixed";
+        return false;
+    }
+
+    if (!decodeRecord(aLine.mid(aIntel ? 1 : 2), aBytes))
+    {
+        aError="Wrong hex digits";
+        return false;
+    }
+
+    if (aIntel)
+    {
+        // Length, address, type, data, checksum
+        if (aBytes.size()<5 || (quint8)aBytes.at(0)+5!=aBytes.size())
+        {
+            aError="Wrong record length";
+            return false;
+        }
+
+        if (byteSum(aBytes, aBytes.size())!=0)
+        {
+            aError="Wrong checksum";
+            return false;
+        }
+
+        int aLength=(quint8)aBytes.at(0);
+        qint64 aAddress=bigEndian(aBytes, 1, 2);
+
+        switch (aBytes.at(3))
+        {
+            case 0x00: // Data
+            {
+                store(aUpperAddress+aAddress, aBytes.constData()+4, aLength);
+                mRecordBytes=qMax(mRecordBytes, aLength);
+            }
+            break;
+            case 0x01: // End of file
+            {
+                aEnd=true;
+            }
+            break;
+            case 0x02: // Extended segment address
+            case 0x04: // Extended linear address
+            {
+                if (aLength!=2)
+                {
+                    aError="Wrong address record";
+                    return false;
+                }
+
+                aUpperAddress=bigEndian(aBytes, 4, 2)<<(aBytes.at(3)==0x02 ? 4 : 16);
+            }
+            break;
+            case 0x03: // Start segment address
+            case 0x05: // Start linear address
+            {
+                mFooter.append(aLine+"\n");
+            }
+            break;
+            default:
+            {
+                aError="Unknown record type";
+                return false;
+            }
+            break;
+        }
+
+        return true;
+    }
+
+    // Count, address, data, checksum
+    if (aBytes.size()<3 || (quint8)aBytes.at(0)+1!=aBytes.size())
+    {
+        aError="Wrong record length";
+        return false;
+    }
+
+    if ((quint8)~byteSum(aBytes, aBytes.size()-1)!=(quint8)aBytes.at(aBytes.size()-1))
+    {
+        aError="Wrong checksum";
+        return false;
+    }
+
+    switch (aLine.at(1))
+    {
+        case '0': // Header
+        {
+            mHeader.append(aLine+"\n");
+        }
+        break;
+        case '1':
+        case '2':
+        case '3':
+        {
+            int aAddressBytes=aLine.at(1)-'0'+1;
+            int aLength=aBytes.size()-aAddressBytes-2;
+
+            if (aLength<0)
+            {
+                aError="Wrong record length";
+                return false;
+            }
+
+            store(bigEndian(aBytes, 1, aAddressBytes), aBytes.constData()+1+aAddressBytes, aLength);
+            mRecordBytes=qMax(mRecordBytes, aLength);
+            mAddressBytes=qMax(mAddressBytes, aAddressBytes);
+        }
+        break;
+        case '5':
+        case '6':
+        {
+            // Record counts are optional, they are left out when the file is written
+        }
+        break;
+        case '7':
+        case '8':
+        case '9':
+        {
+            mFooter.append(aLine+"\n");
+            aEnd=true;
+        }
+        break;
+        default:
+        {
+            aError="Unknown record type";
+            return false;
+        }
+        break;
+    }
+
+    return true;
+}
+
+bool RecordDataSource::writeRecords(QIODevice &aFile) const
+{
+    HexRecordWriter aWriter(mFormat, mRecordBytes, mAddressBytes);
+    bool aSuccess=aFile.write(mHeader)==mHeader.size();
+
+    for (QMap<qint64, QByteArray>::const_iterator i=mSegments.constBegin(); aSuccess && i!=mSegments.constEnd(); ++i)
+    {
+        QByteArray aRecords=aWriter.data(i.key(), i.value());
+        aSuccess=aFile.write(aRecords)==aRecords.size();
+    }
+
+    // Start address of S-records is in the termination record itself
+    QByteArray aFooter=mFooter;
+
+    if (mFormat==HexRecordWriter::INTEL_HEX || aFooter.isEmpty())
+    {
+        aFooter.append(aWriter.footer());
+    }
+
+    return aSuccess && aFile.write(aFooter)==aFooter.size();
+}
+
+void RecordDataSource::store(qint64 aPos, const char *aData, qint64 aLength)
+{
+    if (aLength<=0)
+    {
+        return;
+    }
+
+    qint64 aEnd=aPos+aLength;
+
+    // First segment that overlaps or touches the range
+    QMap<qint64, QByteArray>::iterator aFirst=mSegments.lowerBound(aPos);
+
+    if (aFirst!=mSegments.begin())
+    {
+        QMap<qint64, QByteArray>::iterator aPrevious=aFirst-1;
+
+        if (aPrevious.key()+aPrevious.value().size()>=aPos)
+        {
+            aFirst=aPrevious;
+        }
+    }
+
+    // Records usually follow each other, so most of them only extend one segment
+    if (aFirst!=mSegments.end() && aFirst.key()<=aPos)
+    {
+        QMap<qint64, QByteArray>::iterator aNext=aFirst+1;
+
+        if (aNext==mSegments.end() || aNext.key()>aEnd)
+        {
+            QByteArray &aSegment=aFirst.value();
+            qint64 aOffset=aPos-aFirst.key();
+
+            if (aOffset+aLength>aSegment.size())
+            {
+                aSegment.resize((int)(aOffset+aLength));
+            }
+
+            memcpy(aSegment.data()+aOffset, aData, aLength);
+            return;
+        }
+    }
+
+    // Range joins several segments into one
+    qint64 aStart=aPos;
+    qint64 aMergedEnd=aEnd;
+    QMap<qint64, QByteArray>::iterator aLast=aFirst;
+
+    for (; aLast!=mSegments.end() && aLast.key()<=aEnd; ++aLast)
+    {
+        aStart=qMin(aStart, aLast.key());
+        aMergedEnd=qMax(aMergedEnd, aLast.key()+aLast.value().size());
+    }
+
+    QByteArray aMerged((int)(aMergedEnd-aStart), 0);
+
+    while (aFirst!=aLast)
+    {
+        memcpy(aMerged.data()+aFirst.key()-aStart, aFirst.value().constData(), aFirst.value().size());
+        aFirst=mSegments.erase(aFirst);
+    }
+
+    memcpy(aMerged.data()+aPos-aStart, aData, aLength);
+    mSegments.insert(aStart, aMerged);
+}
@@ -0,0 +1,87 @@
+#ifndef HEXRECORDS_H
+#define HEXRECORDS_H
+
+#include <QMap>
+#include <QByteArray>
+
+#include "hexdatasource.h"
+
+/*
+ * Makes lines of Intel HEX and Motorola S-record files. Data records
+ * don't cross 64 KB segments, Intel HEX gets an extended linear address
+ * record whenever the upper 16 bits of the address change.
+ */
+class HexRecordWriter
+{
+public:
+    enum Format
+    {
+        INTEL_HEX,
+        SREC
+    };
+
+    explicit HexRecordWriter(Format aFormat, int aRecordBytes=16, int aAddressBytes=4); // aAddressBytes of S1, S2 or S3 records
+
+    QByteArray header() const; // S0 record
+    QByteArray data(qint64 aPos, const QByteArray &aData);
+    QByteArray footer() const; // End of file or termination record
+
+    static QByteArray record(const char *aPrefix, const QByteArray &aBytes, bool aIntel); // Checksum is added
+
+private:
+    Format mFormat;
+    int    mRecordBytes;
+    int    mAddressBytes;
+    qint64 mUpperAddress; // Of the last extended address record
+};
+
+// *********************************************************************************
+
+/*
+ * Intel HEX or S-record file opened as a data source. The file is parsed
+ * line by line and only bytes of data records are kept, as segments at
+ * their load addresses. Gaps between segments take no memory, they are
+ * reported as unreadable and read as zeros. Addresses start at 0, so the
+ * lowest one is given by start().
+ *
+ * Writes change the segments, writes into a gap make it data. flush()
+ * writes the whole file again in the same format, header and start
+ * address records are kept as they were. The old file is replaced only
+ * after the new one is completely written and synced.
+ */
+class RecordDataSource : public HexDataSource
+{
+public:
+    explicit RecordDataSource(const QString &aFileName);
+
+    QString name() const;
+    bool    open(bool aWritable);
+    void    close();
+    qint64  size() const;
+    bool    isWritable() const;
+    QVector<HexRange> unreadableRanges() const;
+    bool    read(qint64 aPos, char *aBuffer, qint64 aLength);
+    bool    write(qint64 aPos, const char *aData, qint64 aLength);
+    bool    flush();
+
+    qint64 start() const; // Lowest address with data
+
+    static bool isRecordFile(const QString &aFileName); // By the first line
+
+private:
+    QString                  mFileName;
+    bool                     mWritable;
+    bool                     mModified;
+    HexRecordWriter::Format  mFormat;
+    int                      mRecordBytes;  // Of the longest data record
+    int                      mAddressBytes; // Of S-record data records
+    QByteArray               mHeader;       // Records before data ones that are written back as they were
+    QByteArray               mFooter;
+    QMap<qint64, QByteArray> mSegments;     // Contiguous data by start address, they never touch
+
+    bool writeRecords(QIODevice &aFile) const;
+    bool parseLine(const QByteArray &aLine, qint64 &aUpperAddress, bool &aEnd, QString &aError);
+    void store(qint64 aPos, const char *aData, qint64 aLength);
+};
+
+#endif // HEXRECORDS_H
@@ -0,0 +1,390 @@
+#include "hexsearch.h"
+
+#include "hexprofiler.h"
+
+#include <QtConcurrentRun>
+#include <QFuture>
+#include <QThread>
+
+#include <string.h>
+
+#define MIN_CHUNK_SIZE   (1 << 20)
+#define COMPARE_BLOCK    4096
+
+HexPattern::HexPattern()
+{
+}
+
+HexPattern::HexPattern(const QByteArray &aBytes)
+{
+    mBytes=aBytes;
+    mMask=QByteArray(aBytes.length(), (char)0xFF);
+}
+
+bool HexPattern::fromString(const QString &aText, HexPattern &aPattern)
+{
+    QString aDigits=aText;
+    aDigits.remove(' ');
+
+    if (aDigits.isEmpty() || (aDigits.length() & 1))
+    {
+        return false;
+    }
+
+    aPattern.mBytes.resize(aDigits.length()>>1);
+    aPattern.mMask.resize(aDigits.length()>>1);
+
+    for (int i=0; i<aDigits.length(); ++i)
+    {
+        QChar aChar=aDigits.at(i);
+        int aValue;
+        int aMask;
+
+        if (aChar=='?')
+        {
+            aValue=0;
+            aMask=0;
+        }
+        else
+        {
+            bool ok;
+            aValue=QString(aChar).toInt(&ok, 16);
+            aMask=0xF;
+
+            if (!ok)
+            {
+                return false;
+            }
+        }
+
+        int aShift=(i & 1) ? 0 : 4;
+
+        if ((i & 1)==0)
+        {
+            aPattern.mBytes[i>>1]=0;
+            aPattern.mMask[i>>1]=0;
+        }
+
+        aPattern.mBytes[i>>1]=aPattern.mBytes.at(i>>1) | (aValue << aShift);
+        aPattern.mMask[i>>1]=aPattern.mMask.at(i>>1)   | (aMask << aShift);
+    }
+
+    return true;
+}
+
+int HexPattern::length() const
+{
+    return mBytes.length();
+}
+
+bool HexPattern::isEmpty() const
+{
+    return mBytes.isEmpty();
+}
+
+bool HexPattern::isMasked() const
+{
+    for (int i=0; i<mMask.length(); ++i)
+    {
+        if ((quint8)mMask.at(i)!=0xFF)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool HexPattern::matches(const uchar *aData) const
+{
+    const uchar *aBytes=(const uchar *)mBytes.constData();
+    const uchar *aMask=(const uchar *)mMask.constData();
+
+    for (int i=0; i<mBytes.length(); ++i)
+    {
+        if ((aData[i] & aMask[i])!=aBytes[i])
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool HexPattern::matchesZeros() const
+{
+    for (int i=0; i<mBytes.length(); ++i)
+    {
+        if (mBytes.at(i)!=0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int HexPattern::anchor() const
+{
+    for (int i=0; i<mMask.length(); ++i)
+    {
+        if ((quint8)mMask.at(i)==0xFF)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// *********************************************************************************
+//                                      HexSearch
+// *********************************************************************************
+
+qint64 HexSearch::indexOf(const uchar *aData, qint64 aSize, const HexPattern &aPattern, qint64 aFrom, qint64 aTo)
+{
+    qint64 aLength=aPattern.length();
+
+    if (aFrom<0)
+    {
+        aFrom=0;
+    }
+
+    if (aTo<0 || aTo>aSize-aLength+1)
+    {
+        aTo=aSize-aLength+1; // Last start position + 1
+    }
+
+    if (aLength==0 || aFrom>=aTo)
+    {
+        return -1;
+    }
+
+    int aAnchor=aPattern.anchor();
+
+    if (aAnchor<0)
+    {
+        for (qint64 i=aFrom; i<aTo; ++i)
+        {
+            if (aPattern.matches(aData+i))
+            {
+                return i;
+            }
+        }
+
+        return -1;
+    }
+
+    uchar aAnchorByte=aPattern.mBytes.at(aAnchor);
+    qint64 aPos=aFrom;
+
+    while (aPos<aTo)
+    {
+        const uchar *aFound=(const uchar *)memchr(aData+aPos+aAnchor, aAnchorByte, aTo-aPos);
+
+        if (!aFound)
+        {
+            break;
+        }
+
+        aPos=aFound-aData-aAnchor;
+
+        if (aPattern.matches(aData+aPos))
+        {
+            return aPos;
+        }
+
+        ++aPos;
+    }
+
+    return -1;
+}
+
+qint64 HexSearch::lastIndexOf(const uchar *aData, qint64 aSize, const HexPattern &aPattern, qint64 aFrom, qint64 aTo)
+{
+    HEX_PROFILE_SCOPE("search.lastIndexOf");
+
+    qint64 aLength=aPattern.length();
+
+    if (aLength==0 || aLength>aSize)
+    {
+        return -1;
+    }
+
+    if (aFrom<0 || aFrom>aSize-aLength)
+    {
+        aFrom=aSize-aLength;
+    }
+
+    int aAnchor=aPattern.anchor();
+    uchar aAnchorByte=aAnchor>=0 ? (uchar)aPattern.mBytes.at(aAnchor) : 0;
+
+    for (qint64 i=aFrom; i>=qMax(aTo, (qint64)0); --i)
+    {
+        if ((aAnchor<0 || aData[i+aAnchor]==aAnchorByte) && aPattern.matches(aData+i))
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+int HexSearch::threadsCount(qint64 aSize, int aThreads)
+{
+    if (aThreads<=0)
+    {
+        aThreads=QThread::idealThreadCount();
+    }
+
+    qint64 aMaxThreads=aSize/MIN_CHUNK_SIZE+1;
+
+    if (aThreads>aMaxThreads)
+    {
+        aThreads=aMaxThreads;
+    }
+
+    return aThreads<1 ? 1 : aThreads;
+}
+
+QVector<qint64> HexSearch::findInChunk(const uchar *aData, qint64 aSize, HexPattern aPattern, qint64 aStart, qint64 aEnd)
+{
+    QVector<qint64> aResults;
+    qint64 aPos=aStart;
+
+    while ((aPos=indexOf(aData, aSize, aPattern, aPos, aEnd))>=0)
+    {
+        aResults.append(aPos);
+        ++aPos;
+    }
+
+    return aResults;
+}
+
+QVector<qint64> HexSearch::findAll(const uchar *aData, qint64 aSize, const HexPattern &aPattern, int aThreads)
+{
+    HEX_PROFILE_SCOPE("search.findAll");
+    HEX_PROFILE_COUNT("search.bytes", aSize);
+
+    aThreads=threadsCount(aSize, aThreads);
+
+    if (aThreads==1)
+    {
+        return findInChunk(aData, aSize, aPattern, 0, aSize);
+    }
+
+    // Every chunk owns the matches that start inside it, so nothing is found twice
+    QList< QFuture< QVector<qint64> > > aFutures;
+    qint64 aChunkSize=aSize/aThreads+1;
+
+    for (qint64 aStart=0; aStart<aSize; aStart+=aChunkSize)
+    {
+        aFutures.append(QtConcurrent::run(&HexSearch::findInChunk, aData, aSize, aPattern, aStart, qMin(aStart+aChunkSize, aSize)));
+    }
+
+    QVector<qint64> aResults;
+
+    for (int i=0; i<aFutures.size(); ++i)
+    {
+        aResults+=aFutures[i].result();
+    }
+
+    return aResults;
+}
+
+// ------------------------------------------------------------------
+
+QVector<HexRange> HexSearch::compareChunk(const uchar *aFirst, const uchar *aSecond, qint64 aStart, qint64 aEnd)
+{
+    QVector<HexRange> aResults;
+    qint64 aPos=aStart;
+
+    while (aPos<aEnd)
+    {
+        qint64 aBlock=qMin((qint64)COMPARE_BLOCK, aEnd-aPos);
+
+        if (memcmp(aFirst+aPos, aSecond+aPos, aBlock)==0)
+        {
+            aPos+=aBlock;
+            continue;
+        }
+
+        qint64 aBlockEnd=aPos+aBlock;
+
+        for (; aPos<aBlockEnd; ++aPos)
+        {
+            if (aFirst[aPos]!=aSecond[aPos])
+            {
+                if (!aResults.isEmpty() && aResults.last().pos+aResults.last().length==aPos)
+                {
+                    ++aResults.last().length;
+                }
+                else
+                {
+                    HexRange aRange;
+                    aRange.pos=aPos;
+                    aRange.length=1;
+
+                    aResults.append(aRange);
+                }
+            }
+        }
+    }
+
+    return aResults;
+}
+
+QVector<HexRange> HexSearch::compare(const uchar *aFirst, qint64 aFirstSize, const uchar *aSecond, qint64 aSecondSize, int aThreads)
+{
+    HEX_PROFILE_SCOPE("search.compare");
+
+    qint64 aCommonSize=qMin(aFirstSize, aSecondSize);
+    aThreads=threadsCount(aCommonSize, aThreads);
+
+    QList< QFuture< QVector<HexRange> > > aFutures;
+    qint64 aChunkSize=aCommonSize/aThreads+1;
+
+    for (qint64 aStart=0; aStart<aCommonSize; aStart+=aChunkSize)
+    {
+        aFutures.append(QtConcurrent::run(&HexSearch::compareChunk, aFirst, aSecond, aStart, qMin(aStart+aChunkSize, aCommonSize)));
+    }
+
+    QVector<HexRange> aResults;
+
+    for (int i=0; i<aFutures.size(); ++i)
+    {
+        QVector<HexRange> aChunkResults=aFutures[i].result();
+
+        for (int j=0; j<aChunkResults.size(); ++j)
+        {
+            const HexRange &aRange=aChunkResults.at(j);
+
+            if (!aResults.isEmpty() && aResults.last().pos+aResults.last().length==aRange.pos)
+            {
+                aResults.last().length+=aRange.length;
+            }
+            else
+            {
+                aResults.append(aRange);
+            }
+        }
+    }
+
+    if (aFirstSize!=aSecondSize)
+    {
+        HexRange aTail;
+        aTail.pos=aCommonSize;
+        aTail.length=qMax(aFirstSize, aSecondSize)-aCommonSize;
+
+        if (!aResults.isEmpty() && aResults.last().pos+aResults.last().length==aTail.pos)
+        {
+            aResults.last().length+=aTail.length;
+        }
+        else
+        {
+            aResults.append(aTail);
+        }
+    }
+
+    return aResults;
+}
@@ -0,0 +1,51 @@
+#ifndef HEXSEARCH_H
+#define HEXSEARCH_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+class HexPattern
+{
+public:
+    QByteArray mBytes;
+    QByteArray mMask;  // Bit set to 1 must match
+
+    HexPattern();
+    HexPattern(const QByteArray &aBytes);
+
+    static bool fromString(const QString &aText, HexPattern &aPattern); // "DE AD ?? E?"
+
+    int  length() const;
+    bool isEmpty() const;
+    bool isMasked() const;
+    bool matches(const uchar *aData) const;
+    bool matchesZeros() const;
+    int  anchor() const; // Index of the first fully defined byte or -1
+};
+
+// *********************************************************************************
+
+struct HexRange
+{
+    qint64 pos;
+    qint64 length;
+};
+
+class HexSearch
+{
+public:
+    static qint64 indexOf(const uchar *aData, qint64 aSize, const HexPattern &aPattern, qint64 aFrom=0, qint64 aTo=-1);
+    static qint64 lastIndexOf(const uchar *aData, qint64 aSize, const HexPattern &aPattern, qint64 aFrom=-1, qint64 aTo=0); // Searches back from aFrom down to aTo
+    static QVector<qint64> findAll(const uchar *aData, qint64 aSize, const HexPattern &aPattern, int aThreads=0);
+
+    static QVector<HexRange> compare(const uchar *aFirst, qint64 aFirstSize, const uchar *aSecond, qint64 aSecondSize, int aThreads=0);
+
+    static int threadsCount(qint64 aSize, int aThreads);
+
+private:
+    static QVector<qint64> findInChunk(const uchar *aData, qint64 aSize, HexPattern aPattern, qint64 aStart, qint64 aEnd);
+    static QVector<HexRange> compareChunk(const uchar *aFirst, const uchar *aSecond, qint64 aStart, qint64 aEnd);
+};
+
+#endif // HEXSEARCH_H
@@ -0,0 +1,455 @@
+#include "hexselection.h"
+
+#include <QtAlgorithms>
+
+qint64 HexSpan::end() const
+{
+    return pos+(count-1)*stride+length;
+}
+
+// First repetition of aSpan that ends after aPos
+static qint64 firstRepetition(const HexSpan &aSpan, qint64 aPos)
+{
+    if (aSpan.count==1 || aPos<aSpan.pos+aSpan.length)
+    {
+        return 0;
+    }
+
+    return (aPos-aSpan.pos-aSpan.length)/aSpan.stride+1;
+}
+
+static qint64 floorDiv(qint64 aValue, qint64 aDivisor)
+{
+    qint64 aResult=aValue/aDivisor;
+
+    return aValue%aDivisor!=0 && aValue<0 ? aResult-1 : aResult;
+}
+
+// Some repetition of aSpan has bytes in [aStart, aEnd)
+static bool spanIntersects(const HexSpan &aSpan, qint64 aStart, qint64 aEnd)
+{
+    if (aSpan.end()<=aStart || aSpan.pos>=aEnd)
+    {
+        return false;
+    }
+
+    return aSpan.pos+firstRepetition(aSpan, aStart)*aSpan.stride<aEnd;
+}
+
+static bool spansIntersect(const HexSpan &aFirst, const HexSpan &aSecond)
+{
+    if (aFirst.pos>=aSecond.end() || aSecond.pos>=aFirst.end())
+    {
+        return false;
+    }
+
+    if (aFirst.stride==aSecond.stride)
+    {
+        // Repetition i of aFirst can meet only repetitions i+k of aSecond with a few values of k
+        qint64 aStride=aFirst.stride;
+        qint64 aDistance=aSecond.pos-aFirst.pos;
+
+        for (qint64 k=floorDiv(-aDistance-aSecond.length, aStride); k<=floorDiv(aFirst.length-aDistance, aStride); ++k)
+        {
+            qint64 aOffset=aDistance+k*aStride;
+
+            if (
+                aOffset<aFirst.length
+                &&
+                aOffset+aSecond.length>0
+                &&
+                qMax((qint64)0, -k)<qMin(aFirst.count, aSecond.count-k)
+               )
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Repetitions of the shorter span are checked one by one
+    const HexSpan &aFew=aFirst.count<=aSecond.count ? aFirst : aSecond;
+    const HexSpan &aMany=aFirst.count<=aSecond.count ? aSecond : aFirst;
+
+    for (qint64 i=firstRepetition(aFew, aMany.pos); i<aFew.count; ++i)
+    {
+        qint64 aStart=aFew.pos+i*aFew.stride;
+
+        if (aStart>=aMany.end())
+        {
+            break;
+        }
+
+        if (spanIntersects(aMany, aStart, aStart+aFew.length))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Plain ranges that overlap or touch, or columns of the same rows that do
+static bool joinSpans(const HexSpan &aFirst, const HexSpan &aSecond, HexSpan &aJoined)
+{
+    if (aFirst.count!=aSecond.count || (aFirst.count>1 && aFirst.stride!=aSecond.stride))
+    {
+        return false;
+    }
+
+    qint64 aStart=qMin(aFirst.pos, aSecond.pos);
+    qint64 aEnd=qMax(aFirst.pos+aFirst.length, aSecond.pos+aSecond.length);
+
+    if (qMax(aFirst.pos, aSecond.pos)>qMin(aFirst.pos+aFirst.length, aSecond.pos+aSecond.length))
+    {
+        return false;
+    }
+
+    aJoined.pos=aStart;
+    aJoined.length=aEnd-aStart;
+    aJoined.stride=aFirst.count==1 ? aJoined.length : aFirst.stride;
+    aJoined.count=aFirst.count;
+
+    // Rows that touch each other are one range
+    if (aJoined.count>1 && aJoined.length>=aJoined.stride)
+    {
+        aJoined.length=(aJoined.count-1)*aJoined.stride+aJoined.length;
+        aJoined.stride=aJoined.length;
+        aJoined.count=1;
+    }
+
+    return true;
+}
+
+static void appendRanges(QVector<HexRange> &aRanges, const HexSpan &aSpan)
+{
+    for (qint64 i=0; i<aSpan.count; ++i)
+    {
+        HexRange aRange;
+        aRange.pos=aSpan.pos+i*aSpan.stride;
+        aRange.length=aSpan.length;
+
+        aRanges.append(aRange);
+    }
+}
+
+static bool rangeLessThan(const HexRange &aFirst, const HexRange &aSecond)
+{
+    return aFirst.pos<aSecond.pos;
+}
+
+HexSelection::HexSelection()
+{
+}
+
+bool HexSelection::operator==(const HexSelection &aOther) const
+{
+    if (mSpans.size()!=aOther.mSpans.size())
+    {
+        return false;
+    }
+
+    for (int i=0; i<mSpans.size(); ++i)
+    {
+        const HexSpan &aSpan=mSpans.at(i);
+        const HexSpan &aOtherSpan=aOther.mSpans.at(i);
+
+        if (
+            aSpan.pos!=aOtherSpan.pos
+            ||
+            aSpan.length!=aOtherSpan.length
+            ||
+            aSpan.stride!=aOtherSpan.stride
+            ||
+            aSpan.count!=aOtherSpan.count
+           )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool HexSelection::operator!=(const HexSelection &aOther) const
+{
+    return !(*this==aOther);
+}
+
+bool HexSelection::isEmpty() const
+{
+    return mSpans.isEmpty();
+}
+
+bool HexSelection::isSingleRange() const
+{
+    return mSpans.size()==1 && mSpans.first().count==1;
+}
+
+void HexSelection::clear()
+{
+    mSpans.clear();
+    mEnds.clear();
+}
+
+void HexSelection::add(qint64 aPos, qint64 aLength)
+{
+    if (aLength<=0)
+    {
+        return;
+    }
+
+    HexSpan aSpan;
+    aSpan.pos=aPos;
+    aSpan.length=aLength;
+    aSpan.stride=aLength;
+    aSpan.count=1;
+
+    insertSpan(aSpan);
+}
+
+void HexSelection::addBlock(qint64 aPos, qint64 aLength, qint64 aStride, qint64 aCount)
+{
+    if (aLength<=0 || aCount<=0)
+    {
+        return;
+    }
+
+    // Rows that touch each other are one range
+    if (aCount==1 || aStride<=aLength)
+    {
+        add(aPos, (aCount-1)*aStride+aLength);
+        return;
+    }
+
+    HexSpan aSpan;
+    aSpan.pos=aPos;
+    aSpan.length=aLength;
+    aSpan.stride=aStride;
+    aSpan.count=aCount;
+
+    insertSpan(aSpan);
+}
+
+qint64 HexSelection::start() const
+{
+    return mSpans.isEmpty() ? 0 : mSpans.first().pos;
+}
+
+qint64 HexSelection::end() const
+{
+    return mEnds.isEmpty() ? 0 : mEnds.last();
+}
+
+bool HexSelection::contains(qint64 aPos) const
+{
+    for (int i=firstSpan(aPos); i<mSpans.size() && mSpans.at(i).pos<=aPos; ++i)
+    {
+        const HexSpan &aSpan=mSpans.at(i);
+
+        if (aPos<aSpan.end() && (aPos-aSpan.pos)%aSpan.stride<aSpan.length)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool HexSelection::intersects(qint64 aStart, qint64 aEnd) const
+{
+    for (int i=firstSpan(aStart); i<mSpans.size() && mSpans.at(i).pos<aEnd; ++i)
+    {
+        if (spanIntersects(mSpans.at(i), aStart, aEnd))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+QVector<HexRange> HexSelection::ranges(qint64 aStart, qint64 aEnd) const
+{
+    QVector<HexRange> aRanges;
+    bool aSorted=true;
+
+    for (int i=firstSpan(aStart); i<mSpans.size() && mSpans.at(i).pos<aEnd; ++i)
+    {
+        const HexSpan &aSpan=mSpans.at(i);
+
+        if (aSpan.end()<=aStart)
+        {
+            continue;
+        }
+
+        for (qint64 j=firstRepetition(aSpan, aStart); j<aSpan.count; ++j)
+        {
+            qint64 aRangeStart=aSpan.pos+j*aSpan.stride;
+
+            if (aRangeStart>=aEnd)
+            {
+                break;
+            }
+
+            HexRange aRange;
+            aRange.pos=qMax(aRangeStart, aStart);
+            aRange.length=qMin(aRangeStart+aSpan.length, aEnd)-aRange.pos;
+
+            // Interleaved blocks give ranges out of order
+            if (!aRanges.isEmpty() && aRanges.last().pos>aRange.pos)
+            {
+                aSorted=false;
+            }
+
+            aRanges.append(aRange);
+        }
+    }
+
+    if (!aSorted)
+    {
+        qSort(aRanges.begin(), aRanges.end(), rangeLessThan);
+    }
+
+    return aRanges;
+}
+
+int HexSelection::firstSpan(qint64 aPos) const
+{
+    // Running maximum of ends is sorted even when spans interleave
+    int aLow=0;
+    int aHigh=mEnds.size();
+
+    while (aLow<aHigh)
+    {
+        int aMiddle=(aLow+aHigh)/2;
+
+        if (mEnds.at(aMiddle)>aPos)
+        {
+            aHigh=aMiddle;
+        }
+        else
+        {
+            aLow=aMiddle+1;
+        }
+    }
+
+    return aLow;
+}
+
+void HexSelection::insertSpan(const HexSpan &aSpan)
+{
+    int aFirst=firstSpan(aSpan.pos-1);
+
+    // Joined span can reach more spans, so it is inserted again
+    for (int i=aFirst; i<mSpans.size() && mSpans.at(i).pos<=aSpan.end(); ++i)
+    {
+        HexSpan aJoined;
+
+        if (joinSpans(mSpans.at(i), aSpan, aJoined))
+        {
+            mSpans.remove(i);
+            updateEnds();
+            insertSpan(aJoined);
+
+            return;
+        }
+    }
+
+    // Only spans that share bytes with the new one are cut, blocks that interleave with it stay
+    QVector<HexRange> aRanges;
+    QVector<HexSpan>  aKept;
+
+    for (int i=0; i<mSpans.size(); ++i)
+    {
+        const HexSpan &aOther=mSpans.at(i);
+
+        if (i>=aFirst && aOther.pos<aSpan.end() && spansIntersect(aOther, aSpan))
+        {
+            appendRanges(aRanges, aOther);
+        }
+        else
+        {
+            aKept.append(aOther);
+        }
+    }
+
+    if (aRanges.isEmpty())
+    {
+        int aIndex=aFirst;
+
+        while (aIndex<mSpans.size() && mSpans.at(aIndex).pos<aSpan.pos)
+        {
+            ++aIndex;
+        }
+
+        mSpans.insert(aIndex, aSpan);
+        updateEnds();
+
+        return;
+    }
+
+    appendRanges(aRanges, aSpan);
+    qSort(aRanges.begin(), aRanges.end(), rangeLessThan);
+
+    // Merged ranges go between kept spans by position, plain ones that touch become one
+    mSpans.clear();
+
+    int aKeptIndex=0;
+    int aRangeIndex=0;
+
+    while (aKeptIndex<aKept.size() || aRangeIndex<aRanges.size())
+    {
+        HexSpan aNext;
+
+        if (aRangeIndex>=aRanges.size() || (aKeptIndex<aKept.size() && aKept.at(aKeptIndex).pos<aRanges.at(aRangeIndex).pos))
+        {
+            aNext=aKept.at(aKeptIndex++);
+        }
+        else
+        {
+            const HexRange &aRange=aRanges.at(aRangeIndex++);
+
+            aNext.pos=aRange.pos;
+            aNext.length=aRange.length;
+            aNext.stride=aRange.length;
+            aNext.count=1;
+        }
+
+        if (
+            aNext.count==1
+            &&
+            !mSpans.isEmpty()
+            &&
+            mSpans.last().count==1
+            &&
+            mSpans.last().end()>=aNext.pos
+           )
+        {
+            HexSpan &aLast=mSpans.last();
+
+            aLast.length=qMax(aLast.end(), aNext.end())-aLast.pos;
+            aLast.stride=aLast.length;
+
+            continue;
+        }
+
+        mSpans.append(aNext);
+    }
+
+    updateEnds();
+}
+
+void HexSelection::updateEnds()
+{
+    mEnds.resize(mSpans.size());
+
+    qint64 aEnd=0;
+
+    for (int i=0; i<mSpans.size(); ++i)
+    {
+        aEnd=qMax(aEnd, mSpans.at(i).end());
+        mEnds[i]=aEnd;
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef HEXSELECTION_H
+#define HEXSELECTION_H
+
+#include <QVector>
+
+#include "hexsearch.h"
+
+// Range repeated count times, every stride bytes
+struct HexSpan
+{
+    qint64 pos;
+    qint64 length;
+    qint64 stride;
+    qint64 count;
+
+    qint64 end() const; // Of the last repetition
+};
+
+/*
+ * Set of selected ranges. A column of a block is kept as one span, so
+ * selecting a few columns of every row costs the same for any number of
+ * rows. Spans are sorted by position and never share bytes, but blocks
+ * can interleave, like two columns of the same rows. A new span widens a
+ * block of the same rows that it overlaps or touches, else only spans
+ * that share bytes with it are cut into plain ranges and merged. Queries
+ * find the first span that can reach a position with binary search over
+ * the running maximum of ends and check every span from there.
+ */
+class HexSelection
+{
+public:
+    HexSelection();
+
+    bool operator==(const HexSelection &aOther) const;
+    bool operator!=(const HexSelection &aOther) const;
+
+    bool isEmpty() const;
+    bool isSingleRange() const;
+    void clear();
+
+    void add(qint64 aPos, qint64 aLength);
+    void addBlock(qint64 aPos, qint64 aLength, qint64 aStride, qint64 aCount); // Same range in aCount rows
+
+    qint64 start() const;
+    qint64 end() const;
+
+    bool contains(qint64 aPos) const;
+    bool intersects(qint64 aStart, qint64 aEnd) const;
+    QVector<HexRange> ranges(qint64 aStart, qint64 aEnd) const; // Parts inside [aStart, aEnd), sorted
+
+private:
+    QVector<HexSpan> mSpans;
+    QVector<qint64>  mEnds; // Largest end of spans up to every one
+
+    int firstSpan(qint64 aPos) const; // First one that can end after aPos
+    void insertSpan(const HexSpan &aSpan);
+    void updateEnds();
+};
+
+#endif // HEXSELECTION_H
@@ -0,0 +1,250 @@
+#include "hextransform.h"
+
+#include "hexsearch.h"
+#include "hexprofiler.h"
+
+#include <QtConcurrentRun>
+#include <QFuture>
+#include <QDateTime>
+#include <QtEndian>
+
+#include <string.h>
+
+#define KEY_BLOCK_SIZE   4096
+#define CHUNK_ALIGNMENT  64
+
+static quint64 splitMix64(quint64 aValue)
+{
+    aValue+=Q_UINT64_C(0x9E3779B97F4A7C15);
+    aValue=(aValue ^ (aValue >> 30))*Q_UINT64_C(0xBF58476D1CE4E5B9);
+    aValue=(aValue ^ (aValue >> 27))*Q_UINT64_C(0x94D049BB133111EB);
+
+    return aValue ^ (aValue >> 31);
+}
+
+template <typename T>
+static void swapElements(uchar *aData, qint64 aLength, qint64 aPhase)
+{
+    qint64 aSkip=(sizeof(T)-aPhase % sizeof(T)) % sizeof(T);
+
+    for (qint64 i=aSkip; i+(qint64)sizeof(T)<=aLength; i+=sizeof(T))
+    {
+        T aValue;
+        memcpy(&aValue, aData+i, sizeof(T));
+        aValue=qbswap(aValue);
+        memcpy(aData+i, &aValue, sizeof(T));
+    }
+}
+
+HexTransform::HexTransform(Operation aOperation, const QByteArray &aKey, int aAmount)
+{
+    mOperation=aOperation;
+    mKey=aKey;
+    mAmount=aAmount & 7;
+    mSeed=aOperation==TRANSFORM_RANDOM ? (quint64)QDateTime::currentMSecsSinceEpoch() ^ ((quint64)qrand() << 32) : 0;
+}
+
+HexTransform::Operation HexTransform::operation() const
+{
+    return mOperation;
+}
+
+QByteArray HexTransform::key() const
+{
+    return mKey;
+}
+
+int HexTransform::amount() const
+{
+    return mAmount;
+}
+
+quint64 HexTransform::seed() const
+{
+    return mSeed;
+}
+
+void HexTransform::setSeed(quint64 aSeed)
+{
+    mSeed=aSeed;
+}
+
+bool HexTransform::isValid() const
+{
+    switch (mOperation)
+    {
+        case TRANSFORM_FILL:
+        case TRANSFORM_XOR:
+        case TRANSFORM_ADD:
+        case TRANSFORM_SUB:
+            return !mKey.isEmpty();
+        default:
+            return true;
+    }
+}
+
+bool HexTransform::isInvertible() const
+{
+    return mOperation!=TRANSFORM_FILL && mOperation!=TRANSFORM_RANDOM;
+}
+
+HexTransform HexTransform::inverse() const
+{
+    HexTransform aInverse=*this;
+
+    switch (mOperation)
+    {
+        case TRANSFORM_ADD: aInverse.mOperation=TRANSFORM_SUB; break;
+        case TRANSFORM_SUB: aInverse.mOperation=TRANSFORM_ADD; break;
+        case TRANSFORM_ROL: aInverse.mOperation=TRANSFORM_ROR; break;
+        case TRANSFORM_ROR: aInverse.mOperation=TRANSFORM_ROL; break;
+        default:            break; // XOR and swaps are inverse to themselves
+    }
+
+    return aInverse;
+}
+
+void HexTransform::apply(uchar *aData, qint64 aLength, qint64 aPhase, int aThreads) const
+{
+    if (aLength<=0 || !isValid())
+    {
+        return;
+    }
+
+    HEX_PROFILE_SCOPE("transform");
+
+    aThreads=HexSearch::threadsCount(aLength, aThreads);
+
+    if (aThreads==1)
+    {
+        applyChunk(*this, aData, aLength, aPhase);
+        return;
+    }
+
+    // Aligned chunks never split an element being swapped
+    QList< QFuture<void> > aFutures;
+    qint64 aChunkSize=(aLength/aThreads+CHUNK_ALIGNMENT) & ~(qint64)(CHUNK_ALIGNMENT-1);
+
+    for (qint64 aStart=0; aStart<aLength; aStart+=aChunkSize)
+    {
+        aFutures.append(QtConcurrent::run(&HexTransform::applyChunk, *this, aData+aStart, qMin(aChunkSize, aLength-aStart), aPhase+aStart));
+    }
+
+    for (int i=0; i<aFutures.size(); ++i)
+    {
+        aFutures[i].waitForFinished();
+    }
+}
+
+void HexTransform::applyChunk(HexTransform aTransform, uchar *aData, qint64 aLength, qint64 aPhase)
+{
+    switch (aTransform.mOperation)
+    {
+        case TRANSFORM_FILL:
+        case TRANSFORM_XOR:
+        case TRANSFORM_ADD:
+        case TRANSFORM_SUB:
+        {
+            // Key is expanded to a block, so inner loops run over plain arrays and get vectorized
+            int aKeyLength=aTransform.mKey.length();
+            int aBlockSize=aKeyLength*qMax(1, KEY_BLOCK_SIZE/aKeyLength);
+
+            QByteArray aBlockArray(aBlockSize, 0);
+
+            for (int i=0; i<aBlockSize; ++i)
+            {
+                aBlockArray[i]=aTransform.mKey.at((aPhase+i) % aKeyLength);
+            }
+
+            const uchar *aBlock=(const uchar *)aBlockArray.constData();
+
+            for (qint64 aPos=0; aPos<aLength; aPos+=aBlockSize)
+            {
+                uchar *aTarget=aData+aPos;
+                int    aCount=qMin((qint64)aBlockSize, aLength-aPos);
+
+                switch (aTransform.mOperation)
+                {
+                    case TRANSFORM_FILL:
+                    {
+                        memcpy(aTarget, aBlock, aCount);
+                    }
+                    break;
+                    case TRANSFORM_XOR:
+                    {
+                        for (int i=0; i<aCount; ++i)
+                        {
+                            aTarget[i]^=aBlock[i];
+                        }
+                    }
+                    break;
+                    case TRANSFORM_ADD:
+                    {
+                        for (int i=0; i<aCount; ++i)
+                        {
+                            aTarget[i]+=aBlock[i];
+                        }
+                    }
+                    break;
+                    default:
+                    {
+                        for (int i=0; i<aCount; ++i)
+                        {
+                            aTarget[i]-=aBlock[i];
+                        }
+                    }
+                    break;
+                }
+            }
+        }
+        break;
+        case TRANSFORM_ROL:
+        case TRANSFORM_ROR:
+        {
+            int aLeft=aTransform.mOperation==TRANSFORM_ROL ? aTransform.mAmount : (8-aTransform.mAmount) & 7;
+
+            if (aLeft==0)
+            {
+                break;
+            }
+
+            for (qint64 i=0; i<aLength; ++i)
+            {
+                aData[i]=(uchar)((aData[i] << aLeft) | (aData[i] >> (8-aLeft)));
+            }
+        }
+        break;
+        case TRANSFORM_SWAP16:
+        {
+            swapElements<quint16>(aData, aLength, aPhase);
+        }
+        break;
+        case TRANSFORM_SWAP32:
+        {
+            swapElements<quint32>(aData, aLength, aPhase);
+        }
+        break;
+        case TRANSFORM_SWAP64:
+        {
+            swapElements<quint64>(aData, aLength, aPhase);
+        }
+        break;
+        case TRANSFORM_RANDOM:
+        {
+            // Every 8 bytes come from their offset, so result doesn't depend on chunks
+            qint64 i=0;
+
+            while (i<aLength)
+            {
+                qint64  aOffset=aPhase+i;
+                quint64 aWord=splitMix64(aTransform.mSeed+aOffset/8);
+
+                for (int j=aOffset % 8; j<8 && i<aLength; ++j, ++i)
+                {
+                    aData[i]=(uchar)(aWord >> (j*8));
+                }
+            }
+        }
+        break;
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef HEXTRANSFORM_H
+#define HEXTRANSFORM_H
+
+#include <QByteArray>
+
+/*
+ * Bulk operation over a range. Key is repeated from the start of the
+ * range, so the same transform can be applied to any part of the range
+ * if its offset from the range start is given as aPhase.
+ */
+class HexTransform
+{
+public:
+    enum Operation
+    {
+        TRANSFORM_FILL,
+        TRANSFORM_XOR,
+        TRANSFORM_ADD,
+        TRANSFORM_SUB,
+        TRANSFORM_ROL,
+        TRANSFORM_ROR,
+        TRANSFORM_SWAP16,
+        TRANSFORM_SWAP32,
+        TRANSFORM_SWAP64,
+        TRANSFORM_RANDOM
+    };
+
+    HexTransform(Operation aOperation, const QByteArray &aKey=QByteArray(), int aAmount=0);
+
+    Operation  operation() const;
+    QByteArray key() const;
+    int        amount() const;
+    quint64    seed() const;
+    void       setSeed(quint64 aSeed); // RANDOM replayed from a journal
+
+    bool isValid() const;
+    bool isInvertible() const;
+    HexTransform inverse() const;
+
+    void apply(uchar *aData, qint64 aLength, qint64 aPhase=0, int aThreads=0) const;
+
+private:
+    Operation  mOperation;
+    QByteArray mKey;    // FILL, XOR, ADD, SUB
+    int        mAmount; // Bits for ROL and ROR
+    quint64    mSeed;   // RANDOM, so that redo produces the same bytes
+
+    static void applyChunk(HexTransform aTransform, uchar *aData, qint64 aLength, qint64 aPhase);
+};
+
+#endif // HEXTRANSFORM_H
@@ -0,0 +1,211 @@
+#include "hexviewmode.h"
+
+#include <QVector>
+#include <QtEndian>
+
+#include <string.h>
+
+HexViewMode::HexViewMode(Type aType)
+{
+    mType=aType;
+    mMirrored=false;
+
+    switch (mType)
+    {
+        case BINARY:    mGroupSize=1; mCellWidth=8; break;
+        case OCTAL:     mGroupSize=1; mCellWidth=3; break;
+        case DECIMAL:   mGroupSize=1; mCellWidth=3; break;
+        case WORD16LE:  mGroupSize=2; mCellWidth=2; mMirrored=true; break;
+        case WORD16BE:  mGroupSize=2; mCellWidth=2; break;
+        case WORD32LE:  mGroupSize=4; mCellWidth=2; mMirrored=true; break;
+        case WORD32BE:  mGroupSize=4; mCellWidth=2; break;
+        case WORD64LE:  mGroupSize=8; mCellWidth=2; mMirrored=true; break;
+        case WORD64BE:  mGroupSize=8; mCellWidth=2; break;
+        case FLOAT32LE: mGroupSize=4; mCellWidth=4; mMirrored=true; break; // 'g' with 9 digits takes up to 15 chars
+        case FLOAT32BE: mGroupSize=4; mCellWidth=4; break;
+        case FLOAT64LE: mGroupSize=8; mCellWidth=3; mMirrored=true; break; // 'g' with 17 digits takes up to 24 chars
+        case FLOAT64BE: mGroupSize=8; mCellWidth=3; break;
+        default:        mType=HEX; mGroupSize=1; mCellWidth=2; break;
+    }
+}
+
+QString HexViewMode::name(Type aType)
+{
+    switch (aType)
+    {
+        case HEX:       return "Hex";
+        case BINARY:    return "Binary";
+        case OCTAL:     return "Octal";
+        case DECIMAL:   return "Decimal";
+        case WORD16LE:  return "16-bit words (LE)";
+        case WORD16BE:  return "16-bit words (BE)";
+        case WORD32LE:  return "32-bit words (LE)";
+        case WORD32BE:  return "32-bit words (BE)";
+        case WORD64LE:  return "64-bit words (LE)";
+        case WORD64BE:  return "64-bit words (BE)";
+        case FLOAT32LE: return "float (LE)";
+        case FLOAT32BE: return "float (BE)";
+        case FLOAT64LE: return "double (LE)";
+        case FLOAT64BE: return "double (BE)";
+        default:        break;
+    }
+
+    return QString();
+}
+
+HexViewMode::Type HexViewMode::type() const
+{
+    return mType;
+}
+
+int HexViewMode::groupSize() const
+{
+    return mGroupSize;
+}
+
+int HexViewMode::cellWidth() const
+{
+    return mCellWidth;
+}
+
+bool HexViewMode::isMirrored() const
+{
+    return mMirrored;
+}
+
+bool HexViewMode::isHexDigits() const
+{
+    return mCellWidth==2;
+}
+
+int HexViewMode::width() const
+{
+    // Groups are separated by one space
+    return 16*mCellWidth+16/mGroupSize-1;
+}
+
+int HexViewMode::byteColumn(int aCol) const
+{
+    int aGroup=aCol/mGroupSize;
+    int aSlot=aCol%mGroupSize;
+
+    if (mMirrored)
+    {
+        aSlot=mGroupSize-1-aSlot;
+    }
+
+    return aGroup*(mGroupSize*mCellWidth+1)+aSlot*mCellWidth;
+}
+
+int HexViewMode::byteAt(int aColumn, int *aCharIndex) const
+{
+    int aGroupWidth=mGroupSize*mCellWidth+1;
+
+    if (aColumn<0)
+    {
+        aColumn=0;
+    }
+    else
+    if (aColumn>=width())
+    {
+        aColumn=width()-1;
+    }
+
+    int aGroup=aColumn/aGroupWidth;
+    int aInner=aColumn%aGroupWidth;
+    int aSlot=aInner/mCellWidth;
+
+    // Separator belongs to the last char of the group
+    if (aSlot>=mGroupSize)
+    {
+        aSlot=mGroupSize-1;
+        aInner=aGroupWidth-2;
+    }
+
+    if (aCharIndex)
+    {
+        *aCharIndex=aInner-aSlot*mCellWidth;
+    }
+
+    return aGroup*mGroupSize+(mMirrored ? mGroupSize-1-aSlot : aSlot);
+}
+
+// ------------------------------------------------------------------
+
+static const QVector<QString>& byteTable(HexViewMode::Type aType)
+{
+    static QVector<QString> tables[HexViewMode::TYPES_COUNT];
+
+    QVector<QString> &aTable=tables[aType];
+
+    if (aTable.isEmpty())
+    {
+        aTable.resize(256);
+
+        for (int i=0; i<256; ++i)
+        {
+            switch (aType)
+            {
+                case HexViewMode::BINARY:  aTable[i]=QString::number(i, 2).rightJustified(8, '0'); break;
+                case HexViewMode::OCTAL:   aTable[i]=QString::number(i, 8).rightJustified(3, '0'); break;
+                case HexViewMode::DECIMAL: aTable[i]=QString::number(i).rightJustified(3, ' ');    break;
+                default:                   aTable[i]=QString::number(i, 16).toUpper().rightJustified(2, '0'); break;
+            }
+        }
+    }
+
+    return aTable;
+}
+
+void HexViewMode::format(const uchar *aData, int aCount, QString *aCells) const
+{
+    if (mType!=FLOAT32LE && mType!=FLOAT32BE && mType!=FLOAT64LE && mType!=FLOAT64BE)
+    {
+        // Words are bytes in another order, so every byte keeps its own digits
+        const QVector<QString> &aTable=byteTable(mType==BINARY || mType==OCTAL || mType==DECIMAL ? mType : HEX);
+
+        for (int i=0; i<aCount; ++i)
+        {
+            aCells[i]=aTable.at(aData[i]);
+        }
+
+        return;
+    }
+
+    int aGroupWidth=mGroupSize*mCellWidth;
+
+    for (int i=0; i<aCount; i+=mGroupSize)
+    {
+        QString aText;
+
+        if (i+mGroupSize<=aCount)
+        {
+            bool aBigEndian=!mMirrored;
+
+            if (mGroupSize==4)
+            {
+                quint32 aBits=aBigEndian ? qFromBigEndian<quint32>(aData+i) : qFromLittleEndian<quint32>(aData+i);
+                float aValue;
+                memcpy(&aValue, &aBits, sizeof(aValue));
+
+                aText=QString::number(aValue, 'g', 9);
+            }
+            else
+            {
+                quint64 aBits=aBigEndian ? qFromBigEndian<quint64>(aData+i) : qFromLittleEndian<quint64>(aData+i);
+                double aValue;
+                memcpy(&aValue, &aBits, sizeof(aValue));
+
+                aText=QString::number(aValue, 'g', 17);
+            }
+        }
+
+        aText=aText.rightJustified(aGroupWidth, ' ', true);
+
+        for (int j=i; j<i+mGroupSize && j<aCount; ++j)
+        {
+            int aSlot=mMirrored ? mGroupSize-1-(j-i) : j-i;
+            aCells[j]=aText.mid(aSlot*mCellWidth, mCellWidth);
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef HEXVIEWMODE_H
+#define HEXVIEWMODE_H
+
+#include <QString>
+
+/*
+ * How bytes are shown in the number pane. Bytes are grouped by 1, 2, 4 or
+ * 8 and every byte of a group gets a cell of the same width, so the column
+ * of a byte and the byte under a column are found with a division. Groups
+ * of little endian words are mirrored, their first byte is the last cell.
+ * Bytes are formatted from 256-entry tables built once per mode, only
+ * floats are formatted per group.
+ */
+class HexViewMode
+{
+public:
+    enum Type
+    {
+        HEX,
+        BINARY,
+        OCTAL,
+        DECIMAL,
+        WORD16LE,
+        WORD16BE,
+        WORD32LE,
+        WORD32BE,
+        WORD64LE,
+        WORD64BE,
+        FLOAT32LE,
+        FLOAT32BE,
+        FLOAT64LE,
+        FLOAT64BE,
+        TYPES_COUNT
+    };
+
+    HexViewMode(Type aType=HEX);
+
+    static QString name(Type aType);
+
+    Type type() const;
+    int  groupSize() const;  // Bytes
+    int  cellWidth() const;  // Chars of one byte
+    bool isMirrored() const;
+    bool isHexDigits() const; // Every byte is two hex digits that can be typed
+
+    int width() const;                 // Chars of a row of 16 bytes
+    int byteColumn(int aCol) const;    // First char of byte aCol of a row
+    int byteAt(int aColumn, int *aCharIndex=0) const; // Byte of a row under char aColumn
+
+    // Cells of aCount bytes that start a row, bytes of incomplete groups at the end get blank cells if they can't be shown alone
+    void format(const uchar *aData, int aCount, QString *aCells) const;
+
+protected:
+    Type mType;
+    int  mGroupSize;
+    int  mCellWidth;
+    bool mMirrored;
+};
+
+#endif // HEXVIEWMODE_H
@@ -0,0 +1,94 @@
+#include "mappedfile.h"
+
+#include "hexprofiler.h"
+
+MappedFile::MappedFile(const QString &aFileName) :
+    mFile(aFileName)
+{
+    mData=0;
+    mSize=0;
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(QIODevice::OpenMode aMode)
+{
+    HEX_PROFILE_SCOPE("io.map");
+
+    close();
+
+    if (!mFile.open(aMode))
+    {
+        mError=mFile.errorString();
+        return false;
+    }
+
+    mSize=mFile.size();
+
+    if (mSize>0)
+    {
+        mData=mFile.map(0, mSize);
+
+        if (!mData)
+        {
+            mError=mFile.errorString();
+            mFile.close();
+            mSize=0;
+
+            return false;
+        }
+    }
+
+    mError.clear();
+
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (mData)
+    {
+        mFile.unmap(mData);
+        mData=0;
+    }
+
+    if (mFile.isOpen())
+    {
+        mFile.close();
+    }
+
+    mSize=0;
+}
+
+QString MappedFile::fileName() const
+{
+    return mFile.fileName();
+}
+
+QString MappedFile::errorString() const
+{
+    return mError;
+}
+
+qint64 MappedFile::size() const
+{
+    return mSize;
+}
+
+bool MappedFile::isOpen() const
+{
+    return mFile.isOpen();
+}
+
+const uchar* MappedFile::data() const
+{
+    return mData;
+}
+
+uchar* MappedFile::writableData()
+{
+    return (mFile.openMode() & QIODevice::WriteOnly) ? mData : 0;
+}
@@ -0,0 +1,32 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <QFile>
+
+class MappedFile
+{
+public:
+    explicit MappedFile(const QString &aFileName);
+    ~MappedFile();
+
+    bool open(QIODevice::OpenMode aMode=QIODevice::ReadOnly);
+    void close();
+
+    QString fileName() const;
+    QString errorString() const;
+    qint64 size() const;
+    bool isOpen() const;
+
+    const uchar* data() const;
+    uchar* writableData();
+
+private:
+    QFile   mFile;
+    uchar  *mData;
+    qint64  mSize;
+    QString mError;
+
+    Q_DISABLE_COPY(MappedFile)
+};
+
+#endif // MAPPEDFILE_H
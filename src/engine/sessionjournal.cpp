@@ -0,0 +1,551 @@
+#include "sessionjournal.h"
+
+#include "hexdocument.h"
+#include "hexprofiler.h"
+
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QMutexLocker>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#endif
+
+#define JOURNAL_MAGIC        "HEXJ"
+#define JOURNAL_VERSION      3
+#define FRAME_HEADER_SIZE    6    // Size and checksum of a record
+#define FINGERPRINT_SAMPLES  16
+#define FINGERPRINT_BLOCK    4096
+
+static void setError(QString *aError, const QString &aText)
+{
+    if (aError)
+    {
+        *aError=aText;
+    }
+}
+
+static bool syncFile(QFile &aFile)
+{
+    if (!aFile.flush())
+    {
+        return false;
+    }
+
+#if defined(Q_OS_UNIX)
+    return ::fsync(aFile.handle())==0;
+#elif defined(Q_OS_WIN)
+    return ::_commit(aFile.handle())==0;
+#else
+    return true;
+#endif
+}
+
+JournalRecord::JournalRecord(Type aType) :
+    transform(HexTransform::TRANSFORM_FILL)
+{
+    type=aType;
+    start=0;
+    end=0;
+    cursor=0;
+    scroll=0;
+}
+
+// *********************************************************************************
+//                                  JournalWriter
+// *********************************************************************************
+
+JournalWriter::JournalWriter(const QString &aFileName, QObject *parent) :
+    QThread(parent),
+    mFile(aFileName)
+{
+    mViewPos=-1;
+    mViewSize=0;
+    mStopped=false;
+    mFailed=false;
+}
+
+JournalWriter::~JournalWriter()
+{
+    stop();
+    wait();
+}
+
+bool JournalWriter::open(QString *aError)
+{
+    if (!mFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        setError(aError, "Can't create journal "+mFile.fileName());
+        return false;
+    }
+
+    return true;
+}
+
+void JournalWriter::append(const QByteArray &aData)
+{
+    QMutexLocker aLocker(&mMutex);
+
+    mQueue.append(aData);
+    mQueued.wakeOne();
+}
+
+void JournalWriter::setView(const QByteArray &aData)
+{
+    QMutexLocker aLocker(&mMutex);
+
+    mView=aData;
+    mQueued.wakeOne();
+}
+
+void JournalWriter::stop()
+{
+    QMutexLocker aLocker(&mMutex);
+
+    mStopped=true;
+    mQueued.wakeOne();
+}
+
+void JournalWriter::run()
+{
+    bool aStopped=false;
+
+    while (!aStopped)
+    {
+        QByteArray aBatch;
+        QByteArray aView;
+
+        {
+            QMutexLocker aLocker(&mMutex);
+
+            while (mQueue.isEmpty() && mView.isEmpty() && !mStopped)
+            {
+                mQueued.wait(&mMutex);
+            }
+
+            // Everything queued during the previous sync goes in one batch
+            aBatch=mQueue;
+            aView=mView;
+            mQueue.clear();
+            mView.clear();
+            aStopped=mStopped;
+        }
+
+        // Journal with a gap can't be replayed, so nothing is written after a failure
+        if ((!aBatch.isEmpty() || !aView.isEmpty()) && !mFailed)
+        {
+            HEX_PROFILE_SCOPE("journal.sync");
+
+            bool aWritten=true;
+
+            if (!aBatch.isEmpty())
+            {
+                aWritten=mFile.write(aBatch)==aBatch.size();
+                mViewPos=-1;
+            }
+
+            // Only the last view is replayed, so a view that still ends the file is overwritten.
+            // A crash in the middle cuts only that record, as it is the last one
+            if (aWritten && !aView.isEmpty())
+            {
+                if (mViewPos>=0 && mViewSize==aView.size())
+                {
+                    aWritten=mFile.seek(mViewPos) && mFile.write(aView)==aView.size();
+                }
+                else
+                {
+                    mViewPos=mFile.pos();
+                    mViewSize=aView.size();
+                    aWritten=mFile.write(aView)==aView.size();
+                }
+            }
+
+            if (!aWritten || !syncFile(mFile))
+            {
+                mFailed=true;
+                emit failed(aWritten ? "Can't sync journal "+mFile.fileName() : mFile.errorString());
+            }
+        }
+    }
+
+    mFile.close();
+}
+
+// *********************************************************************************
+//                                  SessionJournal
+// *********************************************************************************
+
+SessionJournal::SessionJournal(const QString &aFileName) :
+    QObject()
+{
+    mFileName=aFileName;
+    mWriter=0;
+    mInOperation=false;
+}
+
+SessionJournal::~SessionJournal()
+{
+    delete mWriter;
+}
+
+QString SessionJournal::fileName() const
+{
+    return mFileName;
+}
+
+QByteArray SessionJournal::fingerprint(const HexDocument *aDocument)
+{
+    HEX_PROFILE_SCOPE("journal.fingerprint");
+
+    // Blocks are spread over the whole data, first and last ones included
+    qint64 aSize=aDocument->size();
+    QCryptographicHash aHash(QCryptographicHash::Md5);
+    QByteArray aBlock(FINGERPRINT_BLOCK, 0);
+
+    for (int i=0; i<FINGERPRINT_SAMPLES; ++i)
+    {
+        qint64 aPos=qMax((qint64)0, (aSize-FINGERPRINT_BLOCK)*i/(FINGERPRINT_SAMPLES-1));
+        qint64 aLength=aDocument->read(aPos, aBlock.data(), FINGERPRINT_BLOCK);
+
+        aHash.addData(aBlock.constData(), (int)aLength);
+    }
+
+    QByteArray aResult;
+    QDataStream aStream(&aResult, QIODevice::WriteOnly);
+
+    aStream << aSize << aHash.result();
+
+    return aResult;
+}
+
+bool SessionJournal::read(const QByteArray &aFingerprint, QList<JournalRecord> &aRecords, QString *aError) const
+{
+    HEX_PROFILE_SCOPE("journal.read");
+
+    aRecords.clear();
+
+    QFile aFile(mFileName);
+
+    if (!aFile.open(QIODevice::ReadOnly))
+    {
+        setError(aError, "There is no journal");
+        return false;
+    }
+
+    QByteArray aData=aFile.readAll();
+    int aPos=0;
+    bool aHeader=true;
+
+    if (!aData.startsWith(JOURNAL_MAGIC))
+    {
+        setError(aError, "File is not a journal");
+        return false;
+    }
+
+    aPos+=qstrlen(JOURNAL_MAGIC);
+
+    while (aPos+FRAME_HEADER_SIZE<=aData.size())
+    {
+        QDataStream aFrameStream(aData.mid(aPos, FRAME_HEADER_SIZE));
+        quint32 aSize;
+        quint16 aChecksum;
+
+        aFrameStream >> aSize >> aChecksum;
+
+        // Record that was being written at a crash
+        if (aSize>(quint32)(aData.size()-aPos-FRAME_HEADER_SIZE))
+        {
+            break;
+        }
+
+        QByteArray aPayload=aData.mid(aPos+FRAME_HEADER_SIZE, aSize);
+
+        if (qChecksum(aPayload.constData(), aPayload.size())!=aChecksum)
+        {
+            break;
+        }
+
+        aPos+=FRAME_HEADER_SIZE+aSize;
+
+        QDataStream aStream(aPayload);
+
+        if (aHeader)
+        {
+            quint16 aVersion;
+            QByteArray aJournalFingerprint;
+
+            aStream >> aVersion >> aJournalFingerprint;
+
+            if (aVersion!=JOURNAL_VERSION)
+            {
+                setError(aError, "Journal is written by another version");
+                return false;
+            }
+
+            if (aJournalFingerprint!=aFingerprint)
+            {
+                setError(aError, "Journal belongs to other data");
+                return false;
+            }
+
+            aHeader=false;
+            continue;
+        }
+
+        quint8 aType;
+        JournalRecord aRecord;
+
+        aStream >> aType;
+        aRecord.type=(JournalRecord::Type)aType;
+
+        switch (aRecord.type)
+        {
+            case JournalRecord::CHANGE:
+            {
+                quint32 aCount;
+                aStream >> aCount;
+
+                for (quint32 i=0; i<aCount && aStream.status()==QDataStream::Ok; ++i)
+                {
+                    JournalEdit aEdit;
+                    aStream >> aEdit.pos >> aEdit.removedLength >> aEdit.inserted;
+                    aRecord.edits.append(aEdit);
+                }
+            }
+            break;
+            case JournalRecord::ANNOTATION_ADD:
+            {
+                aStream >> aRecord.start >> aRecord.end >> aRecord.text;
+            }
+            break;
+            case JournalRecord::ANNOTATION_REMOVE:
+            {
+                aStream >> aRecord.start;
+            }
+            break;
+            case JournalRecord::VIEW:
+            {
+                aStream >> aRecord.cursor >> aRecord.start >> aRecord.end >> aRecord.scroll;
+            }
+            break;
+            case JournalRecord::TRANSFORM:
+            {
+                quint8 aOperation;
+                QByteArray aKey;
+                qint32 aAmount;
+                quint64 aSeed;
+                quint32 aCount;
+
+                aStream >> aOperation >> aKey >> aAmount >> aSeed >> aCount;
+
+                if (aOperation>HexTransform::TRANSFORM_RANDOM)
+                {
+                    aStream.setStatus(QDataStream::ReadCorruptData);
+                    break;
+                }
+
+                aRecord.transform=HexTransform((HexTransform::Operation)aOperation, aKey, aAmount);
+                aRecord.transform.setSeed(aSeed);
+
+                for (quint32 i=0; i<aCount && aStream.status()==QDataStream::Ok; ++i)
+                {
+                    HexRange aRange;
+                    aStream >> aRange.pos >> aRange.length;
+                    aRecord.ranges.append(aRange);
+                }
+            }
+            break;
+            default:
+            {
+                aStream.setStatus(QDataStream::ReadCorruptData);
+            }
+            break;
+        }
+
+        if (aStream.status()!=QDataStream::Ok)
+        {
+            break;
+        }
+
+        aRecords.append(aRecord);
+    }
+
+    if (aHeader)
+    {
+        setError(aError, "Journal is empty");
+        return false;
+    }
+
+    return true;
+}
+
+bool SessionJournal::start(const QByteArray &aFingerprint, QString *aError)
+{
+    delete mWriter;
+    mWriter=new JournalWriter(mFileName);
+    mPendingEdits.clear();
+    mInOperation=false;
+
+    if (!mWriter->open(aError))
+    {
+        delete mWriter;
+        mWriter=0;
+
+        return false;
+    }
+
+    QByteArray aPayload;
+    QDataStream aStream(&aPayload, QIODevice::WriteOnly);
+
+    aStream << (quint16)JOURNAL_VERSION << aFingerprint;
+
+    connect(mWriter, SIGNAL(failed(QString)), this, SIGNAL(writeFailed(QString)));
+
+    mWriter->append(JOURNAL_MAGIC);
+    write(aPayload);
+
+    mWriter->start(QThread::LowPriority);
+
+    return true;
+}
+
+bool SessionJournal::isStarted() const
+{
+    return mWriter!=0;
+}
+
+void SessionJournal::remove()
+{
+    // Writer is done with the file after it is deleted
+    delete mWriter;
+    mWriter=0;
+    mPendingEdits.clear();
+    mInOperation=false;
+
+    QFile::remove(mFileName);
+}
+
+void SessionJournal::edited(qint64 aPos, qint64 aRemovedLength, const QByteArray &aInserted)
+{
+    if (!collectsEdits())
+    {
+        return;
+    }
+
+    JournalEdit aEdit;
+    aEdit.pos=aPos;
+    aEdit.removedLength=aRemovedLength;
+    aEdit.inserted=aInserted;
+
+    mPendingEdits.append(aEdit);
+}
+
+void SessionJournal::operation(const JournalRecord &aRecord)
+{
+    // Edits of a previous change are never mixed into the operation
+    commit();
+    append(aRecord);
+
+    mInOperation=mWriter!=0;
+}
+
+bool SessionJournal::collectsEdits() const
+{
+    return mWriter && !mInOperation;
+}
+
+void SessionJournal::commit()
+{
+    mInOperation=false;
+
+    if (mPendingEdits.isEmpty())
+    {
+        return;
+    }
+
+    JournalRecord aRecord(JournalRecord::CHANGE);
+    aRecord.edits=mPendingEdits;
+
+    mPendingEdits.clear();
+    append(aRecord);
+}
+
+void SessionJournal::append(const JournalRecord &aRecord)
+{
+    if (!mWriter)
+    {
+        return;
+    }
+
+    QByteArray aPayload;
+    QDataStream aStream(&aPayload, QIODevice::WriteOnly);
+
+    aStream << (quint8)aRecord.type;
+
+    switch (aRecord.type)
+    {
+        case JournalRecord::CHANGE:
+        {
+            aStream << (quint32)aRecord.edits.size();
+
+            for (int i=0; i<aRecord.edits.size(); ++i)
+            {
+                const JournalEdit &aEdit=aRecord.edits.at(i);
+                aStream << aEdit.pos << aEdit.removedLength << aEdit.inserted;
+            }
+        }
+        break;
+        case JournalRecord::ANNOTATION_ADD:
+        {
+            aStream << aRecord.start << aRecord.end << aRecord.text;
+        }
+        break;
+        case JournalRecord::ANNOTATION_REMOVE:
+        {
+            aStream << aRecord.start;
+        }
+        break;
+        case JournalRecord::VIEW:
+        {
+            aStream << aRecord.cursor << aRecord.start << aRecord.end << aRecord.scroll;
+
+            // Replaces the previous view instead of adding a record
+            mWriter->setView(frame(aPayload));
+
+            return;
+        }
+        break;
+        case JournalRecord::TRANSFORM:
+        {
+            aStream << (quint8)aRecord.transform.operation() << aRecord.transform.key() << (qint32)aRecord.transform.amount() << aRecord.transform.seed();
+            aStream << (quint32)aRecord.ranges.size();
+
+            for (int i=0; i<aRecord.ranges.size(); ++i)
+            {
+                aStream << aRecord.ranges.at(i).pos << aRecord.ranges.at(i).length;
+            }
+        }
+        break;
+    }
+
+    write(aPayload);
+}
+
+QByteArray SessionJournal::frame(const QByteArray &aPayload)
+{
+    QByteArray aFrame;
+    QDataStream aStream(&aFrame, QIODevice::WriteOnly);
+
+    aStream << (quint32)aPayload.size() << qChecksum(aPayload.constData(), aPayload.size());
+
+    return aFrame+aPayload;
+}
+
+void SessionJournal::write(const QByteArray &aPayload)
+{
+    mWriter->append(frame(aPayload));
+}
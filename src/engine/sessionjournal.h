@@ -0,0 +1,144 @@
+#ifndef SESSIONJOURNAL_H
+#define SESSIONJOURNAL_H
+
+#include <QFile>
+#include <QList>
+#include <QString>
+#include <QByteArray>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include "hexsearch.h"
+#include "hextransform.h"
+
+class HexDocument;
+
+struct JournalEdit
+{
+    qint64     pos;
+    qint64     removedLength; // Removed bytes are read from data again on replay
+    QByteArray inserted;
+};
+
+struct JournalRecord
+{
+    enum Type
+    {
+        CHANGE,            // Edits of one change of data
+        ANNOTATION_ADD,
+        ANNOTATION_REMOVE, // Annotations at start
+        VIEW,
+        TRANSFORM          // Transform of ranges, bytes aren't journaled
+    };
+
+    Type               type;
+    QList<JournalEdit> edits;     // CHANGE
+    QVector<HexRange>  ranges;    // TRANSFORM, phase goes on from one range to the next
+    HexTransform       transform; // TRANSFORM
+    qint64             start;     // ANNOTATION_ADD, ANNOTATION_REMOVE, selection of VIEW
+    qint64             end;       // ANNOTATION_ADD, selection of VIEW
+    qint64             cursor;    // VIEW
+    qint64             scroll;    // VIEW, pixels
+    QString            text;      // ANNOTATION_ADD
+
+    JournalRecord(Type aType=CHANGE);
+};
+
+/*
+ * Writes journal records in its own thread and syncs them to disk. Records
+ * that come while the previous ones are being synced are written and
+ * synced together, so typing never waits for the disk and a burst of
+ * records costs one sync. Only the latest view record is kept: it replaces
+ * a queued one and overwrites the one at the end of the file, so scrolling
+ * doesn't grow the journal. A failed write or sync is reported once by
+ * failed(), nothing is written after it.
+ */
+class JournalWriter : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit JournalWriter(const QString &aFileName, QObject *parent=0);
+    ~JournalWriter(); // Queued records are written first
+
+    bool open(QString *aError=0); // Empties the file, before start()
+    void append(const QByteArray &aData);
+    void setView(const QByteArray &aData);
+    void stop();
+
+protected:
+    QFile          mFile;
+    QMutex         mMutex;
+    QWaitCondition mQueued;
+    QByteArray     mQueue;
+    QByteArray     mView;     // Latest view record that isn't written yet
+    qint64         mViewPos;  // Position of the view record that ends the file or -1, used only by the thread
+    qint64         mViewSize;
+    bool           mStopped;
+    bool           mFailed;   // Used only by the thread
+
+    void run();
+
+signals:
+    void failed(QString aError);
+};
+
+// *********************************************************************************
+
+/*
+ * Log of a session with a document, so that the session can be replayed
+ * after a crash. Edits of one change are collected as they are applied
+ * to the data and queued as one record by commit(), right after the
+ * change. Change that is cheaper to describe than its bytes, like a
+ * transform, is queued by operation() before it is made, and its edits
+ * aren't collected until commit(). Records reach the disk a moment
+ * later, so a crash loses the changes of the last moment, the change
+ * being made and everything queued but not synced yet, but never leaves
+ * a change half written. Journal starts
+ * with the fingerprint of the data it was started for: size and a hash
+ * of blocks sampled across it. Every record is written with its size and
+ * checksum, a record cut by a crash ends the journal. writeFailed() tells
+ * that the journal isn't written anymore.
+ */
+class SessionJournal : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SessionJournal(const QString &aFileName);
+    ~SessionJournal();
+
+    QString fileName() const;
+
+    static QByteArray fingerprint(const HexDocument *aDocument);
+
+    // Records of a journal that was started for data with aFingerprint
+    bool read(const QByteArray &aFingerprint, QList<JournalRecord> &aRecords, QString *aError=0) const;
+
+    bool start(const QByteArray &aFingerprint, QString *aError=0); // Old records are dropped
+    bool isStarted() const;
+    void remove(); // Journal isn't needed anymore
+
+    void edited(qint64 aPos, qint64 aRemovedLength, const QByteArray &aInserted);
+    void operation(const JournalRecord &aRecord); // Stands for the edits up to commit()
+    bool collectsEdits() const; // False between operation() and commit()
+    void commit();
+    void append(const JournalRecord &aRecord);
+
+private:
+    QString            mFileName;
+    JournalWriter     *mWriter;       // 0 if journal isn't started
+    QList<JournalEdit> mPendingEdits;
+    bool               mInOperation;
+
+    static QByteArray frame(const QByteArray &aPayload);
+    void write(const QByteArray &aPayload);
+
+    Q_DISABLE_COPY(SessionJournal)
+
+signals:
+    void writeFailed(QString aError); // Changes after it can't be replayed
+};
+
+#endif // SESSIONJOURNAL_H
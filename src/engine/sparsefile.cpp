@@ -0,0 +1,302 @@
+#include "sparsefile.h"
+
+#include "hexprofiler.h"
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#endif
+
+#include <string.h>
+
+#define SPARSE_BLOCK_SIZE 4096
+#define COPY_CHUNK_SIZE   (1 << 20)
+
+static bool isZeroBlock(const char *aData, qint64 aLength)
+{
+    static const char aZeros[SPARSE_BLOCK_SIZE]={0};
+
+    return memcmp(aData, aZeros, aLength)==0;
+}
+
+QVector<HexRange> SparseFile::holes(QFile &aFile)
+{
+    QVector<HexRange> aHoles;
+
+#if defined(Q_OS_UNIX) && defined(SEEK_DATA) && defined(SEEK_HOLE)
+    if (aFile.isSequential())
+    {
+        return aHoles;
+    }
+
+    int    aHandle=aFile.handle();
+    qint64 aSize=aFile.size();
+    qint64 aSavedPos=::lseek(aHandle, 0, SEEK_CUR);
+    qint64 aPos=0;
+
+    while (aPos<aSize)
+    {
+        qint64 aHoleStart=::lseek(aHandle, aPos, SEEK_HOLE);
+
+        if (aHoleStart<0 || aHoleStart>=aSize)
+        {
+            break;
+        }
+
+        // No data after the last hole means that the hole goes to the end of file
+        qint64 aDataStart=::lseek(aHandle, aHoleStart, SEEK_DATA);
+
+        if (aDataStart<0 || aDataStart>aSize)
+        {
+            aDataStart=aSize;
+        }
+
+        HexRange aHole;
+        aHole.pos=aHoleStart;
+        aHole.length=aDataStart-aHoleStart;
+        aHoles.append(aHole);
+
+        aPos=aDataStart;
+    }
+
+    ::lseek(aHandle, aSavedPos, SEEK_SET);
+#else
+    Q_UNUSED(aFile);
+#endif
+
+    return aHoles;
+}
+
+QVector<HexRange> SparseFile::searchRanges(const QVector<HexRange> &aHoles, qint64 aSize, const HexPattern &aPattern)
+{
+    QVector<HexRange> aRanges;
+    qint64 aLength=aPattern.length();
+    qint64 aPos=0;
+
+    if (!aPattern.matchesZeros())
+    {
+        for (int i=0; i<aHoles.size(); ++i)
+        {
+            // Matches can start inside a hole only close to its end
+            qint64 aSkipEnd=aHoles.at(i).pos+aHoles.at(i).length-aLength+1;
+
+            if (aSkipEnd<=aHoles.at(i).pos)
+            {
+                continue;
+            }
+
+            if (aHoles.at(i).pos>aPos)
+            {
+                HexRange aRange;
+                aRange.pos=aPos;
+                aRange.length=aHoles.at(i).pos-aPos;
+                aRanges.append(aRange);
+            }
+
+            aPos=aSkipEnd;
+        }
+    }
+
+    if (aPos<aSize)
+    {
+        HexRange aRange;
+        aRange.pos=aPos;
+        aRange.length=aSize-aPos;
+        aRanges.append(aRange);
+    }
+
+    return aRanges;
+}
+
+bool SparseFile::write(QFile &aFile, const char *aData, qint64 aSize)
+{
+    // Trailing zeros become a hole too
+    return write(aFile, 0, aData, aSize) && aFile.resize(aSize);
+}
+
+bool SparseFile::write(QFile &aFile, qint64 aFilePos, const char *aData, qint64 aSize)
+{
+    HEX_PROFILE_SCOPE("io.sparseWrite");
+
+    qint64 aPos=0;
+
+    while (aPos<aSize)
+    {
+        qint64 aLength=qMin((qint64)SPARSE_BLOCK_SIZE, aSize-aPos);
+
+        if (isZeroBlock(aData+aPos, aLength))
+        {
+            aPos+=aLength;
+            continue;
+        }
+
+        // Adjacent data blocks are written at once
+        qint64 aEnd=aPos+aLength;
+
+        while (aEnd<aSize)
+        {
+            qint64 aNextLength=qMin((qint64)SPARSE_BLOCK_SIZE, aSize-aEnd);
+
+            if (isZeroBlock(aData+aEnd, aNextLength))
+            {
+                break;
+            }
+
+            aEnd+=aNextLength;
+        }
+
+        if (!aFile.seek(aFilePos+aPos) || aFile.write(aData+aPos, aEnd-aPos)!=aEnd-aPos)
+        {
+            return false;
+        }
+
+        aPos=aEnd;
+    }
+
+    return true;
+}
+
+bool SparseFile::copy(const QString &aSource, const QString &aTarget, QString *aError)
+{
+    QFile aSourceFile(aSource);
+    QFile aTargetFile(aTarget);
+
+    if (!aSourceFile.open(QIODevice::ReadOnly))
+    {
+        if (aError)
+        {
+            *aError=aSourceFile.errorString();
+        }
+
+        return false;
+    }
+
+    if (!aTargetFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        if (aError)
+        {
+            *aError=aTargetFile.errorString();
+        }
+
+        return false;
+    }
+
+    QVector<HexRange> aHoles=holes(aSourceFile);
+    qint64 aSize=aSourceFile.size();
+    qint64 aPos=0;
+
+    // Data between holes is copied, zero blocks inside data stay zeros
+    for (int i=0; i<=aHoles.size() && aPos<aSize; ++i)
+    {
+        qint64 aEnd=i<aHoles.size() ? aHoles.at(i).pos : aSize;
+
+        if (!aSourceFile.seek(aPos) || !aTargetFile.seek(aPos))
+        {
+            if (aError)
+            {
+                *aError=aTargetFile.errorString();
+            }
+
+            return false;
+        }
+
+        while (aPos<aEnd)
+        {
+            QByteArray aChunk=aSourceFile.read(qMin((qint64)COPY_CHUNK_SIZE, aEnd-aPos));
+
+            if (aChunk.isEmpty() || aTargetFile.write(aChunk)!=aChunk.size())
+            {
+                if (aError)
+                {
+                    *aError=aChunk.isEmpty() ? aSourceFile.errorString() : aTargetFile.errorString();
+                }
+
+                return false;
+            }
+
+            aPos+=aChunk.size();
+        }
+
+        if (i<aHoles.size())
+        {
+            aPos+=aHoles.at(i).length;
+        }
+    }
+
+    if (!aTargetFile.resize(aSize))
+    {
+        if (aError)
+        {
+            *aError=aTargetFile.errorString();
+        }
+
+        return false;
+    }
+
+    return true;
+}
+
+void SparseFile::sync(QFile &aFile)
+{
+    aFile.flush();
+
+#if defined(Q_OS_UNIX)
+    ::fsync(aFile.handle());
+#elif defined(Q_OS_WIN)
+    ::_commit(aFile.handle());
+#endif
+}
+
+QString SparseFile::unusedName(const QString &aName)
+{
+    QString aResult=aName;
+
+    for (int i=1; QFile::exists(aResult); ++i)
+    {
+        aResult=aName+QString::number(i);
+    }
+
+    return aResult;
+}
+
+bool SparseFile::replace(const QString &aSource, const QString &aTarget, QString *aError)
+{
+    // Old file stays as a backup until the new one is in its place
+    bool    aExists=QFile::exists(aTarget);
+    QString aBackup=unusedName(aTarget+".orig");
+
+    if (aExists && !QFile::rename(aTarget, aBackup))
+    {
+        if (aError)
+        {
+            *aError="Can't replace file "+aTarget;
+        }
+
+        return false;
+    }
+
+    if (!QFile::rename(aSource, aTarget))
+    {
+        if (aExists)
+        {
+            QFile::rename(aBackup, aTarget);
+        }
+
+        if (aError)
+        {
+            *aError="Can't replace file "+aTarget;
+        }
+
+        return false;
+    }
+
+    if (aExists)
+    {
+        QFile::remove(aBackup);
+    }
+
+    return true;
+}
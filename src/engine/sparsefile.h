@@ -0,0 +1,32 @@
+#ifndef SPARSEFILE_H
+#define SPARSEFILE_H
+
+#include <QFile>
+#include <QVector>
+
+#include "hexsearch.h"
+
+/*
+ * Helpers for files with holes, like disk images. Holes are found with
+ * SEEK_DATA and SEEK_HOLE where they are supported, elsewhere files are
+ * treated as having no holes.
+ */
+class SparseFile
+{
+public:
+    static QVector<HexRange> holes(QFile &aFile);
+
+    // Ranges of start positions where aPattern can be found, so matches inside holes are skipped
+    static QVector<HexRange> searchRanges(const QVector<HexRange> &aHoles, qint64 aSize, const HexPattern &aPattern);
+
+    // Zero blocks are not written, so the file gets holes there. aFile must be empty
+    static bool write(QFile &aFile, const char *aData, qint64 aSize);
+    static bool write(QFile &aFile, qint64 aFilePos, const char *aData, qint64 aSize); // Part of data, file isn't resized
+    static bool copy(const QString &aSource, const QString &aTarget, QString *aError=0);
+
+    static void sync(QFile &aFile); // Flushes aFile and waits until it is on disk
+    static QString unusedName(const QString &aName); // aName or aName with a number, existing files are never taken
+    static bool replace(const QString &aSource, const QString &aTarget, QString *aError=0); // aTarget is kept if aSource can't take its place
+};
+
+#endif // SPARSEFILE_H
@@ -0,0 +1,121 @@
+#include "streamdecompressor.h"
+
+#include <QMutexLocker>
+
+#include "hexprofiler.h"
+
+#define BLOCK_SIZE (256 << 10)
+
+StreamDecompressor::StreamDecompressor(HexCodec::Type aType, const QByteArray &aCompressed, QObject *parent) :
+    QThread(parent)
+{
+    mType=aType;
+    mCompressed=aCompressed;
+    mRequested=0;
+    mProduced=0;
+    mConsumed=0;
+    mStopped=false;
+}
+
+StreamDecompressor::~StreamDecompressor()
+{
+    stop();
+    wait();
+}
+
+void StreamDecompressor::request(qint64 aSize)
+{
+    QMutexLocker aLocker(&mMutex);
+
+    if (aSize<0)
+    {
+        mRequested=-1;
+    }
+    else
+    if (mRequested>=0 && aSize>mRequested)
+    {
+        mRequested=aSize;
+    }
+
+    mWaitCondition.wakeAll();
+}
+
+void StreamDecompressor::stop()
+{
+    QMutexLocker aLocker(&mMutex);
+
+    mStopped=true;
+    mWaitCondition.wakeAll();
+}
+
+qint64 StreamDecompressor::compressedSize() const
+{
+    return mConsumed;
+}
+
+void StreamDecompressor::run()
+{
+    HexCodec     aCodec(mType);
+    const uchar *aInput=(const uchar *)mCompressed.constData();
+    qint64       aInputLeft=mCompressed.size();
+
+    QByteArray aBlock(BLOCK_SIZE, 0);
+    int        aFilled=0;
+    bool       aEnd=false;
+    bool       ok=true;
+
+    while (!aEnd)
+    {
+        mMutex.lock();
+
+        while (!mStopped && mRequested>=0 && mProduced+aFilled>=mRequested)
+        {
+            mWaitCondition.wait(&mMutex);
+        }
+
+        bool aStopped=mStopped;
+        mMutex.unlock();
+
+        if (aStopped)
+        {
+            return;
+        }
+
+        int aProduced;
+
+        {
+            HEX_PROFILE_SCOPE("io.decompress");
+
+            if (!aCodec.decompress(aInput, aInputLeft, (uchar *)aBlock.data()+aFilled, BLOCK_SIZE-aFilled, aProduced, aEnd))
+            {
+                ok=false;
+                break;
+            }
+        }
+
+        HEX_PROFILE_COUNT("io.decompress.bytes", aProduced);
+
+        aFilled+=aProduced;
+
+        if (aFilled==BLOCK_SIZE || (aEnd && aFilled>0))
+        {
+            emit blockDecompressed(aBlock.left(aFilled));
+
+            mMutex.lock();
+            mProduced+=aFilled;
+            mMutex.unlock();
+
+            aFilled=0;
+        }
+    }
+
+    if (aFilled>0)
+    {
+        emit blockDecompressed(aBlock.left(aFilled));
+    }
+
+    mConsumed=mCompressed.size()-aInputLeft;
+    mCompressed.clear();
+
+    emit decompressionFinished(ok, ok ? QString() : aCodec.errorString());
+}
@@ -0,0 +1,44 @@
+#ifndef STREAMDECOMPRESSOR_H
+#define STREAMDECOMPRESSOR_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include "hexcodec.h"
+
+/*
+ * Decompresses the stream block by block in its own thread, but only as
+ * far as requested. Blocks are delivered in order by blockDecompressed().
+ */
+class StreamDecompressor : public QThread
+{
+    Q_OBJECT
+
+public:
+    StreamDecompressor(HexCodec::Type aType, const QByteArray &aCompressed, QObject *parent=0);
+    ~StreamDecompressor();
+
+    void request(qint64 aSize); // Decompress at least aSize bytes, -1 for the whole stream
+    void stop();
+
+    qint64 compressedSize() const; // Bytes taken by the stream, valid after decompressionFinished()
+
+protected:
+    HexCodec::Type mType;
+    QByteArray     mCompressed;
+    QMutex         mMutex;
+    QWaitCondition mWaitCondition;
+    qint64         mRequested;
+    qint64         mProduced;
+    qint64         mConsumed;
+    bool           mStopped;
+
+    void run();
+
+signals:
+    void blockDecompressed(QByteArray aBlock);
+    void decompressionFinished(bool aSuccess, QString aError);
+};
+
+#endif // STREAMDECOMPRESSOR_H
@@ -0,0 +1,409 @@
+#include "stringextractor.h"
+
+#include <QtConcurrentRun>
+#include <QFuture>
+#include <QMutexLocker>
+
+#include "hexsearch.h"
+#include "hexprofiler.h"
+#include "hexdocument.h"
+
+#define CHUNK_SIZE        (1 << 20)
+#define CHUNK_MARGIN      4    // Bytes before a chunk, enough to tell that a string goes on into it
+#define MAX_MATCH_LENGTH  4096 // Strings and matches are not read past it behind chunk end
+#define MAX_TEXT_LENGTH   256
+
+StringExtractor::StringExtractor(HexDocument *aData, int aEncodings, int aMinLength, QObject *parent) :
+    QThread(parent)
+{
+    mData=aData;
+    mEncodings=aEncodings;
+    mMinLength=qMax(aMinLength, 1);
+    mStopped=false;
+}
+
+StringExtractor::StringExtractor(HexDocument *aData, const QRegExp &aRegExp, QObject *parent) :
+    QThread(parent)
+{
+    mData=aData;
+    mRegExp=aRegExp;
+    mEncodings=0;
+    mMinLength=1;
+    mStopped=false;
+}
+
+StringExtractor::~StringExtractor()
+{
+    stop();
+    wait();
+
+    delete mData;
+}
+
+void StringExtractor::stop()
+{
+    QMutexLocker aLocker(&mMutex);
+    mStopped=true;
+}
+
+bool StringExtractor::isStopped()
+{
+    QMutexLocker aLocker(&mMutex);
+    return mStopped;
+}
+
+QList<ExtractedString> StringExtractor::takeResults()
+{
+    QMutexLocker aLocker(&mMutex);
+
+    QList<ExtractedString> aResults=mResults;
+    mResults.clear();
+
+    return aResults;
+}
+
+QString StringExtractor::encodingName(int aEncoding)
+{
+    switch (aEncoding)
+    {
+        case ASCII:   return "ASCII";
+        case UTF8:    return "UTF-8";
+        case UTF16LE: return "UTF-16LE";
+        case UTF16BE: return "UTF-16BE";
+        default:      break;
+    }
+
+    return "Match";
+}
+
+void StringExtractor::run()
+{
+    HEX_PROFILE_SCOPE("strings.extract");
+
+    const qint64 aSize=mData->size();
+    int    aThreads=HexSearch::threadsCount(aSize, 0);
+    qint64 aDone=0;
+    qint64 aCount=0;
+    qint64 aLastEnd=0;
+
+    emit progress(0, aSize);
+
+    // One chunk per thread at a time, so results can be delivered in order
+    while (aDone<aSize && !isStopped())
+    {
+        QList< QFuture< QList<ExtractedString> > > aFutures;
+
+        // Only this thread reads the data, chunks are scanned in parallel
+        for (int i=0; i<aThreads && aDone<aSize; ++i)
+        {
+            qint64 aEnd=qMin(aDone+CHUNK_SIZE, aSize);
+            qint64 aBase=qMax((qint64)0, aDone-CHUNK_MARGIN);
+
+            QByteArray aBuffer((int)(qMin(aEnd+MAX_MATCH_LENGTH, aSize)-aBase), 0);
+            mData->read(aBase, aBuffer.data(), aBuffer.size());
+
+            aFutures.append(QtConcurrent::run(this, &StringExtractor::extractChunk, aBuffer, aBase, aDone, aEnd));
+            aDone=aEnd;
+        }
+
+        QList<ExtractedString> aResults;
+
+        for (int i=0; i<aFutures.size(); ++i)
+        {
+            QList<ExtractedString> aChunkResults=aFutures[i].result();
+
+            for (int j=0; j<aChunkResults.size(); ++j)
+            {
+                const ExtractedString &aResult=aChunkResults.at(j);
+
+                // Match of the previous chunk can run into this one
+                if (mEncodings==0 && aResult.pos<aLastEnd)
+                {
+                    continue;
+                }
+
+                aResults.append(aResult);
+                aLastEnd=aResult.pos+aResult.length;
+            }
+        }
+
+        aCount+=aResults.size();
+
+        if (!aResults.isEmpty())
+        {
+            mMutex.lock();
+            mResults+=aResults;
+            mMutex.unlock();
+
+            emit resultsAvailable();
+        }
+
+        emit progress(aDone, aSize);
+    }
+
+    emit extractionFinished(aCount);
+}
+
+QList<ExtractedString> StringExtractor::extractChunk(const QByteArray &aBuffer, qint64 aBase, qint64 aStart, qint64 aEnd) const
+{
+    const uchar *aData=(const uchar *)aBuffer.constData();
+    QList<ExtractedString> aResults;
+
+    if (mEncodings==0)
+    {
+        aResults=matchRegExp(aData, aBuffer.size(), aStart-aBase, aEnd-aBase, mRegExp);
+    }
+    else
+    {
+        aResults=extractStrings(aData, aBuffer.size(), aStart-aBase, aEnd-aBase, mEncodings, mMinLength);
+    }
+
+    for (int i=0; i<aResults.size(); ++i)
+    {
+        aResults[i].pos+=aBase;
+    }
+
+    return aResults;
+}
+
+// ------------------------------------------------------------------
+
+// Length in bytes of a printable char at aPos or 0. aCode gets the char
+static int printableChar(const uchar *aData, qint64 aSize, qint64 aPos, int aEncoding, uint &aCode)
+{
+    if (aEncoding==StringExtractor::UTF16LE || aEncoding==StringExtractor::UTF16BE)
+    {
+        if (aPos+1>=aSize)
+        {
+            return 0;
+        }
+
+        aCode=aEncoding==StringExtractor::UTF16LE ? aData[aPos] | (aData[aPos+1] << 8) : (aData[aPos] << 8) | aData[aPos+1];
+
+        // Only Latin-1, like strings -e does, else almost any pair of bytes is a char
+        return (aCode>=0x20 && aCode<0x7F) || aCode==0x09 || (aCode>=0xA0 && aCode<0x100) ? 2 : 0;
+    }
+
+    aCode=aData[aPos];
+
+    if (aCode<0x80 || aEncoding==StringExtractor::ASCII)
+    {
+        return (aCode>=0x20 && aCode<0x7F) || aCode==0x09 ? 1 : 0;
+    }
+
+    int  aLength;
+    uint aMin;
+
+    if (aCode>=0xC2 && aCode<=0xDF)
+    {
+        aLength=2;
+        aMin=0x80;
+        aCode&=0x1F;
+    }
+    else
+    if (aCode>=0xE0 && aCode<=0xEF)
+    {
+        aLength=3;
+        aMin=0x800;
+        aCode&=0x0F;
+    }
+    else
+    if (aCode>=0xF0 && aCode<=0xF4)
+    {
+        aLength=4;
+        aMin=0x10000;
+        aCode&=0x07;
+    }
+    else
+    {
+        return 0;
+    }
+
+    if (aPos+aLength>aSize)
+    {
+        return 0;
+    }
+
+    for (int i=1; i<aLength; ++i)
+    {
+        if ((aData[aPos+i] & 0xC0)!=0x80)
+        {
+            return 0;
+        }
+
+        aCode=(aCode << 6) | (aData[aPos+i] & 0x3F);
+    }
+
+    if (
+        aCode<aMin
+        ||
+        aCode>0x10FFFF
+        ||
+        (aCode>=0xD800 && aCode<=0xDFFF)
+        ||
+        aCode<0xA0
+       )
+    {
+        return 0;
+    }
+
+    return aLength;
+}
+
+// Whether a printable char ends right before aPos
+static bool printableCharBefore(const uchar *aData, qint64 aSize, qint64 aPos, int aEncoding)
+{
+    uint aCode;
+    int aMaxLength=aEncoding==StringExtractor::UTF8 ? 4 : 1;
+
+    if (aEncoding==StringExtractor::UTF16LE || aEncoding==StringExtractor::UTF16BE)
+    {
+        return aPos>=2 && printableChar(aData, aSize, aPos-2, aEncoding, aCode)==2;
+    }
+
+    for (int i=1; i<=aMaxLength && aPos-i>=0; ++i)
+    {
+        if (printableChar(aData, aSize, aPos-i, aEncoding, aCode)==i)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool positionLessThan(const ExtractedString &aFirst, const ExtractedString &aSecond)
+{
+    return aFirst.pos<aSecond.pos;
+}
+
+QList<ExtractedString> StringExtractor::extractStrings(const uchar *aData, qint64 aSize, qint64 aStart, qint64 aEnd, int aEncodings, int aMinLength)
+{
+    HEX_PROFILE_SCOPE("strings.chunk");
+    HEX_PROFILE_COUNT("strings.bytes", aEnd-aStart);
+
+    QList<ExtractedString> aResults;
+    static const int encodings[]={ASCII, UTF8, UTF16LE, UTF16BE};
+
+    for (int e=0; e<(int)(sizeof(encodings)/sizeof(encodings[0])); ++e)
+    {
+        int aEncoding=encodings[e];
+
+        if (!(aEncodings & aEncoding))
+        {
+            continue;
+        }
+
+        int  aUnit=aEncoding==UTF16LE || aEncoding==UTF16BE ? 2 : 1;
+        bool aSkipAscii=aEncoding==UTF8 && (aEncodings & ASCII); // They are found as ASCII already
+
+        // UTF-16 strings at odd and even positions are different strings
+        for (int aPhase=0; aPhase<aUnit; ++aPhase)
+        {
+            qint64 aPos=aStart+aPhase;
+            uint   aCode;
+            int    aLength;
+
+            // Middle of a multibyte char belongs to the char
+            while (aEncoding==UTF8 && aPos<aEnd && aPos-aStart<3 && (aData[aPos] & 0xC0)==0x80)
+            {
+                ++aPos;
+            }
+
+            // String that starts in the previous chunk belongs to it
+            if (printableCharBefore(aData, aSize, aPos, aEncoding))
+            {
+                while (aPos<aSize && (aLength=printableChar(aData, aSize, aPos, aEncoding, aCode))>0)
+                {
+                    aPos+=aLength;
+                }
+            }
+
+            while (aPos<aEnd)
+            {
+                if (!printableChar(aData, aSize, aPos, aEncoding, aCode))
+                {
+                    aPos+=aUnit;
+                    continue;
+                }
+
+                ExtractedString aString;
+                aString.pos=aPos;
+                aString.encoding=aEncoding;
+
+                int  aChars=0;
+                bool aNonAscii=false;
+
+                while (aPos<aSize && (aLength=printableChar(aData, aSize, aPos, aEncoding, aCode))>0)
+                {
+                    if (aChars<MAX_TEXT_LENGTH)
+                    {
+                        if (aCode>=0x10000)
+                        {
+                            aString.text.append(QChar(QChar::highSurrogate(aCode)));
+                            aString.text.append(QChar(QChar::lowSurrogate(aCode)));
+                        }
+                        else
+                        {
+                            aString.text.append(QChar(aCode));
+                        }
+                    }
+
+                    aNonAscii=aNonAscii || aCode>=0x80;
+                    ++aChars;
+                    aPos+=aLength;
+                }
+
+                aString.length=aPos-aString.pos;
+
+                if (aChars>=aMinLength && (aNonAscii || !aSkipAscii))
+                {
+                    aResults.append(aString);
+                }
+            }
+        }
+    }
+
+    if (aEncodings & (aEncodings-1))
+    {
+        qStableSort(aResults.begin(), aResults.end(), positionLessThan);
+    }
+
+    return aResults;
+}
+
+QList<ExtractedString> StringExtractor::matchRegExp(const uchar *aData, qint64 aSize, qint64 aStart, qint64 aEnd, QRegExp aRegExp)
+{
+    HEX_PROFILE_SCOPE("strings.regexp");
+    HEX_PROFILE_COUNT("strings.bytes", aEnd-aStart);
+
+    QList<ExtractedString> aResults;
+
+    // Latin-1 maps every byte to one char, so positions in text are positions in data
+    qint64 aTextEnd=qMin(aEnd+MAX_MATCH_LENGTH, aSize);
+    QString aText=QString::fromLatin1((const char *)aData+aStart, aTextEnd-aStart);
+    int aPos=0;
+
+    while ((aPos=aRegExp.indexIn(aText, aPos))>=0 && aStart+aPos<aEnd)
+    {
+        int aLength=aRegExp.matchedLength();
+
+        if (aLength<=0)
+        {
+            ++aPos;
+            continue;
+        }
+
+        ExtractedString aMatch;
+        aMatch.pos=aStart+aPos;
+        aMatch.length=aLength;
+        aMatch.encoding=0;
+        aMatch.text=aText.mid(aPos, qMin(aLength, MAX_TEXT_LENGTH));
+
+        aResults.append(aMatch);
+
+        aPos+=aLength;
+    }
+
+    return aResults;
+}
@@ -0,0 +1,79 @@
+#ifndef STRINGEXTRACTOR_H
+#define STRINGEXTRACTOR_H
+
+#include <QThread>
+#include <QMutex>
+#include <QRegExp>
+#include <QList>
+
+class HexDocument;
+
+struct ExtractedString
+{
+    qint64  pos;
+    qint64  length;   // Bytes
+    int     encoding; // StringExtractor::Encoding, 0 for matches of regular expression
+    QString text;     // Long strings are cut
+};
+
+/*
+ * Finds strings or matches of a regular expression in a snapshot of the
+ * data. The thread reads data chunk by chunk, with a few bytes before
+ * every chunk and a few kilobytes after it where results that start in
+ * the chunk can end, and chunks are scanned in parallel. Every chunk owns
+ * results that start inside it, so strings that cross chunk borders are
+ * found once. Results are delivered in order of position as soon as every
+ * chunk before them is done.
+ */
+class StringExtractor : public QThread
+{
+    Q_OBJECT
+
+public:
+    enum Encoding
+    {
+        ASCII   = 1,
+        UTF8    = 2,
+        UTF16LE = 4,
+        UTF16BE = 8
+    };
+
+    // Strings of at least aMinLength printable chars in any of aEncodings.
+    // aData is read only by the thread and deleted with the extractor
+    StringExtractor(HexDocument *aData, int aEncodings, int aMinLength, QObject *parent=0);
+
+    // Every byte is seen as a Latin-1 char, so "\\x00" matches zero byte
+    StringExtractor(HexDocument *aData, const QRegExp &aRegExp, QObject *parent=0);
+
+    ~StringExtractor();
+
+    void stop();
+    QList<ExtractedString> takeResults(); // Results found since the last call
+
+    static QString encodingName(int aEncoding);
+
+    // Results that start in [aStart, aEnd), bytes after aEnd are read to finish them
+    static QList<ExtractedString> extractStrings(const uchar *aData, qint64 aSize, qint64 aStart, qint64 aEnd, int aEncodings, int aMinLength);
+    static QList<ExtractedString> matchRegExp(const uchar *aData, qint64 aSize, qint64 aStart, qint64 aEnd, QRegExp aRegExp);
+
+protected:
+    HexDocument *mData;
+    QRegExp      mRegExp;
+    int          mEncodings; // 0 for search by mRegExp
+    int          mMinLength;
+    QMutex       mMutex;
+    bool         mStopped;
+
+    QList<ExtractedString> mResults;
+
+    bool isStopped();
+    QList<ExtractedString> extractChunk(const QByteArray &aBuffer, qint64 aBase, qint64 aStart, qint64 aEnd) const; // aBuffer has data from aBase
+    void run();
+
+signals:
+    void resultsAvailable();
+    void progress(qint64 aDone, qint64 aTotal);
+    void extractionFinished(qint64 aCount);
+};
+
+#endif // STRINGEXTRACTOR_H
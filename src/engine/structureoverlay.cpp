@@ -0,0 +1,640 @@
+#include "structureoverlay.h"
+
+#include "hexprofiler.h"
+
+#include <QtEndian>
+
+#include <string.h>
+
+#define ARRAY_CHECKPOINT_STEP 64
+#define MAX_CACHED_INSTANCES  65536
+
+StructureOverlay::Instance::Instance(StructureOverlay *aOverlay, const StructureDef *aDef, qint64 aBase, qint64 aLimit)
+{
+    mOverlay=aOverlay;
+    mDef=aDef;
+    mBase=aBase;
+    mLimit=aLimit;
+
+    if (mDef->mFixedSize<0)
+    {
+        mOffsets.fill(-1, mDef->mFields.size());
+        mSizes.fill(-1, mDef->mFields.size());
+    }
+}
+
+qint64 StructureOverlay::Instance::fieldValue(int aFieldIndex)
+{
+    return mOverlay->readInteger(mDef->mFields.at(aFieldIndex), mOverlay->fieldOffset(this, aFieldIndex));
+}
+
+// ------------------------------------------------------------------
+
+StructureOverlay::StructureOverlay(StructureTemplate *aTemplate)
+{
+    mTemplate=aTemplate;
+    mDocument=0;
+    mSize=0;
+    mVersion=0;
+}
+
+StructureOverlay::~StructureOverlay()
+{
+    clearCache();
+    delete mTemplate;
+}
+
+const StructureTemplate* StructureOverlay::structureTemplate() const
+{
+    return mTemplate;
+}
+
+void StructureOverlay::setDocument(const HexDocument *aDocument)
+{
+    mDocument=aDocument;
+    mSize=aDocument ? aDocument->size() : 0;
+
+    quint64 aVersion=aDocument ? aDocument->version() : 0;
+
+    if (mVersion!=aVersion)
+    {
+        mVersion=aVersion;
+        clearCache();
+    }
+}
+
+void StructureOverlay::clearCache()
+{
+    qDeleteAll(mInstances);
+    mInstances.clear();
+    mArrays.clear();
+}
+
+void StructureOverlay::fieldRanges(qint64 aStart, qint64 aEnd, QList<StructureRange> &aRanges)
+{
+    if (!mTemplate->root() || aStart>=aEnd)
+    {
+        return;
+    }
+
+    if (mInstances.size()>MAX_CACHED_INSTANCES)
+    {
+        qDeleteAll(mInstances);
+        mInstances.clear();
+    }
+
+    collectStruct(mTemplate->root(), 0, mSize, aStart, aEnd, 0, aRanges);
+}
+
+QString StructureOverlay::fieldAt(qint64 aPos)
+{
+    QString aResult;
+
+    if (mTemplate->root() && aPos>=0 && aPos<mSize)
+    {
+        findField(mTemplate->root(), 0, mSize, aPos, QString(), aResult);
+    }
+
+    return aResult;
+}
+
+// ------------------------------------------------------------------
+
+StructureOverlay::Instance* StructureOverlay::instance(const StructureDef *aDef, qint64 aBase, qint64 aLimit)
+{
+    InstanceKey aKey(aDef, aBase);
+    Instance *aInstance=mInstances.value(aKey, 0);
+
+    if (!aInstance)
+    {
+        HEX_PROFILE_COUNT("structure.cache.miss", 1);
+
+        aInstance=new Instance(this, aDef, aBase, aLimit);
+        mInstances.insert(aKey, aInstance);
+    }
+    else
+    {
+        HEX_PROFILE_COUNT("structure.cache.hit", 1);
+    }
+
+    return aInstance;
+}
+
+qint64 StructureOverlay::fieldOffset(Instance *aInstance, int aIndex)
+{
+    const StructureDef *aDef=aInstance->mDef;
+
+    if (aDef->mFixedSize>=0)
+    {
+        return aInstance->mBase+aDef->mFieldOffsets.at(aIndex);
+    }
+
+    if (aInstance->mOffsets.at(aIndex)>=0)
+    {
+        return aInstance->mOffsets.at(aIndex);
+    }
+
+    const StructureField &aField=aDef->mFields.at(aIndex);
+    qint64 aOffset;
+
+    if (aField.mHasOffset)
+    {
+        aOffset=aInstance->mBase+aField.mOffset.evaluate(aInstance);
+    }
+    else
+    {
+        int aPrev=aIndex-1;
+
+        while (aPrev>=0 && aDef->mFields.at(aPrev).mHasOffset)
+        {
+            --aPrev;
+        }
+
+        if (aPrev<0)
+        {
+            aOffset=aInstance->mBase;
+        }
+        else
+        {
+            aOffset=fieldOffset(aInstance, aPrev)+fieldSize(aInstance, aPrev);
+        }
+    }
+
+    aInstance->mOffsets[aIndex]=aOffset;
+
+    return aOffset;
+}
+
+qint64 StructureOverlay::arrayCount(Instance *aInstance, int aIndex)
+{
+    const StructureField &aField=aInstance->mDef->mFields.at(aIndex);
+
+    if (!aField.mIsArray)
+    {
+        return 1;
+    }
+
+    if (aField.mCount.isEmpty())
+    {
+        return -1;
+    }
+
+    qint64 aCount=aField.mCount.evaluate(aInstance);
+
+    return aCount<0 ? 0 : aCount;
+}
+
+qint64 StructureOverlay::fieldSize(Instance *aInstance, int aIndex)
+{
+    const StructureDef   *aDef=aInstance->mDef;
+    const StructureField &aField=aDef->mFields.at(aIndex);
+
+    if (aDef->mFixedSize>=0)
+    {
+        return aField.elementSize()*arrayCount(aInstance, aIndex);
+    }
+
+    if (aInstance->mSizes.at(aIndex)>=0)
+    {
+        return aInstance->mSizes.at(aIndex);
+    }
+
+    qint64 aOffset=fieldOffset(aInstance, aIndex);
+    qint64 aCount=arrayCount(aInstance, aIndex);
+    qint64 aElementSize=aField.elementSize();
+    qint64 aSize;
+
+    if (aElementSize>=0)
+    {
+        if (aCount<0)
+        {
+            aCount=aElementSize>0 && aInstance->mLimit>aOffset ? (aInstance->mLimit-aOffset)/aElementSize : 0;
+        }
+
+        aSize=aCount*aElementSize;
+    }
+    else
+    if (!aField.mIsArray)
+    {
+        aSize=structSize(aField.mStruct, aOffset, aInstance->mLimit);
+    }
+    else
+    {
+        aSize=scanArray(aInstance, aIndex, -1)->end-aOffset;
+    }
+
+    aInstance->mSizes[aIndex]=aSize;
+
+    return aSize;
+}
+
+qint64 StructureOverlay::structSize(const StructureDef *aDef, qint64 aBase, qint64 aLimit)
+{
+    if (aDef->mFixedSize>=0)
+    {
+        return aDef->mFixedSize;
+    }
+
+    Instance *aCached=mInstances.value(InstanceKey(aDef, aBase), 0);
+
+    if (aCached)
+    {
+        return structSize(aCached);
+    }
+
+    // Temporary instance so that scanning millions of records doesn't fill the cache
+    Instance aInstance(this, aDef, aBase, aLimit);
+
+    return structSize(&aInstance);
+}
+
+qint64 StructureOverlay::structSize(Instance *aInstance)
+{
+    const StructureDef *aDef=aInstance->mDef;
+
+    if (aDef->mFixedSize>=0)
+    {
+        return aDef->mFixedSize;
+    }
+
+    for (int i=aDef->mFields.size()-1; i>=0; --i)
+    {
+        if (!aDef->mFields.at(i).mHasOffset)
+        {
+            return fieldOffset(aInstance, i)+fieldSize(aInstance, i)-aInstance->mBase;
+        }
+    }
+
+    return 0;
+}
+
+StructureOverlay::ArrayIndex* StructureOverlay::scanArray(Instance *aInstance, int aIndex, qint64 aUntil)
+{
+    const StructureField &aField=aInstance->mDef->mFields.at(aIndex);
+    qint64 aOffset=fieldOffset(aInstance, aIndex);
+
+    ArrayKey aKey(&aField, aOffset);
+    QHash<ArrayKey, ArrayIndex>::iterator it=mArrays.find(aKey);
+
+    if (it==mArrays.end())
+    {
+        ArrayIndex aNewIndex;
+        aNewIndex.count=0;
+        aNewIndex.end=aOffset;
+        aNewIndex.complete=false;
+
+        it=mArrays.insert(aKey, aNewIndex);
+    }
+
+    ArrayIndex *aArray=&it.value();
+
+    if (aArray->complete)
+    {
+        return aArray;
+    }
+
+    qint64 aCount=arrayCount(aInstance, aIndex);
+    qint64 aLimit=aInstance->mLimit;
+
+    while (aUntil<0 || aArray->end<=aUntil)
+    {
+        if ((aCount>=0 && aArray->count>=aCount) || aArray->end>=aLimit)
+        {
+            aArray->complete=true;
+            break;
+        }
+
+        qint64 aSize=structSize(aField.mStruct, aArray->end, aLimit);
+
+        if (aSize<=0)
+        {
+            aArray->complete=true;
+            break;
+        }
+
+        if ((aArray->count % ARRAY_CHECKPOINT_STEP)==0)
+        {
+            aArray->checkpoints.append(aArray->end);
+        }
+
+        aArray->end+=aSize;
+        ++aArray->count;
+    }
+
+    return aArray;
+}
+
+bool StructureOverlay::locateElement(Instance *aInstance, int aIndex, qint64 aPos, qint64 &aElement, qint64 &aElementOffset)
+{
+    const StructureField &aField=aInstance->mDef->mFields.at(aIndex);
+    qint64 aOffset=fieldOffset(aInstance, aIndex);
+
+    if (aPos<=aOffset)
+    {
+        aElement=0;
+        aElementOffset=aOffset;
+        return true;
+    }
+
+    ArrayIndex *aArray=scanArray(aInstance, aIndex, aPos);
+
+    if (aArray->checkpoints.isEmpty() || aPos>=aArray->end)
+    {
+        return false;
+    }
+
+    int aLow=0;
+    int aHigh=aArray->checkpoints.size()-1;
+
+    while (aLow<aHigh)
+    {
+        int aMiddle=(aLow+aHigh+1)>>1;
+
+        if (aArray->checkpoints.at(aMiddle)<=aPos)
+        {
+            aLow=aMiddle;
+        }
+        else
+        {
+            aHigh=aMiddle-1;
+        }
+    }
+
+    aElement=(qint64)aLow*ARRAY_CHECKPOINT_STEP;
+    aElementOffset=aArray->checkpoints.at(aLow);
+
+    while (aElement<aArray->count)
+    {
+        qint64 aSize=structSize(aField.mStruct, aElementOffset, aInstance->mLimit);
+
+        if (aElementOffset+aSize>aPos)
+        {
+            return true;
+        }
+
+        aElementOffset+=aSize;
+        ++aElement;
+    }
+
+    return false;
+}
+
+// ------------------------------------------------------------------
+
+qint64 StructureOverlay::readInteger(const StructureField &aField, qint64 aPos) const
+{
+    qint64 aSize=aField.elementSize();
+
+    if (aSize<=0 || aSize>8 || aPos<0 || aPos+aSize>mSize)
+    {
+        return 0;
+    }
+
+    uchar aSrc[8];
+    mDocument->read(aPos, (char *)aSrc, aSize);
+
+    switch (aField.mType)
+    {
+        case StructureField::Int8:   return (qint8)aSrc[0];
+        case StructureField::UInt8:  return aSrc[0];
+        case StructureField::Int16:  return aField.mBigEndian ? qFromBigEndian<qint16>(aSrc)  : qFromLittleEndian<qint16>(aSrc);
+        case StructureField::UInt16: return aField.mBigEndian ? qFromBigEndian<quint16>(aSrc) : qFromLittleEndian<quint16>(aSrc);
+        case StructureField::Int32:  return aField.mBigEndian ? qFromBigEndian<qint32>(aSrc)  : qFromLittleEndian<qint32>(aSrc);
+        case StructureField::UInt32: return aField.mBigEndian ? qFromBigEndian<quint32>(aSrc) : qFromLittleEndian<quint32>(aSrc);
+        case StructureField::Int64:
+        case StructureField::UInt64: return aField.mBigEndian ? qFromBigEndian<qint64>(aSrc)  : qFromLittleEndian<qint64>(aSrc);
+        default:                     break;
+    }
+
+    return 0;
+}
+
+QString StructureOverlay::valueToString(const StructureField &aField, qint64 aPos, qint64 aSize) const
+{
+    if (aPos<0 || aPos+aSize>mSize)
+    {
+        return "<out of data>";
+    }
+
+    if (aField.mIsArray && aField.mType!=StructureField::Char)
+    {
+        return QString("%1 bytes").arg(aSize);
+    }
+
+    switch (aField.mType)
+    {
+        case StructureField::Float:
+        {
+            quint32 aBits=readInteger(aField, aPos);
+            float aValue;
+            memcpy(&aValue, &aBits, sizeof(aValue));
+
+            return QString::number(aValue);
+        }
+        case StructureField::Double:
+        {
+            StructureField aRaw=aField;
+            aRaw.mType=StructureField::UInt64;
+
+            quint64 aBits=readInteger(aRaw, aPos);
+            double aValue;
+            memcpy(&aValue, &aBits, sizeof(aValue));
+
+            return QString::number(aValue);
+        }
+        case StructureField::Char:
+        {
+            return "\""+QString::fromLatin1(mDocument->mid(aPos, qMin(aSize, (qint64)64)))+"\"";
+        }
+        case StructureField::Bytes:
+        case StructureField::Struct:
+        {
+            return QString("%1 bytes").arg(aSize);
+        }
+        case StructureField::UInt64:
+        {
+            quint64 aValue=readInteger(aField, aPos);
+
+            return QString("%1 (0x%2)").arg(aValue).arg(aValue, 0, 16);
+        }
+        default:
+        {
+            qint64 aValue=readInteger(aField, aPos);
+
+            return QString("%1 (0x%2)").arg(aValue).arg((quint64)aValue & (Q_UINT64_C(0xFFFFFFFFFFFFFFFF) >> (64-aSize*8)), 0, 16);
+        }
+    }
+}
+
+// ------------------------------------------------------------------
+
+void StructureOverlay::collectStruct(const StructureDef *aDef, qint64 aBase, qint64 aLimit, qint64 aStart, qint64 aEnd, int aColorBase, QList<StructureRange> &aRanges)
+{
+    if (aBase>=aEnd || aBase>=aLimit)
+    {
+        return;
+    }
+
+    Instance *aInstance=instance(aDef, aBase, aLimit);
+    bool aPastEnd=false;
+
+    for (int i=0; i<aDef->mFields.size(); ++i)
+    {
+        const StructureField &aField=aDef->mFields.at(i);
+
+        if (aPastEnd && !aField.mHasOffset)
+        {
+            continue;
+        }
+
+        if (fieldOffset(aInstance, i)>=aEnd)
+        {
+            if (!aField.mHasOffset)
+            {
+                aPastEnd=true;
+            }
+
+            continue;
+        }
+
+        collectField(aInstance, i, aStart, aEnd, aColorBase+i, aRanges);
+    }
+}
+
+void StructureOverlay::collectField(Instance *aInstance, int aIndex, qint64 aStart, qint64 aEnd, int aColorBase, QList<StructureRange> &aRanges)
+{
+    const StructureField &aField=aInstance->mDef->mFields.at(aIndex);
+    qint64 aOffset=fieldOffset(aInstance, aIndex);
+
+    if (aField.mType!=StructureField::Struct)
+    {
+        qint64 aSize=fieldSize(aInstance, aIndex);
+
+        if (aSize>0 && aOffset+aSize>aStart)
+        {
+            StructureRange aRange;
+            aRange.start=qMax(aOffset, aStart);
+            aRange.end=qMin(aOffset+aSize, aEnd);
+            aRange.colorIndex=aColorBase;
+
+            aRanges.append(aRange);
+        }
+
+        return;
+    }
+
+    const StructureDef *aChild=aField.mStruct;
+
+    if (!aField.mIsArray)
+    {
+        if (aChild->mFixedSize<0 || aOffset+aChild->mFixedSize>aStart)
+        {
+            collectStruct(aChild, aOffset, aInstance->mLimit, aStart, aEnd, aColorBase+1, aRanges);
+        }
+
+        return;
+    }
+
+    qint64 aCount=arrayCount(aInstance, aIndex);
+    qint64 aLimit=aInstance->mLimit;
+    qint64 aElement;
+    qint64 aElementOffset;
+
+    if (aChild->mFixedSize>0)
+    {
+        aElement=aStart>aOffset ? (aStart-aOffset)/aChild->mFixedSize : 0;
+        aElementOffset=aOffset+aElement*aChild->mFixedSize;
+    }
+    else
+    if (!locateElement(aInstance, aIndex, aStart, aElement, aElementOffset))
+    {
+        return;
+    }
+
+    while (aElementOffset<aEnd && aElementOffset<aLimit && (aCount<0 || aElement<aCount))
+    {
+        collectStruct(aChild, aElementOffset, aLimit, aStart, aEnd, aColorBase+1+(aElement & 1)*3, aRanges);
+
+        qint64 aSize=structSize(aChild, aElementOffset, aLimit);
+
+        if (aSize<=0)
+        {
+            break;
+        }
+
+        aElementOffset+=aSize;
+        ++aElement;
+    }
+}
+
+bool StructureOverlay::findField(const StructureDef *aDef, qint64 aBase, qint64 aLimit, qint64 aPos, const QString &aPath, QString &aResult)
+{
+    Instance *aInstance=instance(aDef, aBase, aLimit);
+
+    for (int i=0; i<aDef->mFields.size(); ++i)
+    {
+        const StructureField &aField=aDef->mFields.at(i);
+        qint64 aOffset=fieldOffset(aInstance, i);
+
+        if (aOffset>aPos)
+        {
+            if (aField.mHasOffset)
+            {
+                continue;
+            }
+
+            break;
+        }
+
+        QString aFieldPath=aPath.isEmpty() ? aField.mName : aPath+"."+aField.mName;
+
+        if (aField.mType!=StructureField::Struct)
+        {
+            qint64 aSize=fieldSize(aInstance, i);
+
+            if (aPos<aOffset+aSize)
+            {
+                aResult=aFieldPath+" = "+valueToString(aField, aOffset, aSize);
+                return true;
+            }
+
+            continue;
+        }
+
+        if (!aField.mIsArray)
+        {
+            if (findField(aField.mStruct, aOffset, aLimit, aPos, aFieldPath, aResult))
+            {
+                return true;
+            }
+
+            continue;
+        }
+
+        qint64 aElement;
+        qint64 aElementOffset;
+        qint64 aCount=arrayCount(aInstance, i);
+
+        if (aField.mStruct->mFixedSize>0)
+        {
+            aElement=(aPos-aOffset)/aField.mStruct->mFixedSize;
+            aElementOffset=aOffset+aElement*aField.mStruct->mFixedSize;
+        }
+        else
+        if (!locateElement(aInstance, i, aPos, aElement, aElementOffset))
+        {
+            continue;
+        }
+
+        if (
+            (aCount<0 || aElement<aCount)
+            &&
+            findField(aField.mStruct, aElementOffset, aLimit, aPos, QString("%1[%2]").arg(aFieldPath).arg(aElement), aResult)
+           )
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
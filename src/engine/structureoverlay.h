@@ -0,0 +1,91 @@
+#ifndef STRUCTUREOVERLAY_H
+#define STRUCTUREOVERLAY_H
+
+#include <QHash>
+#include <QPair>
+
+#include "structuretemplate.h"
+#include "hexdocument.h"
+
+struct StructureRange
+{
+    qint64 start;
+    qint64 end;
+    int    colorIndex;
+};
+
+/*
+ * Applies StructureTemplate to the data lazily. Only structures that
+ * intersect the requested range are laid out; arrays of variable-sized
+ * elements are indexed incrementally with a checkpoint every
+ * ARRAY_CHECKPOINT_STEP elements. All caches are dropped when the data
+ * version changes.
+ */
+class StructureOverlay
+{
+public:
+    explicit StructureOverlay(StructureTemplate *aTemplate);
+    ~StructureOverlay();
+
+    const StructureTemplate* structureTemplate() const;
+
+    void setDocument(const HexDocument *aDocument);
+    void fieldRanges(qint64 aStart, qint64 aEnd, QList<StructureRange> &aRanges);
+    QString fieldAt(qint64 aPos);
+
+private:
+    class Instance : public StructureValueProvider
+    {
+    public:
+        StructureOverlay   *mOverlay;
+        const StructureDef *mDef;
+        qint64              mBase;
+        qint64              mLimit;
+        QVector<qint64>     mOffsets;
+        QVector<qint64>     mSizes;
+
+        Instance(StructureOverlay *aOverlay, const StructureDef *aDef, qint64 aBase, qint64 aLimit);
+
+        qint64 fieldValue(int aFieldIndex);
+    };
+
+    struct ArrayIndex
+    {
+        QVector<qint64> checkpoints;
+        qint64          count;
+        qint64          end;
+        bool            complete;
+    };
+
+    typedef QPair<const StructureDef *, qint64>   InstanceKey;
+    typedef QPair<const StructureField *, qint64> ArrayKey;
+
+    StructureTemplate                   *mTemplate;
+    const HexDocument                   *mDocument;
+    qint64                               mSize;
+    quint64                              mVersion;
+    QHash<InstanceKey, Instance *>       mInstances;
+    QHash<ArrayKey, ArrayIndex>          mArrays;
+
+    void clearCache();
+
+    Instance* instance(const StructureDef *aDef, qint64 aBase, qint64 aLimit);
+    qint64 fieldOffset(Instance *aInstance, int aIndex);
+    qint64 fieldSize(Instance *aInstance, int aIndex);
+    qint64 arrayCount(Instance *aInstance, int aIndex);
+    qint64 structSize(const StructureDef *aDef, qint64 aBase, qint64 aLimit);
+    qint64 structSize(Instance *aInstance);
+    ArrayIndex* scanArray(Instance *aInstance, int aIndex, qint64 aUntil);
+    bool locateElement(Instance *aInstance, int aIndex, qint64 aPos, qint64 &aElement, qint64 &aElementOffset);
+
+    qint64 readInteger(const StructureField &aField, qint64 aPos) const;
+    QString valueToString(const StructureField &aField, qint64 aPos, qint64 aSize) const;
+
+    void collectStruct(const StructureDef *aDef, qint64 aBase, qint64 aLimit, qint64 aStart, qint64 aEnd, int aColorBase, QList<StructureRange> &aRanges);
+    void collectField(Instance *aInstance, int aIndex, qint64 aStart, qint64 aEnd, int aColorBase, QList<StructureRange> &aRanges);
+    bool findField(const StructureDef *aDef, qint64 aBase, qint64 aLimit, qint64 aPos, const QString &aPath, QString &aResult);
+
+    Q_DISABLE_COPY(StructureOverlay)
+};
+
+#endif // STRUCTUREOVERLAY_H
@@ -0,0 +1,806 @@
+#include "structuretemplate.h"
+
+bool StructureExpression::isEmpty() const
+{
+    return mTokens.isEmpty();
+}
+
+bool StructureExpression::isConstant() const
+{
+    for (int i=0; i<mTokens.size(); ++i)
+    {
+        if (mTokens.at(i).type==Field)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+qint64 StructureExpression::evaluate(StructureValueProvider *aProvider) const
+{
+    qint64 aStack[32];
+    int    aDepth=0;
+
+    for (int i=0; i<mTokens.size(); ++i)
+    {
+        const Token &aToken=mTokens.at(i);
+
+        switch (aToken.type)
+        {
+            case Number:
+            case Field:
+            {
+                if (aDepth==32)
+                {
+                    return 0;
+                }
+
+                if (aToken.type==Number)
+                {
+                    aStack[aDepth]=aToken.value;
+                }
+                else
+                {
+                    aStack[aDepth]=aProvider ? aProvider->fieldValue(aToken.value) : 0;
+                }
+
+                ++aDepth;
+            }
+            break;
+            default:
+            {
+                if (aDepth<2)
+                {
+                    return 0;
+                }
+
+                --aDepth;
+
+                qint64 aRight=aStack[aDepth];
+                qint64 &aLeft=aStack[aDepth-1];
+
+                switch (aToken.type)
+                {
+                    case Add: aLeft+=aRight;                      break;
+                    case Sub: aLeft-=aRight;                      break;
+                    case Mul: aLeft*=aRight;                      break;
+                    case Div: aLeft=aRight==0 ? 0 : aLeft/aRight; break;
+                    default:                                      break;
+                }
+            }
+            break;
+        }
+    }
+
+    return aDepth==1 ? aStack[0] : 0;
+}
+
+// *********************************************************************************
+//                                    StructureField
+// *********************************************************************************
+
+StructureField::StructureField()
+{
+    mType=UInt8;
+    mBigEndian=false;
+    mStruct=0;
+    mIsArray=false;
+    mHasOffset=false;
+}
+
+bool StructureField::isScalar() const
+{
+    return mType!=Struct && mType!=Bytes && mType!=Char;
+}
+
+bool StructureField::isInteger() const
+{
+    return mType<=UInt64;
+}
+
+qint64 StructureField::elementSize() const
+{
+    switch (mType)
+    {
+        case Int8:
+        case UInt8:
+        case Char:
+        case Bytes:
+            return 1;
+        case Int16:
+        case UInt16:
+            return 2;
+        case Int32:
+        case UInt32:
+        case Float:
+            return 4;
+        case Int64:
+        case UInt64:
+        case Double:
+            return 8;
+        case Struct:
+            return mStruct ? mStruct->mFixedSize : -1;
+    }
+
+    return -1;
+}
+
+// *********************************************************************************
+//                                     StructureDef
+// *********************************************************************************
+
+StructureDef::StructureDef()
+{
+    mFixedSize=-1;
+    mResolved=false;
+}
+
+int StructureDef::indexOf(const QString &aFieldName) const
+{
+    for (int i=0; i<mFields.size(); ++i)
+    {
+        if (mFields.at(i).mName==aFieldName)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// *********************************************************************************
+//                                  StructureTemplate
+// *********************************************************************************
+
+class StructureLexer
+{
+public:
+    enum TokenType
+    {
+        End,
+        Identifier,
+        Number,
+        Symbol,
+        Invalid
+    };
+
+    TokenType mType;
+    QString   mText;
+    qint64    mNumber;
+    int       mLine;
+
+    StructureLexer(const QString &aText)
+    {
+        mSource=aText;
+        mPos=0;
+        mLine=1;
+        next();
+    }
+
+    void next()
+    {
+        skipSpaces();
+
+        mText.clear();
+        mNumber=0;
+
+        if (mPos>=mSource.length())
+        {
+            mType=End;
+            return;
+        }
+
+        QChar aChar=mSource.at(mPos);
+
+        if (aChar.isLetter() || aChar=='_')
+        {
+            int aStart=mPos;
+
+            while (mPos<mSource.length() && (mSource.at(mPos).isLetterOrNumber() || mSource.at(mPos)=='_'))
+            {
+                ++mPos;
+            }
+
+            mType=Identifier;
+            mText=mSource.mid(aStart, mPos-aStart);
+        }
+        else
+        if (aChar.isDigit())
+        {
+            int aStart=mPos;
+
+            while (mPos<mSource.length() && (mSource.at(mPos).isLetterOrNumber()))
+            {
+                ++mPos;
+            }
+
+            bool ok;
+
+            mText=mSource.mid(aStart, mPos-aStart);
+            mNumber=mText.toLongLong(&ok, 0);
+            mType=ok ? Number : Invalid;
+        }
+        else
+        {
+            ++mPos;
+
+            mType=QString("{}[];@()+-*/").contains(aChar) ? Symbol : Invalid;
+            mText=aChar;
+        }
+    }
+
+    bool isSymbol(const char *aSymbol) const
+    {
+        return mType==Symbol && mText==aSymbol;
+    }
+
+    bool isIdentifier(const char *aIdentifier) const
+    {
+        return mType==Identifier && mText==aIdentifier;
+    }
+
+private:
+    QString mSource;
+    int     mPos;
+
+    void skipSpaces()
+    {
+        while (mPos<mSource.length())
+        {
+            QChar aChar=mSource.at(mPos);
+
+            if (aChar=='\n')
+            {
+                ++mLine;
+                ++mPos;
+            }
+            else
+            if (aChar.isSpace())
+            {
+                ++mPos;
+            }
+            else
+            if (aChar=='#' || (aChar=='/' && mPos+1<mSource.length() && mSource.at(mPos+1)=='/'))
+            {
+                while (mPos<mSource.length() && mSource.at(mPos)!='\n')
+                {
+                    ++mPos;
+                }
+            }
+            else
+            {
+                break;
+            }
+        }
+    }
+};
+
+// ------------------------------------------------------------------
+
+static bool parseExpression(StructureLexer &aLexer, const StructureDef *aDef, StructureExpression &aExpression, QString &aError);
+
+static bool parseFactor(StructureLexer &aLexer, const StructureDef *aDef, StructureExpression &aExpression, QString &aError)
+{
+    StructureExpression::Token aToken;
+
+    if (aLexer.mType==StructureLexer::Number)
+    {
+        aToken.type=StructureExpression::Number;
+        aToken.value=aLexer.mNumber;
+        aExpression.mTokens.append(aToken);
+
+        aLexer.next();
+        return true;
+    }
+
+    if (aLexer.mType==StructureLexer::Identifier)
+    {
+        int aIndex=aDef->indexOf(aLexer.mText);
+
+        if (aIndex<0)
+        {
+            aError=QString("Unknown field \"%1\"").arg(aLexer.mText);
+            return false;
+        }
+
+        const StructureField &aField=aDef->mFields.at(aIndex);
+
+        if (!aField.isInteger() || aField.mIsArray)
+        {
+            aError=QString("Field \"%1\" is not an integer").arg(aLexer.mText);
+            return false;
+        }
+
+        aToken.type=StructureExpression::Field;
+        aToken.value=aIndex;
+        aExpression.mTokens.append(aToken);
+
+        aLexer.next();
+        return true;
+    }
+
+    if (aLexer.isSymbol("("))
+    {
+        aLexer.next();
+
+        if (!parseExpression(aLexer, aDef, aExpression, aError))
+        {
+            return false;
+        }
+
+        if (!aLexer.isSymbol(")"))
+        {
+            aError="Expected \")\"";
+            return false;
+        }
+
+        aLexer.next();
+        return true;
+    }
+
+    aError=QString("Unexpected \"%1\" in expression").arg(aLexer.mText);
+    return false;
+}
+
+static bool parseTerm(StructureLexer &aLexer, const StructureDef *aDef, StructureExpression &aExpression, QString &aError)
+{
+    if (!parseFactor(aLexer, aDef, aExpression, aError))
+    {
+        return false;
+    }
+
+    while (aLexer.isSymbol("*") || aLexer.isSymbol("/"))
+    {
+        StructureExpression::Token aToken;
+        aToken.type=aLexer.isSymbol("*") ? StructureExpression::Mul : StructureExpression::Div;
+        aToken.value=0;
+
+        aLexer.next();
+
+        if (!parseFactor(aLexer, aDef, aExpression, aError))
+        {
+            return false;
+        }
+
+        aExpression.mTokens.append(aToken);
+    }
+
+    return true;
+}
+
+static bool parseExpression(StructureLexer &aLexer, const StructureDef *aDef, StructureExpression &aExpression, QString &aError)
+{
+    if (!parseTerm(aLexer, aDef, aExpression, aError))
+    {
+        return false;
+    }
+
+    while (aLexer.isSymbol("+") || aLexer.isSymbol("-"))
+    {
+        StructureExpression::Token aToken;
+        aToken.type=aLexer.isSymbol("+") ? StructureExpression::Add : StructureExpression::Sub;
+        aToken.value=0;
+
+        aLexer.next();
+
+        if (!parseTerm(aLexer, aDef, aExpression, aError))
+        {
+            return false;
+        }
+
+        aExpression.mTokens.append(aToken);
+    }
+
+    return true;
+}
+
+static bool typeFromName(const QString &aName, StructureField::Type &aType)
+{
+    static const char *aNames[]={"i8", "u8", "i16", "u16", "i32", "u32", "i64", "u64", "f32", "f64", "char", "bytes"};
+
+    for (int i=0; i<(int)(sizeof(aNames)/sizeof(aNames[0])); ++i)
+    {
+        if (aName==aNames[i])
+        {
+            aType=(StructureField::Type)i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// ------------------------------------------------------------------
+
+StructureTemplate::StructureTemplate()
+{
+    mRoot=0;
+}
+
+StructureTemplate::~StructureTemplate()
+{
+    clear();
+}
+
+void StructureTemplate::clear()
+{
+    for (int i=0; i<mStructures.size(); ++i)
+    {
+        delete mStructures.at(i);
+    }
+
+    mStructures.clear();
+    mRoot=0;
+}
+
+bool StructureTemplate::parse(const QString &aText, QString *aError)
+{
+    clear();
+
+    StructureLexer aLexer(aText);
+    QString        aRootName;
+    QString        aErrorText;
+    bool           aBigEndian=false;
+
+    while (aErrorText.isEmpty() && aLexer.mType!=StructureLexer::End)
+    {
+        if (aLexer.isIdentifier("little") || aLexer.isIdentifier("big"))
+        {
+            aBigEndian=aLexer.isIdentifier("big");
+            aLexer.next();
+
+            if (!aLexer.isSymbol(";"))
+            {
+                aErrorText="Expected \";\"";
+                break;
+            }
+
+            aLexer.next();
+        }
+        else
+        if (aLexer.isIdentifier("root"))
+        {
+            aLexer.next();
+
+            if (aLexer.mType!=StructureLexer::Identifier)
+            {
+                aErrorText="Expected structure name after \"root\"";
+                break;
+            }
+
+            aRootName=aLexer.mText;
+            aLexer.next();
+
+            if (!aLexer.isSymbol(";"))
+            {
+                aErrorText="Expected \";\"";
+                break;
+            }
+
+            aLexer.next();
+        }
+        else
+        if (aLexer.isIdentifier("struct"))
+        {
+            aLexer.next();
+
+            if (aLexer.mType!=StructureLexer::Identifier)
+            {
+                aErrorText="Expected structure name";
+                break;
+            }
+
+            if (structure(aLexer.mText))
+            {
+                aErrorText=QString("Structure \"%1\" already defined").arg(aLexer.mText);
+                break;
+            }
+
+            StructureDef *aDef=new StructureDef();
+            aDef->mName=aLexer.mText;
+            mStructures.append(aDef);
+
+            aLexer.next();
+
+            if (!aLexer.isSymbol("{"))
+            {
+                aErrorText="Expected \"{\"";
+                break;
+            }
+
+            aLexer.next();
+
+            bool aStructBigEndian=aBigEndian;
+
+            while (aErrorText.isEmpty() && !aLexer.isSymbol("}"))
+            {
+                if (aLexer.mType!=StructureLexer::Identifier)
+                {
+                    aErrorText=QString("Unexpected \"%1\"").arg(aLexer.mText);
+                    break;
+                }
+
+                if (aLexer.isIdentifier("little") || aLexer.isIdentifier("big"))
+                {
+                    aStructBigEndian=aLexer.isIdentifier("big");
+                    aLexer.next();
+
+                    if (!aLexer.isSymbol(";"))
+                    {
+                        aErrorText="Expected \";\"";
+                    }
+
+                    aLexer.next();
+                    continue;
+                }
+
+                StructureField aField;
+                aField.mBigEndian=aStructBigEndian;
+
+                if (aLexer.isIdentifier("le") || aLexer.isIdentifier("be"))
+                {
+                    aField.mBigEndian=aLexer.isIdentifier("be");
+                    aLexer.next();
+
+                    if (aLexer.mType!=StructureLexer::Identifier)
+                    {
+                        aErrorText="Expected type name";
+                        break;
+                    }
+                }
+
+                if (!typeFromName(aLexer.mText, aField.mType))
+                {
+                    aField.mType=StructureField::Struct;
+                    aField.mStructName=aLexer.mText;
+                }
+
+                aLexer.next();
+
+                if (aLexer.mType!=StructureLexer::Identifier)
+                {
+                    aErrorText="Expected field name";
+                    break;
+                }
+
+                if (aDef->indexOf(aLexer.mText)>=0)
+                {
+                    aErrorText=QString("Field \"%1\" already defined").arg(aLexer.mText);
+                    break;
+                }
+
+                aField.mName=aLexer.mText;
+                aLexer.next();
+
+                if (aLexer.isSymbol("["))
+                {
+                    aField.mIsArray=true;
+                    aLexer.next();
+
+                    if (!aLexer.isSymbol("]"))
+                    {
+                        if (!parseExpression(aLexer, aDef, aField.mCount, aErrorText))
+                        {
+                            break;
+                        }
+
+                        if (!aLexer.isSymbol("]"))
+                        {
+                            aErrorText="Expected \"]\"";
+                            break;
+                        }
+                    }
+
+                    aLexer.next();
+                }
+
+                if (aLexer.isSymbol("@"))
+                {
+                    aField.mHasOffset=true;
+                    aLexer.next();
+
+                    if (!parseExpression(aLexer, aDef, aField.mOffset, aErrorText))
+                    {
+                        break;
+                    }
+                }
+
+                if (!aLexer.isSymbol(";"))
+                {
+                    aErrorText="Expected \";\"";
+                    break;
+                }
+
+                aLexer.next();
+
+                aDef->mFields.append(aField);
+            }
+
+            if (!aErrorText.isEmpty())
+            {
+                break;
+            }
+
+            aLexer.next();
+
+            if (aLexer.isSymbol(";"))
+            {
+                aLexer.next();
+            }
+        }
+        else
+        {
+            aErrorText=QString("Unexpected \"%1\"").arg(aLexer.mText);
+        }
+    }
+
+    if (aErrorText.isEmpty())
+    {
+        if (mStructures.isEmpty())
+        {
+            aErrorText="No structures defined";
+        }
+        else
+        if (aRootName.isEmpty())
+        {
+            mRoot=mStructures.last();
+        }
+        else
+        {
+            mRoot=(StructureDef *)structure(aRootName);
+
+            if (!mRoot)
+            {
+                aErrorText=QString("Unknown root structure \"%1\"").arg(aRootName);
+            }
+        }
+    }
+    else
+    {
+        aErrorText=QString("Line %1: %2").arg(aLexer.mLine).arg(aErrorText);
+    }
+
+    if (aErrorText.isEmpty() && resolve(&aErrorText))
+    {
+        return true;
+    }
+
+    if (aError)
+    {
+        *aError=aErrorText;
+    }
+
+    clear();
+
+    return false;
+}
+
+bool StructureTemplate::resolve(QString *aError)
+{
+    for (int i=0; i<mStructures.size(); ++i)
+    {
+        StructureDef *aDef=mStructures.at(i);
+
+        for (int j=0; j<aDef->mFields.size(); ++j)
+        {
+            StructureField &aField=aDef->mFields[j];
+
+            if (aField.mType==StructureField::Struct)
+            {
+                aField.mStruct=(StructureDef *)structure(aField.mStructName);
+
+                if (!aField.mStruct)
+                {
+                    *aError=QString("Unknown type \"%1\" of field \"%2.%3\"").arg(aField.mStructName).arg(aDef->mName).arg(aField.mName);
+                    return false;
+                }
+            }
+        }
+    }
+
+    for (int i=0; i<mStructures.size(); ++i)
+    {
+        QList<StructureDef *> aStack;
+
+        if (computeFixedSize(mStructures.at(i), aStack)==-2)
+        {
+            *aError=QString("Structure \"%1\" contains itself").arg(mStructures.at(i)->mName);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+qint64 StructureTemplate::computeFixedSize(StructureDef *aDef, QList<StructureDef *> &aStack)
+{
+    if (aStack.contains(aDef))
+    {
+        return -2;
+    }
+
+    if (aDef->mResolved)
+    {
+        return aDef->mFixedSize;
+    }
+
+    aStack.append(aDef);
+
+    bool   aFixed=true;
+    qint64 aSize=0;
+
+    QVector<qint64> aOffsets;
+
+    for (int i=0; i<aDef->mFields.size(); ++i)
+    {
+        const StructureField &aField=aDef->mFields.at(i);
+
+        if (aField.mType==StructureField::Struct)
+        {
+            qint64 aChildSize=computeFixedSize(aField.mStruct, aStack);
+
+            if (aChildSize==-2)
+            {
+                if (!aField.mIsArray)
+                {
+                    return -2;
+                }
+
+                aChildSize=-1;
+            }
+
+            if (aChildSize<0)
+            {
+                aFixed=false;
+            }
+        }
+
+        if (aField.mHasOffset || (aField.mIsArray && (aField.mCount.isEmpty() || !aField.mCount.isConstant())))
+        {
+            aFixed=false;
+        }
+
+        if (aFixed)
+        {
+            aOffsets.append(aSize);
+            aSize+=aField.elementSize()*(aField.mIsArray ? aField.mCount.evaluate(0) : 1);
+        }
+    }
+
+    aStack.removeLast();
+
+    if (aFixed)
+    {
+        aDef->mFieldOffsets=aOffsets;
+        aDef->mFixedSize=aSize;
+    }
+
+    aDef->mResolved=true;
+
+    return aDef->mFixedSize;
+}
+
+const StructureDef* StructureTemplate::root() const
+{
+    return mRoot;
+}
+
+const StructureDef* StructureTemplate::structure(const QString &aName) const
+{
+    for (int i=0; i<mStructures.size(); ++i)
+    {
+        if (mStructures.at(i)->mName==aName)
+        {
+            return mStructures.at(i);
+        }
+    }
+
+    return 0;
+}
+
+int StructureTemplate::structuresCount() const
+{
+    return mStructures.size();
+}
@@ -0,0 +1,151 @@
+#ifndef STRUCTURETEMPLATE_H
+#define STRUCTURETEMPLATE_H
+
+#include <QString>
+#include <QList>
+#include <QVector>
+
+class StructureDef;
+
+class StructureValueProvider
+{
+public:
+    virtual ~StructureValueProvider() {}
+
+    virtual qint64 fieldValue(int aFieldIndex) = 0;
+};
+
+// *********************************************************************************
+
+class StructureExpression
+{
+public:
+    enum TokenType
+    {
+        Number,
+        Field,
+        Add,
+        Sub,
+        Mul,
+        Div
+    };
+
+    struct Token
+    {
+        TokenType type;
+        qint64    value;
+    };
+
+    QVector<Token> mTokens; // Reverse polish notation
+
+    bool   isEmpty() const;
+    bool   isConstant() const;
+    qint64 evaluate(StructureValueProvider *aProvider) const;
+};
+
+// *********************************************************************************
+
+class StructureField
+{
+public:
+    enum Type
+    {
+        Int8,
+        UInt8,
+        Int16,
+        UInt16,
+        Int32,
+        UInt32,
+        Int64,
+        UInt64,
+        Float,
+        Double,
+        Char,
+        Bytes,
+        Struct
+    };
+
+    QString             mName;
+    Type                mType;
+    bool                mBigEndian;
+    QString             mStructName;
+    StructureDef       *mStruct;
+    bool                mIsArray;
+    StructureExpression mCount;  // Empty count for array means "until the end of the parent"
+    bool                mHasOffset;
+    StructureExpression mOffset; // Relative to the start of the parent structure
+
+    StructureField();
+
+    bool   isScalar() const;
+    bool   isInteger() const;
+    qint64 elementSize() const;  // -1 if it depends on the data
+};
+
+// *********************************************************************************
+
+class StructureDef
+{
+public:
+    QString               mName;
+    QList<StructureField> mFields;
+    QVector<qint64>       mFieldOffsets; // Valid only if mFixedSize>=0
+    qint64                mFixedSize;    // -1 if size depends on the data
+    bool                  mResolved;
+
+    StructureDef();
+
+    int indexOf(const QString &aFieldName) const;
+};
+
+// *********************************************************************************
+
+/*
+ * Declarative description of a binary format. Example:
+ *
+ *     struct Record
+ *     {
+ *         u32   length;
+ *         be u16 kind;
+ *         bytes payload[length];
+ *     }
+ *
+ *     struct File
+ *     {
+ *         char   magic[4];
+ *         u32    count;
+ *         Record records[count];
+ *     }
+ *
+ *     root File;
+ *
+ * Supported types: i8 u8 i16 u16 i32 u32 i64 u64 f32 f64 char bytes and
+ * any declared structure. "little;" / "big;" switch default endianness,
+ * "le" / "be" override it per field, "[]" makes an array lasting until the
+ * end of the parent and "@ expr" places a field at an offset from the
+ * start of the parent. Expressions may refer to earlier integer fields.
+ */
+class StructureTemplate
+{
+public:
+    StructureTemplate();
+    ~StructureTemplate();
+
+    bool parse(const QString &aText, QString *aError=0);
+
+    const StructureDef* root() const;
+    const StructureDef* structure(const QString &aName) const;
+    int structuresCount() const;
+
+private:
+    QList<StructureDef *> mStructures;
+    StructureDef         *mRoot;
+
+    void clear();
+    bool resolve(QString *aError);
+    qint64 computeFixedSize(StructureDef *aDef, QList<StructureDef *> &aStack);
+
+    Q_DISABLE_COPY(StructureTemplate)
+};
+
+#endif // STRUCTURETEMPLATE_H
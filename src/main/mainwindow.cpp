@@ -1,45 +1,968 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 
+#include "src/widgets/compressionview.h"
+#include "src/widgets/stringsview.h"
+#include "src/engine/hexrecords.h"
+
+#include <QMenuBar>
+#include <QStatusBar>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QTextStream>
+#include <QFileInfo>
+#include <QDockWidget>
+#include <QInputDialog>
+
+#define MAX_SOURCE_WINDOW (256 << 20)
+#define MEMORY_BUDGET     (256 << 20) // Caches and undo history of all tabs
+
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::MainWindow)
 {
     ui->setupUi(this);
 
-    mHexEditor=new HexEditor(this);
-    ui->hexLayout->addWidget(mHexEditor);
+    mMemoryBudget=new MemoryBudget(MEMORY_BUDGET, this);
+
+    mTabWidget=new QTabWidget(this);
+    mTabWidget->setTabsClosable(true);
+    mTabWidget->setMovable(true);
+    mTabWidget->setDocumentMode(true);
+    ui->hexLayout->addWidget(mTabWidget);
+
+    mHexEditor=addTab("Untitled");
+
+    mDataInspector=new DataInspector(mHexEditor, this);
+
+    QDockWidget *aInspectorDock=new QDockWidget("Data inspector", this);
+    aInspectorDock->setObjectName("dataInspectorDock");
+    aInspectorDock->setWidget(mDataInspector);
+    addDockWidget(Qt::RightDockWidgetArea, aInspectorDock);
 
-    QString aData="Hello, World!\n    It is test data for HexEditor...\n\tYou can modify any binary data with it. Please try.\nGarbage:";
+    mLoadProgressBar=new QProgressBar(this);
+    mLoadProgressBar->setMaximumWidth(200);
+    mLoadProgressBar->setVisible(false);
+    statusBar()->addPermanentWidget(mLoadProgressBar);
 
-    for (int i=0; i<1024; ++i)
+    QMenu *aFileMenu=menuBar()->addMenu("File");
+    aFileMenu->addAction("New", this, SLOT(newDocument()), QKeySequence::New);
+    aFileMenu->addAction("Open...", this, SLOT(openFile()), QKeySequence::Open);
+    aFileMenu->addAction("Save as...", this, SLOT(saveFileAs()), QKeySequence::SaveAs);
+    aFileMenu->addAction("Export selection...", this, SLOT(exportSelection()));
+    aFileMenu->addAction("Close", this, SLOT(closeCurrentTab()), QKeySequence::Close);
+    aFileMenu->addSeparator();
+    aFileMenu->addAction("Open device or process...", this, SLOT(openSource()));
+    aFileMenu->addAction("Write back", this, SLOT(writeBack()));
+
+    mFollowTailAction=aFileMenu->addAction("Follow tail");
+    mFollowTailAction->setCheckable(true);
+    connect(mFollowTailAction, SIGNAL(toggled(bool)), this, SLOT(setFollowTail(bool)));
+
+    QMenu *aViewMenu=menuBar()->addMenu("View");
+    QMenu *aEncodingMenu=aViewMenu->addMenu("Text encoding");
+    mEncodingGroup=new QActionGroup(this);
+
+    for (int i=0; i<HexEncoding::TYPES_COUNT; ++i)
     {
-        aData.append("X");
+        QAction *aAction=aEncodingMenu->addAction(HexEncoding::name((HexEncoding::Type)i));
+        aAction->setCheckable(true);
+        aAction->setChecked(i==mHexEditor->encoding());
+        aAction->setData(i);
+        mEncodingGroup->addAction(aAction);
     }
 
-    QByteArray aArray=aData.toUtf8();
+    connect(mEncodingGroup, SIGNAL(triggered(QAction*)), this, SLOT(encodingSelected(QAction*)));
 
-    for (int i=0; i<256; ++i)
+    QMenu *aViewModeMenu=aViewMenu->addMenu("Numbers");
+    mViewModeGroup=new QActionGroup(this);
+
+    for (int i=0; i<HexViewMode::TYPES_COUNT; ++i)
     {
-        aArray.append(i);
+        QAction *aAction=aViewModeMenu->addAction(HexViewMode::name((HexViewMode::Type)i));
+        aAction->setCheckable(true);
+        aAction->setChecked(i==mHexEditor->viewMode().type());
+        aAction->setData(i);
+        mViewModeGroup->addAction(aAction);
     }
 
-    aArray.append(46);
-    aArray.append(78);
-    aArray.append(56);
-    aArray.append(67);
+    connect(mViewModeGroup, SIGNAL(triggered(QAction*)), this, SLOT(viewModeSelected(QAction*)));
 
-    mHexEditor->setData(aArray);
+    aViewMenu->addSeparator();
 
-    QPalette aPalette=mHexEditor->palette();
+    mSplitViewAction=aViewMenu->addAction("Split view");
+    mSplitViewAction->setCheckable(true);
+    connect(mSplitViewAction, SIGNAL(toggled(bool)), this, SLOT(setSplitView(bool)));
 
-    aPalette.setColor(QPalette::Base, QColor(245, 245, 255));
-    aPalette.setColor(QPalette::AlternateBase, QColor(10, 200, 90));
+    QMenu *aBookmarksMenu=menuBar()->addMenu("Bookmarks");
+    aBookmarksMenu->addAction("Toggle bookmark", this, SLOT(toggleBookmark()), QKeySequence(Qt::CTRL + Qt::Key_F2));
+    aBookmarksMenu->addAction("Annotate selection...", this, SLOT(annotateSelection()));
+    aBookmarksMenu->addSeparator();
+    aBookmarksMenu->addAction("Next bookmark", this, SLOT(nextBookmark()), QKeySequence(Qt::Key_F2));
+    aBookmarksMenu->addAction("Previous bookmark", this, SLOT(previousBookmark()), QKeySequence(Qt::SHIFT + Qt::Key_F2));
 
-    mHexEditor->setPalette(aPalette);
+    QMenu *aToolsMenu=menuBar()->addMenu("Tools");
+    aToolsMenu->addAction("Load structure template...", this, SLOT(loadStructureTemplate()));
+    aToolsMenu->addAction(aInspectorDock->toggleViewAction());
+    aToolsMenu->addSeparator();
+    aToolsMenu->addAction("Apply patch...", this, SLOT(applyPatch()));
+    aToolsMenu->addAction("Export patch...", this, SLOT(exportPatch()));
+    aToolsMenu->addSeparator();
+    aToolsMenu->addAction("Transform selection...", this, SLOT(transformSelection()));
+    aToolsMenu->addAction("Open compressed stream...", this, SLOT(openCompressedStream()));
+    aToolsMenu->addAction("Strings...", this, SLOT(extractStrings()));
+    aToolsMenu->addSeparator();
+    aToolsMenu->addAction("Memory budget...", this, SLOT(setMemoryBudget()));
+
+#ifdef HEXEDITOR_PROFILING
+    mOverlayAction=aToolsMenu->addAction("Performance overlay");
+    mOverlayAction->setCheckable(true);
+    connect(mOverlayAction, SIGNAL(toggled(bool)), this, SLOT(setProfilerOverlayVisible(bool)));
+#endif
+
+    connect(mTabWidget, SIGNAL(currentChanged(int)),    this, SLOT(currentTabChanged(int)));
+    connect(mTabWidget, SIGNAL(tabCloseRequested(int)), this, SLOT(closeTab(int)));
 }
 
 MainWindow::~MainWindow()
 {
+    // Tabs are deleted after this, current tab shouldn't change for a half-deleted window
+    disconnect(mTabWidget, 0, this, 0);
+
     delete ui;
 }
+
+HexEditor* MainWindow::addTab(const QString &aTitle)
+{
+    HexEditor *aEditor=new HexEditor(this);
+
+    QPalette aPalette=aEditor->palette();
+
+    aPalette.setColor(QPalette::Base, QColor(245, 245, 255));
+    aPalette.setColor(QPalette::AlternateBase, QColor(10, 200, 90));
+
+    aEditor->setPalette(aPalette);
+
+    connect(aEditor, SIGNAL(loadProgress(qint64,qint64)), this, SLOT(loadProgress(qint64,qint64)));
+    connect(aEditor, SIGNAL(loadFinished(bool,QString)),  this, SLOT(loadFinished(bool,QString)));
+    connect(aEditor, SIGNAL(fileModifiedExternally()),    this, SLOT(fileModifiedExternally()));
+    connect(aEditor, SIGNAL(documentReplaced()),          this, SLOT(followDocument()));
+    connect(aEditor, SIGNAL(rangeChanged(qint64,qint64)), this, SLOT(updateTabTitle()));
+    connect(aEditor, SIGNAL(sessionFound()),              this, SLOT(sessionFound()));
+    connect(aEditor, SIGNAL(journalFailed(QString)),      this, SLOT(journalFailed(QString)));
+    connect(aEditor, SIGNAL(exportProgress(qint64,qint64)), this, SLOT(loadProgress(qint64,qint64)));
+    connect(aEditor, SIGNAL(exportFinished(bool,QString)),  this, SLOT(exportFinished(bool,QString)));
+
+    mMemoryBudget->addEditor(aEditor);
+
+    // Title without the modification mark is kept by the page
+    QSplitter *aSplitter=new QSplitter(Qt::Vertical, this);
+    aSplitter->addWidget(aEditor);
+    aSplitter->setWindowTitle(aTitle);
+
+    mTabWidget->setCurrentIndex(mTabWidget->addTab(aSplitter, aTitle));
+
+    return aEditor;
+}
+
+HexEditor* MainWindow::tabEditor(int aIndex) const
+{
+    return static_cast<HexEditor *>(static_cast<QSplitter *>(mTabWidget->widget(aIndex))->widget(0));
+}
+
+HexEditor* MainWindow::splitEditor(int aIndex) const
+{
+    QSplitter *aSplitter=static_cast<QSplitter *>(mTabWidget->widget(aIndex));
+
+    return aSplitter->count()>1 ? static_cast<HexEditor *>(aSplitter->widget(1)) : 0;
+}
+
+int MainWindow::tabOf(HexEditor *aEditor) const
+{
+    for (int i=0; i<mTabWidget->count(); ++i)
+    {
+        if (tabEditor(i)==aEditor)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+bool MainWindow::isBlank(HexEditor *aEditor) const
+{
+    return aEditor->dataSize()==0
+           &&
+           !aEditor->isModified()
+           &&
+           !aEditor->isLoading()
+           &&
+           aEditor->fileName().isEmpty()
+           &&
+           !aEditor->dataSource();
+}
+
+HexEditor* MainWindow::editorForOpening(const QString &aTitle)
+{
+    if (isBlank(mHexEditor))
+    {
+        setTabTitle(mHexEditor, aTitle);
+        return mHexEditor;
+    }
+
+    return addTab(aTitle);
+}
+
+void MainWindow::setTabTitle(HexEditor *aEditor, const QString &aTitle)
+{
+    int aIndex=tabOf(aEditor);
+
+    mTabWidget->widget(aIndex)->setWindowTitle(aTitle);
+    mTabWidget->setTabToolTip(aIndex, aEditor->fileName());
+
+    updateTabTitle();
+}
+
+void MainWindow::newDocument()
+{
+    addTab("Untitled");
+}
+
+void MainWindow::closeTab(int aIndex)
+{
+    HexEditor *aEditor=tabEditor(aIndex);
+
+    if (
+        aEditor->isModified()
+        &&
+        QMessageBox::question(this, "Close", mTabWidget->widget(aIndex)->windowTitle()+" was changed. Close it and lose your changes?", QMessageBox::Yes | QMessageBox::No)!=QMessageBox::Yes
+       )
+    {
+        return;
+    }
+
+    // Changes are thrown away, so they aren't offered at the next opening
+    if (aEditor->isModified())
+    {
+        aEditor->removeJournals();
+    }
+
+    // There is always a tab, so there is always a current editor
+    if (mTabWidget->count()==1)
+    {
+        addTab("Untitled");
+    }
+
+    QWidget *aPage=mTabWidget->widget(aIndex);
+
+    mTabWidget->removeTab(aIndex);
+    delete aPage;
+}
+
+void MainWindow::closeCurrentTab()
+{
+    closeTab(mTabWidget->currentIndex());
+}
+
+void MainWindow::currentTabChanged(int aIndex)
+{
+    if (aIndex<0)
+    {
+        return;
+    }
+
+    mHexEditor=tabEditor(aIndex);
+    mDataInspector->setEditor(mHexEditor);
+    mMemoryBudget->activateEditor(mHexEditor);
+
+    // Actions show state of the current tab without changing it
+    mFollowTailAction->blockSignals(true);
+    mFollowTailAction->setChecked(mHexEditor->isFollowingTail());
+    mFollowTailAction->blockSignals(false);
+
+    mSplitViewAction->blockSignals(true);
+    mSplitViewAction->setChecked(splitEditor(aIndex)!=0);
+    mSplitViewAction->blockSignals(false);
+
+    mEncodingGroup->actions().at(mHexEditor->encoding())->setChecked(true);
+    mViewModeGroup->actions().at(mHexEditor->viewMode().type())->setChecked(true);
+
+#ifdef HEXEDITOR_PROFILING
+    mHexEditor->setProfilerOverlayVisible(mOverlayAction->isChecked());
+#endif
+
+    mLoadProgressBar->setVisible(mHexEditor->isLoading());
+    setWindowTitle(mTabWidget->tabText(aIndex));
+}
+
+void MainWindow::updateTabTitle()
+{
+    for (int i=0; i<mTabWidget->count(); ++i)
+    {
+        QString aTitle=mTabWidget->widget(i)->windowTitle();
+
+        if (tabEditor(i)->isModified())
+        {
+            aTitle.append("*");
+        }
+
+        if (mTabWidget->tabText(i)!=aTitle)
+        {
+            mTabWidget->setTabText(i, aTitle);
+        }
+    }
+
+    setWindowTitle(mTabWidget->tabText(mTabWidget->currentIndex()));
+}
+
+void MainWindow::setMemoryBudget()
+{
+    bool ok;
+    int aLimit=QInputDialog::getInt(this, "Memory budget", QString("Caches and undo history of all tabs, MB (%1 MB used):").arg(mMemoryBudget->usage() >> 20), mMemoryBudget->limit() >> 20, 1, 1 << 20, 1, &ok);
+
+    if (ok)
+    {
+        mMemoryBudget->setLimit((qint64)aLimit << 20);
+    }
+}
+
+void MainWindow::openFile()
+{
+    QString aFileName=QFileDialog::getOpenFileName(this, "Open file");
+
+    if (aFileName.isEmpty())
+    {
+        return;
+    }
+
+    // Intel HEX and S-records are opened at their load addresses
+    if (RecordDataSource::isRecordFile(aFileName))
+    {
+        openRecordFile(aFileName);
+        return;
+    }
+
+    HexEditor *aEditor=editorForOpening(QFileInfo(aFileName).fileName());
+
+    statusBar()->showMessage("Loading "+aFileName);
+
+    aEditor->openFile(aFileName);
+    setTabTitle(aEditor, QFileInfo(aFileName).fileName());
+}
+
+void MainWindow::saveFileAs()
+{
+    QString aFileName=QFileDialog::getSaveFileName(this, "Save as", mHexEditor->fileName());
+
+    if (aFileName.isEmpty())
+    {
+        return;
+    }
+
+    QString aError;
+
+    if (!mHexEditor->saveFile(aFileName, &aError))
+    {
+        QMessageBox::warning(this, "Save as", aError);
+        return;
+    }
+
+    setTabTitle(mHexEditor, QFileInfo(aFileName).fileName());
+}
+
+void MainWindow::exportSelection()
+{
+    QStringList aFilters;
+
+    for (int i=0; i<HexExporter::FORMATS_COUNT; ++i)
+    {
+        aFilters.append(HexExporter::formatFilter((HexExporter::Format)i));
+    }
+
+    QString aFilter;
+    QString aFileName=QFileDialog::getSaveFileName(this, "Export selection", QString(), aFilters.join(";;"), &aFilter);
+
+    if (aFileName.isEmpty())
+    {
+        return;
+    }
+
+    HexExporter::Format aFormat=(HexExporter::Format)qMax(0, aFilters.indexOf(aFilter));
+    QString aError;
+
+    if (!mHexEditor->exportSelection(aFileName, aFormat, &aError))
+    {
+        QMessageBox::warning(this, "Export selection", aError);
+        return;
+    }
+
+    statusBar()->showMessage("Exporting to "+QFileInfo(aFileName).fileName()+"...");
+}
+
+void MainWindow::exportFinished(bool aSuccess, QString aError)
+{
+    if (sender()==mHexEditor)
+    {
+        mLoadProgressBar->setVisible(false);
+        statusBar()->clearMessage();
+    }
+
+    if (!aSuccess && !aError.isEmpty())
+    {
+        QMessageBox::warning(this, "Export selection", aError);
+    }
+}
+
+void MainWindow::openSource()
+{
+    bool ok;
+    QString aName=QInputDialog::getText(this, "Open device or process", "Device path or pid:<process id>:", QLineEdit::Normal, "/dev/", &ok);
+
+    if (!ok || aName.isEmpty())
+    {
+        return;
+    }
+
+    HexDataSource *aSource=HexDataSource::create(aName);
+
+    // Read-only access is enough to look around, write access is asked for by write back
+    if (!aSource->open(false))
+    {
+        QMessageBox::warning(this, "Open device or process", aName+": "+aSource->errorString());
+        delete aSource;
+        return;
+    }
+
+    qint64 aBase=0;
+    qint64 aLength=aSource->size();
+    ProcessMemoryDataSource *aProcess=dynamic_cast<ProcessMemoryDataSource *>(aSource);
+
+    if (aProcess)
+    {
+        QList<ProcessMemoryRegion> aRegions=aProcess->regions();
+        QStringList aNames;
+
+        for (int i=0; i<aRegions.size(); ++i)
+        {
+            aNames.append(QString("%1-%2 %3 %4").arg(aRegions.at(i).start, 0, 16).arg(aRegions.at(i).end, 0, 16).arg(aRegions.at(i).permissions).arg(aRegions.at(i).name));
+        }
+
+        QString aRegion=QInputDialog::getItem(this, "Open process memory", "Region:", aNames, 0, false, &ok);
+
+        if (!ok)
+        {
+            delete aSource;
+            return;
+        }
+
+        aBase=aRegions.at(aNames.indexOf(aRegion)).start;
+        aLength=aRegions.at(aNames.indexOf(aRegion)).end-aBase;
+    }
+    else
+    if (aLength>MAX_SOURCE_WINDOW)
+    {
+        QString aOffset=QInputDialog::getText(this, "Open device", QString("Device is larger than %1 MB, offset (hex):").arg(MAX_SOURCE_WINDOW >> 20), QLineEdit::Normal, "0", &ok);
+
+        if (!ok)
+        {
+            delete aSource;
+            return;
+        }
+
+        aBase=aOffset.toLongLong(0, 16);
+        aLength=aSource->size()-aBase;
+    }
+
+    openSourceWindow(aSource, aBase, aLength, QString("%1 @ %2").arg(aName).arg(aBase, 0, 16), "Open device or process");
+}
+
+void MainWindow::openRecordFile(const QString &aFileName)
+{
+    RecordDataSource *aSource=new RecordDataSource(aFileName);
+
+    if (!aSource->open(QFileInfo(aFileName).isWritable()))
+    {
+        QMessageBox::warning(this, "Open file", aFileName+": "+aSource->errorString());
+        delete aSource;
+        return;
+    }
+
+    // Rows start at multiples of 16, so bytes stay in the columns of their addresses
+    qint64 aBase=aSource->start() & ~Q_INT64_C(15);
+    qint64 aLength=aSource->size()-aBase;
+
+    if (aLength>MAX_SOURCE_WINDOW)
+    {
+        bool ok;
+        QString aAddress=QInputDialog::getText(this, "Open file", QString("Records span more than %1 MB, start address (hex):").arg(MAX_SOURCE_WINDOW >> 20), QLineEdit::Normal, QString::number(aBase, 16), &ok);
+
+        if (!ok)
+        {
+            delete aSource;
+            return;
+        }
+
+        aBase=aAddress.toLongLong(0, 16) & ~Q_INT64_C(15);
+        aLength=aSource->size()-aBase;
+    }
+
+    openSourceWindow(aSource, aBase, aLength, QFileInfo(aFileName).fileName(), "Open file");
+}
+
+void MainWindow::openSourceWindow(HexDataSource *aSource, qint64 aBase, qint64 aLength, const QString &aTitle, const QString &aCaption)
+{
+    HexEditor *aEditor=editorForOpening(aTitle);
+    QString aError;
+
+    if (!aEditor->openSource(aSource, aBase, qMin(aLength, (qint64)MAX_SOURCE_WINDOW), &aError))
+    {
+        // Tab made for the source isn't needed anymore
+        if (mTabWidget->count()>1 && isBlank(aEditor))
+        {
+            closeTab(tabOf(aEditor));
+        }
+        else
+        {
+            setTabTitle(aEditor, "Untitled");
+        }
+
+        QMessageBox::warning(this, aCaption, aError);
+        return;
+    }
+
+    setTabTitle(aEditor, aTitle);
+}
+
+void MainWindow::writeBack()
+{
+    QString aError;
+    HexDataSource *aSource=mHexEditor->dataSource();
+
+    if (aSource && !aSource->isWritable())
+    {
+        if (QMessageBox::question(this, "Write back", aSource->name()+" is opened read-only. Reopen it for writing?", QMessageBox::Yes | QMessageBox::No)!=QMessageBox::Yes)
+        {
+            return;
+        }
+
+        // Failed open leaves the source closed, so it is opened read-only again
+        if (!mHexEditor->reopenSource(true, &aError))
+        {
+            mHexEditor->reopenSource(false);
+
+            QMessageBox::warning(this, "Write back", aSource->name()+": "+aError);
+            return;
+        }
+    }
+
+    if (!mHexEditor->writeBack(&aError))
+    {
+        QMessageBox::warning(this, "Write back", aError);
+    }
+}
+
+void MainWindow::loadProgress(qint64 aLoaded, qint64 aTotal)
+{
+    // Tabs in background load silently
+    if (sender()!=mHexEditor)
+    {
+        return;
+    }
+
+    // Bar works with int, so it is scaled to per mille
+    if (aTotal>0)
+    {
+        mLoadProgressBar->setRange(0, 1000);
+        mLoadProgressBar->setValue(aLoaded*1000/aTotal);
+    }
+    else
+    {
+        mLoadProgressBar->setRange(0, 0);
+    }
+
+    mLoadProgressBar->setVisible(true);
+}
+
+void MainWindow::loadFinished(bool aSuccess, QString aError)
+{
+    HexEditor *aEditor=static_cast<HexEditor *>(sender());
+
+    if (aEditor==mHexEditor)
+    {
+        mLoadProgressBar->setVisible(false);
+        statusBar()->clearMessage();
+    }
+
+    if (!aSuccess && !aError.isEmpty())
+    {
+        QMessageBox::warning(this, "Open file", aEditor->fileName()+": "+aError);
+    }
+}
+
+void MainWindow::fileModifiedExternally()
+{
+    HexEditor *aEditor=static_cast<HexEditor *>(sender());
+
+    // Split views don't watch files, so it is always the editor of a tab
+    mTabWidget->setCurrentIndex(tabOf(aEditor));
+
+    if (QMessageBox::question(this, "File changed", "File "+aEditor->fileName()+" was changed outside. Reload it and lose your changes?", QMessageBox::Yes | QMessageBox::No)==QMessageBox::Yes)
+    {
+        aEditor->openFile(aEditor->fileName());
+    }
+}
+
+void MainWindow::sessionFound()
+{
+    HexEditor *aEditor=static_cast<HexEditor *>(sender());
+
+    mTabWidget->setCurrentIndex(tabOf(aEditor));
+
+    if (QMessageBox::question(this, "Restore session", "File "+aEditor->fileName()+" has unsaved changes from the last session. Restore them?", QMessageBox::Yes | QMessageBox::No)==QMessageBox::Yes)
+    {
+        QString aError;
+
+        if (!aEditor->restoreSession(&aError))
+        {
+            QMessageBox::warning(this, "Restore session", aError);
+        }
+    }
+    else
+    {
+        aEditor->discardSession();
+    }
+}
+
+void MainWindow::journalFailed(QString aError)
+{
+    HexEditor *aEditor=static_cast<HexEditor *>(sender());
+
+    QMessageBox::warning(this, "Session journal", aEditor->fileName()+": "+aError+". Changes are not journaled anymore, they can't be restored after a crash.");
+}
+
+void MainWindow::encodingSelected(QAction *aAction)
+{
+    mHexEditor->setEncoding((HexEncoding::Type)aAction->data().toInt());
+}
+
+void MainWindow::viewModeSelected(QAction *aAction)
+{
+    mHexEditor->setViewMode((HexViewMode::Type)aAction->data().toInt());
+}
+
+void MainWindow::setSplitView(bool aSplit)
+{
+    int aIndex=mTabWidget->currentIndex();
+    HexEditor *aSplitEditor=splitEditor(aIndex);
+
+    if (aSplit==(aSplitEditor!=0))
+    {
+        return;
+    }
+
+    if (!aSplit)
+    {
+        delete aSplitEditor;
+        return;
+    }
+
+    // Second view of the same document, without a copy of the data
+    aSplitEditor=new HexEditor(this);
+    aSplitEditor->setPalette(mHexEditor->palette());
+    aSplitEditor->setEncoding(mHexEditor->encoding());
+    aSplitEditor->setViewMode(mHexEditor->viewMode().type());
+    aSplitEditor->shareDocument(mHexEditor);
+
+    connect(aSplitEditor, SIGNAL(rangeChanged(qint64,qint64)), this, SLOT(updateTabTitle()));
+
+    mMemoryBudget->addEditor(aSplitEditor);
+    mMemoryBudget->activateEditor(mHexEditor);
+
+    static_cast<QSplitter *>(mTabWidget->widget(aIndex))->addWidget(aSplitEditor);
+}
+
+void MainWindow::followDocument()
+{
+    HexEditor *aEditor=static_cast<HexEditor *>(sender());
+    int aIndex=tabOf(aEditor);
+
+    // Split view of a tab follows the document of its editor
+    if (aIndex>=0 && splitEditor(aIndex))
+    {
+        splitEditor(aIndex)->shareDocument(aEditor);
+    }
+}
+
+void MainWindow::setFollowTail(bool aFollowTail)
+{
+    mHexEditor->setFollowTail(aFollowTail);
+}
+
+void MainWindow::nextBookmark()
+{
+    mHexEditor->nextAnnotation();
+}
+
+void MainWindow::previousBookmark()
+{
+    mHexEditor->previousAnnotation();
+}
+
+void MainWindow::toggleBookmark()
+{
+    qint64 aStart=mHexEditor->selectionStart();
+    qint64 aEnd=mHexEditor->selectionEnd();
+
+    if (mHexEditor->removeAnnotationsAt(aStart)==0)
+    {
+        mHexEditor->addAnnotation(aStart, aEnd-aStart);
+    }
+}
+
+void MainWindow::annotateSelection()
+{
+    qint64 aStart=mHexEditor->selectionStart();
+    qint64 aEnd=mHexEditor->selectionEnd();
+
+    bool ok;
+    QString aText=QInputDialog::getText(this, "Annotate selection", "Annotation:", QLineEdit::Normal, QString(), &ok);
+
+    if (!ok || aText.isEmpty())
+    {
+        return;
+    }
+
+    mHexEditor->addAnnotation(aStart, aEnd-aStart, aText);
+}
+
+void MainWindow::loadStructureTemplate()
+{
+    QString aFileName=QFileDialog::getOpenFileName(this, "Load structure template", QString(), "Structure templates (*.hst);;All files (*)");
+
+    if (aFileName.isEmpty())
+    {
+        return;
+    }
+
+    QFile aFile(aFileName);
+
+    if (!aFile.open(QIODevice::ReadOnly))
+    {
+        QMessageBox::warning(this, "Structure template", "Can't open file "+aFileName);
+        return;
+    }
+
+    StructureTemplate *aTemplate=new StructureTemplate();
+    QString aError;
+
+    if (!aTemplate->parse(QTextStream(&aFile).readAll(), &aError))
+    {
+        delete aTemplate;
+        QMessageBox::warning(this, "Structure template", aError);
+        return;
+    }
+
+    mHexEditor->setStructureOverlay(new StructureOverlay(aTemplate));
+}
+
+void MainWindow::applyPatch()
+{
+    QString aFileName=QFileDialog::getOpenFileName(this, "Apply patch", QString(), "Patches (*.ips *.bps *.hexdiff);;All files (*)");
+
+    if (aFileName.isEmpty())
+    {
+        return;
+    }
+
+    QFile aFile(aFileName);
+
+    if (!aFile.open(QIODevice::ReadOnly))
+    {
+        QMessageBox::warning(this, "Apply patch", "Can't open file "+aFileName);
+        return;
+    }
+
+    HexPatch aPatch;
+    QString aError;
+
+    if (!aPatch.read(&aFile, &aError) || !mHexEditor->applyPatch(aPatch, &aError))
+    {
+        QMessageBox::warning(this, "Apply patch", aError);
+    }
+}
+
+void MainWindow::exportPatch()
+{
+    QString aFileName=QFileDialog::getSaveFileName(this, "Export patch", QString(), "BPS patch (*.bps);;IPS patch (*.ips);;Text patch (*.hexdiff)");
+
+    if (aFileName.isEmpty())
+    {
+        return;
+    }
+
+    HexPatch::Format aFormat;
+
+    if (aFileName.endsWith(".ips", Qt::CaseInsensitive))
+    {
+        aFormat=HexPatch::FORMAT_IPS;
+    }
+    else
+    if (aFileName.endsWith(".hexdiff", Qt::CaseInsensitive))
+    {
+        aFormat=HexPatch::FORMAT_HEXDIFF;
+    }
+    else
+    {
+        aFormat=HexPatch::FORMAT_BPS;
+    }
+
+    if (!mHexEditor->isHistoryComplete())
+    {
+        QMessageBox::information(this, "Export patch", "Undo history of this tab was dropped to stay within the memory budget, the patch has only the changes made after it");
+    }
+
+    QFile aFile(aFileName);
+
+    if (!aFile.open(QIODevice::WriteOnly))
+    {
+        QMessageBox::warning(this, "Export patch", "Can't create file "+aFileName);
+        return;
+    }
+
+    QString aError;
+
+    if (!mHexEditor->writePatch(&aFile, aFormat, &aError))
+    {
+        QMessageBox::warning(this, "Export patch", aError);
+    }
+}
+
+void MainWindow::transformSelection()
+{
+    QStringList aOperations;
+
+    aOperations.append("Fill");
+    aOperations.append("XOR");
+    aOperations.append("ADD");
+    aOperations.append("SUB");
+    aOperations.append("ROL");
+    aOperations.append("ROR");
+    aOperations.append("Swap 16-bit");
+    aOperations.append("Swap 32-bit");
+    aOperations.append("Swap 64-bit");
+    aOperations.append("Random");
+
+    bool ok;
+    QString aOperationName=QInputDialog::getItem(this, "Transform selection", "Operation:", aOperations, 0, false, &ok);
+
+    if (!ok)
+    {
+        return;
+    }
+
+    HexTransform::Operation aOperation=(HexTransform::Operation)(HexTransform::TRANSFORM_FILL+aOperations.indexOf(aOperationName));
+    QByteArray aKey;
+    int aAmount=0;
+
+    if (aOperation<=HexTransform::TRANSFORM_SUB)
+    {
+        QString aKeyText=QInputDialog::getText(this, "Transform selection", "Key (hex bytes):", QLineEdit::Normal, "00", &ok);
+
+        if (!ok)
+        {
+            return;
+        }
+
+        aKey=QByteArray::fromHex(aKeyText.toLatin1());
+
+        if (aKey.isEmpty())
+        {
+            QMessageBox::warning(this, "Transform selection", "Key is empty");
+            return;
+        }
+    }
+    else
+    if (aOperation==HexTransform::TRANSFORM_ROL || aOperation==HexTransform::TRANSFORM_ROR)
+    {
+        aAmount=QInputDialog::getInt(this, "Transform selection", "Bits:", 1, 1, 7, 1, &ok);
+
+        if (!ok)
+        {
+            return;
+        }
+    }
+
+    HexTransform aTransform(aOperation, aKey, aAmount);
+
+    // All selected ranges are changed by one undo step
+    if (mHexEditor->selection().isEmpty())
+    {
+        mHexEditor->transform(0, mHexEditor->dataSize(), aTransform);
+    }
+    else
+    {
+        mHexEditor->transformSelection(aTransform);
+    }
+}
+
+void MainWindow::openCompressedStream()
+{
+    qint64 aStart=mHexEditor->selectionStart();
+    qint64 aEnd=mHexEditor->selectionEnd();
+
+    if (aStart==aEnd)
+    {
+        QMessageBox::information(this, "Open compressed stream", "Select the compressed stream first");
+        return;
+    }
+
+    // Compressed data is passed to the decompressor in one array
+    if (aEnd-aStart>HexDocument::maxArraySize())
+    {
+        QMessageBox::information(this, "Open compressed stream", "Selection is too large for a compressed stream");
+        return;
+    }
+
+    QList<HexCodec::Type> aTypes=HexCodec::types();
+    QStringList aNames;
+
+    for (int i=0; i<aTypes.size(); ++i)
+    {
+        aNames.append(HexCodec::name(aTypes.at(i)));
+    }
+
+    char aHeader[8];
+    int  aHeaderSize=mHexEditor->readData(aStart, aHeader, (int)qMin(aEnd-aStart, (qint64)sizeof(aHeader)));
+    HexCodec::Type aDetected;
+    int  aDefault=0;
+
+    if (HexCodec::detect((const uchar *)aHeader, aHeaderSize, aDetected))
+    {
+        aDefault=aTypes.indexOf(aDetected);
+    }
+
+    bool ok;
+    QString aName=QInputDialog::getItem(this, "Open compressed stream", "Compression:", aNames, aDefault, false, &ok);
+
+    if (!ok)
+    {
+        return;
+    }
+
+    CompressionView *aView=new CompressionView(mHexEditor, aStart, aEnd-aStart, aTypes.at(aNames.indexOf(aName)), this);
+    aView->show();
+}
+
+void MainWindow::extractStrings()
+{
+    StringsView *aView=new StringsView(mHexEditor, this);
+    aView->show();
+}
+
+#ifdef HEXEDITOR_PROFILING
+void MainWindow::setProfilerOverlayVisible(bool aVisible)
+{
+    mHexEditor->setProfilerOverlayVisible(aVisible);
+}
+#endif
@@ -2,8 +2,14 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
+#include <QProgressBar>
+#include <QSplitter>
+#include <QTabWidget>
+#include <QActionGroup>
 
 #include "src/widgets/hexeditor.h"
+#include "src/widgets/datainspector.h"
+#include "src/widgets/memorybudget.h"
 
 namespace Ui {
 class MainWindow;
@@ -15,10 +21,71 @@ class MainWindow : public QMainWindow
 
 public:
     Ui::MainWindow *ui;
-    HexEditor      *mHexEditor;
+    QTabWidget     *mTabWidget;      // Every tab is a splitter with an editor and its split view
+    HexEditor      *mHexEditor;      // Of the current tab
+    DataInspector  *mDataInspector;
+    QProgressBar   *mLoadProgressBar;
+    MemoryBudget   *mMemoryBudget;
+    QAction        *mFollowTailAction;
+    QAction        *mSplitViewAction;
+    QActionGroup   *mEncodingGroup;
+    QActionGroup   *mViewModeGroup;
+
+#ifdef HEXEDITOR_PROFILING
+    QAction        *mOverlayAction;
+#endif
 
     explicit MainWindow(QWidget *parent = 0);
     ~MainWindow();
+
+private:
+    HexEditor* addTab(const QString &aTitle);
+    HexEditor* tabEditor(int aIndex) const;
+    HexEditor* splitEditor(int aIndex) const; // 0 if view isn't split
+    int tabOf(HexEditor *aEditor) const;
+    bool isBlank(HexEditor *aEditor) const;
+    HexEditor* editorForOpening(const QString &aTitle); // Blank current tab or a new one
+    void setTabTitle(HexEditor *aEditor, const QString &aTitle);
+    void openRecordFile(const QString &aFileName);
+    void openSourceWindow(HexDataSource *aSource, qint64 aBase, qint64 aLength, const QString &aTitle, const QString &aCaption); // Takes ownership of opened aSource
+
+private slots:
+    void newDocument();
+    void closeTab(int aIndex);
+    void closeCurrentTab();
+    void currentTabChanged(int aIndex);
+    void updateTabTitle();
+    void setMemoryBudget();
+    void openFile();
+    void saveFileAs();
+    void exportSelection();
+    void openSource();
+    void writeBack();
+    void loadProgress(qint64 aLoaded, qint64 aTotal);
+    void loadFinished(bool aSuccess, QString aError);
+    void exportFinished(bool aSuccess, QString aError);
+    void fileModifiedExternally();
+    void sessionFound();
+    void journalFailed(QString aError);
+    void encodingSelected(QAction *aAction);
+    void viewModeSelected(QAction *aAction);
+    void setSplitView(bool aSplit);
+    void followDocument();
+    void setFollowTail(bool aFollowTail);
+    void nextBookmark();
+    void previousBookmark();
+    void toggleBookmark();
+    void annotateSelection();
+    void loadStructureTemplate();
+    void applyPatch();
+    void exportPatch();
+    void transformSelection();
+    void openCompressedStream();
+    void extractStrings();
+
+#ifdef HEXEDITOR_PROFILING
+    void setProfilerOverlayVisible(bool aVisible);
+#endif
 };
 
 #endif // MAINWINDOW_H
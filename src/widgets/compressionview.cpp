@@ -0,0 +1,192 @@
+#include "compressionview.h"
+
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QScrollBar>
+#include <QMessageBox>
+
+#define PREFETCH_SIZE (1 << 20)
+
+CompressionView::CompressionView(HexEditor *aParentEditor, qint64 aPos, qint64 aLength, HexCodec::Type aType, QWidget *parent) :
+    QWidget(parent, Qt::Window)
+{
+    setAttribute(Qt::WA_DeleteOnClose);
+    setWindowTitle(QString("%1 stream at %2").arg(HexCodec::name(aType)).arg(QString::number(aPos, 16).toUpper()));
+    resize(800, 500);
+
+    mParentEditor=aParentEditor;
+    mPos=aPos;
+    mStreamLength=aLength;
+    mType=aType;
+    mParentVersion=aParentEditor->dataVersion();
+
+    mComplete=false;
+    mRecompressPending=false;
+
+
+
+    mEditor=new HexEditor(this);
+    mEditor->setReadOnly(true);
+    mEditor->setPalette(aParentEditor->palette());
+
+    mStatusLabel=new QLabel(this);
+    mLoadAllButton=new QPushButton("Load all", this);
+    mRecompressButton=new QPushButton("Recompress", this);
+
+    QHBoxLayout *aButtonsLayout=new QHBoxLayout();
+    aButtonsLayout->addWidget(mStatusLabel, 1);
+    aButtonsLayout->addWidget(mLoadAllButton);
+    aButtonsLayout->addWidget(mRecompressButton);
+
+    QVBoxLayout *aLayout=new QVBoxLayout(this);
+    aLayout->addWidget(mEditor, 1);
+    aLayout->addLayout(aButtonsLayout);
+
+
+
+    QByteArray aCompressed((int)aLength, 0);
+    aParentEditor->readData(aPos, aCompressed.data(), aLength);
+
+    mDecompressor=new StreamDecompressor(aType, aCompressed, this);
+
+    connect(mDecompressor, SIGNAL(blockDecompressed(QByteArray)), this, SLOT(blockDecompressed(QByteArray)));
+    connect(mDecompressor, SIGNAL(decompressionFinished(bool,QString)), this, SLOT(decompressionFinished(bool,QString)));
+    connect(mEditor->verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(scrolled()));
+    connect(mLoadAllButton, SIGNAL(clicked()), this, SLOT(loadAll()));
+    connect(mRecompressButton, SIGNAL(clicked()), this, SLOT(recompress()));
+
+    mDecompressor->request(PREFETCH_SIZE);
+    mDecompressor->start();
+
+    updateStatus();
+}
+
+HexEditor* CompressionView::editor() const
+{
+    return mEditor;
+}
+
+void CompressionView::updateStatus()
+{
+    QString aStatus=QString("%1 bytes decompressed").arg(mEditor->dataSize());
+
+    if (!mError.isEmpty())
+    {
+        aStatus.append(". Error: "+mError);
+    }
+    else
+    if (mRecompressPending)
+    {
+        aStatus.append(". Waiting for the rest of the stream to recompress...");
+    }
+    else
+    if (!mComplete)
+    {
+        aStatus.append(". Load all to edit");
+    }
+
+    mStatusLabel->setText(aStatus);
+}
+
+void CompressionView::blockDecompressed(QByteArray aBlock)
+{
+    mEditor->appendData(aBlock);
+    updateStatus();
+}
+
+void CompressionView::decompressionFinished(bool aSuccess, QString aError)
+{
+    mComplete=true;
+    mError=aError;
+
+    if (aSuccess)
+    {
+        // Selection may be longer than the stream itself
+        mStreamLength=mDecompressor->compressedSize();
+        mEditor->setReadOnly(false);
+    }
+    else
+    {
+        mRecompressButton->setEnabled(false);
+    }
+
+    mLoadAllButton->setEnabled(false);
+    updateStatus();
+
+    if (mRecompressPending && aSuccess)
+    {
+        recompress();
+    }
+    else
+    {
+        mRecompressPending=false;
+    }
+}
+
+void CompressionView::scrolled()
+{
+    if (mComplete)
+    {
+        return;
+    }
+
+    QScrollBar *aScrollBar=mEditor->verticalScrollBar();
+
+    if (aScrollBar->value()+aScrollBar->pageStep()*2>=aScrollBar->maximum())
+    {
+        mDecompressor->request(mEditor->dataSize()+PREFETCH_SIZE);
+    }
+}
+
+void CompressionView::loadAll()
+{
+    mDecompressor->request(-1);
+}
+
+void CompressionView::recompress()
+{
+    if (!mComplete)
+    {
+        mRecompressPending=true;
+        loadAll();
+        updateStatus();
+        return;
+    }
+
+    mRecompressPending=false;
+
+    if (!mParentEditor)
+    {
+        QMessageBox::warning(this, "Recompress", "Editor that the stream was opened from is closed");
+        return;
+    }
+
+    if (
+        mParentEditor->dataVersion()!=mParentVersion
+        &&
+        QMessageBox::question(this, "Recompress", "Data was modified since the stream was opened. Replace it anyway?", QMessageBox::Yes | QMessageBox::No)!=QMessageBox::Yes
+       )
+    {
+        return;
+    }
+
+    QByteArray aCompressed;
+    QString aError;
+
+    // Decompressed data is read chunk by chunk, not copied to one array
+    if (!HexCodec::compress(mType, mEditor->document(), aCompressed, &aError))
+    {
+        QMessageBox::warning(this, "Recompress", aError);
+        return;
+    }
+
+    qint64 aOldLength=mStreamLength;
+
+    mParentEditor->replace(mPos, mStreamLength, aCompressed);
+
+    mStreamLength=aCompressed.size();
+    mParentVersion=mParentEditor->dataVersion();
+
+    updateStatus();
+    mStatusLabel->setText(mStatusLabel->text()+QString(". Recompressed: %1 -> %2 bytes").arg(aOldLength).arg(mStreamLength));
+}
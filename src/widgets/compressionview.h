@@ -0,0 +1,53 @@
+#ifndef COMPRESSIONVIEW_H
+#define COMPRESSIONVIEW_H
+
+#include <QWidget>
+#include <QLabel>
+#include <QPushButton>
+#include <QPointer>
+
+#include "hexeditor.h"
+#include "src/engine/streamdecompressor.h"
+
+/*
+ * Window with decompressed contents of a range of another editor.
+ * Stream is decompressed only as far as it is scrolled, and it becomes
+ * editable once decompressed completely.
+ */
+class CompressionView : public QWidget
+{
+    Q_OBJECT
+
+public:
+    CompressionView(HexEditor *aParentEditor, qint64 aPos, qint64 aLength, HexCodec::Type aType, QWidget *parent = 0);
+
+    HexEditor* editor() const;
+
+protected:
+    QPointer<HexEditor> mParentEditor; // Null after the tab of the editor is closed
+    qint64              mPos;
+    qint64              mStreamLength;
+    HexCodec::Type      mType;
+    quint64             mParentVersion;
+
+    HexEditor          *mEditor;
+    QLabel             *mStatusLabel;
+    QPushButton        *mLoadAllButton;
+    QPushButton        *mRecompressButton;
+    StreamDecompressor *mDecompressor;
+
+    bool                mComplete;
+    bool                mRecompressPending;
+    QString             mError;
+
+    void updateStatus();
+
+protected slots:
+    void blockDecompressed(QByteArray aBlock);
+    void decompressionFinished(bool aSuccess, QString aError);
+    void scrolled();
+    void loadAll();
+    void recompress();
+};
+
+#endif // COMPRESSIONVIEW_H
@@ -0,0 +1,528 @@
+#include "datainspector.h"
+
+#include <QHeaderView>
+#include <QDateTime>
+#include <QtEndian>
+
+#include <string.h>
+
+#define INSPECTOR_BYTES 16
+
+static int decodeLeb128(const uchar *aData, int aAvailable, bool aSigned, quint64 &aValue)
+{
+    aValue=0;
+
+    int aShift=0;
+
+    for (int i=0; i<aAvailable && i<10; ++i)
+    {
+        aValue|=((quint64)(aData[i] & 0x7F)) << aShift;
+        aShift+=7;
+
+        if ((aData[i] & 0x80)==0)
+        {
+            if (aSigned && aShift<64 && (aData[i] & 0x40))
+            {
+                aValue|=Q_UINT64_C(0xFFFFFFFFFFFFFFFF) << aShift;
+            }
+
+            return i+1;
+        }
+    }
+
+    return 0;
+}
+
+static int encodeLeb128(quint64 aValue, bool aSigned, uchar *aData)
+{
+    int aLength=0;
+
+    while (true)
+    {
+        uchar aByte=aValue & 0x7F;
+
+        if (aSigned)
+        {
+            aValue=(quint64)(((qint64)aValue) >> 7);
+
+            if ((aValue==0 && (aByte & 0x40)==0) || (aValue==Q_UINT64_C(0xFFFFFFFFFFFFFFFF) && (aByte & 0x40)))
+            {
+                aData[aLength++]=aByte;
+                break;
+            }
+        }
+        else
+        {
+            aValue>>=7;
+
+            if (aValue==0)
+            {
+                aData[aLength++]=aByte;
+                break;
+            }
+        }
+
+        aData[aLength++]=aByte | 0x80;
+    }
+
+    return aLength;
+}
+
+static QString timeToString(qint64 aSeconds)
+{
+    if (aSeconds<Q_INT64_C(-62135596800) || aSeconds>Q_INT64_C(253402300799)) // 0001-01-01 .. 9999-12-31
+    {
+        return "Invalid";
+    }
+
+    QDateTime aDateTime;
+    aDateTime.setTimeSpec(Qt::UTC);
+    aDateTime.setMSecsSinceEpoch(aSeconds*1000);
+
+    return aDateTime.toString("yyyy-MM-dd hh:mm:ss")+" UTC";
+}
+
+// ------------------------------------------------------------------
+
+DataInspector::DataInspector(HexEditor *aEditor, QWidget *parent) :
+    QTableWidget(ROW_COUNT, COLUMN_COUNT, parent)
+{
+    mEditor=aEditor;
+    mPosition=-1;
+    mUpdating=false;
+
+    setHorizontalHeaderLabels(QStringList() << "Little endian" << "Big endian");
+    setVerticalHeaderLabels(
+                            QStringList()
+                            << "int8"
+                            << "uint8"
+                            << "int16"
+                            << "uint16"
+                            << "int32"
+                            << "uint32"
+                            << "int64"
+                            << "uint64"
+                            << "float"
+                            << "double"
+                            << "time_t (32)"
+                            << "time_t (64)"
+                            << "GUID"
+                            << "ULEB128"
+                            << "SLEB128"
+                           );
+
+    horizontalHeader()->setStretchLastSection(true);
+    setSelectionMode(QAbstractItemView::SingleSelection);
+
+    for (int i=0; i<ROW_COUNT; ++i)
+    {
+        for (int j=0; j<COLUMN_COUNT; ++j)
+        {
+            QTableWidgetItem *aItem=new QTableWidgetItem();
+
+            if ((i==ROW_INT8 || i==ROW_UINT8 || i==ROW_ULEB128 || i==ROW_SLEB128) && j==COLUMN_BIG_ENDIAN)
+            {
+                aItem->setFlags(Qt::ItemIsEnabled);
+            }
+
+            setItem(i, j, aItem);
+        }
+    }
+
+    connect(mEditor, SIGNAL(positionChanged(qint64)),        this, SLOT(positionChanged(qint64)));
+    connect(mEditor, SIGNAL(rangeChanged(qint64, qint64)),   this, SLOT(rangeChanged(qint64, qint64)));
+    connect(this,    SIGNAL(itemChanged(QTableWidgetItem*)), this, SLOT(valueEdited(QTableWidgetItem*)));
+
+    positionChanged(mEditor->position());
+}
+
+HexEditor* DataInspector::editor() const
+{
+    return mEditor;
+}
+
+void DataInspector::setEditor(HexEditor *aEditor)
+{
+    if (mEditor==aEditor)
+    {
+        return;
+    }
+
+    disconnect(mEditor, 0, this, 0);
+
+    mEditor=aEditor;
+
+    connect(mEditor, SIGNAL(positionChanged(qint64)),        this, SLOT(positionChanged(qint64)));
+    connect(mEditor, SIGNAL(rangeChanged(qint64, qint64)),   this, SLOT(rangeChanged(qint64, qint64)));
+
+    // Same position in other data has other values
+    mPosition=mEditor->position();
+    updateValues();
+}
+
+void DataInspector::positionChanged(qint64 aPosition)
+{
+    if (mPosition!=aPosition)
+    {
+        mPosition=aPosition;
+        updateValues();
+    }
+}
+
+void DataInspector::rangeChanged(qint64 aPos, qint64 aLength)
+{
+    if (aPos<mPosition+INSPECTOR_BYTES && (aLength<0 || aPos+aLength>mPosition))
+    {
+        updateValues();
+    }
+}
+
+void DataInspector::updateValues()
+{
+    uchar aBuffer[INSPECTOR_BYTES];
+    int aAvailable=mEditor->readData(mPosition, (char *)aBuffer, INSPECTOR_BYTES);
+
+    mUpdating=true;
+
+    for (int i=0; i<ROW_COUNT; ++i)
+    {
+        for (int j=0; j<COLUMN_COUNT; ++j)
+        {
+            QTableWidgetItem *aItem=item(i, j);
+            QString aText;
+
+            if (aItem->flags() & Qt::ItemIsEditable)
+            {
+                aText=decode(i, j==COLUMN_BIG_ENDIAN, aBuffer, aAvailable);
+            }
+
+            if (aItem->text()!=aText)
+            {
+                aItem->setText(aText);
+            }
+        }
+    }
+
+    mUpdating=false;
+}
+
+void DataInspector::valueEdited(QTableWidgetItem *aItem)
+{
+    if (mUpdating)
+    {
+        return;
+    }
+
+    int  aRow=aItem->row();
+    bool aBigEndian=aItem->column()==COLUMN_BIG_ENDIAN;
+
+    uchar aBuffer[INSPECTOR_BYTES];
+    int   aLength;
+
+    if (mEditor->isReadOnly() || !encode(aRow, aBigEndian, aItem->text(), aBuffer, aLength))
+    {
+        updateValues();
+        return;
+    }
+
+    QByteArray aArray((const char *)aBuffer, aLength);
+
+    if (aRow==ROW_ULEB128 || aRow==ROW_SLEB128)
+    {
+        uchar   aOld[INSPECTOR_BYTES];
+        quint64 aValue;
+        int     aOldLength=decodeLeb128(aOld, mEditor->readData(mPosition, (char *)aOld, INSPECTOR_BYTES), aRow==ROW_SLEB128, aValue);
+
+        if (aOldLength==0 || (aOldLength!=aLength && mEditor->mode()!=HexEditor::INSERT))
+        {
+            updateValues();
+            return;
+        }
+
+        mEditor->replace(mPosition, aOldLength, aArray);
+    }
+    else
+    {
+        if (mPosition+aLength>mEditor->dataSize())
+        {
+            updateValues();
+            return;
+        }
+
+        mEditor->replace(mPosition, aArray);
+    }
+}
+
+// ------------------------------------------------------------------
+
+int DataInspector::rowSize(int aRow)
+{
+    switch (aRow)
+    {
+        case ROW_INT8:
+        case ROW_UINT8:
+            return 1;
+        case ROW_INT16:
+        case ROW_UINT16:
+            return 2;
+        case ROW_INT32:
+        case ROW_UINT32:
+        case ROW_FLOAT:
+        case ROW_TIME32:
+            return 4;
+        case ROW_INT64:
+        case ROW_UINT64:
+        case ROW_DOUBLE:
+        case ROW_TIME64:
+            return 8;
+        case ROW_GUID:
+            return 16;
+    }
+
+    return -1;
+}
+
+QString DataInspector::decode(int aRow, bool aBigEndian, const uchar *aData, int aAvailable)
+{
+    if (aAvailable<rowSize(aRow))
+    {
+        return QString();
+    }
+
+    switch (aRow)
+    {
+        case ROW_INT8:   return QString::number((qint8)aData[0]);
+        case ROW_UINT8:  return QString::number(aData[0]);
+        case ROW_INT16:  return QString::number(aBigEndian ? qFromBigEndian<qint16>(aData)   : qFromLittleEndian<qint16>(aData));
+        case ROW_UINT16: return QString::number(aBigEndian ? qFromBigEndian<quint16>(aData)  : qFromLittleEndian<quint16>(aData));
+        case ROW_INT32:  return QString::number(aBigEndian ? qFromBigEndian<qint32>(aData)   : qFromLittleEndian<qint32>(aData));
+        case ROW_UINT32: return QString::number(aBigEndian ? qFromBigEndian<quint32>(aData)  : qFromLittleEndian<quint32>(aData));
+        case ROW_INT64:  return QString::number(aBigEndian ? qFromBigEndian<qint64>(aData)   : qFromLittleEndian<qint64>(aData));
+        case ROW_UINT64: return QString::number(aBigEndian ? qFromBigEndian<quint64>(aData)  : qFromLittleEndian<quint64>(aData));
+        case ROW_FLOAT:
+        {
+            quint32 aBits=aBigEndian ? qFromBigEndian<quint32>(aData) : qFromLittleEndian<quint32>(aData);
+            float aValue;
+            memcpy(&aValue, &aBits, sizeof(aValue));
+
+            return QString::number(aValue, 'g', 9);
+        }
+        case ROW_DOUBLE:
+        {
+            quint64 aBits=aBigEndian ? qFromBigEndian<quint64>(aData) : qFromLittleEndian<quint64>(aData);
+            double aValue;
+            memcpy(&aValue, &aBits, sizeof(aValue));
+
+            return QString::number(aValue, 'g', 17);
+        }
+        case ROW_TIME32: return timeToString(aBigEndian ? qFromBigEndian<qint32>(aData) : qFromLittleEndian<qint32>(aData));
+        case ROW_TIME64: return timeToString(aBigEndian ? qFromBigEndian<qint64>(aData) : qFromLittleEndian<qint64>(aData));
+        case ROW_GUID:
+        {
+            // Little endian column shows Microsoft layout with first three groups stored in little endian
+            static const int sBigEndianOrder[16]   ={0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+            static const int sLittleEndianOrder[16]={3, 2, 1, 0, 5, 4, 7, 6, 8, 9, 10, 11, 12, 13, 14, 15};
+
+            const int *aOrder=aBigEndian ? sBigEndianOrder : sLittleEndianOrder;
+            QString aResult="{";
+
+            for (int i=0; i<16; ++i)
+            {
+                if (i==4 || i==6 || i==8 || i==10)
+                {
+                    aResult.append('-');
+                }
+
+                // QString::sprintf() is deprecated in Qt 5, arg() works in both
+                aResult.append(QString("%1").arg((uint)aData[aOrder[i]], 2, 16, QChar('0')).toUpper());
+            }
+
+            aResult.append('}');
+
+            return aResult;
+        }
+        case ROW_ULEB128:
+        case ROW_SLEB128:
+        {
+            quint64 aValue;
+            int aLength=decodeLeb128(aData, aAvailable, aRow==ROW_SLEB128, aValue);
+
+            if (aLength==0)
+            {
+                return QString();
+            }
+
+            if (aRow==ROW_SLEB128)
+            {
+                return QString("%1 (%2 bytes)").arg((qint64)aValue).arg(aLength);
+            }
+
+            return QString("%1 (%2 bytes)").arg(aValue).arg(aLength);
+        }
+    }
+
+    return QString();
+}
+
+bool DataInspector::encode(int aRow, bool aBigEndian, const QString &aText, uchar *aData, int &aLength)
+{
+    QString aValueText=aText.trimmed();
+    bool ok=false;
+
+    aLength=rowSize(aRow);
+
+    switch (aRow)
+    {
+        case ROW_INT8:
+        case ROW_INT16:
+        case ROW_INT32:
+        case ROW_INT64:
+        case ROW_TIME32:
+        case ROW_TIME64:
+        {
+            qint64 aValue;
+
+            if (aRow==ROW_TIME32 || aRow==ROW_TIME64)
+            {
+                if (aValueText.endsWith(" UTC"))
+                {
+                    aValueText.chop(4);
+                }
+
+                QDateTime aDateTime=QDateTime::fromString(aValueText, "yyyy-MM-dd hh:mm:ss");
+
+                if (aDateTime.isValid())
+                {
+                    aDateTime.setTimeSpec(Qt::UTC);
+                    aValue=aDateTime.toMSecsSinceEpoch()/1000;
+                    ok=true;
+                }
+                else
+                {
+                    aValue=aValueText.toLongLong(&ok, 0);
+                }
+            }
+            else
+            {
+                aValue=aValueText.toLongLong(&ok, 0);
+            }
+
+            qint64 aLimit=aLength==8 ? 0 : Q_INT64_C(1) << (aLength*8-1);
+
+            if (!ok || (aLimit && (aValue<-aLimit || aValue>=aLimit)))
+            {
+                return false;
+            }
+
+            for (int i=0; i<aLength; ++i)
+            {
+                aData[aBigEndian ? aLength-1-i : i]=(uchar)(((quint64)aValue) >> (i*8));
+            }
+
+            return true;
+        }
+        case ROW_UINT8:
+        case ROW_UINT16:
+        case ROW_UINT32:
+        case ROW_UINT64:
+        {
+            quint64 aValue=aValueText.toULongLong(&ok, 0);
+
+            if (!ok || (aLength<8 && aValue>=(Q_UINT64_C(1) << (aLength*8))))
+            {
+                return false;
+            }
+
+            for (int i=0; i<aLength; ++i)
+            {
+                aData[aBigEndian ? aLength-1-i : i]=(uchar)(aValue >> (i*8));
+            }
+
+            return true;
+        }
+        case ROW_FLOAT:
+        {
+            float aValue=aValueText.toFloat(&ok);
+            quint32 aBits;
+            memcpy(&aBits, &aValue, sizeof(aBits));
+
+            if (aBigEndian)
+            {
+                qToBigEndian<quint32>(aBits, aData);
+            }
+            else
+            {
+                qToLittleEndian<quint32>(aBits, aData);
+            }
+
+            return ok;
+        }
+        case ROW_DOUBLE:
+        {
+            double aValue=aValueText.toDouble(&ok);
+            quint64 aBits;
+            memcpy(&aBits, &aValue, sizeof(aBits));
+
+            if (aBigEndian)
+            {
+                qToBigEndian<quint64>(aBits, aData);
+            }
+            else
+            {
+                qToLittleEndian<quint64>(aBits, aData);
+            }
+
+            return ok;
+        }
+        case ROW_GUID:
+        {
+            aValueText.remove('{').remove('}').remove('-');
+
+            QByteArray aBytes=QByteArray::fromHex(aValueText.toLatin1());
+
+            if (aValueText.length()!=32 || aBytes.length()!=16)
+            {
+                return false;
+            }
+
+            memcpy(aData, aBytes.constData(), 16);
+
+            if (!aBigEndian)
+            {
+                qSwap(aData[0], aData[3]);
+                qSwap(aData[1], aData[2]);
+                qSwap(aData[4], aData[5]);
+                qSwap(aData[6], aData[7]);
+            }
+
+            return true;
+        }
+        case ROW_ULEB128:
+        case ROW_SLEB128:
+        {
+            aValueText=aValueText.section(' ', 0, 0);
+
+            quint64 aValue;
+
+            if (aRow==ROW_SLEB128)
+            {
+                aValue=(quint64)aValueText.toLongLong(&ok, 0);
+            }
+            else
+            {
+                aValue=aValueText.toULongLong(&ok, 0);
+            }
+
+            if (!ok)
+            {
+                return false;
+            }
+
+            aLength=encodeLeb128(aValue, aRow==ROW_SLEB128, aData);
+
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,63 @@
+#ifndef DATAINSPECTOR_H
+#define DATAINSPECTOR_H
+
+#include <QTableWidget>
+
+#include "hexeditor.h"
+
+class DataInspector : public QTableWidget
+{
+    Q_OBJECT
+
+public:
+    enum Row
+    {
+        ROW_INT8,
+        ROW_UINT8,
+        ROW_INT16,
+        ROW_UINT16,
+        ROW_INT32,
+        ROW_UINT32,
+        ROW_INT64,
+        ROW_UINT64,
+        ROW_FLOAT,
+        ROW_DOUBLE,
+        ROW_TIME32,
+        ROW_TIME64,
+        ROW_GUID,
+        ROW_ULEB128,
+        ROW_SLEB128,
+        ROW_COUNT
+    };
+
+    enum Column
+    {
+        COLUMN_LITTLE_ENDIAN,
+        COLUMN_BIG_ENDIAN,
+        COLUMN_COUNT
+    };
+
+    explicit DataInspector(HexEditor *aEditor, QWidget *parent = 0);
+
+    HexEditor* editor() const;
+    void setEditor(HexEditor *aEditor);
+
+protected:
+    HexEditor *mEditor;
+    qint64     mPosition;
+    bool       mUpdating;
+
+    static int rowSize(int aRow);
+    static QString decode(int aRow, bool aBigEndian, const uchar *aData, int aAvailable);
+    static bool encode(int aRow, bool aBigEndian, const QString &aText, uchar *aData, int &aLength);
+
+public slots:
+    void updateValues();
+
+protected slots:
+    void positionChanged(qint64 aPosition);
+    void rangeChanged(qint64 aPos, qint64 aLength);
+    void valueEdited(QTableWidgetItem *aItem);
+};
+
+#endif // DATAINSPECTOR_H
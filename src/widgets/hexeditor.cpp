@@ -5,43 +5,81 @@
 #include <QKeyEvent>
 #include <QApplication>
 #include <QClipboard>
+#include <QToolTip>
+#include <QHelpEvent>
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QCryptographicHash>
+
+#if QT_VERSION >= 0x050000
+#include <QStandardPaths>
+#else
+#include <QDesktopServices>
+#endif
+
+#include "src/engine/hexsearch.h"
+#include "src/engine/sparsefile.h"
+#include "src/engine/hexprofiler.h"
 
 #include <math.h>
+#include <string.h>
+#include <limits.h>
 
 #define LINE_INTERVAL 2
 #define CHAR_INTERVAL 2
 
+#define ROW_CACHE_SIZE           1024
+#define SCROLL_ANIMATION_STEP_MS 16   // Display refresh rate
+#define SCROLL_ANIMATION_DIVIDER 4    // Part of the remaining distance passed at every step
+#define PREFETCH_LOOKAHEAD_MS    500
+#define PREFETCH_BUDGET_MS       4
+#define PREFETCH_RETRY_MS        16   // Rows whose data is still being read are rendered after that
+#define SESSION_VIEW_DELAY_MS    1000
+#define SESSION_SLOTS            2    // Journal of the last session and the new one
+#define EXPORT_CHUNK_SIZE        (1 << 20)
+#define EXPORT_QUEUE_LIMIT       (4 << 20) // Bytes read ahead of the exporter
+#define LARGE_FILE_SIZE          (64 << 20) // Larger files are read on demand, not loaded
+#define SCROLL_BAR_RANGE         (1 << 30)  // Steps of the vertical scroll bar, rows of larger data take several pixels per step
+#define REMOVE_BATCH_SIZE        (16 << 20) // Span of selected ranges removed by one edit
+#define TRANSFORM_CHUNK_SIZE     (1 << 20)  // Bytes transformed at once
+#define TRANSFORM_ALIGNMENT      64         // Largest swapped element divides it
+
+static const QRgb structureColors[]={
+                                     qRgb(255, 228, 196),
+                                     qRgb(204, 232, 255),
+                                     qRgb(214, 245, 214),
+                                     qRgb(255, 214, 231),
+                                     qRgb(240, 230, 140),
+                                     qRgb(221, 211, 255),
+                                     qRgb(200, 240, 240),
+                                     qRgb(255, 239, 213)
+                                    };
+
+static const QRgb annotationColor=qRgb(255, 250, 150);
+
+static int textWidth(const QFontMetrics &aMetrics, const QString &aText)
+{
+#if QT_VERSION >= 0x050B00
+    return aMetrics.horizontalAdvance(aText);
+#else
+    return aMetrics.width(aText);
+#endif
+}
+
 HexEditor::HexEditor(QWidget *parent) :
     QAbstractScrollArea(parent)
 {
-    for (int i=0; i<256; ++i)
-    {
-        char aChar=i;
-        mAsciiChars.append(QString::fromLatin1(&aChar, 1));
-    }
-
-    mAsciiChars[9] =QChar(26);
-    mAsciiChars[10]=QChar(8629);
-    mAsciiChars[13]=QChar(8601);
-    mAsciiChars[32]=QChar(183);
-
-    for (int i=128; i<=160; ++i)
-    {
-        mAsciiChars[i]=QChar(9734);
-    }
-
-
-
+    mEncoding=HexEncoding::LATIN1;
     mMode=INSERT;
     mReadOnly=false;
     mCursorPosition=0;
-
-    mFont=QFont("Courier new", 1);     // Special action to calculate mCharWidth and mCharHeight at the next step
-    setFont(QFont("Courier new", 10));
+    mAddressOffset=0;
 
     mSelectionStart=0;
     mSelectionEnd=0;
     mSelectionInit=0;
+    mColumnSelection=false;
 
     mCursorVisible=true;
     mCursorAtTheLeft=true;
@@ -50,11 +88,72 @@ HexEditor::HexEditor(QWidget *parent) :
 
     mLeftButtonPressed=false;
     mOneMoreSelection=false;
+
+    mShared=0;
+    mDocument=0;
+    mUndoStack=0;
+    attachDocument(new SharedDocument(new ByteArrayDocument()));
+    mStructureOverlay=0;
+
+    mLoader=0;
+    mWatcher=0;
+    mFollowTail=false;
+
+    mExporter=0;
+    mExportRange=0;
+    mExportPos=0;
+    mExportVersion=0;
+
+    mRowCache.setMaxCost(ROW_CACHE_SIZE);
+    connect(this, SIGNAL(rangeChanged(qint64,qint64)), this, SLOT(invalidateRows(qint64,qint64)));
+
+    mScrollOffset=0;
+    mScrollScale=1;
+    mScrollTarget=0;
+    mScrollAnimatedValue=0;
+    mWheelRemainder=0;
+    mLastScrollOffset=0;
+    mScrollVelocity=0;
+    mScrollClock.start();
+
+    mScrollAnimationTimer.setInterval(SCROLL_ANIMATION_STEP_MS);
+    connect(&mScrollAnimationTimer, SIGNAL(timeout()), this, SLOT(scrollAnimationStep()));
+
+    mPrefetchTimer.setSingleShot(true);
+    connect(&mPrefetchTimer, SIGNAL(timeout()), this, SLOT(prefetchRows()));
+
+    connect(verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(verticalScrolled(int)));
+    connect(verticalScrollBar(), SIGNAL(sliderPressed()), this, SLOT(stopScrollAnimation()));
+
+    mSessionVersion=0;
+    mSessionTimer.setSingleShot(true);
+    mSessionTimer.setInterval(SESSION_VIEW_DELAY_MS);
+    connect(&mSessionTimer, SIGNAL(timeout()), this, SLOT(writeSessionView()));
+    connect(this, SIGNAL(positionChanged(qint64)), &mSessionTimer, SLOT(start()));
+    connect(this, SIGNAL(selectionChanged(qint64,qint64)), &mSessionTimer, SLOT(start()));
+
+#ifdef HEXEDITOR_PROFILING
+    mProfilerOverlayVisible=false;
+#endif
+
+    // Scroll bars are updated here, so the document and scroll state are set before
+    mFont=QFont("Courier new", 1);     // Special action to calculate mCharWidth and mCharHeight at the next step
+    setFont(QFont("Courier new", 10));
+}
+
+HexEditor::~HexEditor()
+{
+    cancelExport();
+    cancelLoading();
+    stopWatching();
+    delete mStructureOverlay;
+    detachDocument();
 }
 
 void HexEditor::undo()
 {
-    mUndoStack.undo();
+    mShared->setActiveEditor(this);
+    mUndoStack->undo();
     emit dataChanged();
 
     setCursorPosition(mCursorPosition);
@@ -66,7 +165,8 @@ void HexEditor::undo()
 
 void HexEditor::redo()
 {
-    mUndoStack.redo();
+    mShared->setActiveEditor(this);
+    mUndoStack->redo();
     emit dataChanged();
 
     setCursorPosition(mCursorPosition);
@@ -85,27 +185,27 @@ void HexEditor::cursorBlicking()
 void HexEditor::scrollToCursor()
 {
     int aOffsetX=horizontalScrollBar()->value();
-    int aOffsetY=verticalScrollBar()->value();
+    qint64 aOffsetY=scrollOffset();
     int aViewWidth=viewport()->width();
     int aViewHeight=viewport()->height();
 
 
 
     int aCurCol=(mCursorPosition & 31) >> 1;
-    int aCurRow=mCursorPosition>>5;
+    qint64 aCurRow=mCursorPosition>>5;
 
     int aCursorWidth;
     int aCursorX;
-    int aCursorY=aCurRow*(mCharHeight+LINE_INTERVAL);
+    qint64 aCursorY=aCurRow*(mCharHeight+LINE_INTERVAL);
 
     if (mCursorAtTheLeft)
     {
-        aCursorX=(mAddressWidth+1+aCurCol*3)*mCharWidth; // mAddressWidth + 1+aCurCol*3
-        aCursorWidth=2*mCharWidth;
+        aCursorX=(mAddressWidth+1+mViewMode.byteColumn(aCurCol))*mCharWidth;
+        aCursorWidth=mViewMode.cellWidth()*mCharWidth;
     }
     else
     {
-        aCursorX=(mAddressWidth+50+aCurCol)*mCharWidth; // mAddressWidth + 1+16*2+15+1 + 1+aCurCol
+        aCursorX=(textColumn()+aCurCol)*mCharWidth;
         aCursorWidth=mCharWidth;
     }
 
@@ -123,28 +223,23 @@ void HexEditor::scrollToCursor()
 
     if (aCursorY<aOffsetY)
     {
-        verticalScrollBar()->setValue(aCursorY);
+        setScrollOffset(aCursorY);
     }
     else
     if (aCursorY+mCharHeight+LINE_INTERVAL>aOffsetY+aViewHeight)
     {
-        verticalScrollBar()->setValue(aCursorY+mCharHeight+LINE_INTERVAL-aViewHeight);
+        setScrollOffset(aCursorY+mCharHeight+LINE_INTERVAL-aViewHeight);
     }
 }
 
-int HexEditor::charAt(QPoint aPos, bool *aAtLeftPart)
+qint64 HexEditor::charAt(QPoint aPos, bool *aAtLeftPart)
 {
     int aOffsetX=horizontalScrollBar()->value();
-    int aOffsetY=verticalScrollBar()->value();
-
-    int aRow         = floor((aPos.y()+aOffsetY)/((double)(mCharHeight+LINE_INTERVAL)));
-    int aLeftColumn  = ((int)floor((aPos.x()+aOffsetX-(mAddressWidth+1)*mCharWidth)/((double)(mCharWidth*3))))<<1;
-    int aRightColumn = floor((aPos.x()+aOffsetX-(mAddressWidth+50)*mCharWidth)/((double)mCharWidth));
+    qint64 aOffsetY=scrollOffset();
 
-    if (aPos.x()+aOffsetX-(mAddressWidth+1)*mCharWidth > mCharWidth*(aLeftColumn+(aLeftColumn>>1)+1))
-    {
-        ++aLeftColumn;
-    }
+    qint64 aRow      = (qint64)floor((aPos.y()+aOffsetY)/((double)(mCharHeight+LINE_INTERVAL)));
+    int aLeftColumn  = floor((aPos.x()+aOffsetX-(mAddressWidth+1)*mCharWidth)/((double)mCharWidth));
+    int aRightColumn = floor((aPos.x()+aOffsetX-textColumn()*mCharWidth)/((double)mCharWidth));
 
     if (aAtLeftPart)
     {
@@ -156,7 +251,7 @@ int HexEditor::charAt(QPoint aPos, bool *aAtLeftPart)
         return aRow*32;
     }
     else
-    if (aLeftColumn>=32)
+    if (aLeftColumn>mViewMode.width())
     {
         if (aAtLeftPart)
         {
@@ -177,38 +272,89 @@ int HexEditor::charAt(QPoint aPos, bool *aAtLeftPart)
     }
     else
     {
-        return aRow*32+aLeftColumn;
+        // Second digit of hex bytes is the second half of the byte, other views have no halves
+        int aCharIndex;
+        int aCol=mViewMode.byteAt(aLeftColumn, &aCharIndex);
+
+        return aRow*32+(aCol<<1)+(mViewMode.isHexDigits() && aCharIndex>0 ? 1 : 0);
     }
 }
 
-int HexEditor::indexOf(const QByteArray &aArray, int aFrom) const
+qint64 HexEditor::indexOf(const QByteArray &aArray, qint64 aFrom) const
 {
-    return mData.indexOf(aArray, aFrom);
+    HEX_PROFILE_SCOPE("search");
+
+    HexPattern aPattern(aArray);
+    QVector<HexRange> aRanges=SparseFile::searchRanges(mShared->holes(), dataSize(), aPattern);
+
+    for (int i=0; i<aRanges.size(); ++i)
+    {
+        qint64 aEnd=aRanges.at(i).pos+aRanges.at(i).length;
+
+        if (aEnd<=aFrom)
+        {
+            continue;
+        }
+
+        qint64 aFound=mDocument->indexOf(aPattern, qMax(aFrom, aRanges.at(i).pos), aEnd);
+
+        if (aFound>=0)
+        {
+            return aFound;
+        }
+    }
+
+    return -1;
 }
 
-int HexEditor::indexOf(const char &aChar, int aFrom) const
+qint64 HexEditor::indexOf(const char &aChar, qint64 aFrom) const
 {
     QByteArray aArray;
     aArray.append(aChar);
     return indexOf(aArray, aFrom);
 }
 
-int HexEditor::lastIndexOf(const QByteArray &aArray, int aFrom) const
+qint64 HexEditor::lastIndexOf(const QByteArray &aArray, qint64 aFrom) const
 {
-    return mData.lastIndexOf(aArray, aFrom);
+    HEX_PROFILE_SCOPE("search");
+
+    HexPattern aPattern(aArray);
+    QVector<HexRange> aRanges=SparseFile::searchRanges(mShared->holes(), dataSize(), aPattern);
+
+    if (aFrom<0)
+    {
+        aFrom=dataSize();
+    }
+
+    for (int i=aRanges.size()-1; i>=0; --i)
+    {
+        if (aRanges.at(i).pos>aFrom)
+        {
+            continue;
+        }
+
+        qint64 aFound=mDocument->lastIndexOf(aPattern, qMin(aFrom, aRanges.at(i).pos+aRanges.at(i).length-1), aRanges.at(i).pos);
+
+        if (aFound>=0)
+        {
+            return aFound;
+        }
+    }
+
+    return -1;
 }
 
-int HexEditor::lastIndexOf(const char &aChar, int aFrom) const
+qint64 HexEditor::lastIndexOf(const char &aChar, qint64 aFrom) const
 {
     QByteArray aArray;
     aArray.append(aChar);
     return lastIndexOf(aArray, aFrom);
 }
 
-void HexEditor::insert(int aIndex, char aChar)
+void HexEditor::insert(qint64 aIndex, char aChar)
 {
     SingleHexUndoCommand *aCommand=new SingleHexUndoCommand(this, SingleHexUndoCommand::Insert, aIndex, aChar);
-    mUndoStack.push(aCommand);
+    pushCommand(aCommand);
     emit dataChanged();
 
     setCursorPosition(mCursorPosition);
@@ -218,7 +364,7 @@ void HexEditor::insert(int aIndex, char aChar)
     viewport()->update();
 }
 
-void HexEditor::insert(int aIndex, const QByteArray &aArray)
+void HexEditor::insert(qint64 aIndex, const QByteArray &aArray)
 {
     if (aArray.length()==0)
     {
@@ -236,7 +382,7 @@ void HexEditor::insert(int aIndex, const QByteArray &aArray)
         aCommand=new MultipleHexUndoCommand(this, MultipleHexUndoCommand::Replace, aIndex, aArray.length(), aArray);
     }
 
-    mUndoStack.push(aCommand);
+    pushCommand(aCommand);
     emit dataChanged();
 
     setCursorPosition(mCursorPosition);
@@ -246,7 +392,7 @@ void HexEditor::insert(int aIndex, const QByteArray &aArray)
     viewport()->update();
 }
 
-void HexEditor::remove(int aPos, int aLength)
+void HexEditor::remove(qint64 aPos, qint64 aLength)
 {
     if (aLength<=0)
     {
@@ -274,12 +420,11 @@ void HexEditor::remove(int aPos, int aLength)
         }
         else
         {
-            QByteArray aArray=QByteArray(aLength, 0);
-            aCommand=new MultipleHexUndoCommand(this, MultipleHexUndoCommand::Replace, aPos, aLength, aArray);
+            aCommand=new TransformHexUndoCommand(this, aPos, aLength, HexTransform(HexTransform::TRANSFORM_FILL, QByteArray(1, 0)));
         }
     }
 
-    mUndoStack.push(aCommand);
+    pushCommand(aCommand);
     emit dataChanged();
 
     setCursorPosition(mCursorPosition);
@@ -289,10 +434,10 @@ void HexEditor::remove(int aPos, int aLength)
     viewport()->update();
 }
 
-void HexEditor::replace(int aPos, char aChar)
+void HexEditor::replace(qint64 aPos, char aChar)
 {
     SingleHexUndoCommand *aCommand=new SingleHexUndoCommand(this, SingleHexUndoCommand::Replace, aPos, aChar);
-    mUndoStack.push(aCommand);
+    pushCommand(aCommand);
     emit dataChanged();
 
     setCursorPosition(mCursorPosition);
@@ -302,10 +447,10 @@ void HexEditor::replace(int aPos, char aChar)
     viewport()->update();
 }
 
-void HexEditor::replace(int aPos, const QByteArray &aArray)
+void HexEditor::replace(qint64 aPos, const QByteArray &aArray)
 {
     MultipleHexUndoCommand *aCommand=new MultipleHexUndoCommand(this, MultipleHexUndoCommand::Replace, aPos, aArray.length(), aArray);
-    mUndoStack.push(aCommand);
+    pushCommand(aCommand);
     emit dataChanged();
 
     setCursorPosition(mCursorPosition);
@@ -315,10 +460,10 @@ void HexEditor::replace(int aPos, const QByteArray &aArray)
     viewport()->update();
 }
 
-void HexEditor::replace(int aPos, int aLength, const QByteArray &aArray)
+void HexEditor::replace(qint64 aPos, qint64 aLength, const QByteArray &aArray)
 {
     MultipleHexUndoCommand *aCommand=new MultipleHexUndoCommand(this, MultipleHexUndoCommand::Replace, aPos, aLength, aArray);
-    mUndoStack.push(aCommand);
+    pushCommand(aCommand);
     emit dataChanged();
 
     setCursorPosition(mCursorPosition);
@@ -328,7 +473,36 @@ void HexEditor::replace(int aPos, int aLength, const QByteArray &aArray)
     viewport()->update();
 }
 
-void HexEditor::setSelection(int aPos, int aCount)
+void HexEditor::transform(qint64 aPos, qint64 aLength, const HexTransform &aTransform)
+{
+    if (aPos<0 || aPos>=dataSize() || aLength<=0 || !aTransform.isValid())
+    {
+        return;
+    }
+
+    TransformHexUndoCommand *aCommand=new TransformHexUndoCommand(this, aPos, aLength, aTransform);
+    pushCommand(aCommand);
+    emit dataChanged();
+
+    viewport()->update();
+}
+
+void HexEditor::transformSelection(const HexTransform &aTransform)
+{
+    QVector<HexRange> aRanges=mSelection.ranges(0, dataSize());
+
+    if (aRanges.isEmpty() || !aTransform.isValid())
+    {
+        return;
+    }
+
+    pushCommand(new TransformHexUndoCommand(this, aRanges, aTransform));
+    emit dataChanged();
+
+    viewport()->update();
+}
+
+void HexEditor::setSelection(qint64 aPos, qint64 aCount)
 {
     if (aCount<0)
     {
@@ -346,19 +520,24 @@ void HexEditor::setSelection(int aPos, int aCount)
     mCursorPosition=aPrevPos;
 }
 
+HexSelection HexEditor::selection() const
+{
+    return mSelection;
+}
+
 void HexEditor::cut()
 {
     copy();
 
-    int aSelStart=mSelectionStart;
+    qint64 aSelStart=selectionStart();
 
-    if (mSelectionStart==mSelectionEnd)
+    if (mSelection.isEmpty())
     {
         remove(mSelectionStart, 1);
     }
     else
     {
-        remove(mSelectionStart, mSelectionEnd-mSelectionStart);
+        removeSelected();
     }
 
     setPosition(aSelStart);
@@ -369,13 +548,40 @@ void HexEditor::copy()
 {
     QString aToClipboard;
 
+    if (!mSelection.isEmpty() && !mSelection.isSingleRange())
+    {
+        // Every range goes on its own line, so columns are copied as they look
+        QVector<HexRange> aRanges=mSelection.ranges(0, dataSize());
+        QStringList aLines;
+
+        for (int i=0; i<aRanges.size(); ++i)
+        {
+            QByteArray aBytes=mDocument->mid(aRanges.at(i).pos, aRanges.at(i).length);
+
+            if (mCursorAtTheLeft)
+            {
+                aLines.append(QString::fromLatin1(aBytes.toHex().toUpper()));
+            }
+            else
+            {
+                aLines.append(HexEncoding::toUnicode(mEncoding, aBytes).remove(QChar(0)));
+            }
+        }
+
+        QApplication::clipboard()->setText(aLines.join("\n"));
+        return;
+    }
+
+    qint64 aSelStart=selectionStart();
+    qint64 aSelEnd=selectionEnd();
+
     if (mCursorAtTheLeft)
     {
-        if (mSelectionStart==mSelectionEnd)
+        if (aSelStart==aSelEnd)
         {
-            if (mSelectionStart<mData.size())
+            if (aSelStart<dataSize())
             {
-                quint8 aChar=mData.at(mSelectionStart);
+                quint8 aChar=mDocument->at(aSelStart);
                 aToClipboard=QString::number(aChar, 16).toUpper();
 
                 if (aToClipboard.length()==1)
@@ -386,9 +592,9 @@ void HexEditor::copy()
         }
         else
         {
-            for (int i=mSelectionStart; i<mSelectionEnd && i<mData.size(); ++i)
+            for (qint64 i=aSelStart; i<aSelEnd && i<dataSize(); ++i)
             {
-                quint8 aChar=mData.at(i);
+                quint8 aChar=mDocument->at(i);
                 QString aHexChar=QString::number(aChar, 16).toUpper();
 
                 if (aHexChar.length()==1)
@@ -402,25 +608,19 @@ void HexEditor::copy()
     }
     else
     {
-        if (mSelectionStart==mSelectionEnd)
+        if (aSelStart==aSelEnd)
         {
-            if (mSelectionStart<mData.size())
+            if (aSelStart<dataSize())
             {
-                char aChar=mData.at(mSelectionStart);
-                aToClipboard=QString::fromLatin1(&aChar, 1);
+                aToClipboard=HexEncoding::toUnicode(mEncoding, mDocument->mid(aSelStart, 1));
             }
         }
         else
         {
-            for (int i=mSelectionStart; i<mSelectionEnd && i<mData.size(); ++i)
-            {
-                char aChar=mData.at(i);
+            qint64 aEnd=qMin(aSelEnd, dataSize());
 
-                if (aChar)
-                {
-                    aToClipboard.append(QString::fromLatin1(&aChar, 1));
-                }
-            }
+            aToClipboard=HexEncoding::toUnicode(mEncoding, mDocument->mid(aSelStart, aEnd-aSelStart));
+            aToClipboard.remove(QChar(0));
         }
     }
 
@@ -429,11 +629,11 @@ void HexEditor::copy()
 
 void HexEditor::paste()
 {
-    int aSelStart=mSelectionStart;
+    qint64 aSelStart=selectionStart();
 
-    if (mSelectionStart!=mSelectionEnd)
+    if (!mSelection.isEmpty())
     {
-        remove(mSelectionStart, mSelectionEnd-mSelectionStart);
+        removeSelected();
     }
 
     QString aText=QApplication::clipboard()->text();
@@ -445,7 +645,7 @@ void HexEditor::paste()
     }
     else
     {
-        aArray=aText.toLatin1();
+        aArray=HexEncoding::fromUnicode(mEncoding, aText);
     }
 
     insert(aSelStart, aArray);
@@ -455,18 +655,115 @@ void HexEditor::paste()
 
 QString HexEditor::toString()
 {
-    return QString::fromLatin1(mData);
+    return QString::fromLatin1(mDocument->mid(0));
+}
+
+qint64 HexEditor::readData(qint64 aPos, char *aBuffer, qint64 aLength) const
+{
+    return mDocument->read(aPos, aBuffer, aLength);
+}
+
+qint64 HexEditor::dataSize() const
+{
+    return mDocument->size();
 }
 
 // ------------------------------------------------------------------
 
+bool HexEditor::writePatch(QIODevice *aDevice, HexPatch::Format aFormat, QString *aError) const
+{
+    // History is reverted from the current data by replacements of the commands, data isn't copied
+    HexPatchSource aCurrent(mDocument);
+    QList<HexReplacement> aReverted;
+
+    for (int i=mUndoStack->index()-1; i>=0; --i)
+    {
+        const HexUndoCommand *aCommand=dynamic_cast<const HexUndoCommand *>(mUndoStack->command(i));
+
+        if (!aCommand)
+        {
+            continue;
+        }
+
+        if (aCommand->revertReadsData())
+        {
+            // Data after the command is the current data with the later commands reverted
+            HexPatch aState=HexPatch::fromReplacements(mDocument->size(), aReverted);
+            aCommand->revert(HexPatchSource(&aCurrent, &aState), aReverted);
+        }
+        else
+        {
+            aCommand->revert(HexPatchSource(), aReverted);
+        }
+    }
+
+    // Changes are the reverting replacements undone from the last one, their bytes are in the current data
+    QList<HexReplacement> aChanges;
+    qint64 aSourceSize=mDocument->size();
+
+    for (int i=aReverted.size()-1; i>=0; --i)
+    {
+        const HexReplacement &aReplacement=aReverted.at(i);
+
+        HexReplacement aChange;
+        aChange.pos=aReplacement.pos;
+        aChange.removedLength=aReplacement.insertedLength;
+        aChange.insertedLength=aReplacement.removedLength;
+
+        aChanges.append(aChange);
+        aSourceSize+=aReplacement.insertedLength-aReplacement.removedLength;
+    }
+
+    HexPatch aRevert=HexPatch::fromReplacements(mDocument->size(), aReverted);
+    HexPatchSource aSource(&aCurrent, &aRevert);
+
+    return HexPatch::fromReplacements(aSourceSize, aChanges, aCurrent).write(aDevice, aFormat, aSource, aError);
+}
+
+bool HexEditor::applyPatch(const HexPatch &aPatch, QString *aError)
+{
+    HexPatch aBoundPatch=aPatch.bind(mDocument->size());
+    HexPatchSource aSource(mDocument);
+
+    if (!aBoundPatch.checkSource(aSource, aError))
+    {
+        return false;
+    }
+
+    // Damaged patch is refused before it changes anything
+    if (!aBoundPatch.checkTarget(aSource, aError))
+    {
+        return false;
+    }
+
+    if (aBoundPatch.isEmpty())
+    {
+        return true;
+    }
+
+    // All ranges are applied by one command, so there is only one relayout
+    pushCommand(new PatchHexUndoCommand(this, aBoundPatch));
+    emit dataChanged();
+
+    setCursorPosition(mCursorPosition);
+    resetSelection();
+
+    updateScrollBars();
+    viewport()->update();
+
+    return true;
+}
+
 void HexEditor::updateScrollBars()
 {
+    HEX_PROFILE_SCOPE("updateScrollBars");
+
     mAddressWidth=0;
-    int aDataSize=mData.size();
-    int aCurSize=1;
+    qint64 aDataSize=dataSize();
+    qint64 aLastAddress=mAddressOffset+aDataSize;
+    qint64 aCurSize=1;
 
-    while (aCurSize<=aDataSize)
+    while (aCurSize<=aLastAddress)
     {
         ++mAddressWidth;
         aCurSize<<=4;
@@ -481,23 +778,77 @@ void HexEditor::updateScrollBars()
 
 
 
-    int aTotalWidth=(mAddressWidth+66)*mCharWidth; // mAddressWidth + 1+16*2+15+1 + 1+16
-    int aTotalHeight=mLinesCount*mCharHeight;
+    int aTotalWidth=(textColumn()+16)*mCharWidth;
+    qint64 aMaxOffset=maxScrollOffset();
+
+
+
+    QSize areaSize=viewport()->size();
+
+    horizontalScrollBar()->setPageStep(areaSize.width());
+    horizontalScrollBar()->setRange(0, aTotalWidth  - areaSize.width()  + 1);
+
+    // Scroll bar has int range, so rows of large data take more than one pixel per step
+    mScrollScale=aMaxOffset/SCROLL_BAR_RANGE+1;
+
+    qint64 aOffset=qMin(mScrollOffset, aMaxOffset);
+    QScrollBar *aScrollBar=verticalScrollBar();
+
+    // Offset is kept by the editor, the scroll bar only follows it
+    aScrollBar->blockSignals(true);
+    aScrollBar->setPageStep((int)qMax((qint64)1, areaSize.height()/mScrollScale));
+    aScrollBar->setSingleStep((int)qMax((qint64)1, (mCharHeight+LINE_INTERVAL)/mScrollScale));
+    aScrollBar->setRange(0, (int)(aMaxOffset/mScrollScale));
+    aScrollBar->setValue((int)(aOffset/mScrollScale));
+    aScrollBar->blockSignals(false);
+
+    if (aOffset!=mScrollOffset)
+    {
+        mScrollOffset=aOffset;
+        scrolled();
+    }
+}
+
+qint64 HexEditor::scrollOffset() const
+{
+    return mScrollOffset;
+}
+
+qint64 HexEditor::maxScrollOffset() const
+{
+    qint64 aTotalHeight=mLinesCount*mCharHeight;
 
     if (mLinesCount>0)
     {
         aTotalHeight+=(mLinesCount-1)*LINE_INTERVAL;
     }
 
+    return qMax((qint64)0, aTotalHeight-viewport()->height()+1);
+}
+
+void HexEditor::setScrollOffset(qint64 aOffset)
+{
+    aOffset=qBound((qint64)0, aOffset, maxScrollOffset());
 
+    if (aOffset==mScrollOffset)
+    {
+        return;
+    }
 
-    QSize areaSize=viewport()->size();
+    mScrollOffset=aOffset;
 
-    horizontalScrollBar()->setPageStep(areaSize.width());
-    verticalScrollBar()->setPageStep(areaSize.height());
+    QScrollBar *aScrollBar=verticalScrollBar();
+    int aValue=(int)(aOffset/mScrollScale);
 
-    horizontalScrollBar()->setRange(0, aTotalWidth  - areaSize.width()  + 1);
-    verticalScrollBar()->setRange(  0, aTotalHeight - areaSize.height() + 1);
+    // Moves inside one step of the scroll bar don't change its value
+    if (aScrollBar->value()!=aValue)
+    {
+        aScrollBar->setValue(aValue);
+    }
+    else
+    {
+        scrolled();
+    }
 }
 
 void HexEditor::resetCursorTimer()
@@ -512,24 +863,22 @@ void HexEditor::resetCursorTimer()
 
 void HexEditor::resetSelection()
 {
-    int aCurPosition=mCursorPosition>>1;
+    qint64 aCurPosition=mCursorPosition>>1;
 
     bool aSelectionChanged=(mSelectionStart!=aCurPosition) || (mSelectionEnd!=aCurPosition);
 
     mSelectionInit=aCurPosition;
     mSelectionStart=aCurPosition;
     mSelectionEnd=aCurPosition;
+    mColumnSelection=false;
+    mKeptSelection.clear();
 
-    if (aSelectionChanged)
-    {
-        viewport()->update();
-        emit selectionChanged(mSelectionStart, mSelectionEnd);
-    }
+    selectionUpdated(aSelectionChanged);
 }
 
 void HexEditor::updateSelection()
 {
-    int aCurPosition=mCursorPosition>>1;
+    qint64 aCurPosition=mCursorPosition>>1;
 
     bool aSelectionChanged=false;
 
@@ -556,11 +905,105 @@ void HexEditor::updateSelection()
         }
     }
 
-    if (aSelectionChanged)
+    selectionUpdated(aSelectionChanged);
+}
+
+void HexEditor::selectionUpdated(bool aChanged)
+{
+    HexSelection aSelection=mKeptSelection;
+
+    if (mSelectionStart!=mSelectionEnd)
+    {
+        if (mColumnSelection)
+        {
+            // Bytes at the anchor and at the cursor are opposite corners of the block,
+            // cursor is after its byte when it is dragged forward
+            qint64 aAnchor=mSelectionInit;
+            qint64 aCursor=mCursorPosition>>1;
+
+            if (aCursor>aAnchor)
+            {
+                --aCursor;
+            }
+
+            int aFirstCol=(int)qMin(aAnchor & 15, aCursor & 15);
+            int aLastCol=(int)qMax(aAnchor & 15, aCursor & 15);
+            qint64 aFirstRow=qMin(aAnchor, aCursor)>>4;
+            qint64 aLastRow=qMax(aAnchor, aCursor)>>4;
+
+            aSelection.addBlock((aFirstRow<<4)+aFirstCol, aLastCol-aFirstCol+1, 16, aLastRow-aFirstRow+1);
+        }
+        else
+        {
+            aSelection.add(mSelectionStart, mSelectionEnd-mSelectionStart);
+        }
+    }
+
+    if (aSelection!=mSelection)
+    {
+        mSelection=aSelection;
+        aChanged=true;
+    }
+
+    if (aChanged)
     {
         viewport()->update();
-        emit selectionChanged(mSelectionStart, mSelectionEnd);
+        emit selectionChanged(selectionStart(), selectionEnd());
+    }
+}
+
+void HexEditor::removeSelected()
+{
+    QVector<HexRange> aRanges=mSelection.ranges(0, dataSize());
+
+    if (aRanges.size()==1)
+    {
+        remove(aRanges.first().pos, aRanges.first().length);
+        return;
+    }
+
+    if (aRanges.isEmpty())
+    {
+        return;
+    }
+
+    // Span of several ranges is replaced by the bytes between them, so rows of a block are compacted by one edit.
+    // Edits are sorted and all of them are applied at once
+    QList<HexEdit> aEdits;
+    int aLast=aRanges.size()-1;
+
+    while (aLast>=0)
+    {
+        qint64 aEnd=aRanges.at(aLast).pos+aRanges.at(aLast).length;
+        int aFirst=aLast;
+
+        while (aFirst>0 && aEnd-aRanges.at(aFirst-1).pos<=REMOVE_BATCH_SIZE)
+        {
+            --aFirst;
+        }
+
+        HexEdit aEdit;
+        aEdit.pos=aRanges.at(aFirst).pos;
+        aEdit.removed=mDocument->mid(aEdit.pos, aEnd-aEdit.pos);
+
+        for (int i=aFirst; i<aLast; ++i)
+        {
+            qint64 aGapStart=aRanges.at(i).pos+aRanges.at(i).length;
+            aEdit.inserted.append(aEdit.removed.constData()+(aGapStart-aEdit.pos), (int)(aRanges.at(i+1).pos-aGapStart));
+        }
+
+        aEdits.prepend(aEdit);
+        aLast=aFirst-1;
     }
+
+    pushCommand(new PatchHexUndoCommand(this, aEdits));
+    emit dataChanged();
+
+    setCursorPosition(mCursorPosition);
+    resetSelection();
+
+    updateScrollBars();
+    viewport()->update();
 }
 
 void HexEditor::cursorMoved(bool aKeepSelection)
@@ -578,68 +1021,220 @@ void HexEditor::cursorMoved(bool aKeepSelection)
     scrollToCursor();
 }
 
-void HexEditor::resizeEvent(QResizeEvent *event)
+void HexEditor::fillRange(QPainter &aPainter, qint64 aStart, qint64 aEnd, const QColor &aColor, int aOffsetX, qint64 aOffsetY)
 {
-    QAbstractScrollArea::resizeEvent(event);
-    updateScrollBars();
-}
+    int aRowHeight=mCharHeight+LINE_INTERVAL;
+    qint64 aFirstRow=aStart>>4;
+    qint64 aLastRow=(aEnd-1)>>4;
 
-void HexEditor::paintEvent(QPaintEvent * /*event*/)
-{
-    QPainter painter(viewport());
-    QPalette aPalette=palette();
+    // Rows out of the viewport are skipped, so coordinates fit in int
+    qint64 aRow=qMax(aFirstRow, -aOffsetY/aRowHeight);
+    qint64 aEndRow=qMin(aLastRow, (viewport()->height()-aOffsetY)/aRowHeight);
 
-    QColor aTextColor=aPalette.color(QPalette::Text);
-    QColor aHighlightColor=aPalette.color(QPalette::Highlight);
-    QColor aHighlightedTextColor=aPalette.color(QPalette::HighlightedText);
-    QColor aAlternateBaseColor=aPalette.color(QPalette::AlternateBase);
+    for (; aRow<=aEndRow; ++aRow)
+    {
+        int aStartCol=aRow==aFirstRow       ? (aStart & 15)     : 0;
+        int aEndCol=aRow==aLastRow          ? ((aEnd-1) & 15)   : 15;
+        int aY=(int)(aRow*aRowHeight+aOffsetY);
 
-    int aOffsetX=-horizontalScrollBar()->value();
-    int aOffsetY=-verticalScrollBar()->value();
-    int aViewWidth=viewport()->width();
-    int aViewHeight=viewport()->height();
+        if (mViewMode.isMirrored())
+        {
+            // Bytes of a little endian group go from right to left, so each group is filled alone
+            int aGroupSize=mViewMode.groupSize();
 
-    painter.setFont(mFont);
+            for (int aCol=aStartCol; aCol<=aEndCol; aCol=(aCol/aGroupSize+1)*aGroupSize)
+            {
+                int aLastCol=qMin((aCol/aGroupSize+1)*aGroupSize-1, aEndCol);
 
-    // Draw background for chars (Selection and cursor)
-    {
-        // Check for selection
-        if (mSelectionStart!=mSelectionEnd)
+                aPainter.fillRect((mAddressWidth+1+mViewMode.byteColumn(aLastCol))*mCharWidth+aOffsetX, aY, (aLastCol-aCol+1)*mViewMode.cellWidth()*mCharWidth, mCharHeight, aColor);
+            }
+        }
+        else
+        {
+            aPainter.fillRect((mAddressWidth+1+mViewMode.byteColumn(aStartCol))*mCharWidth+aOffsetX, aY, (mViewMode.byteColumn(aEndCol)-mViewMode.byteColumn(aStartCol)+mViewMode.cellWidth())*mCharWidth, mCharHeight, aColor);
+        }
+
+        aPainter.fillRect((textColumn()+aStartCol)*mCharWidth+aOffsetX, aY, (aEndCol-aStartCol+1)*mCharWidth, mCharHeight, aColor);
+    }
+}
+
+bool HexEditor::viewportEvent(QEvent *event)
+{
+    if (event->type()==QEvent::ToolTip)
+    {
+        QHelpEvent *aHelpEvent=(QHelpEvent *)event;
+        bool aAtLeftPart;
+        qint64 aPos=charAt(aHelpEvent->pos(), &aAtLeftPart)>>1;
+
+        QStringList aLines;
+        QList<HexAnnotation> aAnnotations=mDocument->annotations().find(aPos, aPos+1);
+
+        for (int i=0; i<aAnnotations.size(); ++i)
+        {
+            if (!aAnnotations.at(i).text.isEmpty())
+            {
+                aLines.append(aAnnotations.at(i).text);
+            }
+        }
+
+        if (mStructureOverlay)
+        {
+            mStructureOverlay->setDocument(mDocument);
+            QString aField=mStructureOverlay->fieldAt(aPos);
+
+            if (!aField.isEmpty())
+            {
+                aLines.append(aField);
+            }
+        }
+
+        QString aText=aLines.join("\n");
+
+        if (aText.isEmpty())
+        {
+            QToolTip::hideText();
+        }
+        else
+        {
+            QToolTip::showText(aHelpEvent->globalPos(), aText, viewport());
+        }
+
+        return true;
+    }
+
+    return QAbstractScrollArea::viewportEvent(event);
+}
+
+void HexEditor::resizeEvent(QResizeEvent *event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBars();
+}
+
+void HexEditor::paintEvent(QPaintEvent * /*event*/)
+{
+    HEX_PROFILE_FRAME();
+    HEX_PROFILE_SCOPE("paint");
+
+    QPainter painter(viewport());
+    QPalette aPalette=palette();
+
+    QColor aTextColor=aPalette.color(QPalette::Text);
+    QColor aHighlightColor=aPalette.color(QPalette::Highlight);
+    QColor aHighlightedTextColor=aPalette.color(QPalette::HighlightedText);
+    QColor aAlternateBaseColor=aPalette.color(QPalette::AlternateBase);
+    QColor aHoleColor=aPalette.color(QPalette::Midlight);
+
+    int aOffsetX=-horizontalScrollBar()->value();
+    qint64 aOffsetY=-scrollOffset();
+    int aViewWidth=viewport()->width();
+    int aViewHeight=viewport()->height();
+
+    painter.setFont(mFont);
+
+    // Structure overlay
+    if (mStructureOverlay)
+    {
+        qint64 aFirstRow=-aOffsetY/(mCharHeight+LINE_INTERVAL);
+        qint64 aLastRow=(aViewHeight-aOffsetY)/(mCharHeight+LINE_INTERVAL);
+
+        QList<StructureRange> aRanges;
+
+        mStructureOverlay->setDocument(mDocument);
+        mStructureOverlay->fieldRanges(aFirstRow<<4, qMin((aLastRow+1)<<4, dataSize()), aRanges);
+
+        for (int i=0; i<aRanges.size(); ++i)
+        {
+            const StructureRange &aRange=aRanges.at(i);
+            fillRange(painter, aRange.start, aRange.end, QColor(structureColors[aRange.colorIndex % (sizeof(structureColors)/sizeof(structureColors[0]))]), aOffsetX, aOffsetY);
+        }
+    }
+
+    // Annotations, only the visible part of every range is filled
+    if (mDocument->annotations().count()>0)
+    {
+        qint64 aFirstPos=qMax((qint64)0, -aOffsetY/(mCharHeight+LINE_INTERVAL))<<4;
+        qint64 aLastPos=qMin(((aViewHeight-aOffsetY)/(mCharHeight+LINE_INTERVAL)+1)<<4, dataSize());
+
+        QList<HexAnnotation> aAnnotations=mDocument->annotations().find(aFirstPos, aLastPos);
+
+        for (int i=0; i<aAnnotations.size(); ++i)
+        {
+            const HexAnnotation &aAnnotation=aAnnotations.at(i);
+            fillRange(painter, qMax(aFirstPos, aAnnotation.start), qMin(aLastPos, aAnnotation.end), QColor(annotationColor), aOffsetX, aOffsetY);
+        }
+    }
+
+    // Draw background for chars (Selection and cursor)
+    {
+        // Check for selection, only visible parts of several ranges are filled
+        if (!mSelection.isEmpty() && (mViewMode.isMirrored() || !mSelection.isSingleRange()))
+        {
+            qint64 aFirstPos=qMax((qint64)0, -aOffsetY/(mCharHeight+LINE_INTERVAL))<<4;
+            qint64 aLastPos=((aViewHeight-aOffsetY)/(mCharHeight+LINE_INTERVAL)+1)<<4;
+
+            QVector<HexRange> aRanges=mSelection.ranges(aFirstPos, aLastPos);
+
+            for (int i=0; i<aRanges.size(); ++i)
+            {
+                const HexRange &aRange=aRanges.at(i);
+                fillRange(painter, aRange.pos, aRange.pos+aRange.length, aHighlightColor, aOffsetX, aOffsetY);
+            }
+        }
+        else
+        if (!mSelection.isEmpty())
         {
             // Draw selection
-            int aStartRow=mSelectionStart>>4;
-            int aStartCol=mSelectionStart & 15;
+            qint64 aStartRow=mSelection.start()>>4;
+            int aStartCol=mSelection.start() & 15;
+
+            qint64 aEndRow=(mSelection.end()-1)>>4;
+            int aEndCol=(mSelection.end()-1) & 15;
+
+            // Rows beyond the viewport are cut to the row next to it, so coordinates fit in int
+            qint64 aAboveRow=-aOffsetY/(mCharHeight+LINE_INTERVAL)-1;
+            qint64 aBelowRow=(aViewHeight-aOffsetY)/(mCharHeight+LINE_INTERVAL)+1;
+
+            if (aStartRow<aAboveRow)
+            {
+                aStartRow=aAboveRow;
+                aStartCol=0;
+            }
 
-            int aEndRow=(mSelectionEnd-1)>>4;
-            int aEndCol=(mSelectionEnd-1) & 15;
+            if (aEndRow>aBelowRow)
+            {
+                aEndRow=aBelowRow;
+                aEndCol=15;
+            }
 
-            int aStartLeftX=(mAddressWidth+1+aStartCol*3)*mCharWidth+aOffsetX; // mAddressWidth + 1+aStartCol*3
-            int aStartRightX=(mAddressWidth+50+aStartCol)*mCharWidth+aOffsetX; // mAddressWidth + 1+16*2+15+1 + 1+aStartCol
-            int aStartY=aStartRow*(mCharHeight+LINE_INTERVAL)+aOffsetY;
+            int aStartLeftX=(mAddressWidth+1+mViewMode.byteColumn(aStartCol))*mCharWidth+aOffsetX;
+            int aStartRightX=(textColumn()+aStartCol)*mCharWidth+aOffsetX;
+            int aStartY=(int)(aStartRow*(mCharHeight+LINE_INTERVAL)+aOffsetY);
 
-            int aEndLeftX=(mAddressWidth+1+aEndCol*3)*mCharWidth+aOffsetX; // mAddressWidth + 1+aEndCol*3
-            int aEndRightX=(mAddressWidth+50+aEndCol)*mCharWidth+aOffsetX; // mAddressWidth + 1+16*2+15+1 + 1+aEndCol
-            int aEndY=aEndRow*(mCharHeight+LINE_INTERVAL)+aOffsetY;
+            int aEndLeftX=(mAddressWidth+1+mViewMode.byteColumn(aEndCol))*mCharWidth+aOffsetX;
+            int aEndRightX=(textColumn()+aEndCol)*mCharWidth+aOffsetX;
+            int aCellWidth=mViewMode.cellWidth()*mCharWidth;
+            int aEndY=(int)(aEndRow*(mCharHeight+LINE_INTERVAL)+aOffsetY);
 
             if (aStartRow==aEndRow)
             {
-                painter.fillRect(aStartLeftX, aStartY, aEndLeftX-aStartLeftX+mCharWidth*2, mCharHeight, aHighlightColor);
+                painter.fillRect(aStartLeftX, aStartY, aEndLeftX-aStartLeftX+aCellWidth, mCharHeight, aHighlightColor);
                 painter.fillRect(aStartRightX, aStartY, aEndRightX-aStartRightX+mCharWidth, mCharHeight, aHighlightColor);
             }
             else
             {
                 QRect aHexRect(
                                mAddressWidth*mCharWidth+aOffsetX,
-                               (aStartRow+1)*(mCharHeight+LINE_INTERVAL)-LINE_INTERVAL+aOffsetY,
-                               49*mCharWidth,
-                               (aEndRow-aStartRow-1)*(mCharHeight+LINE_INTERVAL)+LINE_INTERVAL
+                               aStartY+mCharHeight,
+                               (mViewMode.width()+2)*mCharWidth,
+                               aEndY-aStartY-mCharHeight
                               );
 
                 QRect aTextRect(
-                                (mAddressWidth+50)*mCharWidth+aOffsetX,
-                                (aStartRow+1)*(mCharHeight+LINE_INTERVAL)-LINE_INTERVAL+aOffsetY,
+                                textColumn()*mCharWidth+aOffsetX,
+                                aStartY+mCharHeight,
                                 16*mCharWidth,
-                                (aEndRow-aStartRow-1)*(mCharHeight+LINE_INTERVAL)+LINE_INTERVAL
+                                aEndY-aStartY-mCharHeight
                                );
 
                 if (aEndRow>aStartRow+1)
@@ -649,7 +1244,7 @@ void HexEditor::paintEvent(QPaintEvent * /*event*/)
                 }
 
                 painter.fillRect(aStartLeftX, aStartY, aHexRect.right()-aStartLeftX+1, mCharHeight, aHighlightColor);
-                painter.fillRect(aHexRect.left(), aEndY-LINE_INTERVAL, aEndLeftX-aHexRect.left()+mCharWidth*2, mCharHeight+LINE_INTERVAL, aHighlightColor);
+                painter.fillRect(aHexRect.left(), aEndY-LINE_INTERVAL, aEndLeftX-aHexRect.left()+aCellWidth, mCharHeight+LINE_INTERVAL, aHighlightColor);
 
                 painter.fillRect(aStartRightX, aStartY, aTextRect.right()-aStartRightX+1, mCharHeight, aHighlightColor);
                 painter.fillRect(aTextRect.left(), aEndY-LINE_INTERVAL, aEndRightX-aTextRect.left()+mCharWidth, mCharHeight+LINE_INTERVAL, aHighlightColor);
@@ -658,17 +1253,24 @@ void HexEditor::paintEvent(QPaintEvent * /*event*/)
         else
         {
             // Draw cursor
-            int aCurRow=mCursorPosition>>5;
-            int aCursorY=aCurRow*(mCharHeight+LINE_INTERVAL)+aOffsetY;
+            qint64 aCurRow=mCursorPosition>>5;
+            qint64 aCursorRowY=aCurRow*(mCharHeight+LINE_INTERVAL)+aOffsetY;
 
-            if (aCursorY+mCharHeight>=0 && aCursorY<=aViewHeight)
+            if (aCursorRowY+mCharHeight>=0 && aCursorRowY<=aViewHeight)
             {
+                int aCursorY=(int)aCursorRowY;
                 int aCurCol=mCursorPosition & 31;
                 bool aIsSecondChar=(aCurCol & 1);
                 aCurCol>>=1;
 
-                int aCursorX=(mAddressWidth+1+aCurCol*3)*mCharWidth+aOffsetX;
+                int aCursorX=(mAddressWidth+1+mViewMode.byteColumn(aCurCol))*mCharWidth+aOffsetX;
+                int aCursorWidth=mCharWidth;
 
+                if (!mViewMode.isHexDigits())
+                {
+                    aCursorWidth=mViewMode.cellWidth()*mCharWidth;
+                }
+                else
                 if (aIsSecondChar)
                 {
                     aCursorX+=mCharWidth;
@@ -690,15 +1292,15 @@ void HexEditor::paintEvent(QPaintEvent * /*event*/)
                 {
                     if (mMode==INSERT)
                     {
-                        painter.fillRect(aCursorX, aCursorY+mCharHeight, mCharWidth, LINE_INTERVAL, aHighlightColor);
+                        painter.fillRect(aCursorX, aCursorY+mCharHeight, aCursorWidth, LINE_INTERVAL, aHighlightColor);
                     }
                     else
                     {
-                        painter.fillRect(aCursorX, aCursorY, mCharWidth, mCharHeight, aHighlightColor);
+                        painter.fillRect(aCursorX, aCursorY, aCursorWidth, mCharHeight, aHighlightColor);
                     }
                 }
 
-                aCursorX=(mAddressWidth+50+aCurCol)*mCharWidth+aOffsetX;
+                aCursorX=(textColumn()+aCurCol)*mCharWidth+aOffsetX;
 
                 if (
                     (
@@ -729,66 +1331,146 @@ void HexEditor::paintEvent(QPaintEvent * /*event*/)
 
     // HEX data and ASCII characters
     {
-        int aDataSize=mData.size();
-        int aCurRow=0;
-        int aCurCol=0;
+        qint64 aDataSize=dataSize();
+        int aRowHeight=mCharHeight+LINE_INTERVAL;
+        qint64 aCurRow=qMax((qint64)0, -aOffsetY/aRowHeight);
+
+        if (aTextColor!=mRowCacheColor)
+        {
+            mRowCache.clear();
+            mRowCacheColor=aTextColor;
+            mHoleRowImage=QImage();
+        }
 
-        for (int i=0; i<aDataSize; ++i)
+        for (qint64 i=aCurRow<<4; i<aDataSize; i+=16, ++aCurRow)
         {
-            int aCharY=aCurRow*(mCharHeight+LINE_INTERVAL)+aOffsetY;
+            qint64 aRowY=aCurRow*aRowHeight+aOffsetY;
 
-            if (aCharY+mCharHeight<0)
+            if (aRowY>aViewHeight)
             {
-                i+=15;
-                ++aCurRow;
-                continue;
+                break;
+            }
+
+            int aCharY=(int)aRowY;
+            qint64 aRowEnd=qMin(i+16, aDataSize);
+            bool aPlainRow;
+
+            if (!mSelection.isEmpty())
+            {
+                aPlainRow=!mSelection.intersects(i, aRowEnd);
             }
             else
-            if (aCharY>aViewHeight)
             {
-                break;
+                aPlainRow=mMode==INSERT || mSelectionStart<i || mSelectionStart>=aRowEnd;
             }
 
-            // -----------------------------------------------------------------------------------------------------------------
+            // Rows without selection and cursor are drawn from the cache
+            if (aPlainRow)
+            {
+                if (isHoleRow(aCurRow))
+                {
+                    fillRange(painter, i, aRowEnd, aHoleColor, aOffsetX, aOffsetY);
+                }
+
+                painter.drawImage((mAddressWidth+1)*mCharWidth+aOffsetX, aCharY, *rowImage(aCurRow));
+                continue;
+            }
 
-            quint8 aAsciiChar=mData.at(i);
-            QString aHexChar=QString::number(aAsciiChar, 16).toUpper();
+            char    aRowData[16];
+            QString aGlyphs[16];
+            QString aCells[16];
+            bool    aSelected[16];
+            readRow(i, aRowEnd, aRowData, aGlyphs);
+            mViewMode.format((const uchar *)aRowData, (int)(aRowEnd-i), aCells);
 
-            int aCharX=(mAddressWidth+1+aCurCol*3)*mCharWidth+aOffsetX;
+            QVector<HexRange> aRowRanges=mSelection.ranges(i, aRowEnd);
 
-            if (aCharX>=(mAddressWidth-2)*mCharWidth && aCharX<=aViewWidth)
+            for (int j=0; j<16; ++j)
             {
-                if (i>=mSelectionStart && i<mSelectionEnd)
-                {
-                    painter.setPen(aHighlightedTextColor);
-                }
-                else
-                {
-                    painter.setPen(aTextColor);
-                }
+                aSelected[j]=false;
+            }
 
-                if (aHexChar.length()<2)
+            for (int j=0; j<aRowRanges.size(); ++j)
+            {
+                for (qint64 k=aRowRanges.at(j).pos; k<aRowRanges.at(j).pos+aRowRanges.at(j).length; ++k)
                 {
-                    aHexChar.insert(0, "0");
+                    aSelected[k-i]=true;
                 }
+            }
+
+            for (qint64 j=i; j<aRowEnd; ++j)
+            {
+                int aCurCol=(int)(j-i);
+
+                // -----------------------------------------------------------------------------------------------------------------
+
+                const QString &aCell=aCells[aCurCol];
+
+                int aCharX=(mAddressWidth+1+mViewMode.byteColumn(aCurCol))*mCharWidth+aOffsetX;
 
-                if (i==mSelectionStart && i==mSelectionEnd && mMode==OVERWRITE)
+                if (aCharX>=(mAddressWidth-2)*mCharWidth && aCharX<=aViewWidth)
                 {
-                    if ((mCursorAtTheLeft && !mCursorVisible) || (mCursorPosition & 1))
-                    {
-                        painter.setPen(aTextColor);
-                    }
-                    else
+                    bool aCursorHere=mSelection.isEmpty() && j==mSelectionStart && mMode==OVERWRITE;
+
+                    for (int k=0; k<aCell.length(); ++k)
                     {
-                        painter.setPen(aHighlightedTextColor);
+                        if (aCursorHere)
+                        {
+                            // Only the digit under the cursor in hex views, the whole cell in others
+                            if (
+                                (!mCursorAtTheLeft || mCursorVisible)
+                                &&
+                                (
+                                 !mViewMode.isHexDigits()
+                                 ||
+                                 k==(mCursorPosition & 1)
+                                )
+                               )
+                            {
+                                painter.setPen(aHighlightedTextColor);
+                            }
+                            else
+                            {
+                                painter.setPen(aTextColor);
+                            }
+                        }
+                        else
+                        if (aSelected[aCurCol])
+                        {
+                            painter.setPen(aHighlightedTextColor);
+                        }
+                        else
+                        {
+                            painter.setPen(aTextColor);
+                        }
+
+                        painter.drawText(aCharX+k*mCharWidth, aCharY, mCharWidth, mCharHeight, Qt::AlignCenter, aCell.at(k));
                     }
                 }
 
-                painter.drawText(aCharX,            aCharY, mCharWidth, mCharHeight, Qt::AlignCenter, aHexChar.at(0));
+                // -----------------------------------------------------------------------------------------------------------------
 
-                if (i==mSelectionStart && i==mSelectionEnd && mMode==OVERWRITE)
+                aCharX=(textColumn()+aCurCol)*mCharWidth+aOffsetX;
+
+                if (aCharX>=(mAddressWidth-2)*mCharWidth && aCharX<=aViewWidth)
                 {
-                    if ((!mCursorAtTheLeft || mCursorVisible) && (mCursorPosition & 1))
+                    if (
+                        (
+                         mSelection.isEmpty()
+                         &&
+                         j==mSelectionStart
+                         &&
+                         mMode==OVERWRITE
+                         &&
+                         (
+                          mCursorAtTheLeft
+                          ||
+                          mCursorVisible
+                         )
+                        )
+                        ||
+                        aSelected[aCurCol]
+                       )
                     {
                         painter.setPen(aHighlightedTextColor);
                     }
@@ -796,57 +1478,9 @@ void HexEditor::paintEvent(QPaintEvent * /*event*/)
                     {
                         painter.setPen(aTextColor);
                     }
-                }
 
-                painter.drawText(aCharX+mCharWidth, aCharY, mCharWidth, mCharHeight, Qt::AlignCenter, aHexChar.at(1));
-            }
-
-            // -----------------------------------------------------------------------------------------------------------------
-
-            aCharX=(mAddressWidth+50+aCurCol)*mCharWidth+aOffsetX;
-
-            if (aCharX>=(mAddressWidth-2)*mCharWidth && aCharX<=aViewWidth)
-            {
-                if (
-                    (
-                     i==mSelectionStart
-                     &&
-                     i==mSelectionEnd
-                     &&
-                     mMode==OVERWRITE
-                     &&
-                     (
-                      mCursorAtTheLeft
-                      ||
-                      mCursorVisible
-                     )
-                    )
-                    ||
-                    (
-                     i>=mSelectionStart
-                     &&
-                     i<mSelectionEnd
-                    )
-                   )
-                {
-                    painter.setPen(aHighlightedTextColor);
+                    painter.drawText(aCharX, aCharY, mCharWidth, mCharHeight, Qt::AlignCenter, aGlyphs[aCurCol]);
                 }
-                else
-                {
-                    painter.setPen(aTextColor);
-                }
-
-                painter.drawText(aCharX, aCharY, mCharWidth, mCharHeight, Qt::AlignCenter, mAsciiChars.at(aAsciiChar));
-            }
-
-            // -----------------------------------------------------------------------------------------------------------------
-
-            ++aCurCol;
-
-            if (aCurCol==16)
-            {
-                ++aCurRow;
-                aCurCol=0;
             }
         }
     }
@@ -860,7 +1494,7 @@ void HexEditor::paintEvent(QPaintEvent * /*event*/)
         aLineX=mAddressWidth*mCharWidth;
         painter.drawLine(aLineX, 0, aLineX, aViewHeight);
 
-        aLineX=(mAddressWidth+49)*mCharWidth+aOffsetX; // mAddressWidth + 1+16*2+15+1
+        aLineX=(mAddressWidth+mViewMode.width()+2)*mCharWidth+aOffsetX;
         painter.drawLine(aLineX, 0, aLineX, aViewHeight);
     }
 
@@ -869,23 +1503,25 @@ void HexEditor::paintEvent(QPaintEvent * /*event*/)
         painter.setPen(aTextColor);
         painter.fillRect(0, 0, mAddressWidth*mCharWidth, aViewHeight, aAlternateBaseColor);
 
-        for (int i=0; i<mLinesCount; ++i)
+        for (qint64 i=qMax((qint64)0, -aOffsetY/(mCharHeight+LINE_INTERVAL)); i<mLinesCount; ++i)
         {
-            int aCharY=i*(mCharHeight+LINE_INTERVAL)+aOffsetY;
+            qint64 aRowY=i*(mCharHeight+LINE_INTERVAL)+aOffsetY;
 
-            if (aCharY+mCharHeight<0)
+            if (aRowY+mCharHeight<0)
             {
                 continue;
             }
             else
-            if (aCharY>aViewHeight)
+            if (aRowY>aViewHeight)
             {
                 break;
             }
 
+            int aCharY=(int)aRowY;
+
 
 
-            QString aHexAddress=QString::number(i, 16).toUpper();
+            QString aHexAddress=QString::number(mAddressOffset+(i<<4), 16).toUpper();
 
             for (int j=0; j<mAddressWidth; ++j)
             {
@@ -898,9 +1534,9 @@ void HexEditor::paintEvent(QPaintEvent * /*event*/)
 
                 QChar aHexChar;
 
-                if (j<mAddressWidth-1 && mAddressWidth-j-2<aHexAddress.length())
+                if (mAddressWidth-j<=aHexAddress.length())
                 {
-                    aHexChar=aHexAddress.at(aHexAddress.length()-mAddressWidth+j+1);
+                    aHexChar=aHexAddress.at(aHexAddress.length()-mAddressWidth+j);
                 }
                 else
                 {
@@ -911,6 +1547,34 @@ void HexEditor::paintEvent(QPaintEvent * /*event*/)
             }
         }
     }
+
+    HEX_PROFILE_COUNT("paint.bytes", qMax((qint64)0, qMin(dataSize(), ((aViewHeight-aOffsetY)/(mCharHeight+LINE_INTERVAL)+1)<<4)-((-aOffsetY/(mCharHeight+LINE_INTERVAL))<<4)));
+
+#ifdef HEXEDITOR_PROFILING
+    // Performance overlay with statistics of the previous frame
+    if (mProfilerOverlayVisible)
+    {
+        QStringList aLines=HexProfiler::instance()->overlayLines();
+        QFontMetrics aMetrics(mFont);
+
+        int aWidth=0;
+
+        for (int i=0; i<aLines.size(); ++i)
+        {
+            aWidth=qMax(aWidth, textWidth(aMetrics, aLines.at(i)));
+        }
+
+        QRect aRect(aViewWidth-aWidth-mCharWidth*3, mCharHeight, aWidth+mCharWidth*2, aLines.size()*aMetrics.height()+mCharHeight);
+
+        painter.fillRect(aRect, QColor(0, 0, 0, 180));
+        painter.setPen(QColor(255, 255, 255));
+
+        for (int i=0; i<aLines.size(); ++i)
+        {
+            painter.drawText(aRect.left()+mCharWidth, aRect.top()+mCharHeight/2+i*aMetrics.height()+aMetrics.ascent(), aLines.at(i));
+        }
+    }
+#endif
 }
 
 void HexEditor::keyPressEvent(QKeyEvent *event)
@@ -920,7 +1584,7 @@ void HexEditor::keyPressEvent(QKeyEvent *event)
     // =======================================================================================
     if (event->matches(QKeySequence::MoveToPreviousChar))
     {
-        if (mCursorAtTheLeft)
+        if (mCursorAtTheLeft && mViewMode.isHexDigits())
         {
             setCursorPosition(mCursorPosition-1);
         }
@@ -934,7 +1598,7 @@ void HexEditor::keyPressEvent(QKeyEvent *event)
     else
     if (event->matches(QKeySequence::MoveToNextChar))
     {
-        if (mCursorAtTheLeft)
+        if (mCursorAtTheLeft && mViewMode.isHexDigits())
         {
             setCursorPosition(mCursorPosition+1);
         }
@@ -990,7 +1654,7 @@ void HexEditor::keyPressEvent(QKeyEvent *event)
     else
     if (event->matches(QKeySequence::MoveToEndOfDocument))
     {
-        setCursorPosition(mData.size()*2);
+        setCursorPosition(dataSize()*2);
         cursorMoved(false);
     }
     // =======================================================================================
@@ -1000,7 +1664,9 @@ void HexEditor::keyPressEvent(QKeyEvent *event)
     if (event->matches(QKeySequence::SelectAll))
     {
         mSelectionInit=0;
-        setCursorPosition(mData.size()*2);
+        mColumnSelection=false;
+        mKeptSelection.clear();
+        setCursorPosition(dataSize()*2);
         cursorMoved(true);
     }
     else
@@ -1060,7 +1726,7 @@ void HexEditor::keyPressEvent(QKeyEvent *event)
     else
     if (event->matches(QKeySequence::SelectEndOfDocument))
     {
-        setCursorPosition(mData.size()*2);
+        setCursorPosition(dataSize()*2);
         cursorMoved(true);
     }
     // =======================================================================================
@@ -1093,7 +1759,7 @@ void HexEditor::keyPressEvent(QKeyEvent *event)
     //                                     Editing
     // =======================================================================================
     else
-    if (!mReadOnly)
+    if (!isReadOnly())
     {
         if (event->matches(QKeySequence::Undo))
         {
@@ -1107,11 +1773,11 @@ void HexEditor::keyPressEvent(QKeyEvent *event)
         else
         if (event->matches(QKeySequence::Delete))
         {
-            int aSelStart=mSelectionStart;
+            qint64 aSelStart=selectionStart();
 
-            if (mSelectionStart==mSelectionEnd)
+            if (mSelection.isEmpty())
             {
-                if (mSelectionStart<mData.size())
+                if (mSelectionStart<dataSize())
                 {
                     if (mMode==INSERT)
                     {
@@ -1126,7 +1792,7 @@ void HexEditor::keyPressEvent(QKeyEvent *event)
             }
             else
             {
-                remove(mSelectionStart, mSelectionEnd-mSelectionStart);
+                removeSelected();
             }
 
             setPosition(aSelStart);
@@ -1135,9 +1801,9 @@ void HexEditor::keyPressEvent(QKeyEvent *event)
         else
         if ((event->key() == Qt::Key_Backspace) && (event->modifiers() == Qt::NoModifier))
         {
-            int aSelStart=mSelectionStart;
+            qint64 aSelStart=selectionStart();
 
-            if (mSelectionStart==mSelectionEnd)
+            if (mSelection.isEmpty())
             {
                 if (mSelectionStart>0)
                 {
@@ -1155,7 +1821,7 @@ void HexEditor::keyPressEvent(QKeyEvent *event)
             }
             else
             {
-                remove(mSelectionStart, mSelectionEnd-mSelectionStart);
+                removeSelected();
             }
 
             setPosition(aSelStart);
@@ -1181,36 +1847,41 @@ void HexEditor::keyPressEvent(QKeyEvent *event)
 
                 if (mCursorAtTheLeft)
                 {
+                    // Bytes are typed as hex digits only in views that show them so
                     if (
+                        mViewMode.isHexDigits()
+                        &&
                         (
-                         aKey>='0'
-                         &&
-                         aKey<='9'
-                        )
-                        ||
-                        (
-                         aKey>='a'
-                         &&
-                         aKey<='f'
-                        )
-                        ||
-                        (
-                         aKey>='A'
-                         &&
-                         aKey<='F'
+                         (
+                          aKey>='0'
+                          &&
+                          aKey<='9'
+                         )
+                         ||
+                         (
+                          aKey>='a'
+                          &&
+                          aKey<='f'
+                         )
+                         ||
+                         (
+                          aKey>='A'
+                          &&
+                          aKey<='F'
+                         )
                         )
                        )
                     {
-                        if (mSelectionStart!=mSelectionEnd)
+                        if (!mSelection.isEmpty())
                         {
-                            int aSelStart=mSelectionStart;
-                            remove(mSelectionStart, mSelectionEnd-mSelectionStart);
+                            qint64 aSelStart=selectionStart();
+                            removeSelected();
                             setPosition(aSelStart);
                             cursorMoved(false);
                         }
 
                         if (
-                            mSelectionStart==mData.size()
+                            mSelectionStart==dataSize()
                             ||
                             (
                              mMode==INSERT
@@ -1222,9 +1893,9 @@ void HexEditor::keyPressEvent(QKeyEvent *event)
                             insert(mSelectionStart, 0);
                         }
 
-                        if (mSelectionStart<mData.size())
+                        if (mSelectionStart<dataSize())
                         {
-                            QByteArray aHexChar=QString::number((quint8)mData.at(mSelectionStart), 16).toLatin1();
+                            QByteArray aHexChar=QString::number((quint8)mDocument->at(mSelectionStart), 16).toLatin1();
 
                             if (aHexChar.length()<2)
                             {
@@ -1249,16 +1920,41 @@ void HexEditor::keyPressEvent(QKeyEvent *event)
                 }
                 else
                 {
-                    if (mSelectionStart!=mSelectionEnd)
+                    QByteArray aBytes=HexEncoding::fromUnicode(mEncoding, aKeyText);
+
+                    if (aBytes.isEmpty())
+                    {
+                        return;
+                    }
+
+                    if (!mSelection.isEmpty())
                     {
-                        int aSelStart=mSelectionStart;
-                        remove(mSelectionStart, mSelectionEnd-mSelectionStart);
+                        qint64 aSelStart=selectionStart();
+                        removeSelected();
                         setPosition(aSelStart);
                         cursorMoved(false);
                     }
 
+                    if (aBytes.length()>1)
+                    {
+                        qint64 aPos=mSelectionStart;
+
+                        if (mMode==INSERT)
+                        {
+                            insert(aPos, aBytes);
+                        }
+                        else
+                        {
+                            replace(aPos, qMin((qint64)aBytes.length(), dataSize()-aPos), aBytes);
+                        }
+
+                        setPosition(aPos+aBytes.length());
+                        cursorMoved(false);
+                        return;
+                    }
+
                     if (
-                        mSelectionStart==mData.size()
+                        mSelectionStart==dataSize()
                         ||
                         mMode==INSERT
                        )
@@ -1266,9 +1962,9 @@ void HexEditor::keyPressEvent(QKeyEvent *event)
                         insert(mSelectionStart, 0);
                     }
 
-                    if (mSelectionStart<mData.size())
+                    if (mSelectionStart<dataSize())
                     {
-                        replace(mSelectionStart, aKey);
+                        replace(mSelectionStart, aBytes.at(0));
 
                         setPosition(mSelectionStart+1);
                         cursorMoved(false);
@@ -1286,7 +1982,7 @@ void HexEditor::mousePressEvent(QMouseEvent *event)
     if (mLeftButtonPressed)
     {
         bool aShift=event->modifiers() & Qt::ShiftModifier;
-        int aPosition=charAt(event->pos(), &mCursorAtTheLeft);
+        qint64 aPosition=charAt(event->pos(), &mCursorAtTheLeft);
 
         if (aShift)
         {
@@ -1298,10 +1994,26 @@ void HexEditor::mousePressEvent(QMouseEvent *event)
             {
                 mOneMoreSelection=true;
             }
+
+            setCursorPosition(aPosition);
+            cursorMoved(true);
         }
+        else
+        {
+            // Ctrl keeps ranges selected before, Alt selects a block of columns
+            HexSelection aKept=mSelection;
 
-        setCursorPosition(aPosition);
-        cursorMoved(aShift);
+            setCursorPosition(aPosition);
+            cursorMoved(false);
+
+            if (event->modifiers() & Qt::ControlModifier)
+            {
+                mKeptSelection=aKept;
+            }
+
+            mColumnSelection=(event->modifiers() & Qt::AltModifier)!=0;
+            selectionUpdated(false);
+        }
     }
 
     QAbstractScrollArea::mousePressEvent(event);
@@ -1311,7 +2023,7 @@ void HexEditor::mouseMoveEvent(QMouseEvent *event)
 {
     if (mLeftButtonPressed)
     {
-        int aPosition=charAt(event->pos(), &mCursorAtTheLeft);
+        qint64 aPosition=charAt(event->pos(), &mCursorAtTheLeft);
 
         if ((aPosition>>1)>=mSelectionInit)
         {
@@ -1338,48 +2050,1497 @@ void HexEditor::mouseReleaseEvent(QMouseEvent *event)
 
 void HexEditor::wheelEvent(QWheelEvent *event)
 {
-    if (event->delta()>=0)
+    int aRowHeight=mCharHeight+LINE_INTERVAL;
+
+#if QT_VERSION >= 0x050000
+    QPoint aPixelDelta=event->pixelDelta();
+
+    // Touchpads give exact pixels and their own inertia
+    if (!aPixelDelta.isNull())
     {
-        verticalScrollBar()->setValue(verticalScrollBar()->value()-10*(mCharHeight+LINE_INTERVAL));
+        stopScrollAnimation();
+
+        horizontalScrollBar()->setValue(horizontalScrollBar()->value()-aPixelDelta.x());
+        setScrollOffset(scrollOffset()-aPixelDelta.y());
+
+        event->accept();
+        return;
     }
-    else
+
+    int aDeltaX=event->angleDelta().x();
+    int aDeltaY=event->angleDelta().y();
+#else
+    int aDeltaX=event->orientation()==Qt::Horizontal ? event->delta() : 0;
+    int aDeltaY=event->orientation()==Qt::Vertical   ? event->delta() : 0;
+#endif
+
+    if (aDeltaX!=0)
     {
-        verticalScrollBar()->setValue(verticalScrollBar()->value()+10*(mCharHeight+LINE_INTERVAL));
+        horizontalScrollBar()->setValue(horizontalScrollBar()->value()-aDeltaX*mCharWidth*3/120);
     }
-}
 
-// ------------------------------------------------------------------
+    if (aDeltaY!=0)
+    {
+        // 120 is one notch, high resolution wheels send parts of it
+        mWheelRemainder+=aDeltaY*QApplication::wheelScrollLines()*aRowHeight;
 
-QByteArray HexEditor::data() const
-{
-    return mData;
-}
+        int aPixels=mWheelRemainder/120;
+        mWheelRemainder%=120;
 
-void HexEditor::setData(QByteArray const &aData)
-{
-    if (mData!=aData)
-    {
-        mData=aData;
-        setCursorPosition(mCursorPosition);
-        mUndoStack.clear();
+        if (!mScrollAnimationTimer.isActive())
+        {
+            mScrollTarget=scrollOffset();
+            mScrollAnimatedValue=mScrollTarget;
+        }
 
-        updateScrollBars();
-        viewport()->update();
+        mScrollTarget=qBound((qint64)0, mScrollTarget-aPixels, maxScrollOffset());
 
-        emit dataChanged();
+        if (mScrollTarget!=scrollOffset())
+        {
+            mScrollAnimationTimer.start();
+        }
     }
-}
 
-HexEditor::Mode HexEditor::mode() const
-{
-    return mMode;
+    event->accept();
 }
 
-void HexEditor::setMode(const Mode &aMode)
+void HexEditor::scrollAnimationStep()
 {
-    if (mMode!=aMode)
+    // View was moved by somebody else, so animation is cancelled
+    if (scrollOffset()!=mScrollAnimatedValue)
     {
-        mMode=aMode;
+        stopScrollAnimation();
+        return;
+    }
+
+    qint64 aRemaining=mScrollTarget-scrollOffset();
+    qint64 aStep=aRemaining/SCROLL_ANIMATION_DIVIDER;
+
+    if (aStep==0)
+    {
+        aStep=aRemaining;
+    }
+
+    mScrollAnimatedValue=scrollOffset()+aStep;
+    setScrollOffset(mScrollAnimatedValue);
+
+    if (mScrollAnimatedValue==mScrollTarget || scrollOffset()!=mScrollAnimatedValue)
+    {
+        stopScrollAnimation();
+    }
+}
+
+void HexEditor::stopScrollAnimation()
+{
+    mScrollAnimationTimer.stop();
+    mWheelRemainder=0;
+}
+
+void HexEditor::verticalScrolled(int aValue)
+{
+    // Value set by setScrollOffset() keeps the exact offset, only moves of the scroll bar itself change it
+    if (aValue!=mScrollOffset/mScrollScale)
+    {
+        mScrollOffset=qMin((qint64)aValue*mScrollScale, maxScrollOffset());
+    }
+
+    scrolled();
+}
+
+void HexEditor::scrolled()
+{
+    viewport()->update();
+    mSessionTimer.start();
+
+    qint64 aElapsed=mScrollClock.restart();
+    qint64 aDelta=mScrollOffset-mLastScrollOffset;
+
+    mLastScrollOffset=mScrollOffset;
+
+    if (aElapsed>PREFETCH_LOOKAHEAD_MS)
+    {
+        // Scrolling has just started
+        mScrollVelocity=aDelta*1000.0/PREFETCH_LOOKAHEAD_MS;
+    }
+    else
+    {
+        mScrollVelocity=mScrollVelocity*0.7+aDelta*1000.0/qMax(aElapsed, (qint64)1)*0.3;
+    }
+
+    mPrefetchTimer.start(0);
+}
+
+void HexEditor::prefetchRows()
+{
+    if (!mRowCacheColor.isValid())
+    {
+        return;
+    }
+
+    int aRowHeight=mCharHeight+LINE_INTERVAL;
+    qint64 aFirstRow=scrollOffset()/aRowHeight;
+    int aVisibleRows=viewport()->height()/aRowHeight+1;
+    qint64 aRowsCount=(dataSize()+15)>>4;
+
+    // Rows that will become visible during the lookahead interval, but at least one page
+    int aAheadRows=(int)qMin(qMax((double)aVisibleRows, qAbs(mScrollVelocity)*PREFETCH_LOOKAHEAD_MS/1000/aRowHeight), (double)ROW_CACHE_SIZE/2);
+
+    int aDirection=mScrollVelocity>=0 ? 1 : -1;
+    qint64 aRow=aDirection>0 ? aFirstRow+aVisibleRows : aFirstRow-1;
+
+    if (aRow<0 || aRow>=aRowsCount)
+    {
+        return;
+    }
+
+    // Data of the rows is read in the background, so only rows that are already in memory are rendered here
+    int aContext=HexEncoding::contextSize(mEncoding);
+    qint64 aLastRow=qBound((qint64)0, aRow+aDirection*(aAheadRows-1), aRowsCount-1);
+    qint64 aFromRow=qMin(aRow, aLastRow);
+    qint64 aToRow=qMax(aRow, aLastRow);
+
+    mDocument->prefetch(aFromRow*16-aContext, (aToRow-aFromRow+1)*16+2*aContext);
+
+    bool aWaiting=false;
+
+    QElapsedTimer aBudget;
+    aBudget.start();
+
+    for (int i=0; i<aAheadRows && aRow>=0 && aRow<aRowsCount; ++i, aRow+=aDirection)
+    {
+        if (mRowCache.contains(aRow))
+        {
+            continue;
+        }
+
+        if (aBudget.elapsed()>=PREFETCH_BUDGET_MS)
+        {
+            // Continue when the event loop is idle again
+            mPrefetchTimer.start(0);
+            return;
+        }
+
+        if (!mDocument->isCached(aRow*16-aContext, 16+2*aContext))
+        {
+            aWaiting=true;
+            continue;
+        }
+
+        rowImage(aRow);
+    }
+
+    if (aWaiting)
+    {
+        mPrefetchTimer.start(PREFETCH_RETRY_MS);
+    }
+}
+
+void HexEditor::documentRangeChanged(HexEditor *aSource, qint64 aPos, qint64 aLength)
+{
+    emit rangeChanged(aPos, aLength);
+
+    // Editor that made the change updates itself
+    if (aSource==this)
+    {
+        return;
+    }
+
+    emit dataChanged();
+
+    if (aLength<0)
+    {
+        updateScrollBars();
+
+        if (mSelection.end()>dataSize() || (mCursorPosition>>1)>dataSize())
+        {
+            setCursorPosition(mCursorPosition);
+            resetSelection();
+        }
+
+        viewport()->update();
+        return;
+    }
+
+    // Only rows of the change are painted again, with neighbours that multibyte chars can reach
+    int aContext=HexEncoding::contextSize(mEncoding);
+    int aRowHeight=mCharHeight+LINE_INTERVAL;
+    qint64 aFirstRow=qMax(aPos-aContext, (qint64)0)>>4;
+    qint64 aLastRow=(aPos+qMax(aLength, (qint64)1)-1+aContext)>>4;
+    qint64 aTop=qMax(aFirstRow*aRowHeight-scrollOffset(), (qint64)0);
+    qint64 aBottom=qMin((aLastRow+1)*aRowHeight-scrollOffset(), (qint64)viewport()->height());
+
+    if (aTop<aBottom)
+    {
+        viewport()->update(0, (int)aTop, viewport()->width(), (int)(aBottom-aTop));
+    }
+}
+
+void HexEditor::documentStateChanged()
+{
+    viewport()->update();
+}
+
+void HexEditor::invalidateRows(qint64 aPos, qint64 aLength)
+{
+    // Glyphs of bytes around the change depend on it in multibyte encodings
+    int aContext=HexEncoding::contextSize(mEncoding);
+
+    if (aContext>0)
+    {
+        aPos=qMax(aPos-aContext, (qint64)0);
+
+        if (aLength>=0)
+        {
+            aLength+=aContext*2;
+        }
+    }
+
+    qint64 aFirstRow=aPos>>4;
+    qint64 aLastRow=aLength<0 ? Q_INT64_C(0x7FFFFFFFFFFFFFFF) : (aPos+qMax(aLength, (qint64)1)-1)>>4;
+
+    // Large changes have more rows than the cache
+    if (aLastRow-aFirstRow>=mRowCache.size())
+    {
+        QList<qint64> aRows=mRowCache.keys();
+
+        for (int i=0; i<aRows.size(); ++i)
+        {
+            if (aRows.at(i)>=aFirstRow && aRows.at(i)<=aLastRow)
+            {
+                mRowCache.remove(aRows.at(i));
+            }
+        }
+    }
+    else
+    {
+        for (qint64 i=aFirstRow; i<=aLastRow; ++i)
+        {
+            mRowCache.remove(i);
+        }
+    }
+}
+
+bool HexEditor::isHoleRow(qint64 aRow) const
+{
+    qint64 aStart=aRow<<4;
+
+    if (aStart+16>dataSize())
+    {
+        return false;
+    }
+
+    // Last hole that starts before the row end
+    const QVector<HexRange> &aHoles=mShared->holes();
+    int aLow=0;
+    int aHigh=aHoles.size();
+
+    while (aLow<aHigh)
+    {
+        int aMiddle=(aLow+aHigh)/2;
+
+        if (aHoles.at(aMiddle).pos<=aStart)
+        {
+            aLow=aMiddle+1;
+        }
+        else
+        {
+            aHigh=aMiddle;
+        }
+    }
+
+    return aLow>0 && aHoles.at(aLow-1).pos+aHoles.at(aLow-1).length>=aStart+16;
+}
+
+QImage* HexEditor::rowImage(qint64 aRow)
+{
+    if (isHoleRow(aRow))
+    {
+        if (mHoleRowImage.isNull())
+        {
+            mHoleRowImage=QImage((mViewMode.width()+18)*mCharWidth, mCharHeight, QImage::Format_ARGB32_Premultiplied); // Number pane + 2 + 16
+            renderRow(mHoleRowImage, aRow);
+        }
+
+        return &mHoleRowImage;
+    }
+
+    QImage *aImage=mRowCache.object(aRow);
+
+    if (!aImage)
+    {
+        aImage=new QImage((mViewMode.width()+18)*mCharWidth, mCharHeight, QImage::Format_ARGB32_Premultiplied); // Number pane + 2 + 16
+        renderRow(*aImage, aRow);
+
+        mRowCache.insert(aRow, aImage);
+    }
+
+    return aImage;
+}
+
+void HexEditor::renderRow(QImage &aImage, qint64 aRow)
+{
+    aImage.fill(0);
+
+    QPainter aPainter(&aImage);
+    aPainter.setFont(mFont);
+    aPainter.setPen(mRowCacheColor);
+
+    qint64 aStart=aRow<<4;
+    qint64 aEnd=qMin(aStart+16, dataSize());
+    int aCount=(int)(aEnd-aStart);
+
+    char    aRowData[16];
+    QString aGlyphs[16];
+    QString aCells[16];
+    readRow(aStart, aEnd, aRowData, aGlyphs);
+    mViewMode.format((const uchar *)aRowData, aCount, aCells);
+
+    int aTextX=mViewMode.width()+2;
+
+    for (int aCol=0; aCol<aCount; ++aCol)
+    {
+        int aCellX=mViewMode.byteColumn(aCol);
+        const QString &aCell=aCells[aCol];
+
+        for (int k=0; k<aCell.length(); ++k)
+        {
+            aPainter.drawText((aCellX+k)*mCharWidth, 0, mCharWidth, mCharHeight, Qt::AlignCenter, aCell.at(k));
+        }
+
+        aPainter.drawText((aTextX+aCol)*mCharWidth, 0, mCharWidth, mCharHeight, Qt::AlignCenter, aGlyphs[aCol]);
+    }
+}
+
+void HexEditor::readRow(qint64 aStart, qint64 aEnd, char *aRowData, QString *aGlyphs) const
+{
+    // Chars of multibyte encodings can start before the row and end after it
+    int aContext=HexEncoding::contextSize(mEncoding);
+    qint64 aFrom=qMax(aStart-aContext, (qint64)0);
+    qint64 aTo=qMin(aEnd+aContext, dataSize());
+
+    uchar aBuffer[16+2*3];
+    mDocument->read(aFrom, (char *)aBuffer, aTo-aFrom);
+
+    memcpy(aRowData, aBuffer+(aStart-aFrom), aEnd-aStart);
+    HexEncoding::decode(mEncoding, aBuffer, (int)(aTo-aFrom), (int)(aStart-aFrom), (int)(aEnd-aStart), aStart, aGlyphs);
+}
+
+// ------------------------------------------------------------------
+
+QByteArray HexEditor::data() const
+{
+    return mDocument->mid(0); // Shared, not copied, for data in memory
+}
+
+void HexEditor::setData(QByteArray const &aData)
+{
+    HEX_PROFILE_SCOPE("setData");
+
+    // No comparison with the old data here, it would touch every byte of both arrays
+    setDocument(new ByteArrayDocument(aData));
+}
+
+HexDocument* HexEditor::document() const
+{
+    return mDocument;
+}
+
+void HexEditor::setDocument(HexDocument *aDocument)
+{
+    cancelLoading();
+    stopWatching();
+    mFileName.clear();
+    mAddressOffset=0;
+    mSessionRecords.clear();
+
+    // Editors that share the old document keep it
+    attachDocument(new SharedDocument(aDocument));
+
+    setCursorPosition(mCursorPosition);
+
+    updateScrollBars();
+    viewport()->update();
+
+    emit dataChanged();
+    emit rangeChanged(0, -1);
+    emit documentReplaced();
+}
+
+void HexEditor::shareDocument(HexEditor *aEditor)
+{
+    if (!aEditor || aEditor->mShared==mShared)
+    {
+        return;
+    }
+
+    cancelLoading();
+    stopWatching();
+
+    // Loading and watching stay with aEditor, changes they make come through the shared document
+    mFileName=aEditor->mFileName;
+    mAddressOffset=aEditor->mAddressOffset;
+
+    attachDocument(aEditor->mShared);
+
+    setCursorPosition(mCursorPosition);
+    resetSelection();
+
+    updateScrollBars();
+    viewport()->update();
+
+    emit dataChanged();
+    emit rangeChanged(0, -1);
+    emit documentReplaced();
+}
+
+bool HexEditor::isSharingDocument() const
+{
+    return mShared->editorsCount()>1;
+}
+
+SharedDocument* HexEditor::sharedDocument() const
+{
+    return mShared;
+}
+
+bool HexEditor::isModified() const
+{
+    return mShared->isModified();
+}
+
+bool HexEditor::isHistoryComplete() const
+{
+    return !mShared->isHistoryDropped();
+}
+
+void HexEditor::attachDocument(SharedDocument *aShared)
+{
+    detachDocument();
+
+    mShared=aShared;
+    mShared->attach(this);
+    mDocument=mShared->document();
+    mUndoStack=mShared->undoStack();
+
+    connect(mShared, SIGNAL(rangeChanged(HexEditor*,qint64,qint64)), this, SLOT(documentRangeChanged(HexEditor*,qint64,qint64)));
+    connect(mShared, SIGNAL(stateChanged()),                   this, SLOT(documentStateChanged()));
+    connect(mShared, SIGNAL(journalFailed(QString)),           this, SIGNAL(journalFailed(QString)));
+}
+
+void HexEditor::detachDocument()
+{
+    if (!mShared)
+    {
+        return;
+    }
+
+    disconnect(mShared, 0, this, 0);
+
+    if (mShared->detach(this))
+    {
+        delete mShared;
+    }
+
+    mShared=0;
+    mDocument=0;
+    mUndoStack=0;
+}
+
+void HexEditor::pushCommand(QUndoCommand *aCommand)
+{
+    // Command runs on behalf of this editor right away
+    mShared->setActiveEditor(this);
+    mUndoStack->push(aCommand);
+}
+
+void HexEditor::appendData(const QByteArray &aData)
+{
+    if (aData.isEmpty())
+    {
+        return;
+    }
+
+    qint64 aPos=dataSize();
+
+    mDocument->append(aData);
+
+    updateScrollBars();
+    viewport()->update();
+
+    emit dataChanged();
+    mShared->notifyChanged(this, aPos, aData.size());
+}
+
+void HexEditor::openFile(const QString &aFileName)
+{
+    if (openFileSource(aFileName))
+    {
+        return;
+    }
+
+    setData(QByteArray());
+
+    mFileName=aFileName;
+    mShared->setLoading(true);
+
+    mLoader=new FileLoader(aFileName, this);
+
+    connect(mLoader, SIGNAL(chunkLoaded(QByteArray)),      this, SLOT(loaderChunkLoaded(QByteArray)));
+    connect(mLoader, SIGNAL(progress(qint64,qint64)),      this, SLOT(loaderProgress(qint64,qint64)));
+    connect(mLoader, SIGNAL(loadFinished(bool,QString)),   this, SLOT(loaderFinished(bool,QString)));
+
+    mLoader->start();
+}
+
+bool HexEditor::openFileSource(const QString &aFileName)
+{
+    QVector<HexRange> aHoles;
+    qint64 aSize;
+
+    {
+        QFile aFile(aFileName);
+
+        // Errors are reported by the loader
+        if (!aFile.open(QIODevice::ReadOnly) || aFile.isSequential())
+        {
+            return false;
+        }
+
+        aHoles=SparseFile::holes(aFile);
+        aSize=aFile.size();
+    }
+
+    // Pages of large files count in the memory budget, loaded data wouldn't
+    if (aHoles.isEmpty() && aSize<=LARGE_FILE_SIZE)
+    {
+        return false;
+    }
+
+    FileDataSource *aSource=new FileDataSource(aFileName);
+
+    if (!aSource->open(false))
+    {
+        delete aSource;
+        return false;
+    }
+
+    // Holes never take memory, data between them is read page by page
+    SourceDocument *aDocument=new SourceDocument(aSource);
+    aDocument->setHoles(aHoles);
+
+    setDocument(aDocument);
+
+    mFileName=aFileName;
+    mShared->setHoles(aHoles);
+
+    startWatching();
+
+    emit loadFinished(true, QString());
+    startSession();
+
+    return true;
+}
+
+bool HexEditor::saveFile(const QString &aFileName, QString *aError)
+{
+    if (isLoading())
+    {
+        if (aError)
+        {
+            *aError="File is still being loaded";
+        }
+
+        return false;
+    }
+
+    // Own writes shouldn't be taken as external changes
+    stopWatching();
+
+    // Unchanged bytes are still read from the file, so it is replaced only after the new one is written
+    SourceDocument *aSourceDocument=dynamic_cast<SourceDocument *>(mDocument);
+    bool aReplace=aSourceDocument
+                  &&
+                  dynamic_cast<FileDataSource *>(aSourceDocument->source())
+                  &&
+                  QFileInfo(aSourceDocument->source()->name())==QFileInfo(aFileName);
+
+    QFile aFile(aReplace ? SparseFile::unusedName(aFileName+".tmp") : aFileName);
+    bool aSuccess=aFile.open(QIODevice::WriteOnly | QIODevice::Truncate);
+
+    // Chunk by chunk, so data that isn't in memory isn't read at once
+    for (qint64 aPos=0; aSuccess && aPos<mDocument->size(); )
+    {
+        qint64 aLength;
+        const char *aChunk=mDocument->chunk(aPos, aLength);
+
+        aSuccess=SparseFile::write(aFile, aPos, aChunk, aLength);
+        aPos+=aLength;
+    }
+
+    // Trailing zeros become a hole too
+    if (!aSuccess || !aFile.resize(mDocument->size()))
+    {
+        if (aError)
+        {
+            *aError=aFile.errorString();
+        }
+
+        if (aReplace)
+        {
+            aFile.close();
+            aFile.remove();
+        }
+
+        if (!mFileName.isEmpty())
+        {
+            startWatching();
+        }
+
+        return false;
+    }
+
+    if (aReplace)
+    {
+        SparseFile::sync(aFile);
+        aFile.close();
+
+        // Windows doesn't rename open files
+        aSourceDocument->closeSource();
+
+        QString aReplaceError;
+
+        if (!SparseFile::replace(aFile.fileName(), aFileName, &aReplaceError))
+        {
+            aFile.remove();
+            aSourceDocument->reopenSource(false);
+
+            if (aError)
+            {
+                *aError=aReplaceError;
+            }
+
+            startWatching();
+
+            return false;
+        }
+
+        // Document is read from the saved file from now on
+        bool aOpened=aSourceDocument->reopenSource(false, aError);
+
+        aSourceDocument->sourceReplaced();
+        aSourceDocument->setHoles(mShared->holes());
+
+        if (!aOpened)
+        {
+            return false;
+        }
+    }
+
+    aFile.close();
+
+    mFileName=aFileName;
+    mShared->setClean();
+    startWatching();
+    restartSession();
+
+    return true;
+}
+
+bool HexEditor::openSource(HexDataSource *aSource, qint64 aBase, qint64 aLength, QString *aError)
+{
+    HEX_PROFILE_SCOPE("openSource");
+
+    aLength=qMax((qint64)0, qMin(aLength, aSource->size()-aBase));
+
+    // Bytes are read on demand, only the first page is checked here
+    SourceDocument *aDocument=new SourceDocument(aSource, aBase, aLength);
+
+    if (aLength>0)
+    {
+        aDocument->at(0);
+
+        if (!aDocument->errorString().isEmpty())
+        {
+            if (aError)
+            {
+                *aError=QString("%1 at %2").arg(aDocument->errorString()).arg(aBase, 0, 16);
+            }
+
+            delete aDocument;
+            return false;
+        }
+    }
+
+    setDocument(aDocument);
+    mAddressOffset=aBase;
+
+    // Unreadable ranges are shown the same way as holes
+    QVector<HexRange> aUnreadable=aSource->unreadableRanges();
+    QVector<HexRange> aHoles;
+
+    for (int i=0; i<aUnreadable.size(); ++i)
+    {
+        qint64 aStart=qMax(aUnreadable.at(i).pos, aBase);
+        qint64 aEnd=qMin(aUnreadable.at(i).pos+aUnreadable.at(i).length, aBase+aLength);
+
+        if (aStart<aEnd)
+        {
+            HexRange aHole;
+            aHole.pos=aStart-aBase;
+            aHole.length=aEnd-aStart;
+            aHoles.append(aHole);
+        }
+    }
+
+    mShared->setHoles(aHoles);
+
+    updateScrollBars();
+    viewport()->update();
+
+    return true;
+}
+
+bool HexEditor::writeBack(QString *aError)
+{
+    SourceDocument *aDocument=dynamic_cast<SourceDocument *>(mDocument);
+
+    if (!aDocument)
+    {
+        if (aError)
+        {
+            *aError="Data is not opened from a data source";
+        }
+
+        return false;
+    }
+
+    // Only modified ranges are written
+    if (!aDocument->writeBack(aError))
+    {
+        return false;
+    }
+
+    mShared->setClean();
+
+    return true;
+}
+
+HexDataSource* HexEditor::dataSource() const
+{
+    SourceDocument *aDocument=dynamic_cast<SourceDocument *>(mDocument);
+
+    return aDocument ? aDocument->source() : 0;
+}
+
+bool HexEditor::reopenSource(bool aWritable, QString *aError)
+{
+    SourceDocument *aDocument=dynamic_cast<SourceDocument *>(mDocument);
+
+    return aDocument && aDocument->reopenSource(aWritable, aError);
+}
+
+qint64 HexEditor::sourceBase() const
+{
+    SourceDocument *aDocument=dynamic_cast<SourceDocument *>(mDocument);
+
+    return aDocument ? aDocument->base() : 0;
+}
+
+qint64 HexEditor::addressOffset() const
+{
+    return mAddressOffset;
+}
+
+QString HexEditor::fileName() const
+{
+    return mFileName;
+}
+
+bool HexEditor::isFollowingTail() const
+{
+    return mFollowTail;
+}
+
+void HexEditor::setFollowTail(bool aFollowTail)
+{
+    mFollowTail=aFollowTail;
+
+    if (mFollowTail)
+    {
+        stopScrollAnimation();
+        setScrollOffset(maxScrollOffset());
+    }
+}
+
+QVector<HexRange> HexEditor::holes() const
+{
+    return mShared->holes();
+}
+
+bool HexEditor::exportSelection(const QString &aFileName, HexExporter::Format aFormat, QString *aError)
+{
+    if (mExporter)
+    {
+        if (aError)
+        {
+            *aError="Another export is running";
+        }
+
+        return false;
+    }
+
+    mExportRanges=mSelection.ranges(0, dataSize());
+
+    if (mSelection.isEmpty())
+    {
+        HexRange aRange;
+        aRange.pos=0;
+        aRange.length=dataSize();
+
+        mExportRanges.append(aRange);
+    }
+
+    qint64 aTotal=0;
+
+    for (int i=0; i<mExportRanges.size(); ++i)
+    {
+        aTotal+=mExportRanges.at(i).length;
+    }
+
+    mExporter=new HexExporter(aFileName, aFormat, aTotal);
+
+    if (!mExporter->open(aError))
+    {
+        delete mExporter;
+        mExporter=0;
+
+        return false;
+    }
+
+    mExportRange=0;
+    mExportPos=mExportRanges.isEmpty() ? 0 : mExportRanges.first().pos;
+    mExportVersion=mDocument->version();
+
+    connect(mExporter, SIGNAL(progress(qint64,qint64)),      this, SLOT(exporterProgress(qint64,qint64)));
+    connect(mExporter, SIGNAL(exportFinished(bool,QString)), this, SLOT(exporterFinished(bool,QString)));
+
+    mExporter->start();
+    feedExporter();
+
+    return true;
+}
+
+bool HexEditor::isExporting() const
+{
+    return mExporter!=0;
+}
+
+void HexEditor::cancelExport()
+{
+    if (!mExporter)
+    {
+        return;
+    }
+
+    // Signals that are already queued are ignored, since they come from other sender
+    mExporter->stop();
+    mExporter->wait();
+    delete mExporter;
+    mExporter=0;
+
+    emit exportFinished(false, QString());
+}
+
+void HexEditor::feedExporter()
+{
+    if (!mExporter)
+    {
+        return;
+    }
+
+    if (mDocument->version()!=mExportVersion && mExportRange<mExportRanges.size())
+    {
+        mExporter->stop();
+        mExporter->wait();
+        delete mExporter;
+        mExporter=0;
+
+        emit exportFinished(false, "Data was changed during export");
+        return;
+    }
+
+    // Only a few chunks are read ahead, so memory doesn't depend on the size of the export
+    while (mExportRange<mExportRanges.size() && mExporter->queuedSize()<EXPORT_QUEUE_LIMIT)
+    {
+        HEX_PROFILE_SCOPE("export.read");
+
+        const HexRange &aRange=mExportRanges.at(mExportRange);
+        qint64 aLength=qMin((qint64)EXPORT_CHUNK_SIZE, aRange.pos+aRange.length-mExportPos);
+
+        QByteArray aChunk((int)aLength, 0);
+        mDocument->read(mExportPos, aChunk.data(), aLength);
+
+        mExporter->append(mExportPos, aChunk);
+        mExportPos+=aLength;
+
+        if (mExportPos>=aRange.pos+aRange.length)
+        {
+            ++mExportRange;
+
+            if (mExportRange<mExportRanges.size())
+            {
+                mExportPos=mExportRanges.at(mExportRange).pos;
+            }
+        }
+    }
+
+    if (mExportRange>=mExportRanges.size())
+    {
+        mExporter->finish();
+    }
+}
+
+void HexEditor::exporterProgress(qint64 aDone, qint64 aTotal)
+{
+    if (sender()!=mExporter)
+    {
+        return;
+    }
+
+    emit exportProgress(aDone, aTotal);
+    feedExporter();
+}
+
+void HexEditor::exporterFinished(bool aSuccess, QString aError)
+{
+    if (sender()!=mExporter)
+    {
+        return;
+    }
+
+    mExporter->wait();
+    mExporter->deleteLater();
+    mExporter=0;
+
+    emit exportFinished(aSuccess, aError);
+}
+
+int HexEditor::addAnnotation(qint64 aPos, qint64 aLength, const QString &aText)
+{
+    int aId=mDocument->annotations().add(aPos, aPos+qMax(aLength, (qint64)1), aText);
+    viewport()->update();
+
+    if (mShared->journal())
+    {
+        JournalRecord aRecord(JournalRecord::ANNOTATION_ADD);
+        aRecord.start=aPos;
+        aRecord.end=aPos+qMax(aLength, (qint64)1);
+        aRecord.text=aText;
+
+        mShared->journal()->append(aRecord);
+    }
+
+    return aId;
+}
+
+int HexEditor::removeAnnotationsAt(qint64 aPos)
+{
+    QList<HexAnnotation> aAnnotations=mDocument->annotations().find(aPos, aPos+1);
+
+    for (int i=0; i<aAnnotations.size(); ++i)
+    {
+        mDocument->annotations().remove(aAnnotations.at(i));
+    }
+
+    viewport()->update();
+
+    if (mShared->journal() && !aAnnotations.isEmpty())
+    {
+        JournalRecord aRecord(JournalRecord::ANNOTATION_REMOVE);
+        aRecord.start=aPos;
+
+        mShared->journal()->append(aRecord);
+    }
+
+    return aAnnotations.size();
+}
+
+QList<HexAnnotation> HexEditor::annotations(qint64 aStart, qint64 aEnd) const
+{
+    return mDocument->annotations().find(aStart, aEnd);
+}
+
+void HexEditor::nextAnnotation()
+{
+    HexAnnotation aAnnotation;
+
+    if (mDocument->annotations().next(position(), aAnnotation))
+    {
+        setPosition(aAnnotation.start);
+        cursorMoved(false);
+    }
+}
+
+void HexEditor::previousAnnotation()
+{
+    HexAnnotation aAnnotation;
+
+    if (mDocument->annotations().previous(position(), aAnnotation))
+    {
+        setPosition(aAnnotation.start);
+        cursorMoved(false);
+    }
+}
+
+bool HexEditor::isLoading() const
+{
+    return mShared->isLoading();
+}
+
+void HexEditor::cancelLoading()
+{
+    if (!mLoader)
+    {
+        return;
+    }
+
+    // Signals that are already queued are ignored, since they come from other sender
+    mLoader->stop();
+    mLoader->wait();
+    delete mLoader;
+    mLoader=0;
+
+    mShared->setLoading(false);
+}
+
+void HexEditor::loaderChunkLoaded(QByteArray aChunk)
+{
+    if (sender()!=mLoader)
+    {
+        return;
+    }
+
+    // Files are read on demand, only streams are loaded, and they can't outgrow one array
+    if (mDocument->size()+aChunk.size()>HexDocument::maxArraySize())
+    {
+        cancelLoading();
+        emit loadFinished(false, "Stream is too large to be kept in memory");
+        return;
+    }
+
+    appendData(aChunk);
+}
+
+void HexEditor::loaderProgress(qint64 aLoaded, qint64 aTotal)
+{
+    if (sender()!=mLoader)
+    {
+        return;
+    }
+
+    if (aLoaded==0 && aTotal>0)
+    {
+        mDocument->reserve(aTotal);
+    }
+
+    emit loadProgress(aLoaded, aTotal);
+}
+
+void HexEditor::loaderFinished(bool aSuccess, QString aError)
+{
+    if (sender()!=mLoader)
+    {
+        return;
+    }
+
+    mLoader->wait();
+
+    // Split views get holes and editing back together with this editor
+    if (aSuccess)
+    {
+        mShared->setHoles(mLoader->holes());
+    }
+
+    mLoader->deleteLater();
+    mLoader=0;
+
+    mShared->setLoading(false);
+
+    if (aSuccess)
+    {
+        startWatching();
+    }
+
+    emit loadFinished(aSuccess, aError);
+
+    if (aSuccess)
+    {
+        startSession();
+    }
+}
+
+void HexEditor::startSession()
+{
+    QByteArray aFingerprint=SessionJournal::fingerprint(mDocument);
+    QDateTime  aLastTime;
+    bool       aChanged=false;
+
+    mSessionRecords.clear();
+    mLastSessionPath.clear();
+
+    // Journal with changes wins, the newer one if both have them
+    for (int i=0; i<SESSION_SLOTS; ++i)
+    {
+        QString aPath=sessionPath(mFileName, i);
+        QList<JournalRecord> aRecords;
+
+        if (!SessionJournal(aPath).read(aFingerprint, aRecords))
+        {
+            QFile::remove(aPath);
+            continue;
+        }
+
+        bool aRecordsChanged=false;
+
+        for (int j=0; j<aRecords.size() && !aRecordsChanged; ++j)
+        {
+            aRecordsChanged=aRecords.at(j).type==JournalRecord::CHANGE;
+        }
+
+        QDateTime aTime=QFileInfo(aPath).lastModified();
+
+        if (
+            mLastSessionPath.isEmpty()
+            ||
+            (aRecordsChanged && !aChanged)
+            ||
+            (aRecordsChanged==aChanged && aTime>aLastTime)
+           )
+        {
+            mSessionRecords=aRecords;
+            mLastSessionPath=aPath;
+            aLastTime=aTime;
+            aChanged=aRecordsChanged;
+        }
+    }
+
+    mSessionVersion=mDocument->version();
+
+    // Old journal stays on disk until its records are restored or discarded
+    SessionJournal *aJournal=new SessionJournal(newSessionPath());
+
+    aJournal->start(aFingerprint);
+    mShared->setJournal(aJournal);
+
+    // Bookmarks and view state are restored without asking, a journal without them is dropped
+    if (aChanged)
+    {
+        emit sessionFound();
+    }
+    else
+    if (!restoreSession())
+    {
+        discardSession();
+    }
+}
+
+void HexEditor::restartSession()
+{
+    if (mFileName.isEmpty())
+    {
+        return;
+    }
+
+    // Journal of the old file state can't be replayed anymore
+    if (mShared->journal())
+    {
+        mShared->journal()->remove();
+    }
+
+    SessionJournal *aJournal=new SessionJournal(newSessionPath());
+
+    aJournal->start(SessionJournal::fingerprint(mDocument));
+    mShared->setJournal(aJournal);
+
+    // Bookmarks go on to the new journal
+    QList<HexAnnotation> aAnnotations=mDocument->annotations().find(0, mDocument->size()+1);
+
+    for (int i=0; i<aAnnotations.size(); ++i)
+    {
+        JournalRecord aRecord(JournalRecord::ANNOTATION_ADD);
+        aRecord.start=aAnnotations.at(i).start;
+        aRecord.end=aAnnotations.at(i).end;
+        aRecord.text=aAnnotations.at(i).text;
+
+        aJournal->append(aRecord);
+    }
+
+    writeSessionView();
+}
+
+QString HexEditor::newSessionPath() const
+{
+    for (int i=0; i<SESSION_SLOTS; ++i)
+    {
+        QString aPath=sessionPath(mFileName, i);
+
+        if (aPath!=mLastSessionPath)
+        {
+            return aPath;
+        }
+    }
+
+    return QString();
+}
+
+QString HexEditor::sessionPath(const QString &aFileName, int aSlot)
+{
+#if QT_VERSION >= 0x050000
+    QString aDir=QStandardPaths::writableLocation(QStandardPaths::DataLocation)+"/sessions";
+#else
+    QString aDir=QDesktopServices::storageLocation(QDesktopServices::DataLocation)+"/sessions";
+#endif
+
+    QDir().mkpath(aDir);
+
+    QString aName=QCryptographicHash::hash(QFileInfo(aFileName).absoluteFilePath().toUtf8(), QCryptographicHash::Md5).toHex();
+
+    if (aSlot>0)
+    {
+        aName+="."+QString::number(aSlot);
+    }
+
+    return aDir+"/"+aName+".journal";
+}
+
+bool HexEditor::restoreSession(QString *aError)
+{
+    HEX_PROFILE_SCOPE("session.restore");
+
+    if (mSessionRecords.isEmpty() || mDocument->version()!=mSessionVersion)
+    {
+        if (aError)
+        {
+            *aError="There is no session to restore";
+        }
+
+        return false;
+    }
+
+    // Replayed records are journaled again, so the new journal gets them too
+    QList<JournalRecord> aRecords=mSessionRecords;
+    int aView=-1;
+
+    mSessionRecords.clear();
+
+    for (int i=0; i<aRecords.size(); ++i)
+    {
+        const JournalRecord &aRecord=aRecords.at(i);
+
+        switch (aRecord.type)
+        {
+            case JournalRecord::CHANGE:
+            {
+                pushCommand(new EditsHexUndoCommand(this, aRecord.edits));
+            }
+            break;
+            case JournalRecord::TRANSFORM:
+            {
+                if (!aRecord.ranges.isEmpty())
+                {
+                    pushCommand(new TransformHexUndoCommand(this, aRecord.ranges, aRecord.transform));
+                }
+            }
+            break;
+            case JournalRecord::ANNOTATION_ADD:
+            {
+                addAnnotation(aRecord.start, aRecord.end-aRecord.start, aRecord.text);
+            }
+            break;
+            case JournalRecord::ANNOTATION_REMOVE:
+            {
+                removeAnnotationsAt(aRecord.start);
+            }
+            break;
+            case JournalRecord::VIEW:
+            {
+                aView=i;
+            }
+            break;
+        }
+    }
+
+    emit dataChanged();
+    updateScrollBars();
+
+    // Only the last view state matters
+    if (aView>=0)
+    {
+        const JournalRecord &aRecord=aRecords.at(aView);
+
+        setCursorPosition(aRecord.cursor);
+        setSelection(aRecord.start, aRecord.end-aRecord.start);
+        setScrollOffset(aRecord.scroll);
+    }
+
+    viewport()->update();
+
+    // Records are in the new journal now
+    discardSession();
+
+    return true;
+}
+
+void HexEditor::discardSession()
+{
+    mSessionRecords.clear();
+
+    if (!mLastSessionPath.isEmpty())
+    {
+        QFile::remove(mLastSessionPath);
+        mLastSessionPath.clear();
+    }
+}
+
+void HexEditor::removeJournals()
+{
+    discardSession();
+
+    if (mShared->journal())
+    {
+        mShared->journal()->remove();
+    }
+}
+
+void HexEditor::writeSessionView()
+{
+    SessionJournal *aJournal=mShared->journal();
+
+    if (!aJournal || !aJournal->isStarted())
+    {
+        return;
+    }
+
+    JournalRecord aRecord(JournalRecord::VIEW);
+    aRecord.cursor=mCursorPosition;
+    aRecord.start=mSelectionStart;
+    aRecord.end=mSelectionEnd;
+    aRecord.scroll=scrollOffset();
+
+    aJournal->append(aRecord);
+}
+
+void HexEditor::startWatching()
+{
+    stopWatching();
+
+    mWatcher=new FileWatcher(mFileName, mDocument->size(), this);
+
+    connect(mWatcher, SIGNAL(dataAppended(QByteArray)),         this, SLOT(watcherDataAppended(QByteArray)));
+    connect(mWatcher, SIGNAL(blockChanged(qint64,QByteArray)),  this, SLOT(watcherBlockChanged(qint64,QByteArray)));
+    connect(mWatcher, SIGNAL(fileTruncated(qint64)),            this, SLOT(watcherFileTruncated(qint64)));
+}
+
+void HexEditor::stopWatching()
+{
+    if (!mWatcher)
+    {
+        return;
+    }
+
+    mWatcher->stop();
+    mWatcher->wait();
+    delete mWatcher;
+    mWatcher=0;
+}
+
+bool HexEditor::canApplyFileChange()
+{
+    // Positions in the file and in data are the same only while data matches the file
+    if (!mShared->isModified())
+    {
+        return true;
+    }
+
+    stopWatching();
+    emit fileModifiedExternally();
+
+    return false;
+}
+
+void HexEditor::watcherDataAppended(QByteArray aData)
+{
+    if (sender()!=mWatcher)
+    {
+        return;
+    }
+
+    // Appended bytes follow the end of file, so they go to the end even if there are edits
+    appendData(aData);
+
+    if (!mShared->isModified())
+    {
+        restartSession();
+    }
+
+    if (mFollowTail)
+    {
+        stopScrollAnimation();
+        setScrollOffset(maxScrollOffset());
+    }
+}
+
+void HexEditor::watcherBlockChanged(qint64 aPos, QByteArray aData)
+{
+    if (sender()!=mWatcher || !canApplyFileChange())
+    {
+        return;
+    }
+
+    qint64 aLength=qMin((qint64)aData.size(), mDocument->size()-aPos);
+
+    if (aLength<=0)
+    {
+        return;
+    }
+
+    mDocument->replace(aPos, aLength, aData.left((int)aLength));
+
+    viewport()->update();
+
+    emit dataChanged();
+    mShared->notifyChanged(this, aPos, aLength);
+    restartSession();
+}
+
+void HexEditor::watcherFileTruncated(qint64 aSize)
+{
+    if (sender()!=mWatcher || !canApplyFileChange() || aSize>=mDocument->size())
+    {
+        return;
+    }
+
+    mDocument->remove(aSize, mDocument->size()-aSize);
+    setCursorPosition(mCursorPosition);
+
+    updateScrollBars();
+    viewport()->update();
+
+    emit dataChanged();
+    mShared->notifyChanged(this, aSize, -1);
+    restartSession();
+}
+
+HexEditor::Mode HexEditor::mode() const
+{
+    return mMode;
+}
+
+void HexEditor::setMode(const Mode &aMode)
+{
+    if (mMode!=aMode)
+    {
+        mMode=aMode;
 
         resetCursorTimer();
 
@@ -1389,7 +3550,7 @@ void HexEditor::setMode(const Mode &aMode)
 
 bool HexEditor::isReadOnly() const
 {
-    return mReadOnly;
+    return mReadOnly || mShared->isLoading();
 }
 
 void HexEditor::setReadOnly(const bool &aReadOnly)
@@ -1397,12 +3558,12 @@ void HexEditor::setReadOnly(const bool &aReadOnly)
     mReadOnly=aReadOnly;
 }
 
-int HexEditor::position() const
+qint64 HexEditor::position() const
 {
     return mCursorPosition>>1;
 }
 
-void HexEditor::setPosition(int aPosition)
+void HexEditor::setPosition(qint64 aPosition)
 {
     if ((mCursorPosition>>1)!=aPosition)
     {
@@ -1422,9 +3583,9 @@ void HexEditor::setCursorPosition(qint64 aCursorPos)
         aCursorPos=0;
     }
     else
-    if (aCursorPos>mData.size()<<1)
+    if (aCursorPos>dataSize()<<1)
     {
-        aCursorPos=mData.size()<<1;
+        aCursorPos=dataSize()<<1;
     }
 
     if (mCursorPosition!=aCursorPos)
@@ -1458,7 +3619,7 @@ void HexEditor::setFont(const QFont &aFont)
 
         for (int i=0; i<16; ++i)
         {
-            int aCharWidth=aFontMetrics.width(QString::number(i, 16).at(0));
+            int aCharWidth=textWidth(aFontMetrics, QString::number(i, 16));
 
             if (aCharWidth>mCharWidth)
             {
@@ -1469,54 +3630,408 @@ void HexEditor::setFont(const QFont &aFont)
         mCharWidth+=CHAR_INTERVAL;
         mCharHeight=aFontMetrics.height()+CHAR_INTERVAL;
 
-        updateScrollBars();
-        viewport()->update();
+        mRowCache.clear();
+        mHoleRowImage=QImage();
+
+        updateScrollBars();
+        viewport()->update();
+    }
+}
+
+HexViewMode HexEditor::viewMode() const
+{
+    return mViewMode;
+}
+
+void HexEditor::setViewMode(HexViewMode::Type aType)
+{
+    if (mViewMode.type()!=aType)
+    {
+        mViewMode=HexViewMode(aType);
+
+        // Halves of bytes can be selected in hex views only
+        if (!mViewMode.isHexDigits())
+        {
+            mCursorPosition&=~Q_INT64_C(1);
+        }
+
+        mRowCache.clear();
+        mHoleRowImage=QImage();
+
+        updateScrollBars();
+        scrollToCursor();
+        viewport()->update();
+    }
+}
+
+int HexEditor::textColumn() const
+{
+    return mAddressWidth+mViewMode.width()+3; // Address, space, number pane, space, line, space
+}
+
+HexEncoding::Type HexEditor::encoding() const
+{
+    return mEncoding;
+}
+
+void HexEditor::setEncoding(HexEncoding::Type aEncoding)
+{
+    if (mEncoding!=aEncoding)
+    {
+        mEncoding=aEncoding;
+
+        // Tables are ready, rows are rendered again when they are shown
+        mRowCache.clear();
+        mHoleRowImage=QImage();
+
+        viewport()->update();
+    }
+}
+
+int HexEditor::charWidth()
+{
+    return mCharWidth;
+}
+
+int HexEditor::charHeight()
+{
+    return mCharHeight;
+}
+
+quint8 HexEditor::addressWidth()
+{
+    return mAddressWidth;
+}
+
+qint64 HexEditor::linesCount()
+{
+    return mLinesCount;
+}
+
+qint64 HexEditor::selectionStart()
+{
+    return mSelection.isEmpty() ? mSelectionStart : mSelection.start();
+}
+
+qint64 HexEditor::selectionEnd()
+{
+    return mSelection.isEmpty() ? mSelectionEnd : mSelection.end();
+}
+
+bool HexEditor::isCursorAtTheLeft()
+{
+    return mCursorAtTheLeft;
+}
+
+quint64 HexEditor::dataVersion() const
+{
+    return mDocument->version();
+}
+
+qint64 HexEditor::rowCacheSize() const
+{
+    // All row images have the same size
+    qint64 aRowSize=(qint64)(mViewMode.width()+18)*mCharWidth*mCharHeight*4;
+
+    return (mRowCache.size()+(mHoleRowImage.isNull() ? 0 : 1))*aRowSize;
+}
+
+void HexEditor::clearRowCache()
+{
+    mRowCache.clear();
+    mHoleRowImage=QImage();
+}
+
+#ifdef HEXEDITOR_PROFILING
+bool HexEditor::isProfilerOverlayVisible() const
+{
+    return mProfilerOverlayVisible;
+}
+
+void HexEditor::setProfilerOverlayVisible(bool aVisible)
+{
+    mProfilerOverlayVisible=aVisible;
+    viewport()->update();
+}
+#endif
+
+StructureOverlay* HexEditor::structureOverlay() const
+{
+    return mStructureOverlay;
+}
+
+void HexEditor::setStructureOverlay(StructureOverlay *aOverlay)
+{
+    if (mStructureOverlay!=aOverlay)
+    {
+        delete mStructureOverlay;
+        mStructureOverlay=aOverlay;
+
+        viewport()->update();
+    }
+}
+
+// *********************************************************************************
+//                                    SharedDocument
+// *********************************************************************************
+
+SharedDocument::SharedDocument(HexDocument *aDocument) :
+    QObject()
+{
+    mDocument=aDocument;
+    mActiveEditor=0;
+    mJournal=0;
+    mModifiedWithoutHistory=false;
+    mHistoryDropped=false;
+    mLoading=false;
+}
+
+SharedDocument::~SharedDocument()
+{
+    mUndoStack.clear(); // Commands go before the document they point to
+    setJournal(0);      // File stays for the next session
+    delete mDocument;
+}
+
+HexDocument* SharedDocument::document() const
+{
+    return mDocument;
+}
+
+QUndoStack* SharedDocument::undoStack()
+{
+    return &mUndoStack;
+}
+
+void SharedDocument::attach(HexEditor *aEditor)
+{
+    if (!mEditors.contains(aEditor))
+    {
+        mEditors.append(aEditor);
+    }
+
+    if (!mActiveEditor)
+    {
+        mActiveEditor=aEditor;
+    }
+}
+
+bool SharedDocument::detach(HexEditor *aEditor)
+{
+    mEditors.removeAll(aEditor);
+
+    if (mActiveEditor==aEditor)
+    {
+        mActiveEditor=mEditors.isEmpty() ? 0 : mEditors.first();
+    }
+
+    return mEditors.isEmpty();
+}
+
+int SharedDocument::editorsCount() const
+{
+    return mEditors.size();
+}
+
+HexEditor* SharedDocument::activeEditor() const
+{
+    return mActiveEditor;
+}
+
+void SharedDocument::setActiveEditor(HexEditor *aEditor)
+{
+    mActiveEditor=aEditor;
+}
+
+void SharedDocument::notifyChanged(HexEditor *aSource, qint64 aPos, qint64 aLength)
+{
+    if (mJournal)
+    {
+        mJournal->commit();
+    }
+
+    clipHoles(aPos, aLength);
+
+    emit rangeChanged(aSource, aPos, aLength);
+}
+
+const QVector<HexRange>& SharedDocument::holes() const
+{
+    return mHoles;
+}
+
+void SharedDocument::setHoles(const QVector<HexRange> &aHoles)
+{
+    mHoles=aHoles;
+    emit stateChanged();
+}
+
+bool SharedDocument::isLoading() const
+{
+    return mLoading;
+}
+
+void SharedDocument::setLoading(bool aLoading)
+{
+    if (mLoading!=aLoading)
+    {
+        mLoading=aLoading;
+        emit stateChanged();
+    }
+}
+
+SessionJournal* SharedDocument::journal() const
+{
+    return mJournal;
+}
+
+void SharedDocument::setJournal(SessionJournal *aJournal)
+{
+    if (mJournal==aJournal)
+    {
+        return;
+    }
+
+    delete mJournal;
+    mJournal=aJournal;
+
+    mDocument->setJournal(mJournal);
+
+    if (mJournal)
+    {
+        connect(mJournal, SIGNAL(writeFailed(QString)), this, SIGNAL(journalFailed(QString)));
+    }
+}
+
+bool SharedDocument::isModified() const
+{
+    return mModifiedWithoutHistory || !mUndoStack.isClean();
+}
+
+void SharedDocument::setClean()
+{
+    mUndoStack.setClean();
+    mModifiedWithoutHistory=false;
+}
+
+qint64 SharedDocument::historySize() const
+{
+    qint64 aSize=0;
+
+    for (int i=0; i<mUndoStack.count(); ++i)
+    {
+        const HexUndoCommand *aCommand=dynamic_cast<const HexUndoCommand *>(mUndoStack.command(i));
+
+        if (aCommand)
+        {
+            aSize+=aCommand->memoryUsage();
+        }
+    }
+
+    return aSize;
+}
+
+void SharedDocument::dropHistory()
+{
+    if (mUndoStack.count()==0)
+    {
+        return;
+    }
+
+    // Cleared stack is clean, but data still differs from the file
+    mModifiedWithoutHistory=isModified();
+    mHistoryDropped=true;
+
+    mUndoStack.clear();
+}
+
+bool SharedDocument::isHistoryDropped() const
+{
+    return mHistoryDropped;
+}
+
+void SharedDocument::clipHoles(qint64 aPos, qint64 aLength)
+{
+    // Holes after shift are dropped
+    qint64 aEnd=aLength<0 ? Q_INT64_C(0x7FFFFFFFFFFFFFFF) : aPos+aLength;
+
+    for (int i=mHoles.size()-1; i>=0; --i)
+    {
+        HexRange aHole=mHoles.at(i);
+        qint64 aHoleEnd=aHole.pos+aHole.length;
+
+        if (aHoleEnd<=aPos || aHole.pos>=aEnd)
+        {
+            continue;
+        }
+
+        mHoles.remove(i);
+
+        if (aEnd<aHoleEnd)
+        {
+            HexRange aTail;
+            aTail.pos=aEnd;
+            aTail.length=aHoleEnd-aEnd;
+            mHoles.insert(i, aTail);
+        }
+
+        if (aHole.pos<aPos)
+        {
+            aHole.length=aPos-aHole.pos;
+            mHoles.insert(i, aHole);
+        }
     }
 }
 
-int HexEditor::charWidth()
-{
-    return mCharWidth;
-}
+// *********************************************************************************
+//                                    HexUndoCommand
+// *********************************************************************************
 
-int HexEditor::charHeight()
+HexUndoCommand::HexUndoCommand(QUndoCommand *parent) :
+    QUndoCommand(parent)
 {
-    return mCharHeight;
+    mShared=0;
 }
 
-quint8 HexEditor::addressWidth()
+bool HexUndoCommand::revertReadsData() const
 {
-    return mAddressWidth;
+    return false;
 }
 
-int HexEditor::linesCount()
+qint64 HexUndoCommand::memoryUsage() const
 {
-    return mLinesCount;
+    return 0;
 }
 
-int HexEditor::selectionStart()
+HexEditor* HexUndoCommand::editor() const
 {
-    return mSelectionStart;
+    return mShared->activeEditor();
 }
 
-int HexEditor::selectionEnd()
+HexDocument* HexUndoCommand::document() const
 {
-    return mSelectionEnd;
+    return mShared->document();
 }
 
-bool HexEditor::isCursorAtTheLeft()
+static HexReplacement replacement(qint64 aPos, qint64 aRemovedLength, const QByteArray &aInserted)
 {
-    return mCursorAtTheLeft;
+    HexReplacement aReplacement;
+    aReplacement.pos=aPos;
+    aReplacement.removedLength=aRemovedLength;
+    aReplacement.insertedLength=aInserted.size();
+    aReplacement.inserted=aInserted;
+
+    return aReplacement;
 }
 
 // *********************************************************************************
 //                                 SingleHexUndoCommand
 // *********************************************************************************
 
-SingleHexUndoCommand::SingleHexUndoCommand(HexEditor *aEditor, Type aType, int aPos, char aNewChar, QUndoCommand *parent) :
-    QUndoCommand(parent)
+SingleHexUndoCommand::SingleHexUndoCommand(HexEditor *aEditor, Type aType, qint64 aPos, char aNewChar, QUndoCommand *parent) :
+    HexUndoCommand(parent)
 {
-    mEditor=aEditor;
+    mShared=aEditor->mShared;
     mType=aType;
     mPos=aPos;
     mNewChar=aNewChar;
@@ -1524,56 +4039,63 @@ SingleHexUndoCommand::SingleHexUndoCommand(HexEditor *aEditor, Type aType, int a
 
 void SingleHexUndoCommand::undo()
 {
+    HEX_PROFILE_SCOPE("undo.undo");
+
     switch (mType)
     {
         case Insert:
         {
-            mEditor->mData.remove(mPos, 1);
+            document()->remove(mPos, 1);
         }
         break;
         case Replace:
         {
             QByteArray aArray;
             aArray.append(mOldChar);
-            mEditor->mData.replace(mPos, 1, aArray);
+            document()->replace(mPos, 1, aArray);
         }
         break;
         case Remove:
         {
-            mEditor->mData.insert(mPos, mOldChar);
+            document()->insert(mPos, QByteArray(1, mOldChar));
         }
         break;
     }
 
-    mEditor->setCursorPosition(mPrevPosition);
+    mShared->notifyChanged(editor(), mPos, mType==Replace ? 1 : -1);
+    editor()->setCursorPosition(mPrevPosition);
 }
 
 void SingleHexUndoCommand::redo()
 {
-    mPrevPosition=mEditor->mCursorPosition;
+    HEX_PROFILE_SCOPE("undo.redo");
+
+    mPrevPosition=editor()->mCursorPosition;
 
     switch (mType)
     {
         case Insert:
         {
-            mEditor->mData.insert(mPos, mNewChar);
+            document()->insert(mPos, QByteArray(1, mNewChar));
         }
         break;
         case Replace:
         {
-            mOldChar=mEditor->mData.at(mPos);
+            mOldChar=document()->at(mPos);
             QByteArray aArray;
             aArray.append(mNewChar);
-            mEditor->mData.replace(mPos, 1, aArray);
+            document()->replace(mPos, 1, aArray);
         }
         break;
         case Remove:
         {
-            mOldChar=mEditor->mData.at(mPos);
-            mEditor->mData.remove(mPos, 1);
+            mOldChar=document()->at(mPos);
+            document()->remove(mPos, 1);
         }
         break;
     }
+
+    mShared->notifyChanged(editor(), mPos, mType==Replace ? 1 : -1);
 }
 
 bool SingleHexUndoCommand::mergeWith(const QUndoCommand *command)
@@ -1600,14 +4122,19 @@ int SingleHexUndoCommand::id() const
     return 1;
 }
 
+void SingleHexUndoCommand::revert(const HexPatchSource & /*aData*/, QList<HexReplacement> &aReplacements) const
+{
+    aReplacements.append(replacement(mPos, mType==Remove ? 0 : 1, mType==Insert ? QByteArray() : QByteArray(1, mOldChar)));
+}
+
 // *********************************************************************************
 //                                MultipleHexUndoCommand
 // *********************************************************************************
 
-MultipleHexUndoCommand::MultipleHexUndoCommand(HexEditor *aEditor, Type aType, int aPos, int aLength, QByteArray aNewArray, QUndoCommand *parent) :
-    QUndoCommand(parent)
+MultipleHexUndoCommand::MultipleHexUndoCommand(HexEditor *aEditor, Type aType, qint64 aPos, qint64 aLength, QByteArray aNewArray, QUndoCommand *parent) :
+    HexUndoCommand(parent)
 {
-    mEditor=aEditor;
+    mShared=aEditor->mShared;
     mType=aType;
     mPos=aPos;
     mLength=aLength;
@@ -1616,50 +4143,494 @@ MultipleHexUndoCommand::MultipleHexUndoCommand(HexEditor *aEditor, Type aType, i
 
 void MultipleHexUndoCommand::undo()
 {
+    HEX_PROFILE_SCOPE("undo.undo");
+
     switch (mType)
     {
         case Insert:
         {
-            mEditor->mData.remove(mPos, mNewArray.length());
+            document()->remove(mPos, mNewArray.length());
         }
         break;
         case Replace:
         {
-            mEditor->mData.replace(mPos, mNewArray.length(), mOldArray);
+            document()->replace(mPos, mNewArray.length(), mOldArray);
         }
         break;
         case Remove:
         {
-            mEditor->mData.insert(mPos, mOldArray);
+            document()->insert(mPos, mOldArray);
         }
         break;
     }
 
-    mEditor->setCursorPosition(mPrevPosition);
+    mShared->notifyChanged(editor(), mPos, mType==Replace && mNewArray.length()==mLength ? mLength : -1);
+    editor()->setCursorPosition(mPrevPosition);
 }
 
 void MultipleHexUndoCommand::redo()
 {
-    mPrevPosition=mEditor->mCursorPosition;
+    HEX_PROFILE_SCOPE("undo.redo");
+
+    mPrevPosition=editor()->mCursorPosition;
 
     switch (mType)
     {
         case Insert:
         {
-            mEditor->mData.insert(mPos, mNewArray);
+            document()->insert(mPos, mNewArray);
         }
         break;
         case Replace:
         {
-            mOldArray=mEditor->mData.mid(mPos, mLength);
-            mEditor->mData.replace(mPos, mLength, mNewArray);
+            mOldArray=document()->mid(mPos, mLength);
+            document()->replace(mPos, mLength, mNewArray);
         }
         break;
         case Remove:
         {
-            mOldArray=mEditor->mData.mid(mPos, mLength);
-            mEditor->mData.remove(mPos, mLength);
+            mOldArray=document()->mid(mPos, mLength);
+            document()->remove(mPos, mLength);
         }
         break;
     }
+
+    mShared->notifyChanged(editor(), mPos, mType==Replace && mNewArray.length()==mLength ? mLength : -1);
+}
+
+void MultipleHexUndoCommand::revert(const HexPatchSource & /*aData*/, QList<HexReplacement> &aReplacements) const
+{
+    aReplacements.append(replacement(mPos, mType==Remove ? 0 : mNewArray.size(), mType==Insert ? QByteArray() : mOldArray));
+}
+
+qint64 MultipleHexUndoCommand::memoryUsage() const
+{
+    return mOldArray.size()+mNewArray.size();
+}
+
+// *********************************************************************************
+//                                 PatchHexUndoCommand
+// *********************************************************************************
+
+PatchHexUndoCommand::PatchHexUndoCommand(HexEditor *aEditor, const HexPatch &aPatch, QUndoCommand *parent) :
+    HexUndoCommand(parent)
+{
+    mShared=aEditor->mShared;
+    mChangedStart=0;
+    mChangedLength=0;
+
+    // Only changed ranges are kept, with the bytes they replace
+    mEdits=aPatch.edits(HexPatchSource(document()));
+
+    updateChangedRange();
+}
+
+PatchHexUndoCommand::PatchHexUndoCommand(HexEditor *aEditor, const QList<HexEdit> &aEdits, QUndoCommand *parent) :
+    HexUndoCommand(parent)
+{
+    mShared=aEditor->mShared;
+    mEdits=aEdits;
+    mChangedStart=0;
+    mChangedLength=0;
+
+    updateChangedRange();
+}
+
+void PatchHexUndoCommand::undo()
+{
+    HEX_PROFILE_SCOPE("undo.undo");
+
+    // Positions of the edits are before the redo, so they move by the size changes of the previous ones
+    QList<HexReplacement> aReplacements;
+    qint64 aShift=0;
+
+    for (int i=0; i<mEdits.size(); ++i)
+    {
+        const HexEdit &aEdit=mEdits.at(i);
+
+        aReplacements.append(replacement(aEdit.pos+aShift, aEdit.inserted.size(), aEdit.removed));
+        aShift+=aEdit.inserted.size()-aEdit.removed.size();
+    }
+
+    document()->replace(aReplacements);
+
+    mShared->notifyChanged(editor(), mChangedStart, mChangedLength);
+    editor()->setCursorPosition(mPrevPosition);
+}
+
+void PatchHexUndoCommand::redo()
+{
+    HEX_PROFILE_SCOPE("undo.redo");
+
+    mPrevPosition=editor()->mCursorPosition;
+
+    QList<HexReplacement> aReplacements;
+
+    for (int i=0; i<mEdits.size(); ++i)
+    {
+        const HexEdit &aEdit=mEdits.at(i);
+        aReplacements.append(replacement(aEdit.pos, aEdit.removed.size(), aEdit.inserted));
+    }
+
+    document()->replace(aReplacements);
+
+    mShared->notifyChanged(editor(), mChangedStart, mChangedLength);
+}
+
+void PatchHexUndoCommand::updateChangedRange()
+{
+    if (mEdits.isEmpty())
+    {
+        return;
+    }
+
+    qint64 aEnd=0;
+
+    mChangedStart=mEdits.first().pos;
+
+    for (int i=0; i<mEdits.size(); ++i)
+    {
+        const HexEdit &aEdit=mEdits.at(i);
+
+        if (aEdit.removed.size()!=aEdit.inserted.size())
+        {
+            mChangedLength=-1;
+        }
+
+        mChangedStart=qMin(mChangedStart, aEdit.pos);
+        aEnd=qMax(aEnd, aEdit.pos+aEdit.inserted.size());
+    }
+
+    if (mChangedLength>=0)
+    {
+        mChangedLength=aEnd-mChangedStart;
+    }
+}
+
+void PatchHexUndoCommand::revert(const HexPatchSource & /*aData*/, QList<HexReplacement> &aReplacements) const
+{
+    // Reverted from the first edit, so every one is back at its position before the redo
+    for (int i=0; i<mEdits.size(); ++i)
+    {
+        const HexEdit &aEdit=mEdits.at(i);
+        aReplacements.append(replacement(aEdit.pos, aEdit.inserted.size(), aEdit.removed));
+    }
+}
+
+qint64 PatchHexUndoCommand::memoryUsage() const
+{
+    qint64 aSize=0;
+
+    for (int i=0; i<mEdits.size(); ++i)
+    {
+        aSize+=mEdits.at(i).removed.size()+mEdits.at(i).inserted.size();
+    }
+
+    return aSize;
+}
+
+// *********************************************************************************
+//                               TransformHexUndoCommand
+// *********************************************************************************
+
+// Range is changed chunk by chunk, in place when the document has the bytes in memory.
+// Chunks end at multiples of TRANSFORM_ALIGNMENT of the phase, so swapped elements aren't split.
+// Bytes of every chunk are appended to aOld before they are changed
+static qint64 transformChunkLength(qint64 aLength, qint64 aDone, qint64 aPhase)
+{
+    return qMin(aLength-aDone, TRANSFORM_CHUNK_SIZE-((aPhase+aDone) & (TRANSFORM_ALIGNMENT-1)));
+}
+
+static void applyTransform(HexDocument *aDocument, qint64 aPos, qint64 aLength, const HexTransform &aTransform, qint64 aPhase, QList<QByteArray> *aOld=0)
+{
+    qint64 aDone=0;
+
+    while (aDone<aLength)
+    {
+        qint64 aChunkPos=aPos+aDone;
+        qint64 aChunkLength=transformChunkLength(aLength, aDone, aPhase);
+
+        if (aOld)
+        {
+            aOld->append(aDocument->mid(aChunkPos, aChunkLength));
+        }
+
+        char *aData=aDocument->writableData(aChunkPos, aChunkLength);
+
+        if (aData)
+        {
+            aTransform.apply((uchar *)aData, aChunkLength, aPhase+aDone);
+            aDocument->touch(aChunkPos, aChunkLength);
+        }
+        else
+        {
+            QByteArray aArray=aDocument->mid(aChunkPos, aChunkLength);
+
+            aTransform.apply((uchar *)aArray.data(), aChunkLength, aPhase+aDone);
+            aDocument->replace(aChunkPos, aChunkLength, aArray);
+        }
+
+        aDone+=aChunkLength;
+    }
+}
+
+TransformHexUndoCommand::TransformHexUndoCommand(HexEditor *aEditor, qint64 aPos, qint64 aLength, const HexTransform &aTransform, QUndoCommand *parent) :
+    HexUndoCommand(parent),
+    mTransform(aTransform)
+{
+    mShared=aEditor->mShared;
+
+    HexRange aRange;
+    aRange.pos=aPos;
+    aRange.length=qMax((qint64)0, qMin(aLength, document()->size()-aPos));
+
+    mRanges.append(aRange);
+}
+
+TransformHexUndoCommand::TransformHexUndoCommand(HexEditor *aEditor, const QVector<HexRange> &aRanges, const HexTransform &aTransform, QUndoCommand *parent) :
+    HexUndoCommand(parent),
+    mRanges(aRanges),
+    mTransform(aTransform)
+{
+    mShared=aEditor->mShared;
+}
+
+void TransformHexUndoCommand::undo()
+{
+    HEX_PROFILE_SCOPE("undo.undo");
+
+    if (mTransform.isInvertible())
+    {
+        HexTransform aInverse=mTransform.inverse();
+        qint64 aPhase=0;
+
+        journal(aInverse);
+
+        for (int i=0; i<mRanges.size(); ++i)
+        {
+            applyTransform(document(), mRanges.at(i).pos, mRanges.at(i).length, aInverse, aPhase);
+            aPhase+=mRanges.at(i).length;
+        }
+    }
+    else
+    {
+        // Old chunks follow each other through all ranges
+        int aChunk=0;
+
+        for (int i=0; i<mRanges.size(); ++i)
+        {
+            qint64 aPos=mRanges.at(i).pos;
+            qint64 aEnd=aPos+mRanges.at(i).length;
+
+            while (aPos<aEnd)
+            {
+                const QByteArray &aOld=mOldChunks.at(aChunk++);
+
+                document()->replace(aPos, aOld.size(), aOld);
+                aPos+=aOld.size();
+            }
+        }
+
+        mOldChunks.clear();
+    }
+
+    qint64 aStart=mRanges.first().pos;
+    mShared->notifyChanged(editor(), aStart, mRanges.last().pos+mRanges.last().length-aStart);
+    editor()->setCursorPosition(mPrevPosition);
+}
+
+void TransformHexUndoCommand::redo()
+{
+    HEX_PROFILE_SCOPE("undo.redo");
+
+    mPrevPosition=editor()->mCursorPosition;
+
+    journal(mTransform);
+
+    qint64 aPhase=0;
+
+    for (int i=0; i<mRanges.size(); ++i)
+    {
+        applyTransform(document(), mRanges.at(i).pos, mRanges.at(i).length, mTransform, aPhase, mTransform.isInvertible() ? 0 : &mOldChunks);
+        aPhase+=mRanges.at(i).length;
+    }
+
+    qint64 aStart=mRanges.first().pos;
+    mShared->notifyChanged(editor(), aStart, mRanges.last().pos+mRanges.last().length-aStart);
+}
+
+void TransformHexUndoCommand::revert(const HexPatchSource &aData, QList<HexReplacement> &aReplacements) const
+{
+    HexTransform aInverse=mTransform.isInvertible() ? mTransform.inverse() : mTransform;
+    qint64 aPhase=0;
+    int aChunk=0;
+
+    for (int i=0; i<mRanges.size(); ++i)
+    {
+        qint64 aPos=mRanges.at(i).pos;
+        qint64 aLength=mRanges.at(i).length;
+        qint64 aDone=0;
+
+        while (aDone<aLength)
+        {
+            QByteArray aOld;
+
+            if (mTransform.isInvertible())
+            {
+                aOld=aData.mid(aPos+aDone, transformChunkLength(aLength, aDone, aPhase));
+                aInverse.apply((uchar *)aOld.data(), aOld.size(), aPhase+aDone);
+            }
+            else
+            {
+                aOld=mOldChunks.at(aChunk++);
+            }
+
+            if (aOld.isEmpty())
+            {
+                break;
+            }
+
+            aReplacements.append(replacement(aPos+aDone, aOld.size(), aOld));
+            aDone+=aOld.size();
+        }
+
+        aPhase+=aLength;
+    }
+}
+
+bool TransformHexUndoCommand::revertReadsData() const
+{
+    return mTransform.isInvertible();
+}
+
+void TransformHexUndoCommand::journal(const HexTransform &aTransform) const
+{
+    SessionJournal *aJournal=mShared->journal();
+
+    if (aJournal)
+    {
+        JournalRecord aRecord(JournalRecord::TRANSFORM);
+        aRecord.ranges=mRanges;
+        aRecord.transform=aTransform;
+
+        aJournal->operation(aRecord);
+    }
+}
+
+qint64 TransformHexUndoCommand::memoryUsage() const
+{
+    qint64 aSize=mTransform.key().size()+mRanges.size()*sizeof(HexRange);
+
+    for (int i=0; i<mOldChunks.size(); ++i)
+    {
+        aSize+=mOldChunks.at(i).size();
+    }
+
+    return aSize;
+}
+
+// *********************************************************************************
+//                                 EditsHexUndoCommand
+// *********************************************************************************
+
+EditsHexUndoCommand::EditsHexUndoCommand(HexEditor *aEditor, const QList<JournalEdit> &aEdits, QUndoCommand *parent) :
+    HexUndoCommand(parent)
+{
+    mShared=aEditor->mShared;
+    mJournalEdits=aEdits;
+    mChangedStart=0;
+    mChangedLength=0;
+}
+
+void EditsHexUndoCommand::undo()
+{
+    HEX_PROFILE_SCOPE("undo.undo");
+
+    for (int i=mEdits.size()-1; i>=0; --i)
+    {
+        const HexEdit &aEdit=mEdits.at(i);
+        document()->replace(aEdit.pos, aEdit.inserted.size(), aEdit.removed);
+    }
+
+    mShared->notifyChanged(editor(), mChangedStart, mChangedLength);
+    editor()->setCursorPosition(mPrevPosition);
+}
+
+void EditsHexUndoCommand::redo()
+{
+    HEX_PROFILE_SCOPE("undo.redo");
+
+    mPrevPosition=editor()->mCursorPosition;
+
+    if (mEdits.isEmpty())
+    {
+        // Every edit goes after the previous one, so removed bytes are read just before it
+        qint64 aEnd=0;
+
+        mChangedStart=Q_INT64_C(0x7FFFFFFFFFFFFFFF);
+
+        for (int i=0; i<mJournalEdits.size(); ++i)
+        {
+            const JournalEdit &aJournalEdit=mJournalEdits.at(i);
+
+            HexEdit aEdit;
+            aEdit.pos=aJournalEdit.pos;
+            aEdit.removed=document()->mid(aJournalEdit.pos, aJournalEdit.removedLength);
+            aEdit.inserted=aJournalEdit.inserted;
+
+            document()->replace(aEdit.pos, aEdit.removed.size(), aEdit.inserted);
+            mEdits.append(aEdit);
+
+            if (aEdit.removed.size()!=aEdit.inserted.size())
+            {
+                mChangedLength=-1;
+            }
+
+            mChangedStart=qMin(mChangedStart, aEdit.pos);
+            aEnd=qMax(aEnd, aEdit.pos+aEdit.inserted.size());
+        }
+
+        mJournalEdits.clear(); // Edits keep everything needed from now on
+
+        if (mEdits.isEmpty())
+        {
+            mChangedStart=0;
+        }
+        else
+        if (mChangedLength>=0)
+        {
+            mChangedLength=aEnd-mChangedStart;
+        }
+    }
+    else
+    {
+        for (int i=0; i<mEdits.size(); ++i)
+        {
+            const HexEdit &aEdit=mEdits.at(i);
+            document()->replace(aEdit.pos, aEdit.removed.size(), aEdit.inserted);
+        }
+    }
+
+    mShared->notifyChanged(editor(), mChangedStart, mChangedLength);
+}
+
+void EditsHexUndoCommand::revert(const HexPatchSource & /*aData*/, QList<HexReplacement> &aReplacements) const
+{
+    for (int i=mEdits.size()-1; i>=0; --i)
+    {
+        const HexEdit &aEdit=mEdits.at(i);
+        aReplacements.append(replacement(aEdit.pos, aEdit.inserted.size(), aEdit.removed));
+    }
+}
+
+qint64 EditsHexUndoCommand::memoryUsage() const
+{
+    qint64 aSize=0;
+
+    for (int i=0; i<mEdits.size(); ++i)
+    {
+        aSize+=mEdits.at(i).removed.size()+mEdits.at(i).inserted.size();
+    }
+
+    return aSize;
 }
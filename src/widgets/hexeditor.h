@@ -5,29 +5,52 @@
 
 #include <QUndoCommand>
 #include <QTimer>
+#include <QPainter>
+#include <QCache>
+#include <QImage>
+#include <QElapsedTimer>
+
+#include "src/engine/structureoverlay.h"
+#include "src/engine/hexpatch.h"
+#include "src/engine/hextransform.h"
+#include "src/engine/fileloader.h"
+#include "src/engine/filewatcher.h"
+#include "src/engine/hexdatasource.h"
+#include "src/engine/hexdocument.h"
+#include "src/engine/hexencoding.h"
+#include "src/engine/hexviewmode.h"
+#include "src/engine/hexselection.h"
+#include "src/engine/hexexporter.h"
+#include "src/engine/sessionjournal.h"
+
+class SharedDocument;
 
 class HexEditor : public QAbstractScrollArea
 {
     Q_OBJECT
 
+    friend class HexUndoCommand;
     friend class SingleHexUndoCommand;
     friend class MultipleHexUndoCommand;
+    friend class PatchHexUndoCommand;
+    friend class TransformHexUndoCommand;
+    friend class EditsHexUndoCommand;
 
 public:
     Q_PROPERTY(QByteArray   Data                     READ data                     WRITE setData)
     Q_PROPERTY(Mode         Mode                     READ mode                     WRITE setMode)
     Q_PROPERTY(bool         ReadOnly                 READ isReadOnly               WRITE setReadOnly)
     Q_PROPERTY(qint64       Position                 READ position                 WRITE setPosition)
-    Q_PROPERTY(int          CursorPosition           READ cursorPosition           WRITE setCursorPosition)
+    Q_PROPERTY(qint64       CursorPosition           READ cursorPosition           WRITE setCursorPosition)
     Q_PROPERTY(QFont        Font                     READ font                     WRITE setFont)
 
     Q_PROPERTY(int      charWidth      READ charWidth)
     Q_PROPERTY(int      charHeight     READ charHeight)
     Q_PROPERTY(quint8   addressWidth   READ addressWidth)
-    Q_PROPERTY(int      linesCount     READ linesCount)
+    Q_PROPERTY(qint64   linesCount     READ linesCount)
 
-    Q_PROPERTY(int    SelectionStart    READ selectionStart)
-    Q_PROPERTY(int    SelectionEnd      READ selectionEnd)
+    Q_PROPERTY(qint64 SelectionStart    READ selectionStart)
+    Q_PROPERTY(qint64 SelectionEnd      READ selectionEnd)
     Q_PROPERTY(bool   CursorAtTheLeft   READ isCursorAtTheLeft)
 
     Q_ENUMS(Mode)
@@ -41,31 +64,75 @@ public:
 
 
     HexEditor(QWidget *parent = 0);
+    ~HexEditor();
 
 
 
     void scrollToCursor();
-    int charAt(QPoint aPos, bool *aAtLeftPart=0);
-    int indexOf(const QByteArray &aArray, int aFrom=0) const;
-    int indexOf(const char &aChar, int aFrom=0) const;
-    int lastIndexOf(const QByteArray &aArray, int aFrom=0) const;
-    int lastIndexOf(const char &aChar, int aFrom=0) const;
-    void insert(int aIndex, char aChar);
-    void insert(int aIndex, const QByteArray &aArray);
-    void remove(int aPos, int aLength=1);
-    void replace(int aPos, char aChar);
-    void replace(int aPos, const QByteArray &aArray);
-    void replace(int aPos, int aLength, const QByteArray &aArray);
-    void setSelection(int aPos, int aCount);
+    qint64 charAt(QPoint aPos, bool *aAtLeftPart=0);
+    qint64 indexOf(const QByteArray &aArray, qint64 aFrom=0) const;
+    qint64 indexOf(const char &aChar, qint64 aFrom=0) const;
+    qint64 lastIndexOf(const QByteArray &aArray, qint64 aFrom=0) const;
+    qint64 lastIndexOf(const char &aChar, qint64 aFrom=0) const;
+    void insert(qint64 aIndex, char aChar);
+    void insert(qint64 aIndex, const QByteArray &aArray);
+    void remove(qint64 aPos, qint64 aLength=1);
+    void replace(qint64 aPos, char aChar);
+    void replace(qint64 aPos, const QByteArray &aArray);
+    void replace(qint64 aPos, qint64 aLength, const QByteArray &aArray);
+    void transform(qint64 aPos, qint64 aLength, const HexTransform &aTransform);
+    void transformSelection(const HexTransform &aTransform); // All ranges in one step
+    void setSelection(qint64 aPos, qint64 aCount);
+    HexSelection selection() const;
     void cut();
     void copy();
     void paste();
     QString toString();
+    qint64 readData(qint64 aPos, char *aBuffer, qint64 aLength) const;
+    qint64 dataSize() const;
+    bool writePatch(QIODevice *aDevice, HexPatch::Format aFormat, QString *aError=0) const; // Changes in the undo history
+    bool applyPatch(const HexPatch &aPatch, QString *aError=0);
 
     // ------------------------------------------------------------------
 
-    QByteArray data() const;
+    QByteArray data() const; // At most HexDocument::maxArraySize() bytes
     void setData(QByteArray const &aData);
+    HexDocument* document() const;
+    void setDocument(HexDocument *aDocument); // Takes ownership
+    void shareDocument(HexEditor *aEditor);   // Shows document of aEditor with the same undo stack
+    bool isSharingDocument() const;
+    SharedDocument* sharedDocument() const;
+    bool isModified() const;
+    bool isHistoryComplete() const; // False after undo history was dropped, patches start from that moment
+    void appendData(const QByteArray &aData);
+
+    void openFile(const QString &aFileName);
+    bool saveFile(const QString &aFileName, QString *aError=0);
+    bool openSource(HexDataSource *aSource, qint64 aBase, qint64 aLength, QString *aError=0); // Takes ownership of opened aSource
+    bool writeBack(QString *aError=0);
+    HexDataSource* dataSource() const;
+    bool reopenSource(bool aWritable, QString *aError=0); // Source is used by the reading thread of the document too
+    qint64 sourceBase() const;
+    qint64 addressOffset() const; // Address of the first byte in the address column
+    bool isLoading() const;
+    void cancelLoading();
+    QString fileName() const;
+    bool isFollowingTail() const;
+    QVector<HexRange> holes() const;
+
+    // Selected ranges are read chunk by chunk and written by a thread, whole data if nothing is selected
+    bool exportSelection(const QString &aFileName, HexExporter::Format aFormat, QString *aError=0);
+    bool isExporting() const;
+    void cancelExport();
+
+    // Sessions with files are journaled, journal of the last session is looked for when a file is loaded
+    bool restoreSession(QString *aError=0); // Only before data is changed
+    void discardSession(); // Journal of the last session is removed, this one goes on
+    void removeJournals(); // Changes are thrown away, so nothing is offered at the next opening
+
+    int addAnnotation(qint64 aPos, qint64 aLength, const QString &aText=QString()); // Returns id of annotation
+    int removeAnnotationsAt(qint64 aPos); // Returns count of removed annotations
+    QList<HexAnnotation> annotations(qint64 aStart, qint64 aEnd) const;
 
     Mode mode() const;
     void setMode(const Mode &aMode);
@@ -73,8 +140,8 @@ public:
     bool isReadOnly() const;
     void setReadOnly(const bool &aReadOnly);
 
-    int position() const;
-    void setPosition(int aPosition);
+    qint64 position() const;
+    void setPosition(qint64 aPosition);
 
     qint64 cursorPosition() const;
     void setCursorPosition(qint64 aCursorPos);
@@ -82,31 +149,55 @@ public:
     QFont font() const;
     void setFont(const QFont &aFont);
 
+    HexViewMode viewMode() const;
+    void setViewMode(HexViewMode::Type aType);
+
+    HexEncoding::Type encoding() const;
+    void setEncoding(HexEncoding::Type aEncoding);
+
     int    charWidth();
     int    charHeight();
     quint8 addressWidth();
-    int    linesCount();
+    qint64 linesCount();
 
-    int  selectionStart();
-    int  selectionEnd();
+    qint64 selectionStart(); // Of the first range
+    qint64 selectionEnd();   // Of the last range
     bool isCursorAtTheLeft();
 
+    quint64 dataVersion() const;
+
+    qint64 rowCacheSize() const; // Bytes of cached row images
+    void clearRowCache();
+
+    StructureOverlay* structureOverlay() const;
+    void setStructureOverlay(StructureOverlay *aOverlay);
+
+#ifdef HEXEDITOR_PROFILING
+    bool isProfilerOverlayVisible() const;
+#endif
+
 protected:
-    QByteArray mData;
+    SharedDocument *mShared;
+    HexDocument *mDocument;    // Of mShared
     Mode       mMode;
     bool       mReadOnly;
     qint64     mCursorPosition;
     QFont      mFont;
 
-    QString    mAsciiChars;
+    HexEncoding::Type mEncoding; // Of the text pane
+    HexViewMode mViewMode;       // Of the number pane
     int        mCharWidth;
     int        mCharHeight;
     quint8     mAddressWidth;
-    int        mLinesCount;
-
-    int        mSelectionStart;
-    int        mSelectionEnd;
-    int        mSelectionInit;
+    qint64     mAddressOffset; // Base of data sources, so they show their own addresses
+    qint64     mLinesCount;
+
+    qint64     mSelectionStart; // Range that follows the cursor
+    qint64     mSelectionEnd;
+    qint64     mSelectionInit;
+    bool       mColumnSelection; // Range is a block of the same columns in every row
+    HexSelection mKeptSelection; // Ranges selected before, with Ctrl
+    HexSelection mSelection;     // All ranges
     bool       mCursorVisible;
     bool       mCursorAtTheLeft;
     QTimer     mCursorTimer;
@@ -114,13 +205,74 @@ protected:
     bool       mLeftButtonPressed;
     bool       mOneMoreSelection;
 
-    QUndoStack mUndoStack;
-
+    QUndoStack *mUndoStack;    // Of mShared
+
+    StructureOverlay *mStructureOverlay;
+
+    FileLoader *mLoader;
+    QString     mFileName;
+    FileWatcher *mWatcher;
+    bool        mFollowTail;
+
+    HexExporter      *mExporter;
+    QVector<HexRange> mExportRanges;
+    int               mExportRange;   // Next range to read
+    qint64            mExportPos;     // Next byte to read
+    quint64           mExportVersion; // Export fails if data changes before it is read
+
+    QCache<qint64, QImage> mRowCache;    // Text of rows without selection and cursor
+    QColor              mRowCacheColor;
+    QTimer              mPrefetchTimer;
+    qint64              mScrollOffset;   // Pixels above the viewport
+    qint64              mScrollScale;    // Pixels per step of the vertical scroll bar, more than one if rows don't fit in its int range
+    QTimer              mScrollAnimationTimer;
+    qint64              mScrollTarget;
+    qint64              mScrollAnimatedValue;
+    int                 mWheelRemainder;
+    qint64              mLastScrollOffset;
+    double              mScrollVelocity; // Pixels per second, positive when scrolling down
+    QElapsedTimer       mScrollClock;
+
+    QImage              mHoleRowImage;   // All rows inside holes look the same
+
+    QList<JournalRecord> mSessionRecords; // Of the last session, valid while data has mSessionVersion
+    QString              mLastSessionPath; // Journal of mSessionRecords, kept until they are restored or discarded
+    quint64              mSessionVersion;
+    QTimer               mSessionTimer;   // Writes cursor and scroll state when they stop changing
+
+#ifdef HEXEDITOR_PROFILING
+    bool       mProfilerOverlayVisible;
+#endif
+
+    void attachDocument(SharedDocument *aShared);
+    void detachDocument();
+    bool openFileSource(const QString &aFileName); // Sparse and large files are read on demand
+    void pushCommand(QUndoCommand *aCommand);
     void updateScrollBars();
+    qint64 scrollOffset() const;
+    qint64 maxScrollOffset() const;
+    void setScrollOffset(qint64 aOffset); // Vertical scroll bar follows in its own steps
+    void scrolled();
+    void startWatching();
+    void stopWatching();
+    void startSession();
+    void restartSession(); // Data matches the file again
+    QString newSessionPath() const; // Name that the journal of the last session doesn't have
+    static QString sessionPath(const QString &aFileName, int aSlot);
+    bool canApplyFileChange();
     void resetCursorTimer();
     void resetSelection();
     void updateSelection();
+    void selectionUpdated(bool aChanged);
+    void removeSelected(); // All ranges in one step
     void cursorMoved(bool aKeepSelection);
+    void fillRange(QPainter &aPainter, qint64 aStart, qint64 aEnd, const QColor &aColor, int aOffsetX, qint64 aOffsetY); // Visible rows only
+    bool isHoleRow(qint64 aRow) const;
+    int textColumn() const; // First char of the text pane
+    QImage* rowImage(qint64 aRow);
+    void renderRow(QImage &aImage, qint64 aRow);
+    void readRow(qint64 aStart, qint64 aEnd, char *aRowData, QString *aGlyphs) const;
+    bool viewportEvent(QEvent *event);
     void resizeEvent(QResizeEvent *event);
     void paintEvent(QPaintEvent *event);
     void keyPressEvent(QKeyEvent *event);
@@ -132,20 +284,140 @@ protected:
 public slots:
     void undo();
     void redo();
+    void setFollowTail(bool aFollowTail);
+    void nextAnnotation();
+    void previousAnnotation();
+
+#ifdef HEXEDITOR_PROFILING
+    void setProfilerOverlayVisible(bool aVisible);
+#endif
 
 protected slots:
     void cursorBlicking();
+    void scrollAnimationStep();
+    void stopScrollAnimation();
+    void verticalScrolled(int aValue);
+    void prefetchRows();
+    void documentRangeChanged(HexEditor *aSource, qint64 aPos, qint64 aLength);
+    void documentStateChanged();
+    void invalidateRows(qint64 aPos, qint64 aLength);
+    void loaderChunkLoaded(QByteArray aChunk);
+    void loaderProgress(qint64 aLoaded, qint64 aTotal);
+    void loaderFinished(bool aSuccess, QString aError);
+    void watcherDataAppended(QByteArray aData);
+    void watcherBlockChanged(qint64 aPos, QByteArray aData);
+    void watcherFileTruncated(qint64 aSize);
+    void writeSessionView();
+    void feedExporter();
+    void exporterProgress(qint64 aDone, qint64 aTotal);
+    void exporterFinished(bool aSuccess, QString aError);
 
 signals:
     void dataChanged();
-    void selectionChanged(int aStart, int aEnd);
+    void rangeChanged(qint64 aPos, qint64 aLength); // aLength<0 means that all data after aPos was shifted
+    void selectionChanged(qint64 aStart, qint64 aEnd);
     void modeChanged(Mode aMode);
-    void positionChanged(int aPosition);
+    void positionChanged(qint64 aPosition);
+    void loadProgress(qint64 aLoaded, qint64 aTotal); // aTotal<0 if size is unknown
+    void loadFinished(bool aSuccess, QString aError);
+    void fileModifiedExternally(); // File was changed while there are edits, watching is stopped
+    void documentReplaced();       // Editor shows another document now
+    void sessionFound();           // Last session of the loaded file has changes, restoreSession() replays them
+    void journalFailed(QString aError); // Changes aren't journaled anymore, a crash loses them
+    void exportProgress(qint64 aDone, qint64 aTotal);
+    void exportFinished(bool aSuccess, QString aError); // aError is empty if export was cancelled
 };
 
 // *********************************************************************************
 
-class SingleHexUndoCommand : public QUndoCommand
+/*
+ * Document and undo stack of editors that show the same data. Every editor
+ * keeps its own cursor, selection and scroll state, changes made through
+ * any of them are announced to all. Undo commands run on behalf of the
+ * active editor, so they never point to an editor that is gone. Holes and
+ * loading state belong to the data, so they are kept here too. Deleted by
+ * the last editor that detaches.
+ */
+class SharedDocument : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SharedDocument(HexDocument *aDocument); // Takes ownership
+    ~SharedDocument();
+
+    HexDocument* document() const;
+    QUndoStack* undoStack();
+
+    void attach(HexEditor *aEditor);
+    bool detach(HexEditor *aEditor); // Returns true if no editors are left
+    int editorsCount() const;
+
+    HexEditor* activeEditor() const;
+    void setActiveEditor(HexEditor *aEditor);
+
+    void notifyChanged(HexEditor *aSource, qint64 aPos, qint64 aLength); // Ends a change in the journal
+
+    const QVector<HexRange>& holes() const;
+    void setHoles(const QVector<HexRange> &aHoles); // Sorted ranges that are zeros without being stored, like holes of sparse files
+
+    bool isLoading() const; // Data is read-only in all editors while it is loaded
+    void setLoading(bool aLoading);
+
+    SessionJournal* journal() const;
+    void setJournal(SessionJournal *aJournal); // Takes ownership, 0 stops journaling
+
+    bool isModified() const; // Stays true when history is dropped
+    void setClean();
+    qint64 historySize() const; // Bytes kept by undo commands
+    void dropHistory();         // Frees memory of undo commands, nothing can be undone after it
+    bool isHistoryDropped() const;
+
+private:
+    HexDocument        *mDocument;
+    QUndoStack          mUndoStack;
+    QList<HexEditor *>  mEditors;
+    HexEditor          *mActiveEditor;
+    SessionJournal     *mJournal;
+    bool                mModifiedWithoutHistory;
+    bool                mHistoryDropped;
+    QVector<HexRange>   mHoles;
+    bool                mLoading;
+
+    void clipHoles(qint64 aPos, qint64 aLength); // Changed bytes are not a hole anymore
+
+    Q_DISABLE_COPY(SharedDocument)
+
+signals:
+    void rangeChanged(HexEditor *aSource, qint64 aPos, qint64 aLength);
+    void stateChanged(); // Holes or loading state
+    void journalFailed(QString aError);
+};
+
+// *********************************************************************************
+
+class HexUndoCommand : public QUndoCommand
+{
+public:
+    HexUndoCommand(QUndoCommand *parent=0);
+
+    // Appends replacements that turn data after redo() back to data before it, in the order they are done.
+    // aData is data after redo(), it is read only if revertReadsData()
+    virtual void revert(const HexPatchSource &aData, QList<HexReplacement> &aReplacements) const = 0;
+    virtual bool revertReadsData() const;
+
+    virtual qint64 memoryUsage() const; // Bytes of data kept for undo and redo
+
+protected:
+    SharedDocument *mShared;
+
+    HexEditor* editor() const; // Active editor of mShared, commands outlive editors
+    HexDocument* document() const;
+};
+
+// *********************************************************************************
+
+class SingleHexUndoCommand : public HexUndoCommand
 {
 public:
     enum Type
@@ -155,17 +427,17 @@ public:
         Replace
     };
 
-    SingleHexUndoCommand(HexEditor *aEditor, Type aType, int aPos, char aNewChar=0, QUndoCommand *parent=0);
+    SingleHexUndoCommand(HexEditor *aEditor, Type aType, qint64 aPos, char aNewChar=0, QUndoCommand *parent=0);
 
     void undo();
     void redo();
     bool mergeWith(const QUndoCommand *command);
     int id() const;
+    void revert(const HexPatchSource &aData, QList<HexReplacement> &aReplacements) const;
 
 private:
-    HexEditor *mEditor;
     Type       mType;
-    int        mPos;
+    qint64     mPos;
     char       mNewChar;
     char       mOldChar;
     qint64     mPrevPosition;
@@ -173,7 +445,7 @@ private:
 
 // *********************************************************************************
 
-class MultipleHexUndoCommand : public QUndoCommand
+class MultipleHexUndoCommand : public HexUndoCommand
 {
 public:
     enum Type
@@ -183,19 +455,93 @@ public:
         Replace
     };
 
-    MultipleHexUndoCommand(HexEditor *aEditor, Type aType, int aPos, int aLength, QByteArray aNewArray=QByteArray(), QUndoCommand *parent=0);
+    MultipleHexUndoCommand(HexEditor *aEditor, Type aType, qint64 aPos, qint64 aLength, QByteArray aNewArray=QByteArray(), QUndoCommand *parent=0);
 
     void undo();
     void redo();
+    void revert(const HexPatchSource &aData, QList<HexReplacement> &aReplacements) const;
+    qint64 memoryUsage() const;
 
 private:
-    HexEditor  *mEditor;
     Type        mType;
-    int         mPos;
-    int         mLength;
+    qint64      mPos;
+    qint64      mLength;
     QByteArray  mNewArray;
     QByteArray  mOldArray;
     qint64      mPrevPosition;
 };
 
+// *********************************************************************************
+
+class PatchHexUndoCommand : public HexUndoCommand
+{
+public:
+    PatchHexUndoCommand(HexEditor *aEditor, const HexPatch &aPatch, QUndoCommand *parent=0); // Bound aPatch, edits are made from the current data
+    PatchHexUndoCommand(HexEditor *aEditor, const QList<HexEdit> &aEdits, QUndoCommand *parent=0); // Sorted edits that don't overlap, at positions before any of them is done
+
+    void undo();
+    void redo();
+    void revert(const HexPatchSource &aData, QList<HexReplacement> &aReplacements) const;
+    qint64 memoryUsage() const;
+
+private:
+    QList<HexEdit>  mEdits;
+    qint64          mChangedStart;
+    qint64          mChangedLength;
+    qint64          mPrevPosition;
+
+    void updateChangedRange();
+};
+
+// *********************************************************************************
+
+/*
+ * Transform of one or more ranges. Key goes on from one range to the
+ * next, as if they were one range.
+ */
+class TransformHexUndoCommand : public HexUndoCommand
+{
+public:
+    TransformHexUndoCommand(HexEditor *aEditor, qint64 aPos, qint64 aLength, const HexTransform &aTransform, QUndoCommand *parent=0);
+    TransformHexUndoCommand(HexEditor *aEditor, const QVector<HexRange> &aRanges, const HexTransform &aTransform, QUndoCommand *parent=0); // Sorted ranges
+
+    void undo();
+    void redo();
+    void revert(const HexPatchSource &aData, QList<HexReplacement> &aReplacements) const;
+    bool revertReadsData() const;
+    qint64 memoryUsage() const;
+
+private:
+    QVector<HexRange>  mRanges;
+    HexTransform       mTransform;
+    QList<QByteArray>  mOldChunks; // Only if transform can't be inverted, bytes of all ranges chunk by chunk
+    qint64             mPrevPosition;
+
+    void journal(const HexTransform &aTransform) const; // Journals the transform instead of its bytes
+};
+
+// *********************************************************************************
+
+/*
+ * Change replayed from a session journal. Removed bytes aren't journaled,
+ * they are read from data when edits are done.
+ */
+class EditsHexUndoCommand : public HexUndoCommand
+{
+public:
+    EditsHexUndoCommand(HexEditor *aEditor, const QList<JournalEdit> &aEdits, QUndoCommand *parent=0);
+
+    void undo();
+    void redo();
+    void revert(const HexPatchSource &aData, QList<HexReplacement> &aReplacements) const;
+    qint64 memoryUsage() const;
+
+private:
+    QList<JournalEdit> mJournalEdits;
+    QList<HexEdit>     mEdits; // Filled by the first redo()
+    qint64             mChangedStart;
+    qint64             mChangedLength;
+    qint64             mPrevPosition;
+};
+
 #endif // HEXEDITOR_H
@@ -0,0 +1,138 @@
+#include "memorybudget.h"
+
+#include <QSet>
+
+#define BUDGET_CHECK_INTERVAL 1000 // ms
+
+MemoryBudget::MemoryBudget(qint64 aLimit, QObject *parent) :
+    QObject(parent)
+{
+    mLimit=aLimit;
+
+    // Caches grow while data is only being looked at, so usage is checked from time to time
+    mTimer.setInterval(BUDGET_CHECK_INTERVAL);
+    connect(&mTimer, SIGNAL(timeout()), this, SLOT(enforce()));
+    mTimer.start();
+}
+
+qint64 MemoryBudget::limit() const
+{
+    return mLimit;
+}
+
+void MemoryBudget::setLimit(qint64 aLimit)
+{
+    mLimit=aLimit;
+    enforce();
+}
+
+qint64 MemoryBudget::usage() const
+{
+    qint64 aUsage=0;
+    QSet<SharedDocument *> aCounted;
+
+    for (int i=0; i<mEditors.size(); ++i)
+    {
+        HexEditor *aEditor=mEditors.at(i);
+        SharedDocument *aShared=aEditor->sharedDocument();
+
+        aUsage+=aEditor->rowCacheSize();
+
+        // Editors of one document share its pages and history
+        if (!aCounted.contains(aShared))
+        {
+            aCounted.insert(aShared);
+            aUsage+=aShared->document()->cacheSize()+aShared->historySize();
+        }
+    }
+
+    return aUsage;
+}
+
+void MemoryBudget::addEditor(HexEditor *aEditor)
+{
+    if (mEditors.contains(aEditor))
+    {
+        return;
+    }
+
+    mEditors.prepend(aEditor);
+    connect(aEditor, SIGNAL(destroyed(QObject*)), this, SLOT(editorDestroyed(QObject*)));
+}
+
+void MemoryBudget::removeEditor(HexEditor *aEditor)
+{
+    disconnect(aEditor, 0, this, 0);
+    mEditors.removeAll(aEditor);
+}
+
+void MemoryBudget::activateEditor(HexEditor *aEditor)
+{
+    mEditors.removeAll(aEditor);
+    mEditors.append(aEditor);
+
+    enforce();
+}
+
+bool MemoryBudget::isActive(HexEditor *aEditor) const
+{
+    // Split view of the document in use is in use too
+    return !mEditors.isEmpty() && aEditor->sharedDocument()==mEditors.last()->sharedDocument();
+}
+
+void MemoryBudget::enforce()
+{
+    qint64 aExcess=usage()-mLimit;
+
+    for (int aStep=0; aStep<STEPS_COUNT && aExcess>0; ++aStep)
+    {
+        bool aActiveStep=aStep>=ACTIVE_PAGES;
+        QSet<SharedDocument *> aDone;
+
+        for (int i=0; i<mEditors.size() && aExcess>0; ++i)
+        {
+            HexEditor *aEditor=mEditors.at(i);
+            SharedDocument *aShared=aEditor->sharedDocument();
+
+            if (isActive(aEditor)!=aActiveStep)
+            {
+                continue;
+            }
+
+            if (aStep==INACTIVE_ROWS || aStep==ACTIVE_ROWS)
+            {
+                aExcess-=aEditor->rowCacheSize();
+                aEditor->clearRowCache();
+
+                continue;
+            }
+
+            if (aDone.contains(aShared))
+            {
+                continue;
+            }
+
+            aDone.insert(aShared);
+
+            if (aStep==INACTIVE_HISTORY)
+            {
+                aExcess-=aShared->historySize();
+                aShared->dropHistory();
+            }
+            else
+            {
+                HexDocument *aDocument=aShared->document();
+                qint64 aCacheSize=aDocument->cacheSize();
+
+                aDocument->trimCache(aCacheSize-aExcess);
+                aExcess-=aCacheSize-aDocument->cacheSize();
+            }
+        }
+    }
+}
+
+void MemoryBudget::editorDestroyed(QObject *aEditor)
+{
+    // Only the address is left, it isn't a HexEditor anymore
+    mEditors.removeAll(static_cast<HexEditor *>(aEditor));
+}
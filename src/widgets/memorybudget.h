@@ -0,0 +1,58 @@
+#ifndef MEMORYBUDGET_H
+#define MEMORYBUDGET_H
+
+#include <QObject>
+#include <QTimer>
+#include <QList>
+
+#include "hexeditor.h"
+
+/*
+ * Memory limit for caches and undo history of all open documents. Data
+ * itself doesn't count, it can't be dropped, but large files are only
+ * read page by page into the caches. When the limit is exceeded,
+ * editors used long ago give up memory first: row images, then pages of
+ * their documents, then undo history. Editors of the document in use only
+ * give up their caches, its history is never dropped.
+ */
+class MemoryBudget : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit MemoryBudget(qint64 aLimit, QObject *parent=0);
+
+    qint64 limit() const;
+    void setLimit(qint64 aLimit);
+    qint64 usage() const;
+
+    void addEditor(HexEditor *aEditor);
+    void removeEditor(HexEditor *aEditor);
+    void activateEditor(HexEditor *aEditor); // Editor in use, its document gives up memory last
+
+protected:
+    // Memory that is cheaper to get back goes first
+    enum Step
+    {
+        INACTIVE_ROWS,
+        INACTIVE_PAGES,
+        INACTIVE_HISTORY,
+        ACTIVE_PAGES,
+        ACTIVE_ROWS,
+        STEPS_COUNT
+    };
+
+    qint64             mLimit;
+    QList<HexEditor *> mEditors; // Least recently used first
+    QTimer             mTimer;
+
+    bool isActive(HexEditor *aEditor) const;
+
+public slots:
+    void enforce();
+
+protected slots:
+    void editorDestroyed(QObject *aEditor);
+};
+
+#endif // MEMORYBUDGET_H
@@ -0,0 +1,358 @@
+#include "stringsview.h"
+
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QMessageBox>
+
+#define DEFAULT_MIN_LENGTH 4
+
+StringsModel::StringsModel(QObject *parent) :
+    QAbstractTableModel(parent)
+{
+}
+
+int StringsModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : mResults.size();
+}
+
+int StringsModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : 4;
+}
+
+QVariant StringsModel::data(const QModelIndex &index, int role) const
+{
+    if (role!=Qt::DisplayRole || !index.isValid() || index.row()>=mResults.size())
+    {
+        return QVariant();
+    }
+
+    const ExtractedString &aResult=mResults.at(index.row());
+
+    switch (index.column())
+    {
+        case 0: return QString::number(aResult.pos, 16).toUpper();
+        case 1: return aResult.length;
+        case 2: return StringExtractor::encodingName(aResult.encoding);
+        case 3:
+        {
+            // Matches can contain any bytes
+            QString aText=aResult.text;
+
+            for (int i=0; i<aText.length(); ++i)
+            {
+                if (aText.at(i).unicode()<0x20)
+                {
+                    aText[i]=QChar(183);
+                }
+            }
+
+            return aText;
+        }
+        default: break;
+    }
+
+    return QVariant();
+}
+
+QVariant StringsModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (role!=Qt::DisplayRole || orientation!=Qt::Horizontal)
+    {
+        return QVariant();
+    }
+
+    switch (section)
+    {
+        case 0: return "Offset";
+        case 1: return "Length";
+        case 2: return "Encoding";
+        case 3: return "Text";
+        default: break;
+    }
+
+    return QVariant();
+}
+
+void StringsModel::append(const QList<ExtractedString> &aResults)
+{
+    if (aResults.isEmpty())
+    {
+        return;
+    }
+
+    beginInsertRows(QModelIndex(), mResults.size(), mResults.size()+aResults.size()-1);
+
+    for (int i=0; i<aResults.size(); ++i)
+    {
+        mResults.append(aResults.at(i));
+    }
+
+    endInsertRows();
+}
+
+void StringsModel::clear()
+{
+    beginResetModel();
+    mResults.clear();
+    endResetModel();
+}
+
+const ExtractedString& StringsModel::result(int aRow) const
+{
+    return mResults.at(aRow);
+}
+
+// *********************************************************************************
+//                                   StringsView
+// *********************************************************************************
+
+StringsView::StringsView(HexEditor *aEditor, QWidget *parent) :
+    QWidget(parent, Qt::Window)
+{
+    setAttribute(Qt::WA_DeleteOnClose);
+    setWindowTitle("Strings");
+    resize(700, 500);
+
+    mEditor=aEditor;
+    mDataVersion=0;
+    mExtractor=0;
+
+
+
+    mModeComboBox=new QComboBox(this);
+    mModeComboBox->addItem("Strings");
+    mModeComboBox->addItem("Regular expression");
+
+    mAsciiCheckBox=new QCheckBox("ASCII", this);
+    mUtf8CheckBox=new QCheckBox("UTF-8", this);
+    mUtf16LeCheckBox=new QCheckBox("UTF-16LE", this);
+    mUtf16BeCheckBox=new QCheckBox("UTF-16BE", this);
+
+    mAsciiCheckBox->setChecked(true);
+    mUtf16LeCheckBox->setChecked(true);
+
+    mMinLengthSpinBox=new QSpinBox(this);
+    mMinLengthSpinBox->setRange(1, 1024);
+    mMinLengthSpinBox->setValue(DEFAULT_MIN_LENGTH);
+    mMinLengthSpinBox->setPrefix("Min length: ");
+
+    mRegExpEdit=new QLineEdit(this);
+    mRegExpEdit->setToolTip("Bytes are Latin-1 chars, \\xHH matches any byte");
+    mRegExpEdit->setVisible(false);
+
+    mStartButton=new QPushButton("Start", this);
+    mStatusLabel=new QLabel(this);
+
+    mModel=new StringsModel(this);
+
+    // Rows have the same height, so only visible rows are ever laid out
+    mTableView=new QTableView(this);
+    mTableView->setModel(mModel);
+    mTableView->setSelectionBehavior(QAbstractItemView::SelectRows);
+    mTableView->setSelectionMode(QAbstractItemView::SingleSelection);
+    mTableView->setWordWrap(false);
+    mTableView->horizontalHeader()->setStretchLastSection(true);
+    mTableView->verticalHeader()->setVisible(false);
+    mTableView->verticalHeader()->setDefaultSectionSize(fontMetrics().height()+4);
+#if QT_VERSION >= 0x050000
+    mTableView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+#else
+    mTableView->verticalHeader()->setResizeMode(QHeaderView::Fixed);
+#endif
+
+    QHBoxLayout *aOptionsLayout=new QHBoxLayout();
+    aOptionsLayout->addWidget(mModeComboBox);
+    aOptionsLayout->addWidget(mAsciiCheckBox);
+    aOptionsLayout->addWidget(mUtf8CheckBox);
+    aOptionsLayout->addWidget(mUtf16LeCheckBox);
+    aOptionsLayout->addWidget(mUtf16BeCheckBox);
+    aOptionsLayout->addWidget(mMinLengthSpinBox);
+    aOptionsLayout->addWidget(mRegExpEdit, 1);
+    aOptionsLayout->addWidget(mStartButton);
+
+    QVBoxLayout *aLayout=new QVBoxLayout(this);
+    aLayout->addLayout(aOptionsLayout);
+    aLayout->addWidget(mTableView, 1);
+    aLayout->addWidget(mStatusLabel);
+
+
+
+    connect(mModeComboBox, SIGNAL(currentIndexChanged(int)), this, SLOT(modeChanged(int)));
+    connect(mStartButton, SIGNAL(clicked()), this, SLOT(startOrStop()));
+    connect(mRegExpEdit, SIGNAL(returnPressed()), this, SLOT(startOrStop()));
+    connect(mTableView, SIGNAL(activated(QModelIndex)), this, SLOT(resultActivated(QModelIndex)));
+    connect(mTableView, SIGNAL(clicked(QModelIndex)), this, SLOT(resultActivated(QModelIndex)));
+}
+
+void StringsView::stopExtraction()
+{
+    if (mExtractor)
+    {
+        delete mExtractor; // Waits for the thread
+        mExtractor=0;
+    }
+
+    mStartButton->setText("Start");
+}
+
+void StringsView::modeChanged(int aMode)
+{
+    bool aStrings=aMode==0;
+
+    mAsciiCheckBox->setVisible(aStrings);
+    mUtf8CheckBox->setVisible(aStrings);
+    mUtf16LeCheckBox->setVisible(aStrings);
+    mUtf16BeCheckBox->setVisible(aStrings);
+    mMinLengthSpinBox->setVisible(aStrings);
+    mRegExpEdit->setVisible(!aStrings);
+}
+
+void StringsView::startOrStop()
+{
+    if (mExtractor)
+    {
+        stopExtraction();
+        mStatusLabel->setText(QString("Stopped, %1 found").arg(mModel->rowCount()));
+        return;
+    }
+
+    if (!mEditor)
+    {
+        mStatusLabel->setText("Editor of this window was closed");
+        return;
+    }
+
+    mModel->clear();
+
+    bool    aStrings=mModeComboBox->currentIndex()==0;
+    int     aEncodings=0;
+    QRegExp aRegExp(mRegExpEdit->text());
+
+    if (aStrings)
+    {
+        if (mAsciiCheckBox->isChecked())
+        {
+            aEncodings|=StringExtractor::ASCII;
+        }
+
+        if (mUtf8CheckBox->isChecked())
+        {
+            aEncodings|=StringExtractor::UTF8;
+        }
+
+        if (mUtf16LeCheckBox->isChecked())
+        {
+            aEncodings|=StringExtractor::UTF16LE;
+        }
+
+        if (mUtf16BeCheckBox->isChecked())
+        {
+            aEncodings|=StringExtractor::UTF16BE;
+        }
+
+        if (aEncodings==0)
+        {
+            QMessageBox::warning(this, "Strings", "Select at least one encoding");
+            return;
+        }
+    }
+    else
+    if (aRegExp.isEmpty() || !aRegExp.isValid())
+    {
+        QMessageBox::warning(this, "Strings", "Invalid regular expression: "+aRegExp.errorString());
+        return;
+    }
+
+    // Snapshot is read by the extractor chunk by chunk, edits made during the search don't touch it
+    HexDocument *aData=mEditor->document()->snapshot();
+
+    if (!aData)
+    {
+        mStatusLabel->setText("Data can't be read in the background");
+        return;
+    }
+
+    mDataVersion=mEditor->dataVersion();
+
+    if (aStrings)
+    {
+        mExtractor=new StringExtractor(aData, aEncodings, mMinLengthSpinBox->value(), this);
+    }
+    else
+    {
+        mExtractor=new StringExtractor(aData, aRegExp, this);
+    }
+
+    connect(mExtractor, SIGNAL(resultsAvailable()),         this, SLOT(resultsAvailable()));
+    connect(mExtractor, SIGNAL(progress(qint64,qint64)),    this, SLOT(extractionProgress(qint64,qint64)));
+    connect(mExtractor, SIGNAL(extractionFinished(qint64)), this, SLOT(extractionFinished(qint64)));
+
+    mStartButton->setText("Stop");
+    mExtractor->start();
+}
+
+void StringsView::resultsAvailable()
+{
+    if (sender()!=mExtractor)
+    {
+        return;
+    }
+
+    mModel->append(mExtractor->takeResults());
+}
+
+void StringsView::extractionProgress(qint64 aDone, qint64 aTotal)
+{
+    if (sender()!=mExtractor)
+    {
+        return;
+    }
+
+    mStatusLabel->setText(QString("Searching... %1%, %2 found").arg(aTotal>0 ? aDone*100/aTotal : 100).arg(mModel->rowCount()));
+}
+
+void StringsView::extractionFinished(qint64 aCount)
+{
+    if (sender()!=mExtractor)
+    {
+        return;
+    }
+
+    // Results delivered right before the end
+    mModel->append(mExtractor->takeResults());
+
+    mExtractor->wait();
+    mExtractor->deleteLater();
+    mExtractor=0;
+
+    mStartButton->setText("Start");
+    mStatusLabel->setText(QString("%1 found").arg(aCount));
+}
+
+void StringsView::resultActivated(const QModelIndex &aIndex)
+{
+    if (!aIndex.isValid())
+    {
+        return;
+    }
+
+    if (!mEditor)
+    {
+        mStatusLabel->setText("Editor of this window was closed");
+        return;
+    }
+
+    const ExtractedString &aResult=mModel->result(aIndex.row());
+
+    if (mEditor->dataVersion()!=mDataVersion)
+    {
+        mStatusLabel->setText("Data was modified after the search, positions may be outdated");
+    }
+
+    mEditor->setPosition(aResult.pos);
+    mEditor->scrollToCursor();
+    mEditor->setSelection(aResult.pos, aResult.length);
+}
@@ -0,0 +1,78 @@
+#ifndef STRINGSVIEW_H
+#define STRINGSVIEW_H
+
+#include <QWidget>
+#include <QAbstractTableModel>
+#include <QTableView>
+#include <QComboBox>
+#include <QCheckBox>
+#include <QSpinBox>
+#include <QLineEdit>
+#include <QLabel>
+#include <QPushButton>
+#include <QPointer>
+
+#include "hexeditor.h"
+#include "src/engine/stringextractor.h"
+
+class StringsModel : public QAbstractTableModel
+{
+public:
+    explicit StringsModel(QObject *parent=0);
+
+    int rowCount(const QModelIndex &parent=QModelIndex()) const;
+    int columnCount(const QModelIndex &parent=QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role=Qt::DisplayRole) const;
+    QVariant headerData(int section, Qt::Orientation orientation, int role=Qt::DisplayRole) const;
+
+    void append(const QList<ExtractedString> &aResults);
+    void clear();
+    const ExtractedString& result(int aRow) const;
+
+private:
+    QVector<ExtractedString> mResults;
+};
+
+// *********************************************************************************
+
+/*
+ * Window with strings or matches of a regular expression found in the
+ * editor data. Results are shown while the search is still running,
+ * activating one of them selects it in the editor.
+ */
+class StringsView : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit StringsView(HexEditor *aEditor, QWidget *parent = 0);
+
+protected:
+    QPointer<HexEditor> mEditor; // Null after the tab of the editor is closed
+    quint64          mDataVersion; // Of the data that results are found in
+    StringExtractor *mExtractor;
+    StringsModel    *mModel;
+
+    QComboBox       *mModeComboBox;
+    QCheckBox       *mAsciiCheckBox;
+    QCheckBox       *mUtf8CheckBox;
+    QCheckBox       *mUtf16LeCheckBox;
+    QCheckBox       *mUtf16BeCheckBox;
+    QSpinBox        *mMinLengthSpinBox;
+    QLineEdit       *mRegExpEdit;
+    QPushButton     *mStartButton;
+    QLabel          *mStatusLabel;
+    QTableView      *mTableView;
+
+    void stopExtraction();
+
+protected slots:
+    void modeChanged(int aMode);
+    void startOrStop();
+    void resultsAvailable();
+    void extractionProgress(qint64 aDone, qint64 aTotal);
+    void extractionFinished(qint64 aCount);
+    void resultActivated(const QModelIndex &aIndex);
+};
+
+#endif // STRINGSVIEW_H
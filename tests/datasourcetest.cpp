@@ -0,0 +1,263 @@
+#include "datasourcetest.h"
+
+#include <QtTest/QtTest>
+#include <QDir>
+
+#include "src/engine/hexdocument.h"
+
+#ifdef Q_OS_LINUX
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+#define FILE_SIZE    (3 << 20)  // Multiple of blocks and larger than the bounce buffer
+#define BOUNCE_SIZE  (1 << 20)
+
+enum SourceType
+{
+    SOURCE_FILE,
+    SOURCE_MAPPED,
+    SOURCE_BLOCK_DEVICE
+};
+
+Q_DECLARE_METATYPE(SourceType)
+
+#ifdef Q_OS_LINUX
+// Child is killed however the test ends
+struct ChildProcess
+{
+    pid_t pid;
+
+    ~ChildProcess()
+    {
+        if (pid>0)
+        {
+            kill(pid, SIGKILL);
+            waitpid(pid, 0, 0);
+        }
+    }
+};
+#endif
+
+DataSourceTest::DataSourceTest() :
+    QObject()
+{
+}
+
+QByteArray DataSourceTest::testData(int aSize, quint32 aSeed)
+{
+    QByteArray aData(aSize, 0);
+    quint32 aValue=aSeed;
+
+    for (int i=0; i<aSize; ++i)
+    {
+        aValue=aValue*1103515245+12345;
+        aData[i]=(char)(aValue >> 16);
+    }
+
+    return aData;
+}
+
+bool DataSourceTest::createFile(const QByteArray &aData)
+{
+    QFile aFile(mFileName);
+
+    return aFile.open(QIODevice::WriteOnly | QIODevice::Truncate) && aFile.write(aData)==aData.size();
+}
+
+QByteArray DataSourceTest::fileData() const
+{
+    QFile aFile(mFileName);
+
+    if (!aFile.open(QIODevice::ReadOnly))
+    {
+        return QByteArray();
+    }
+
+    return aFile.readAll();
+}
+
+void DataSourceTest::init()
+{
+    mFileName=QDir::current().absoluteFilePath("HexEditorTests.tmp");
+}
+
+void DataSourceTest::cleanup()
+{
+    QFile::remove(mFileName);
+}
+
+// ------------------------------------------------------------------
+
+void DataSourceTest::readWriteBack_data()
+{
+    QTest::addColumn<SourceType>("type");
+
+    QTest::newRow("file")         << SOURCE_FILE;
+    QTest::newRow("mapped")       << SOURCE_MAPPED;
+    QTest::newRow("block device") << SOURCE_BLOCK_DEVICE;
+}
+
+void DataSourceTest::readWriteBack()
+{
+    QFETCH(SourceType, type);
+
+    QByteArray aData=testData(FILE_SIZE);
+    QVERIFY(createFile(aData));
+
+    HexDataSource *aSource;
+
+    switch (type)
+    {
+        case SOURCE_FILE:   aSource=new FileDataSource(mFileName);        break;
+        case SOURCE_MAPPED: aSource=new MappedDataSource(mFileName);      break;
+        default:            aSource=new BlockDeviceDataSource(mFileName); break;
+    }
+
+    bool aOpened=aSource->open(true);
+    QString aOpenError=aSource->errorString();
+
+    // Document owns the source from now on
+    SourceDocument aDocument(aSource);
+
+    QVERIFY2(aOpened, qPrintable(aOpenError));
+    QCOMPARE(aSource->size(), (qint64)FILE_SIZE);
+
+    if (type==SOURCE_BLOCK_DEVICE && !static_cast<BlockDeviceDataSource *>(aSource)->isDirect())
+    {
+        qWarning("Filesystem of the current directory refuses O_DIRECT, bounce buffer isn't tested");
+    }
+
+    // Unaligned ranges, across blocks and across the bounce buffer
+    qint64 aRanges[][2]={
+                          {0,                 1},
+                          {4095,              2},
+                          {BOUNCE_SIZE-100,   300},
+                          {12345,             2*BOUNCE_SIZE+777},
+                          {FILE_SIZE-3,       3}
+                        };
+
+    for (int i=0; i<(int)(sizeof(aRanges)/sizeof(aRanges[0])); ++i)
+    {
+        QByteArray aBuffer((int)aRanges[i][1], 0);
+
+        QVERIFY2(aSource->read(aRanges[i][0], aBuffer.data(), aBuffer.size()), qPrintable(aSource->errorString()));
+        QCOMPARE(aBuffer, aData.mid((int)aRanges[i][0], (int)aRanges[i][1]));
+    }
+
+    // Partial blocks at the start, across the bounce buffer and at the end
+    aDocument.replace(10, 4, "ABCD");
+    aDocument.replace(BOUNCE_SIZE-2, 4, "EFGH");
+    aDocument.replace(FILE_SIZE-3, 3, "IJK");
+
+    aData.replace(10, 4, "ABCD");
+    aData.replace(BOUNCE_SIZE-2, 4, "EFGH");
+    aData.replace(FILE_SIZE-3, 3, "IJK");
+
+    QString aError;
+
+    QVERIFY2(aDocument.writeBack(&aError), qPrintable(aError));
+    QCOMPARE(aDocument.mid(0), aData);
+
+    aSource->close();
+
+    QCOMPARE(fileData(), aData);
+}
+
+void DataSourceTest::processMemory()
+{
+#ifdef Q_OS_LINUX
+    int aPageSize=(int)sysconf(_SC_PAGESIZE);
+    char *aPages=(char *)mmap(0, aPageSize*3, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    QVERIFY(aPages!=MAP_FAILED);
+
+    QByteArray aFirst=testData(aPageSize, 1);
+    QByteArray aLast=testData(aPageSize, 2);
+
+    memcpy(aPages, aFirst.constData(), aPageSize);
+    memcpy(aPages+aPageSize*2, aLast.constData(), aPageSize);
+
+    int aPipe[2];
+
+    QVERIFY(pipe(aPipe)==0);
+
+    ChildProcess aChild;
+    aChild.pid=fork();
+
+    if (aChild.pid==0)
+    {
+        // Child has the known pages at the same address, with an unmapped gap between them
+        munmap(aPages+aPageSize, aPageSize);
+
+        char aReady=1;
+        ssize_t aWritten=write(aPipe[1], &aReady, 1);
+        Q_UNUSED(aWritten);
+
+        for (;;)
+        {
+            pause();
+        }
+    }
+
+    char aReady=0;
+    bool aStarted=aChild.pid>0 && read(aPipe[0], &aReady, 1)==1;
+
+    ::close(aPipe[0]);
+    ::close(aPipe[1]);
+    munmap(aPages, aPageSize*3);
+
+    QVERIFY(aStarted);
+
+    qint64 aAddress=(quintptr)aPages;
+    ProcessMemoryDataSource aSource(aChild.pid);
+
+    if (!aSource.open(true))
+    {
+#if QT_VERSION >= 0x050000
+        QSKIP(qPrintable("No access to memory of the child: "+aSource.errorString()));
+#else
+        QSKIP(qPrintable("No access to memory of the child: "+aSource.errorString()), SkipAll);
+#endif
+    }
+
+    QVector<HexRange> aUnreadable=aSource.unreadableRanges();
+    bool aGapFound=false;
+
+    for (int i=0; i<aUnreadable.size(); ++i)
+    {
+        if (
+            aUnreadable.at(i).pos<=aAddress+aPageSize
+            &&
+            aUnreadable.at(i).pos+aUnreadable.at(i).length>=aAddress+aPageSize*2
+           )
+        {
+            aGapFound=true;
+        }
+    }
+
+    QVERIFY(aGapFound);
+
+    // Gap reads as zeros
+    QByteArray aBuffer(aPageSize*3, 1);
+
+    QVERIFY2(aSource.read(aAddress, aBuffer.data(), aBuffer.size()), qPrintable(aSource.errorString()));
+    QCOMPARE(aBuffer.left(aPageSize), aFirst);
+    QCOMPARE(aBuffer.mid(aPageSize, aPageSize), QByteArray(aPageSize, 0));
+    QCOMPARE(aBuffer.mid(aPageSize*2), aLast);
+
+    QByteArray aPatch("patched");
+
+    QVERIFY2(aSource.write(aAddress+aPageSize*2+10, aPatch.constData(), aPatch.size()), qPrintable(aSource.errorString()));
+    QVERIFY2(aSource.read(aAddress+aPageSize*2, aBuffer.data(), aPageSize), qPrintable(aSource.errorString()));
+    QCOMPARE(aBuffer.left(aPageSize), aLast.left(10)+aPatch+aLast.mid(10+aPatch.size()));
+#else
+#if QT_VERSION >= 0x050000
+    QSKIP("Process memory is supported only on Linux");
+#else
+    QSKIP("Process memory is supported only on Linux", SkipAll);
+#endif
+#endif
+}
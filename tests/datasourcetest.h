@@ -0,0 +1,37 @@
+#ifndef DATASOURCETEST_H
+#define DATASOURCETEST_H
+
+#include <QObject>
+
+#include "src/engine/hexdatasource.h"
+
+/*
+ * Data sources against real storage: a temporary file in the current
+ * directory and memory of a forked child process. The file is put in the
+ * current directory rather than the temporary one, since tmpfs refuses
+ * O_DIRECT.
+ */
+class DataSourceTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    DataSourceTest();
+
+protected:
+    QString mFileName;
+
+    static QByteArray testData(int aSize, quint32 aSeed=0x12345678);
+    bool createFile(const QByteArray &aData);
+    QByteArray fileData() const;
+
+private slots:
+    void init();
+    void cleanup();
+
+    void readWriteBack_data();
+    void readWriteBack();
+    void processMemory();
+};
+
+#endif // DATASOURCETEST_H
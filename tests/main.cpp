@@ -0,0 +1,13 @@
+#include <QCoreApplication>
+#include <QtTest/QtTest>
+
+#include "datasourcetest.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    DataSourceTest aTest;
+
+    return QTest::qExec(&aTest, argc, argv);
+}